@@ -18,6 +18,11 @@
 #include "model-net.h"
 #include "model-net-sched.h"
 #include "net/dragonfly.h"
+#include "net/fattree.h"
+#include "net/hyperx.h"
+#include "net/graph.h"
+#include "net/flow.h"
+#include "net/slimfly.h"
 #include "net/loggp.h"
 #include "net/simplenet-upd.h"
 #include "net/simplep2p.h"
@@ -120,6 +125,11 @@ typedef struct model_net_wrap_msg {
         sn_message         m_snet;  // simplenet
         sp_message         m_sp2p;  // simplep2p
         nodes_message      m_torus; // torus
+        fattree_message    m_fattree; // fat-tree
+        slimfly_message    m_slimfly; // slim fly
+        hyperx_message     m_hyperx; // hyperx
+        graph_message      m_graph; // graph file topology
+        flow_message       m_flow; // flow-level
         // add new ones here
     } msg;
 } model_net_wrap_msg;
@@ -54,6 +54,8 @@ struct terminal_message
    uint64_t num_chunks;
    int remote_event_size_bytes;
    int local_event_size_bytes;
+   /* injection queue of the packet at the source terminal */
+   int traffic_class;
 
   // For buffer message
    short vc_index;
@@ -69,10 +71,18 @@ struct terminal_message
    tw_stime saved_collective_init_time;  
    tw_stime saved_hist_start_time;
    int saved_hist_num;
+   short saved_queue;
+   short saved_last_injq;
+   int saved_peak_occupancy;
+   tw_stime saved_credit_start;
+   /* analytically routed packet: time its tail leaves the last link reserved */
+   tw_stime analytic_tail_time;
 
 
    /* for reverse computation of a node's fan in*/
    int saved_fan_nodes;
+   /* id of the collective operation the message belongs to */
+   int collective_id;
    tw_lpid sender_svr;
 
   /* LP ID of the sending node, has to be a network node in the dragonfly */
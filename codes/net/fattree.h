@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef FATTREE_H
+#define FATTREE_H
+
+#include <ross.h>
+
+typedef struct fattree_message fattree_message;
+
+/* this message is used for both fat-tree terminals and switches */
+struct fattree_message
+{
+  /* magic number */
+  int magic;
+  /* event type of the message */
+  short type;
+  /* category: comes from codes */
+  char category[CATEGORY_NAME_MAX];
+  /* packet ID, unique per terminal */
+  unsigned long long packet_ID;
+  /* packet travel start time */
+  tw_stime travel_start_time;
+  /* final destination LP ID, this comes from codes can be a server or any other LP type*/
+  tw_lpid final_dest_gid;
+  /*sending LP ID from CODES, can be a server or any other LP type */
+  tw_lpid sender_lp;
+  tw_lpid sender_mn_lp; // source modelnet id
+  /* destination terminal LP of the fat-tree */
+  tw_lpid dest_terminal_gid;
+  /* source and destination terminal IDs (0 .. number of terminals - 1) */
+  int src_terminal_id;
+  int dest_terminal_id;
+  /* selects the up ports of the packet for ECMP routing */
+  uint32_t flow_hash;
+  /* number of switches traversed by the packet */
+  short my_N_hop;
+
+  uint64_t packet_size;
+  int remote_event_size_bytes;
+  int local_event_size_bytes;
+  int is_pull;
+  uint64_t pull_size;
+
+  /* switch port the packet entered through */
+  int in_port;
+  /* output port of a send, or the port a credit is returned to */
+  int port;
+  /* buffer space (bytes) returned by a credit */
+  uint64_t credit_bytes;
+
+  /* for reverse computation */
+  tw_stime saved_available_time;
+  tw_stime saved_blocked_start;
+  uint64_t saved_peak_bytes;
+};
+
+#endif /* end of include guard: FATTREE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
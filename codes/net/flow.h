@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <ross.h>
+
+typedef struct flow_message flow_message;
+
+/* this message is used for both flow terminals and the flow controller */
+struct flow_message
+{
+  /* magic number */
+  int magic;
+  /* event type of the message */
+  short type;
+  /* category: comes from codes */
+  char category[CATEGORY_NAME_MAX];
+  /* flow start time */
+  tw_stime travel_start_time;
+  /* final destination LP ID, this comes from codes can be a server or any other LP type*/
+  tw_lpid final_dest_gid;
+  /*sending LP ID from CODES, can be a server or any other LP type */
+  tw_lpid sender_lp;
+  tw_lpid sender_mn_lp; // source modelnet id
+  /* destination terminal LP */
+  tw_lpid dest_terminal_gid;
+  /* source and destination terminal IDs (0 .. number of terminals - 1) */
+  int src_terminal_id;
+  int dest_terminal_id;
+  /* links on the path of the flow */
+  short num_hops;
+
+  uint64_t packet_size;
+  int remote_event_size_bytes;
+  int local_event_size_bytes;
+  int is_pull;
+  uint64_t pull_size;
+
+  /* flow a completion event belongs to: its slot in the flow table, its
+   * unique id and the rate generation the completion was scheduled for */
+  int slot;
+  uint64_t flow_id;
+  uint32_t gen;
+
+  /* for reverse computation */
+  uint64_t saved_log_end;
+  int saved_comp_flows;
+  tw_stime saved_max_latency;
+};
+
+#endif /* end of include guard: FLOW_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <ross.h>
+#include "codes/net/vct.h"
+
+typedef struct graph_message graph_message;
+
+/* this message is used for both graph terminals and switches */
+struct graph_message
+{
+  /* packet and credit state of the terminals and switch ports */
+  vct_message vct;
+  /* selects the next hop among equal-cost paths */
+  uint32_t flow_hash;
+};
+
+#endif /* end of include guard: GRAPH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef HYPERX_H
+#define HYPERX_H
+
+#include <ross.h>
+#include "codes/net/vct.h"
+
+typedef struct hyperx_message hyperx_message;
+
+/* this message is used for both HyperX terminals and routers */
+struct hyperx_message
+{
+  /* packet and credit state of the terminals and router ports */
+  vct_message vct;
+  /* intermediate router of a Valiant path, -1 once it is reached or
+   * for other paths */
+  int intm_router;
+  /* dimensions in which the packet still has to move towards the
+   * intermediate or destination router */
+  uint32_t dim_mask;
+  /* dimensions in which the packet took a non-minimal hop (DAL) */
+  uint32_t derouted_mask;
+};
+
+#endif /* end of include guard: HYPERX_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -14,6 +14,8 @@ enum loggp_event_type
 {
     LG_MSG_READY = 1,  /* sender has transmitted msg to receiver */
     LG_MSG_START,      /* initiate a transmission */
+    LG_MSG_RTS,        /* rendezvous request-to-send, at the receiver */
+    LG_MSG_CTS,        /* rendezvous clear-to-send, back at the sender */
 };
 
 typedef struct loggp_message loggp_message;
@@ -42,6 +44,7 @@ struct loggp_message
     tw_stime net_recv_next_idle_saved;
     tw_stime xmit_time_saved;
     tw_stime recv_time_saved;
+    tw_stime host_next_idle_saved;
 };
 
 #endif /* end of include guard: LOGGP_H */
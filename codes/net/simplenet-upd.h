@@ -14,6 +14,7 @@ enum sn_event_type
 {
     SN_MSG_READY = 1,  /* sender has transmitted msg to receiver */
     SN_MSG_START,      /* initiate a transmission */
+    SN_SWITCH_ACK,     /* switch output buffer accepted the msg (switch mode) */
 };
 
 struct sn_message
@@ -34,6 +35,7 @@ struct sn_message
     /* for reverse computation */
     tw_stime net_send_next_idle_saved;
     tw_stime net_recv_next_idle_saved;
+    tw_stime switch_port_next_idle_saved;
     tw_stime send_time_saved;
     tw_stime recv_time_saved;
 };
@@ -13,6 +13,8 @@ enum sp_event_type
 {
     SP_MSG_READY = 1,  /* sender has transmitted msg to receiver */
     SP_MSG_START,      /* initiate a transmission */
+    SP_FLOW_DONE,      /* fair sharing mode: the first flow of a NIC side
+                          is done, unless flows started/ended since */
 };
 
 struct sp_message
@@ -44,6 +46,16 @@ struct sp_message
     tw_stime send_prev_idle_all_saved;
     tw_stime recv_next_idle_all_saved;
     tw_stime recv_prev_idle_all_saved;
+
+    /* fair sharing mode */
+    int fair_dir; /* SP_FLOW_DONE: NIC side, 0 = send, 1 = recv */
+    int fair_gen; /* SP_FLOW_DONE: generation of the side when scheduled */
+    uint64_t flow_id; /* id of the flow within the NIC */
+    tw_stime flow_min_done; /* the link bandwidth doesn't allow an earlier end */
+    tw_stime sender_done; /* READY: expected end of the send at the receiver */
+    double flow_tag_saved;
+    double vtime_saved;
+    tw_stime vtime_update_saved;
 };
 
 #endif /* end of include guard: SIMPLEP2P_H */
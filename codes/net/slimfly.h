@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef SLIMFLY_H
+#define SLIMFLY_H
+
+#include <ross.h>
+#include "codes/net/vct.h"
+
+typedef struct slimfly_message slimfly_message;
+
+/* this message is used for both Slim Fly terminals and routers */
+struct slimfly_message
+{
+  /* packet and credit state of the terminals and router ports */
+  vct_message vct;
+  /* intermediate router of a non-minimal path, -1 once it is reached or
+   * for minimal paths */
+  int intm_router;
+};
+
+#endif /* end of include guard: SLIMFLY_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -7,16 +7,21 @@
 #ifndef TORUS_H
 #define TORUS_H
 
+/* maximum number of torus dimensions (n_dims) */
+#define TORUS_MAX_DIMS 8
+
 typedef enum nodes_event_t nodes_event_t;
 typedef struct nodes_message nodes_message;
 
-/* event type of each torus message, can be packet generate, flit arrival, flit send or credit */
+/* event type of each torus message, can be packet generate, flit arrival, flit send, credit
+ * or a hop of an analytically routed packet */
 enum nodes_event_t
 {
   GENERATE = 1,
   ARRIVAL, 
   SEND,
   CREDIT,
+  ANALYTIC,
   T_COLLECTIVE_INIT,
   T_COLLECTIVE_FAN_IN,
   T_COLLECTIVE_FAN_OUT  
@@ -33,6 +38,10 @@ struct nodes_message
 
   /* message saved collective time */
   tw_stime saved_collective_init_time;
+  /* saved first offer / last injection time of the source node */
+  tw_stime saved_inject_time;
+  /* analytically routed packet: time its tail leaves the last link reserved */
+  tw_stime analytic_tail_time;
   
   /* packet ID */
   unsigned long long packet_ID;
@@ -42,9 +51,15 @@ struct nodes_message
   /* for reverse computation */
   int saved_src_dim;
   int saved_src_dir;
+  int saved_src_vc;
+  /* port and virtual channel of a credit whose data was replaced by the chunk
+   * waiting for the freed slot */
+  int saved_credit_dim;
+  int saved_credit_dir;
+  int saved_credit_vc;
 
-  /* coordinates of the destination torus nodes */
-  int* dest;
+  /* coordinates of the destination torus node, set at packet generation */
+  int dest[TORUS_MAX_DIMS];
 
   /* final destination LP ID, comes from codes, can be a server or any other I/O LP type */
   tw_lpid final_dest_gid;
@@ -63,6 +78,8 @@ struct nodes_message
   int source_dim;
   /* source direction of the message */
   int source_direction;
+  /* virtual channel of the last hop (of the freed slot for a credit) */
+  int vc;
   /* next torus hop that the packet will traverse */
   int next_stop;
   /* size of the torus packet */
@@ -70,6 +87,8 @@ struct nodes_message
 
  /* for reverse computation of a node's fan in*/
   int saved_fan_nodes;
+  /* id of the collective operation the message belongs to */
+  int collective_id;
 
   /* chunk id of the flit (distinguishes flits) */
   int chunk_id;
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef VCT_H
+#define VCT_H
+
+#include <ross.h>
+
+typedef struct vct_message vct_message;
+
+/* packet and credit state shared by the virtual cut-through router models
+ * (Slim Fly, HyperX, graph). A model message starts with this struct and
+ * carries its routing state after it */
+struct vct_message
+{
+  /* magic number */
+  int magic;
+  /* event type of the message */
+  short type;
+  /* category: comes from codes */
+  char category[CATEGORY_NAME_MAX];
+  /* packet ID, unique per terminal */
+  unsigned long long packet_ID;
+  /* packet travel start time */
+  tw_stime travel_start_time;
+  /* final destination LP ID, this comes from codes can be a server or any other LP type*/
+  tw_lpid final_dest_gid;
+  /*sending LP ID from CODES, can be a server or any other LP type */
+  tw_lpid sender_lp;
+  tw_lpid sender_mn_lp; // source modelnet id
+  /* destination terminal LP */
+  tw_lpid dest_terminal_gid;
+  /* source and destination terminal IDs (0 .. number of terminals - 1) */
+  int src_terminal_id;
+  int dest_terminal_id;
+  /* minimal or non-minimal path */
+  short path_type;
+  /* number of routers traversed by the packet */
+  short my_N_hop;
+
+  uint64_t packet_size;
+  int remote_event_size_bytes;
+  int local_event_size_bytes;
+  int is_pull;
+  uint64_t pull_size;
+
+  /* router port and virtual channel the packet entered through */
+  int in_port;
+  short in_vc;
+  /* output port and virtual channel of a send, or the port and virtual
+   * channel a credit is returned to */
+  int port;
+  short vc;
+  /* buffer space (bytes) returned by a credit */
+  uint64_t credit_bytes;
+
+  /* for reverse computation */
+  tw_stime saved_available_time;
+  tw_stime saved_blocked_start;
+  uint64_t saved_peak_bytes;
+};
+
+#endif /* end of include guard: VCT_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
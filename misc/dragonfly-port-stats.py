@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2015 University of Chicago.
+# See COPYRIGHT notice in top-level directory.
+#
+# Reader for the per-port router counters written by the dragonfly model to
+# the "dragonfly-router-ports" file of the lp-io output directory.
+# The record layout must match struct dragonfly_port_record in dragonfly.c.
+
+import argparse
+import struct
+import sys
+
+RECORD = struct.Struct("=iiiiQQdii")
+PORT_TYPES = {0: "global", 1: "local", 2: "terminal"}
+SORT_KEYS = ("bytes", "chunks", "blocked", "peak")
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) % RECORD.size != 0:
+        sys.exit("%s: size %d is not a multiple of the record size %d"
+                 % (path, len(data), RECORD.size))
+    for off in range(0, len(data), RECORD.size):
+        (group, router, ptype, pidx, nbytes, chunks, blocked, peak,
+         _) = RECORD.unpack_from(data, off)
+        yield {"group": group, "router": router,
+               "type": PORT_TYPES.get(ptype, str(ptype)), "port": pidx,
+               "bytes": nbytes, "chunks": chunks, "blocked": blocked,
+               "peak": peak}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="print dragonfly per-port router counters")
+    parser.add_argument("file", help="dragonfly-router-ports file")
+    parser.add_argument("-t", "--type", choices=sorted(PORT_TYPES.values()),
+                        help="only show ports of this type")
+    parser.add_argument("-s", "--sort", choices=SORT_KEYS,
+                        help="sort by this counter (descending)")
+    parser.add_argument("-n", "--top", type=int, default=0,
+                        help="only show the first N ports")
+    args = parser.parse_args()
+
+    recs = list(read_records(args.file))
+    if args.type:
+        recs = [r for r in recs if r["type"] == args.type]
+    if args.sort:
+        recs.sort(key=lambda r: r[args.sort], reverse=True)
+    else:
+        recs.sort(key=lambda r: (r["group"], r["router"], r["type"],
+                                 r["port"]))
+    if args.top > 0:
+        recs = recs[:args.top]
+
+    print("# group router type port bytes chunks blocked_ns peak_occupancy")
+    for r in recs:
+        print("%d %d %s %d %d %d %.3f %d" % (
+            r["group"], r["router"], r["type"], r["port"], r["bytes"],
+            r["chunks"], r["blocked"], r["peak"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2015 University of Chicago.
+# See COPYRIGHT notice in top-level directory.
+#
+# Converts the text latency and bandwidth matrices of the simplep2p model
+# (net_latency_ns_file, net_bw_mbps_file) into the binary matrix file read
+# through PARAMS:net_matrix_file. The layout must match struct
+# sp_matrix_header in simplep2p.c; values are written in native byte order.
+
+import argparse
+import array
+import struct
+import sys
+
+MAGIC = b"SP2PMAT\0"
+VERSION = 1
+FLAG_TRI = 0x1
+HEADER = struct.Struct("=8sIIIIII")
+
+
+def read_pairs(path, is_tri):
+    """returns the rows of egress,ingress pairs of a text matrix"""
+    rows = []
+    with open(path) as f:
+        for line in f:
+            toks = line.replace(",", " ").split()
+            if not toks:
+                continue
+            if len(toks) % 2 != 0:
+                sys.exit("%s: odd number of values in row %d"
+                         % (path, len(rows) + 1))
+            rows.append([float(t) for t in toks])
+    if not rows:
+        sys.exit("%s: empty matrix" % path)
+    n = len(rows) + 1 if is_tri else len(rows)
+    for i, r in enumerate(rows):
+        expect = 2 * (n - i - 1) if is_tri else 2 * n
+        if len(r) != expect:
+            sys.exit("%s: row %d has %d values, expected %d for a %s matrix"
+                     % (path, i + 1, len(r), expect,
+                        "triangular" if is_tri else "square"))
+    return n, rows
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="convert simplep2p text matrices to the binary format")
+    parser.add_argument("latency", help="latency matrix (ns)")
+    parser.add_argument("bandwidth", help="bandwidth matrix (MiB/s)")
+    parser.add_argument("output", help="binary matrix file to write")
+    parser.add_argument("-t", "--triangular", action="store_true",
+                        help="the inputs are triangular matrices")
+    args = parser.parse_args()
+
+    n_lat, lat = read_pairs(args.latency, args.triangular)
+    n_bw, bw = read_pairs(args.bandwidth, args.triangular)
+    if n_lat != n_bw:
+        sys.exit("latency and bandwidth matrices differ in size (%d vs. %d)"
+                 % (n_lat, n_bw))
+
+    flags = FLAG_TRI if args.triangular else 0
+    with open(args.output, "wb") as out:
+        out.write(HEADER.pack(MAGIC, VERSION, flags, n_lat, 0, 0, 0))
+        for rows in (lat, bw):
+            vals = array.array("f")
+            for r in rows:
+                vals.extend(r)
+            vals.tofile(out)
+
+    print("wrote %d x %d %s matrix to %s"
+          % (n_lat, n_lat, "triangular" if args.triangular else "square",
+             args.output))
+
+
+if __name__ == "__main__":
+    main()
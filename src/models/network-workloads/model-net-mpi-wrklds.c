@@ -12,8 +12,16 @@
 #include "codes/codes_mapping.h"
 #include "codes/model-net.h"
 #include "codes/codes-jobmap.h"
+#include "codes/quicklist.h"
 
 #define TRACE -1
+/* number of (source, tag) hash buckets of an MPI matching queue, a power of 2 */
+#define MPI_QUEUE_BUCKETS 64
+#define REQ_TABLE_MIN_SLOTS 16
+/* maximum number of entries in the algorithm selection list of a collective */
+#define MAX_COL_ALGOS 8
+/* size of the control messages of the rendezvous protocol (request to send, completion) */
+#define MPI_CTRL_MSG_SIZE 64
 /*global variable for loading multiple jobs' traces*/
 char workloads_conf_file[8192];//the file in which the path and name of each job's traces are
 char alloc_file[8192];// the file in which the preassgined LP lists for the jobs
@@ -38,6 +46,7 @@ char workload_file[8192];
 char offset_file[8192];
 static int wrkld_id;
 static int num_net_traces = 0;
+static int num_jobs = 0;
 
 typedef struct nw_state nw_state;
 typedef struct nw_message nw_message;
@@ -50,6 +59,7 @@ long long num_bytes_sent=0;
 long long num_bytes_recvd=0;
 double max_time = 0,  max_comm_time = 0, max_wait_time = 0, max_send_time = 0, max_recv_time = 0;
 double avg_time = 0, avg_comm_time = 0, avg_wait_time = 0, avg_send_time = 0, avg_recv_time = 0;
+double max_col_time = 0, avg_col_time = 0;
 
 /* global variables for codes mapping */
 static char lp_group_name[MAX_NAME_LENGTH], lp_type_name[MAX_NAME_LENGTH], annotation[MAX_NAME_LENGTH];
@@ -63,45 +73,148 @@ struct codes_jobmap_params_list jobmap_p;
 /* runtime option for disabling computation time simulation */
 static int disable_delay = 0;
 
+/* sends larger than the eager threshold (bytes) use the rendezvous protocol, 0 disables it */
+static long eager_threshold = 0;
+
 /* MPI_OP_GET_NEXT is for getting next MPI operation when the previous operation completes.
 * MPI_SEND_ARRIVED is issued when a MPI message arrives at its destination (the message is transported by model-net and an event is invoked when it arrives.
-* MPI_SEND_POSTED is issued when a MPI message has left the source LP (message is transported via model-net). */
+* MPI_SEND_POSTED is issued when a MPI message has left the source LP (message is transported via model-net).
+* MPI_COL_ARRIVED and MPI_COL_POSTED are their counterparts for the point-to-point messages a collective operation is decomposed into.
+* MPI_COL_COMPLETED is issued by the network model when a collective offloaded to it completes.
+* MPI_REND_ARRIVED is issued at the receiver when the data of a rendezvous send, pulled once the receive was matched, has arrived. */
 enum MPI_NW_EVENTS
 {
 	MPI_OP_GET_NEXT=1,
 	MPI_SEND_ARRIVED,
         MPI_SEND_ARRIVED_CB, // for tracking message times on sender
 	MPI_SEND_POSTED,
+	MPI_COL_ARRIVED,
+	MPI_COL_POSTED,
+	MPI_COL_COMPLETED,
+	MPI_REND_ARRIVED,
+};
+
+/* algorithms the collective operations are decomposed with. COL_NETWORK hands the
+ * collective to the network model (model_net_event_collective). */
+enum MPI_COL_ALGOS
+{
+	COL_BINOMIAL,
+	COL_RECURSIVE_DOUBLING,
+	COL_RING,
+	COL_PAIRWISE,
+	COL_BRUCK,
+	COL_NETWORK,
 };
 
-/* stores pointers of pending MPI operations to be matched with their respective sends/receives. */
+/* collectives with a configurable algorithm */
+enum MPI_COLS
+{
+	COL_BCAST,
+	COL_REDUCE,
+	COL_ALLREDUCE,
+	COL_ALLGATHER,
+	COL_ALLTOALL,
+	NUM_COLS
+};
+
+/* algorithm selection of a collective, as in the MPICH tuning tables: the first entry
+ * whose max_bytes is not smaller than the message size is used */
+struct col_tuning
+{
+	int num_entries;
+	int algo[MAX_COL_ALGOS];
+	long long max_bytes[MAX_COL_ALGOS];
+};
+
+/* one round of a collective at a rank: the peer to send to (-1 if none), the number
+ * of bytes sent and the peer to receive from (-1 if none). */
+struct col_step
+{
+	int send_to;
+	int send_bytes;
+	int recv_from;
+};
+
+/* messages of a collective round that arrived before the rank reached the round */
+struct col_arrival
+{
+	int col_seq;
+	int col_round;
+	int count;
+	struct qlist_head link;
+};
+
+/* names of the collectives (PARAMS:mpi_<name>_algorithm) and their default algorithm selection */
+static const char* col_names[NUM_COLS] = {"bcast", "reduce", "allreduce", "allgather", "alltoall"};
+static const char* col_default_algos[NUM_COLS] = {
+	"binomial", "binomial", "recursive_doubling:2048,ring",
+	"recursive_doubling:32768,ring", "bruck:256,pairwise"};
+static const char* col_algo_names[] = {"binomial", "recursive_doubling", "ring",
+	"pairwise", "bruck", "network"};
+/* algorithms each collective can be run with, one bit per algorithm */
+static const int col_valid_algos[NUM_COLS] = {
+	(1 << COL_BINOMIAL) | (1 << COL_NETWORK),
+	(1 << COL_BINOMIAL) | (1 << COL_NETWORK),
+	(1 << COL_RECURSIVE_DOUBLING) | (1 << COL_RING) | (1 << COL_NETWORK),
+	(1 << COL_RECURSIVE_DOUBLING) | (1 << COL_RING),
+	(1 << COL_PAIRWISE) | (1 << COL_BRUCK)};
+/* algorithm used instead of COL_NETWORK when the network model cannot run the collective */
+static const int col_fallback_algos[NUM_COLS] = {COL_BINOMIAL, COL_BINOMIAL,
+	COL_RECURSIVE_DOUBLING, COL_RING, COL_PAIRWISE};
+static struct col_tuning col_tunings[NUM_COLS];
+
+/* stores pointers of pending MPI operations to be matched with their respective sends/receives.
+ * An element is linked in the insertion order of its queue and in the bucket of its (source, tag)
+ * pair, or in the wildcard list for receives with MPI_ANY_SOURCE/MPI_ANY_TAG. A matched element
+ * keeps its links so that reverse computation can put it back in place in O(1). */
 struct mpi_msgs_queue
 {
 	struct codes_workload_op* mpi_op;
-	struct mpi_msgs_queue* next;
+	int source_rank;
+	int tag;
+	/* position in the insertion order of the queue */
+	unsigned long seq;
+	struct qlist_head order;
+	struct qlist_head bucket;
+	/* link in the retired list or in the pool of free elements */
+	struct qlist_head free;
+	/* time the element was matched */
+	tw_stime retire_time;
 };
 
-/* stores request IDs of completed MPI operations (Isends or Irecvs) */
-struct completed_requests
+/* slot of a request ID table, empty when count is zero */
+struct req_slot
 {
 	dumpi_req_id req_id;
-	struct completed_requests* next;
+	int count;
 };
 
-/* for wait operations, store the pending operation and number of completed waits so far. */
+/* open-addressing (linear probing) table of request IDs. A request ID may be present more than once, each slot keeps the number of copies. */
+struct req_table
+{
+	int num_elems;
+	int num_slots;
+	int capacity;
+	struct req_slot* slots;
+};
+
+/* for wait operations, store the pending operation and number of completed waits so far. wait_reqs holds the request IDs waited on by waitall and waitsome, so a completed request is counted without scanning the request list. */
 struct pending_waits
 {
 	struct codes_workload_op* mpi_op;
 	int num_completed;
 	tw_stime start_time;
+	struct req_table wait_reqs;
 };
 
-/* maintains the head and tail of the queue, as well as the number of elements currently in queue. Queues are pending_recvs queue (holds unmatched MPI recv operations) and arrival_queue (holds unmatched MPI send messages). */
+/* maintains the insertion order of the queue, its (source, tag) buckets and wildcard list, as well as the number of elements currently in queue. Queues are pending_recvs queue (holds unmatched MPI recv operations) and arrival_queue (holds unmatched MPI send messages). */
 struct mpi_queue_ptrs
 {
 	int num_elems;
-	struct mpi_msgs_queue* queue_head;
-	struct mpi_msgs_queue* queue_tail;
+	unsigned long next_seq;
+	struct qlist_head order;
+	struct qlist_head buckets[MPI_QUEUE_BUCKETS];
+	struct qlist_head wildcards;
 };
 
 /* state of the network LP. It contains the pointers to send/receive lists */
@@ -139,21 +252,44 @@ struct nw_state
 	/* time spent in wait operation */
 	double wait_time;
 
+	/* time spent in collective operations */
+	double col_time;
+
 	/* FIFO for isend messages arrived on destination */
 	struct mpi_queue_ptrs* arrival_queue;
 
 	/* FIFO for irecv messages posted but not yet matched with send operations */
 	struct mpi_queue_ptrs* pending_recvs_queue;
 
+	/* matched queue elements, kept for reverse computation until GVT has passed them */
+	struct qlist_head retired_elems;
+	/* pool of free queue elements */
+	struct qlist_head free_elems;
+
 	/* list of pending waits (and saved pending wait for reverse computation) */
 	struct pending_waits* pending_waits;
 
-	/* List of completed send/receive requests */
-	struct completed_requests* completed_reqs;
+	/* request IDs of completed sends/receives */
+	struct req_table completed_reqs;
+
+	/* collective operation in progress: number of collectives started (identifies the
+	 * current one), its type, algorithm, size, current round, number of rounds and
+	 * number of sends of the round not yet completed */
+	int col_seq;
+	short col_active;
+	int col_type;
+	int col_algo;
+	int col_bytes;
+	int col_round;
+	int col_num_rounds;
+	int col_sends_pending;
+	tw_stime col_start_time;
+	/* early messages of collective rounds */
+	struct qlist_head col_arrivals;
 };
 
 /* data for handling reverse computation.
-* saved_matched_req holds the request ID of matched receives/sends for wait operations.
+* ptr_match_elem holds the queue element removed when a send is matched with a receive in the forward event handler, it is linked back by the reverse handler.
 * ptr_match_op holds the matched MPI operation which are removed from the queues when a send is matched with the receive in forward event handler.
 * network event being sent. op is the MPI operation issued by the network workloads API. rv_data holds the data for reverse computation (TODO: Fill this data structure only when the simulation runs in optimistic mode). */
 struct nw_message
@@ -177,6 +313,13 @@ struct nw_message
         double msg_send_time;
         int16_t req_id;
         int tag;
+        /* collective and round a message of a collective belongs to */
+        int col_seq;
+        int col_round;
+        /* receive completed by the data of a rendezvous send */
+        int16_t recv_req_id;
+        int recv_op_type;
+        double recv_start_time;
      } msg_info;
 
      /* required for reverse computation*/
@@ -185,12 +328,23 @@ struct nw_message
 	int found_match;
 	short matched_op;
 	dumpi_req_id saved_matched_req;
-	struct codes_workload_op* ptr_match_op;
+	struct mpi_msgs_queue* ptr_match_elem;
 	struct pending_waits* saved_pending_wait;
 
 	double saved_send_time;
 	double saved_recv_time;
 	double saved_wait_time;
+	double saved_col_time;
+	/* number of collective rounds completed by the event */
+	int col_rounds;
+	/* state of the previous collective, overwritten when a collective starts */
+	int saved_col_type;
+	int saved_col_algo;
+	int saved_col_bytes;
+	int saved_col_round;
+	int saved_col_num_rounds;
+	int saved_col_sends_pending;
+	double saved_col_start_time;
       } rc;
   } u;
 };
@@ -216,9 +370,28 @@ static void codes_exec_mpi_recv_rc(nw_state* s, nw_message* m, tw_lp* lp);
 /* execute the computational delay */
 static void codes_exec_comp_delay(nw_state* s, nw_message* m, tw_lp* lp);
 
-/* execute collective operation, currently only skips these operations. */
+/* execute collective operation, decomposed into point-to-point messages or offloaded to the network model. */
 static void codes_exec_mpi_col(nw_state* s, nw_message* m, tw_lp* lp);
 
+/* reverse of mpi collective function. */
+static void codes_exec_mpi_col_rc(nw_state* s, nw_message* m, tw_lp* lp);
+
+/* upon arrival of a message of a collective, moves the collective on */
+static void update_col_arrival(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+static void update_col_arrival_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+
+/* upon local completion of a send of a collective, moves the collective on */
+static void update_col_send_completion(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+static void update_col_send_completion_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+
+/* completes both sides of a rendezvous transfer once its data has arrived */
+static void update_rendezvous_arrival(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+static void update_rendezvous_arrival_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+
+/* completes a collective offloaded to the network model */
+static void update_col_completion(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+static void update_col_completion_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp);
+
 /* gets the next MPI operation from the network-workloads API. */
 static void get_next_mpi_operation(nw_state* s, tw_bf * bf, nw_message * m, tw_lp * lp);
 
@@ -246,19 +419,22 @@ static void update_message_time(nw_state*s, tw_bf* bf, nw_message* m, tw_lp * lp
 static void update_message_time_rc(nw_state*s, tw_bf* bf, nw_message* m, tw_lp * lp);
 
 /* insert MPI operation in the waiting queue*/
-static void mpi_pending_queue_insert_op(struct mpi_queue_ptrs* mpi_queue, struct codes_workload_op* mpi_op);
+static void mpi_pending_queue_insert_op(nw_state* s, struct mpi_queue_ptrs* mpi_queue, struct codes_workload_op* mpi_op);
 
-/* remove completed request IDs from the queue for reuse. Reverse of above function. */
-static void remove_req_id(struct completed_requests** requests, int16_t req_id);
+/* remove completed request IDs from the table for reuse. Reverse of insert_req_id. */
+static void remove_req_id(struct req_table* requests, dumpi_req_id req_id);
 
 /* remove MPI operation from the waiting queue.*/
 static int mpi_queue_remove_matching_op(nw_state* s, tw_lp* lp, struct mpi_queue_ptrs* mpi_queue, nw_message * m);
 
 /* remove the tail of the MPI operation from waiting queue */
-static int mpi_queue_remove_tail(tw_lpid lpid, struct mpi_queue_ptrs* mpi_queue);
+static int mpi_queue_remove_tail(nw_state* s, struct mpi_queue_ptrs* mpi_queue);
+
+/* put a matched element back in its queue. Reverse of mpi_queue_remove_matching_op. */
+static void mpi_queue_relink(nw_state* s, struct mpi_queue_ptrs* mpi_queue, struct mpi_msgs_queue* elem);
 
-/* insert completed MPI requests in the queue. */
-static void mpi_completed_queue_insert_op(struct completed_requests** mpi_completed_queue, dumpi_req_id req_id);
+/* insert completed MPI requests in the table. */
+static void insert_req_id(struct req_table* requests, dumpi_req_id req_id);
 
 /* notifies the wait operations (if any) about the completed receives and sends requests. */
 static int notify_waits(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, dumpi_req_id req_id);
@@ -275,14 +451,21 @@ static tw_lpid rank_to_lpid(int rank)
     return codes_mapping_get_lpid_from_relative(rank, NULL, "nw-lp", NULL, 0);
 }
 
+/* matched elements can be rolled back only in optimistic mode */
+static int mpi_queue_state_saving = 0;
+
 /* initializes the queue and allocates memory */
 static struct mpi_queue_ptrs* queue_init()
 {
 	struct mpi_queue_ptrs* mpi_queue = malloc(sizeof(struct mpi_queue_ptrs));
+	int i;
 
 	mpi_queue->num_elems = 0;
-	mpi_queue->queue_head = NULL;
-	mpi_queue->queue_tail = NULL;
+	mpi_queue->next_seq = 0;
+	INIT_QLIST_HEAD(&mpi_queue->order);
+	for(i = 0; i < MPI_QUEUE_BUCKETS; i++)
+		INIT_QLIST_HEAD(&mpi_queue->buckets[i]);
+	INIT_QLIST_HEAD(&mpi_queue->wildcards);
 
 	return mpi_queue;
 }
@@ -290,31 +473,82 @@ static struct mpi_queue_ptrs* queue_init()
 /* helper function: counts number of elements in the queue */
 static int numQueue(struct mpi_queue_ptrs* mpi_queue)
 {
-	struct mpi_msgs_queue* tmp = malloc(sizeof(struct mpi_msgs_queue));
-	assert(tmp);
+	return mpi_queue->num_elems;
+}
+
+/* bucket of a (source, tag) pair */
+static struct qlist_head* queue_bucket(struct mpi_queue_ptrs* mpi_queue, int source_rank, int tag)
+{
+	unsigned int h = (unsigned int)source_rank * 2654435761u ^ (unsigned int)tag;
+	return &mpi_queue->buckets[(h ^ (h >> 16)) & (MPI_QUEUE_BUCKETS - 1)];
+}
 
-	tmp = mpi_queue->queue_head;
-	int count = 0;
+/* takes a queue element from the pool of the LP */
+static struct mpi_msgs_queue* queue_elem_alloc(nw_state* s)
+{
+	struct mpi_msgs_queue* elem;
 
-	while(tmp)
+	if(qlist_empty(&s->free_elems))
 	{
-		++count;
-		tmp = tmp->next;
+		elem = malloc(sizeof(struct mpi_msgs_queue));
+		assert(elem);
+		return elem;
 	}
-	return count;
-	free(tmp);
+	elem = qlist_entry(s->free_elems.next, struct mpi_msgs_queue, free);
+	qlist_del(&elem->free);
+	return elem;
+}
+
+/* returns a queue element to the pool of the LP */
+static void queue_elem_free(nw_state* s, struct mpi_msgs_queue* elem)
+{
+	qlist_add(&elem->free, &s->free_elems);
+}
+
+/* a matched element leaves its queue. It keeps its links for reverse computation and returns
+ * to the pool once the match is older than GVT (right away if there is no rollback) */
+static void queue_elem_retire(nw_state* s, tw_lp* lp, struct mpi_msgs_queue* elem)
+{
+	if(!mpi_queue_state_saving)
+	{
+		queue_elem_free(s, elem);
+		return;
+	}
+	elem->retire_time = tw_now(lp);
+	qlist_add_tail(&elem->free, &s->retired_elems);
+
+	while(!qlist_empty(&s->retired_elems))
+	{
+		struct mpi_msgs_queue* old = qlist_entry(s->retired_elems.next,
+			struct mpi_msgs_queue, free);
+		if(old->retire_time >= lp->pe->GVT)
+			break;
+		qlist_del(&old->free);
+		queue_elem_free(s, old);
+	}
+}
+
+/* unlinks e from its list, e keeps pointing at its neighbours */
+static void queue_unlink(struct qlist_head* e)
+{
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+/* links e back between the neighbours it had when it was unlinked */
+static void queue_relink(struct qlist_head* e)
+{
+	e->prev->next = e;
+	e->next->prev = e;
 }
 
 /* prints elements in a send/recv queue */
 static void printQueue(tw_lpid lpid, struct mpi_queue_ptrs* mpi_queue, char* msg)
 {
 	printf("\n ************ Printing the queue %s *************** ", msg);
-	struct mpi_msgs_queue* tmp = malloc(sizeof(struct mpi_msgs_queue));
-	assert(tmp);
+	struct mpi_msgs_queue* tmp;
 
-	tmp = mpi_queue->queue_head;
-
-	while(tmp)
+	qlist_for_each_entry(tmp, &mpi_queue->order, order)
 	{
 		if(tmp->mpi_op->op_type == CODES_WK_SEND || tmp->mpi_op->op_type == CODES_WK_ISEND)
 			printf("\n lpid %ld send operation data type %d count %d tag %d source %d",
@@ -326,47 +560,59 @@ static void printQueue(tw_lpid lpid, struct mpi_queue_ptrs* mpi_queue, char* msg
 				    tmp->mpi_op->u.recv.tag, tmp->mpi_op->u.recv.source_rank );
 		else
 			printf("\n Invalid data type in the queue %d ", tmp->mpi_op->op_type);
-		tmp = tmp->next;
 	}
-	free(tmp);
 }
 
-/* re-insert element in the queue at the index --- maintained for reverse computation */
-static void mpi_queue_update(struct mpi_queue_ptrs* mpi_queue, struct codes_workload_op* mpi_op, int pos)
+/* re-insert a matched element in its queue --- maintained for reverse computation. The
+ * elements matched or inserted after it have been rolled back, so its neighbours are the same */
+static void mpi_queue_relink(nw_state* s, struct mpi_queue_ptrs* mpi_queue, struct mpi_msgs_queue* elem)
 {
-	struct mpi_msgs_queue* elem = malloc(sizeof(struct mpi_msgs_queue));
-	assert(elem);
-	elem->mpi_op = mpi_op;
+	if(mpi_queue_state_saving)
+		qlist_del(&elem->free);
+	queue_relink(&elem->order);
+	queue_relink(&elem->bucket);
+	mpi_queue->num_elems++;
+}
 
-	/* inserting at the head */
-	if(pos == 0)
-	{
-	   if(!mpi_queue->queue_tail)
-		mpi_queue->queue_tail = elem;
-	   elem->next = mpi_queue->queue_head;
-	   mpi_queue->queue_head = elem;
-	   mpi_queue->num_elems++;
-	   return;
-	}
+/* initializes an empty request ID table, slots are allocated on the first insertion */
+static void req_table_init(struct req_table* requests)
+{
+	requests->num_elems = 0;
+	requests->num_slots = 0;
+	requests->capacity = 0;
+	requests->slots = NULL;
+}
 
-	int index = 0;
-	struct mpi_msgs_queue* tmp = mpi_queue->queue_head;
-	while(index < pos - 1)
-	{
-		tmp = tmp->next;
-		++index;
-	}
+static unsigned int req_hash(dumpi_req_id req_id)
+{
+	unsigned int h = (unsigned int)(uint16_t)req_id * 2654435761u;
+	return h ^ (h >> 16);
+}
 
-	if(!tmp)
-		printf("\n Invalid index! %d pos %d size %d ", index, pos, numQueue(mpi_queue));
-	if(tmp == mpi_queue->queue_tail)
-	    mpi_queue->queue_tail = elem;
+/* slot holding the request ID, or the empty slot ending its probe sequence */
+static int req_find_slot(const struct req_table* requests, dumpi_req_id req_id)
+{
+	int mask = requests->capacity - 1;
+	int i = req_hash(req_id) & mask;
 
-	elem->next = tmp->next;
-	tmp->next = elem;
-	mpi_queue->num_elems++;
+	while(requests->slots[i].count && requests->slots[i].req_id != req_id)
+		i = (i + 1) & mask;
+	return i;
+}
 
-	return;
+/* number of copies of the request ID in the table */
+static int req_count(const struct req_table* requests, dumpi_req_id req_id)
+{
+	if(!requests->num_elems)
+		return 0;
+	return requests->slots[req_find_slot(requests, req_id)].count;
+}
+
+/* frees a pending wait operation along with its request table */
+static void free_wait(struct pending_waits* wait_elem)
+{
+	free(wait_elem->wait_reqs.slots);
+	free(wait_elem);
 }
 
 /* prints the elements of a queue (for debugging purposes). */
@@ -374,13 +620,11 @@ static void printCompletedQueue(nw_state* s, tw_lp* lp)
 {
 	   if(TRACE == lp->gid)
 	   {
+	   	int i, j;
 	   	printf("\n %lf contents of completed operations queue ", tw_now(lp));
-	   	struct completed_requests* current = s->completed_reqs;
-	   	while(current)
-	    	{
-			printf(" %d ",current->req_id);
-			current = current->next;
-	   	}
+	   	for(i = 0; i < s->completed_reqs.capacity; i++)
+			for(j = 0; j < s->completed_reqs.slots[i].count; j++)
+				printf(" %d ", s->completed_reqs.slots[i].req_id);
 	   }
 }
 
@@ -389,20 +633,11 @@ static void notify_waits_rc(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, du
 {
    int i;
 
-   /*if(bf->c1)
-    {*/
-	/* if pending wait is still present and is of type MPI_WAIT then do nothing*/
-/*	s->wait_time = s->saved_wait_time;
-	mpi_completed_queue_insert_op(&s->completed_reqs, completed_req);
-	s->pending_waits = wait_elem;
-	s->saved_pending_wait = NULL;
-    }
-*/
   if(lp->gid == TRACE)
 	  printf("\n %lf reverse -- notify waits req id %d ", tw_now(lp), completed_req);
   printCompletedQueue(s, lp);
   if(m->u.rc.matched_op == 1)
-	s->pending_waits->num_completed--;
+	s->pending_waits->num_completed -= req_count(&s->pending_waits->wait_reqs, completed_req);
    /* if a wait-elem exists, it means the request ID has been matched*/
    if(m->u.rc.matched_op == 2)
     {
@@ -413,26 +648,47 @@ static void notify_waits_rc(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, du
 	}
         struct pending_waits* wait_elem = m->u.rc.saved_pending_wait;
 	s->wait_time = m->u.rc.saved_wait_time;
-	int count = wait_elem->mpi_op->u.waits.count;
 
-	for( i = 0; i < count; i++ )
-		mpi_completed_queue_insert_op(&s->completed_reqs, wait_elem->mpi_op->u.waits.req_ids[i]);
+	if(wait_elem->mpi_op->op_type == CODES_WK_WAIT)
+		insert_req_id(&s->completed_reqs, completed_req);
+	else
+	{
+		int count = wait_elem->mpi_op->u.waits.count;
+
+		for( i = 0; i < count; i++ )
+			insert_req_id(&s->completed_reqs, wait_elem->mpi_op->u.waits.req_ids[i]);
 
-	wait_elem->num_completed--;
+		wait_elem->num_completed -= req_count(&wait_elem->wait_reqs, completed_req);
+	}
 	s->pending_waits = wait_elem;
 	tw_rand_reverse_unif(lp->rng);
 
    }
 }
 
+/* the wait operation has completed, its request IDs have been removed from the completed requests */
+static void complete_wait(nw_state* s, tw_lp* lp, nw_message* m, struct pending_waits* wait_elem)
+{
+	m->u.rc.matched_op = 2;
+	m->u.rc.saved_wait_time = s->wait_time;
+	s->wait_time += (tw_now(lp) - wait_elem->start_time);
+	m->u.rc.saved_pending_wait = wait_elem;
+	s->pending_waits = NULL;
+
+	/* the wait is brought back by the reverse handler in optimistic mode */
+	if(!mpi_queue_state_saving)
+		free_wait(wait_elem);
+	codes_issue_next_event(lp);
+}
+
 /* notify the completed send/receive request to the wait operation. */
 static int notify_waits(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, dumpi_req_id completed_req)
 {
 	int i;
-	/* traverse the pending waits list and look what type of wait operations are
-	there. If its just a single wait and the request ID has just been completed,
-	then the network node LP can go on with fetching the next operation from the log.
-	If its waitall then wait for all pending requests to complete and then proceed. */
+	/* look at the type of the pending wait operation. If its just a single wait and the
+	request ID has just been completed, then the network node LP can go on with fetching
+	the next operation from the log. If its waitall then count the completed request and
+	wait for all pending requests to complete before proceeding. */
 	struct pending_waits* wait_elem = s->pending_waits;
 	m->u.rc.matched_op = 0;
 
@@ -448,30 +704,24 @@ static int notify_waits(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, dumpi_
 	{
 		if(wait_elem->mpi_op->u.wait.req_id == completed_req)
 		  {
-			m->u.rc.saved_wait_time = s->wait_time;
-			s->wait_time += (tw_now(lp) - wait_elem->start_time);
-                        remove_req_id(&s->completed_reqs, completed_req);
-
-			m->u.rc.saved_pending_wait = wait_elem;
-			s->pending_waits = NULL;
-			codes_issue_next_event(lp);
+			remove_req_id(&s->completed_reqs, completed_req);
+			complete_wait(s, lp, m, wait_elem);
 			return 0;
 		 }
 	}
 	else
-	if(op_type == CODES_WK_WAITALL)
+	if(op_type == CODES_WK_WAITALL || op_type == CODES_WK_WAITSOME)
 	{
 	   int required_count = wait_elem->mpi_op->u.waits.count;
-	  for(i = 0; i < required_count; i++)
-	   {
-	    if(wait_elem->mpi_op->u.waits.req_ids[i] == completed_req)
+	   int matched = req_count(&wait_elem->wait_reqs, completed_req);
+
+	   if(matched)
 		{
 			if(lp->gid == TRACE)
 				printCompletedQueue(s, lp);
 			m->u.rc.matched_op = 1;
-			wait_elem->num_completed++;
+			wait_elem->num_completed += matched;
 		}
-	   }
 
 	    if(wait_elem->num_completed == required_count)
 	     {
@@ -480,14 +730,9 @@ static int notify_waits(nw_state* s, tw_bf* bf, tw_lp* lp, nw_message* m, dumpi_
 			printf("\n %lf req %d completed %d", tw_now(lp), completed_req, wait_elem->num_completed);
 			printCompletedQueue(s, lp);
 		}
-		m->u.rc.matched_op = 2;
-		m->u.rc.saved_wait_time = s->wait_time;
-		s->wait_time += (tw_now(lp) - wait_elem->start_time);
-		m->u.rc.saved_pending_wait = wait_elem;
-		s->pending_waits = NULL;
 		for(i = 0; i < required_count; i++)
 			remove_req_id(&s->completed_reqs, wait_elem->mpi_op->u.waits.req_ids[i]);
-		codes_issue_next_event(lp); //wait completed
+		complete_wait(s, lp, m, wait_elem); //wait completed
 	    }
        }
 	return 0;
@@ -498,12 +743,13 @@ static void codes_exec_mpi_wait_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp*
 {
     if(s->pending_waits)
      {
+	free_wait(s->pending_waits);
     	s->pending_waits = NULL;
 	return;
      }
    else
     {
- 	mpi_completed_queue_insert_op(&s->completed_reqs, m->op->u.wait.req_id);
+ 	insert_req_id(&s->completed_reqs, m->op->u.wait.req_id);
 	tw_rand_reverse_unif(lp->rng);
     }
 }
@@ -511,19 +757,16 @@ static void codes_exec_mpi_wait_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp*
 /* execute MPI wait operation */
 static void codes_exec_mpi_wait(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
 {
-    /* check in the completed receives queue if the request ID has already been completed.*/
+    /* check in the completed requests if the request ID has already been completed.*/
     assert(!s->pending_waits);
     dumpi_req_id req_id = m->op->u.wait.req_id;
 
-    struct completed_requests* current = s->completed_reqs;
-    while(current) {
-        if(current->req_id == req_id) {
-            remove_req_id(&s->completed_reqs, req_id);
-            m->u.rc.saved_wait_time = s->wait_time;
-            codes_issue_next_event(lp);
-            return;
-        }
-        current = current->next;
+    if(req_count(&s->completed_reqs, req_id))
+    {
+        remove_req_id(&s->completed_reqs, req_id);
+        m->u.rc.saved_wait_time = s->wait_time;
+        codes_issue_next_event(lp);
+        return;
     }
 
     /* If not, add the wait operation in the pending 'waits' list. */
@@ -531,6 +774,7 @@ static void codes_exec_mpi_wait(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp
     wait_op->mpi_op = m->op;
     wait_op->num_completed = 0;
     wait_op->start_time = tw_now(lp);
+    req_table_init(&wait_op->wait_reqs);
     s->pending_waits = wait_op;
 }
 
@@ -545,21 +789,15 @@ static void codes_exec_mpi_wait_all_rc(nw_state* s, tw_bf* bf, nw_message* m, tw
     {
    	int i;
 	int count = m->op->u.waits.count;
-	dumpi_req_id req_id[count];
 
 	for( i = 0; i < count; i++)
-	{
-		req_id[i] = m->op->u.waits.req_ids[i];
-		mpi_completed_queue_insert_op(&s->completed_reqs, req_id[i]);
-	}
+		insert_req_id(&s->completed_reqs, m->op->u.waits.req_ids[i]);
 	tw_rand_reverse_unif(lp->rng);
     }
     else
     {
-	struct pending_waits* wait_op = s->pending_waits;
-	free(wait_op);
+	free_wait(s->pending_waits);
 	s->pending_waits = NULL;
-	assert(!s->pending_waits);
 	if(lp->gid == TRACE)
 		printf("\n %lf Nullifying codes waitall ", tw_now(lp));
     }
@@ -569,10 +807,8 @@ static void codes_exec_mpi_wait_all(nw_state* s, tw_bf* bf, nw_message* m, tw_lp
   //assert(!s->pending_waits);
   int count = m->op->u.waits.count;
   int i, num_completed = 0;
-  dumpi_req_id req_id[count];
-  struct completed_requests* current = s->completed_reqs;
 
-  /* check number of completed irecvs in the completion queue */
+  /* check number of completed requests in the completed table */
   if(lp->gid == TRACE)
     {
   	printf(" \n (%lf) MPI waitall posted %d count", tw_now(lp), m->op->u.waits.count);
@@ -580,16 +816,8 @@ static void codes_exec_mpi_wait_all(nw_state* s, tw_bf* bf, nw_message* m, tw_lp
 		printf(" %d ", (int)m->op->u.waits.req_ids[i]);
    	printCompletedQueue(s, lp);
    }
-  while(current)
-   {
-	  for(i = 0; i < count; i++)
-	   {
-	     req_id[i] = m->op->u.waits.req_ids[i];
-	     if(req_id[i] == current->req_id)
- 		 num_completed++;
-   	  }
-	 current = current->next;
-   }
+  for(i = 0; i < count; i++)
+	num_completed += req_count(&s->completed_reqs, m->op->u.waits.req_ids[i]);
 
   if(TRACE== lp->gid)
 	  printf("\n %lf Num completed %d count %d ", tw_now(lp), num_completed, count);
@@ -599,7 +827,7 @@ static void codes_exec_mpi_wait_all(nw_state* s, tw_bf* bf, nw_message* m, tw_lp
   {
 	m->u.rc.found_match = 1;
 	for( i = 0; i < count; i++)
-		remove_req_id(&s->completed_reqs, req_id[i]);
+		remove_req_id(&s->completed_reqs, m->op->u.waits.req_ids[i]);
 
 	codes_issue_next_event(lp);
   }
@@ -610,83 +838,141 @@ static void codes_exec_mpi_wait_all(nw_state* s, tw_bf* bf, nw_message* m, tw_lp
 	  wait_op->mpi_op = m->op;
 	  wait_op->num_completed = num_completed;
 	  wait_op->start_time = tw_now(lp);
+	  req_table_init(&wait_op->wait_reqs);
+	  for(i = 0; i < count; i++)
+		insert_req_id(&wait_op->wait_reqs, m->op->u.waits.req_ids[i]);
 	  s->pending_waits = wait_op;
   }
 }
 
-/* request ID is being reused so delete it from the list once the matching is done */
-static void remove_req_id(struct completed_requests** mpi_completed_queue, dumpi_req_id req_id)
+/* request ID is being reused so delete it from the table once the matching is done.
+ * Deletion shifts back the following slots of the probe sequence, so no tombstones are needed. */
+static void remove_req_id(struct req_table* requests, dumpi_req_id req_id)
 {
-	struct completed_requests* current = *mpi_completed_queue;
-
-	if(!current)
+	if(!requests->num_elems)
 		tw_error(TW_LOC, "\n REQ ID DOES NOT EXIST");
 
-       if(current->req_id == req_id)
-	{
-		*mpi_completed_queue = current->next;
-		free(current);
+	int mask = requests->capacity - 1;
+	int i = req_find_slot(requests, req_id);
+	struct req_slot* slots = requests->slots;
+
+	if(!slots[i].count)
 		return;
-	}
 
-	struct completed_requests* elem;
-	while(current->next)
-	{
-	   elem = current->next;
-	   if(elem->req_id == req_id)
-	     {
-		current->next = elem->next;
-		free(elem);
+	requests->num_elems--;
+	if(--slots[i].count)
 		return;
-	     }
-	   current = current->next;
+
+	requests->num_slots--;
+	int j = i;
+	while(1)
+	{
+		j = (j + 1) & mask;
+		if(!slots[j].count)
+			break;
+
+		/* move the entry back unless its home slot lies cyclically in (i, j] */
+		int k = req_hash(slots[j].req_id) & mask;
+		if((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		slots[i] = slots[j];
+		slots[j].count = 0;
+		i = j;
 	}
-	return;
 }
 
-/* inserts mpi operation in the completed requests queue */
-static void mpi_completed_queue_insert_op(struct completed_requests** mpi_completed_queue, dumpi_req_id req_id)
+/* inserts a request ID in the table, doubling it when it gets half full */
+static void insert_req_id(struct req_table* requests, dumpi_req_id req_id)
 {
-	struct completed_requests* reqs = malloc(sizeof(struct completed_requests));
-	assert(reqs);
+	if(2 * (requests->num_slots + 1) > requests->capacity)
+	{
+		struct req_table grown;
+		int i;
+
+		grown.num_elems = requests->num_elems;
+		grown.num_slots = requests->num_slots;
+		grown.capacity = requests->capacity ? 2 * requests->capacity : REQ_TABLE_MIN_SLOTS;
+		grown.slots = calloc(grown.capacity, sizeof(struct req_slot));
+		assert(grown.slots);
+
+		for(i = 0; i < requests->capacity; i++)
+			if(requests->slots[i].count)
+				grown.slots[req_find_slot(&grown, requests->slots[i].req_id)] = requests->slots[i];
 
-	reqs->req_id = req_id;
+		free(requests->slots);
+		*requests = grown;
+	}
 
-	if(!(*mpi_completed_queue))
+	int i = req_find_slot(requests, req_id);
+	if(!requests->slots[i].count)
 	{
-			reqs->next = NULL;
-			*mpi_completed_queue = reqs;
-			return;
+		requests->slots[i].req_id = req_id;
+		requests->num_slots++;
 	}
-	reqs->next = *mpi_completed_queue;
-	*mpi_completed_queue = reqs;
-	return;
+	requests->slots[i].count++;
+	requests->num_elems++;
 }
 
 /* insert MPI send or receive operation in the queues starting from tail. Unmatched sends go to arrival queue and unmatched receives go to pending receives queues. */
-static void mpi_pending_queue_insert_op(struct mpi_queue_ptrs* mpi_queue, struct codes_workload_op* mpi_op)
+static void mpi_pending_queue_insert_op(nw_state* s, struct mpi_queue_ptrs* mpi_queue, struct codes_workload_op* mpi_op)
 {
 	/* insert mpi operation */
-	struct mpi_msgs_queue* elem = malloc(sizeof(struct mpi_msgs_queue));
-	assert(elem);
+	struct mpi_msgs_queue* elem = queue_elem_alloc(s);
 
 	elem->mpi_op = mpi_op;
-     	elem->next = NULL;
-
-	if(!mpi_queue->queue_head)
-	  mpi_queue->queue_head = elem;
-
-	if(mpi_queue->queue_tail)
-	    mpi_queue->queue_tail->next = elem;
+	if(mpi_op->op_type == CODES_WK_SEND || mpi_op->op_type == CODES_WK_ISEND)
+	{
+		elem->source_rank = mpi_op->u.send.source_rank;
+		elem->tag = mpi_op->u.send.tag;
+	}
+	else
+	{
+		elem->source_rank = mpi_op->u.recv.source_rank;
+		elem->tag = mpi_op->u.recv.tag;
+	}
+	elem->seq = mpi_queue->next_seq++;
 
-        mpi_queue->queue_tail = elem;
+	qlist_add_tail(&elem->order, &mpi_queue->order);
+	if(elem->source_rank == -1 || elem->tag == -1)
+		qlist_add_tail(&elem->bucket, &mpi_queue->wildcards);
+	else
+		qlist_add_tail(&elem->bucket, queue_bucket(mpi_queue, elem->source_rank, elem->tag));
 	mpi_queue->num_elems++;
 
 	return;
 }
 
 /* match the send/recv operations */
-static int match_receive(nw_state* s, tw_lp* lp, tw_lpid lpid, struct codes_workload_op* op1, struct codes_workload_op* op2)
+/* checks if a send of num_bytes uses the rendezvous protocol */
+static int is_rendezvous(int num_bytes)
+{
+	return eager_threshold > 0 && num_bytes > eager_threshold;
+}
+
+/* the receive of a rendezvous send has been matched: pull the data from the sender.
+ * The data arrival event carries what is needed to complete both sides. */
+static void rendezvous_pull(tw_lp* lp, struct codes_workload_op* send_op, struct codes_workload_op* recv_op)
+{
+	nw_message self_m;
+
+	memset(&self_m, 0, sizeof(self_m));
+	self_m.msg_type = MPI_REND_ARRIVED;
+	self_m.u.msg_info.sim_start_time = send_op->sim_start_time;
+	self_m.u.msg_info.op_type = send_op->op_type;
+	self_m.u.msg_info.src_rank = send_op->u.send.source_rank;
+	self_m.u.msg_info.dest_rank = send_op->u.send.dest_rank;
+	self_m.u.msg_info.num_bytes = send_op->u.send.num_bytes;
+	self_m.u.msg_info.tag = send_op->u.send.tag;
+	self_m.u.msg_info.req_id = send_op->u.send.req_id;
+	self_m.u.msg_info.recv_req_id = recv_op->u.recv.req_id;
+	self_m.u.msg_info.recv_op_type = recv_op->op_type;
+	self_m.u.msg_info.recv_start_time = recv_op->sim_start_time;
+
+	model_net_pull_event(net_id, "test", rank_to_lpid(send_op->u.send.source_rank),
+	    send_op->u.send.num_bytes, 0.0, sizeof(nw_message), (const void*)&self_m, lp);
+}
+
+static int match_receive(struct codes_workload_op* op1, struct codes_workload_op* op2)
 {
         assert(op1->op_type == CODES_WK_IRECV || op1->op_type == CODES_WK_RECV);
         assert(op2->op_type == CODES_WK_SEND || op2->op_type == CODES_WK_ISEND);
@@ -694,129 +980,127 @@ static int match_receive(nw_state* s, tw_lp* lp, tw_lpid lpid, struct codes_work
         if((op1->u.recv.num_bytes >= op2->u.send.num_bytes) &&
                    ((op1->u.recv.tag == op2->u.send.tag) || op1->u.recv.tag == -1) &&
                    ((op1->u.recv.source_rank == op2->u.send.source_rank) || op1->u.recv.source_rank == -1))
-                   {
-                        if(lp->gid == TRACE)
-                           printf("\n op1 rank %d bytes %d ", op1->u.recv.source_rank, op1->u.recv.num_bytes);
-                        s->recv_time += tw_now(lp) - op1->sim_start_time;
-                        mpi_completed_queue_insert_op(&s->completed_reqs, op1->u.recv.req_id);
                         return 1;
-                   }
         return -1;
 }
 
 /* used for reverse computation. removes the tail of the queue */
-static int mpi_queue_remove_tail(tw_lpid lpid, struct mpi_queue_ptrs* mpi_queue)
+static int mpi_queue_remove_tail(nw_state* s, struct mpi_queue_ptrs* mpi_queue)
 {
-	assert(mpi_queue->queue_tail);
-	if(mpi_queue->queue_tail == NULL)
+	if(qlist_empty(&mpi_queue->order))
 	{
 		printf("\n Error! tail not updated ");
 		return 0;
 	}
-	struct mpi_msgs_queue* tmp = mpi_queue->queue_head;
+	/* the tail of the queue is also the tail of its bucket */
+	struct mpi_msgs_queue* elem = qlist_entry(mpi_queue->order.prev, struct mpi_msgs_queue, order);
 
-	if(mpi_queue->queue_head == mpi_queue->queue_tail)
-	{
-		mpi_queue->queue_head = NULL;
-		mpi_queue->queue_tail = NULL;
-		free(tmp);
-		mpi_queue->num_elems--;
-		 return 1;
-	}
+	qlist_del(&elem->order);
+	qlist_del(&elem->bucket);
+	mpi_queue->num_elems--;
+	mpi_queue->next_seq--;
+	queue_elem_free(s, elem);
+	return 1;
+}
 
-	struct mpi_msgs_queue* elem = mpi_queue->queue_tail;
+/* first receive of the list that matches the send, the list is linked through the bucket field */
+static struct mpi_msgs_queue* find_matching_recv(struct qlist_head* list, struct codes_workload_op* send_op)
+{
+	struct mpi_msgs_queue* elem;
 
-	while(tmp->next != mpi_queue->queue_tail)
-		tmp = tmp->next;
+	qlist_for_each_entry(elem, list, bucket)
+	{
+		if(match_receive(elem->mpi_op, send_op) >= 0)
+			return elem;
+	}
+	return NULL;
+}
 
-	mpi_queue->queue_tail = tmp;
-	mpi_queue->queue_tail->next = NULL;
-	mpi_queue->num_elems--;
+/* first send of the list that matches the receive, the list is linked through the bucket field */
+static struct mpi_msgs_queue* find_matching_send(struct qlist_head* list, struct codes_workload_op* recv_op)
+{
+	struct mpi_msgs_queue* elem;
 
-	free(elem);
-	return 1;
+	qlist_for_each_entry(elem, list, bucket)
+	{
+		if(match_receive(recv_op, elem->mpi_op) >= 0)
+			return elem;
+	}
+	return NULL;
 }
 
 /* search for a matching mpi operation and remove it from the list.
- * Record the index in the list from where the element got deleted.
- * Index is used for inserting the element once again in the queue for reverse computation. */
+ * An arriving send takes the earliest posted receive among the first match of its (source, tag)
+ * bucket and the first match of the wildcard list. A receive without wildcards only looks at its
+ * bucket, a receive with MPI_ANY_SOURCE/MPI_ANY_TAG walks the arrival order.
+ * The removed element is saved in the message for reverse computation. */
 static int mpi_queue_remove_matching_op(nw_state* s, tw_lp* lp, struct mpi_queue_ptrs* mpi_queue, nw_message * m)
 {
-       struct codes_workload_op * mpi_op = m->op;
-
-	if(mpi_queue->queue_head == NULL)
-		return -1;
+	struct codes_workload_op * mpi_op = m->op;
+	struct codes_workload_op * recv_op;
+	struct codes_workload_op * send_op;
+	struct mpi_msgs_queue* match = NULL;
 
-	/* remove mpi operation */
-	struct mpi_msgs_queue* tmp = mpi_queue->queue_head;
-	int indx = 0;
-
-	/* if head of the list has the required mpi op to be deleted */
-	int rcv_val = 0;
 	if(mpi_op->op_type == CODES_WK_SEND || mpi_op->op_type == CODES_WK_ISEND)
 	  {
-		rcv_val = match_receive(s, lp, lp->gid, tmp->mpi_op, mpi_op);
-		m->u.rc.saved_matched_req = tmp->mpi_op->u.recv.req_id;
-	 }
+		struct mpi_msgs_queue* wild;
+
+		match = find_matching_recv(queue_bucket(mpi_queue, mpi_op->u.send.source_rank,
+					mpi_op->u.send.tag), mpi_op);
+		wild = find_matching_recv(&mpi_queue->wildcards, mpi_op);
+		if(wild && (!match || wild->seq < match->seq))
+			match = wild;
+		if(!match)
+			return -1;
+		recv_op = match->mpi_op;
+	  }
 	else if(mpi_op->op_type == CODES_WK_RECV || mpi_op->op_type == CODES_WK_IRECV)
 	  {
-		rcv_val = match_receive(s, lp, lp->gid, mpi_op, tmp->mpi_op);
-	  	m->u.rc.saved_matched_req = mpi_op->u.recv.req_id;
-	  }
-	if(rcv_val >= 0)
-	{
-		/* TODO: fix RC */
-		/*memcpy(&m->u.rc.ptr_match_op, &tmp->mpi_op, sizeof(struct codes_workload_op));*/
-		if(mpi_queue->queue_head == mpi_queue->queue_tail)
-		   {
-			mpi_queue->queue_tail = NULL;
-			mpi_queue->queue_head = NULL;
-			 free(tmp);
-		   }
-		 else
-		   {
-			mpi_queue->queue_head = tmp->next;
-			free(tmp);
-		   }
-		mpi_queue->num_elems--;
-		return indx;
-	}
-
-	/* record the index where matching operation has been found */
-	struct mpi_msgs_queue* elem;
-
-	while(tmp->next)
-	{
-	   indx++;
-	   elem = tmp->next;
+		struct mpi_msgs_queue* elem;
 
-	    if(mpi_op->op_type == CODES_WK_SEND || mpi_op->op_type == CODES_WK_ISEND)
-	     {
-		rcv_val = match_receive(s, lp, lp->gid, elem->mpi_op, mpi_op);
-	     	m->u.rc.saved_matched_req = elem->mpi_op->u.recv.req_id;
-	     }
-	    else if(mpi_op->op_type == CODES_WK_RECV || mpi_op->op_type == CODES_WK_IRECV)
-	     {
-		rcv_val = match_receive(s, lp, lp->gid, mpi_op, elem->mpi_op);
-		m->u.rc.saved_matched_req = mpi_op->u.recv.req_id;
-	     }
-   	     if(rcv_val >= 0)
+		recv_op = mpi_op;
+		if(recv_op->u.recv.source_rank == -1 || recv_op->u.recv.tag == -1)
 		{
-		    /* TODO: fix RC */
-		    /*memcpy(&m->u.rc.ptr_match_op, &elem->mpi_op, sizeof(struct codes_workload_op));*/
-		    if(elem == mpi_queue->queue_tail)
-			mpi_queue->queue_tail = tmp;
+			qlist_for_each_entry(elem, &mpi_queue->order, order)
+			{
+				if(match_receive(recv_op, elem->mpi_op) >= 0)
+				{
+					match = elem;
+					break;
+				}
+			}
+		}
+		else
+			match = find_matching_send(queue_bucket(mpi_queue,
+				recv_op->u.recv.source_rank, recv_op->u.recv.tag), recv_op);
+		if(!match)
+			return -1;
+	  }
+	else
+		return -1;
 
-		    tmp->next = elem->next;
+	if(lp->gid == TRACE)
+		printf("\n op1 rank %d bytes %d ", recv_op->u.recv.source_rank, recv_op->u.recv.num_bytes);
+	send_op = (recv_op == mpi_op) ? match->mpi_op : mpi_op;
+	m->u.rc.saved_matched_req = recv_op->u.recv.req_id;
+	m->u.rc.ptr_match_elem = match;
 
-		    free(elem);
-		    mpi_queue->num_elems--;
+	queue_unlink(&match->order);
+	queue_unlink(&match->bucket);
+	mpi_queue->num_elems--;
+	queue_elem_retire(s, lp, match);
 
-		    return indx;
-		}
-	   tmp = tmp->next;
-        }
-	return -1;
+	/* a rendezvous receive completes when the data pulled from the sender arrives */
+	if(is_rendezvous(send_op->u.send.num_bytes))
+	{
+		rendezvous_pull(lp, send_op, recv_op);
+		return 1;
+	}
+	s->recv_time += tw_now(lp) - recv_op->sim_start_time;
+	/* nothing waits on a blocking receive */
+	if(recv_op->op_type == CODES_WK_IRECV)
+		insert_req_id(&s->completed_reqs, recv_op->u.recv.req_id);
+	return 1;
 }
 /* Trigger getting next event at LP */
 static void codes_issue_next_event(tw_lp* lp)
@@ -866,14 +1150,25 @@ static void codes_exec_mpi_recv_rc(nw_state* s, nw_message* m, tw_lp* lp)
 	s->recv_time = m->u.rc.saved_recv_time;
 	if(m->u.rc.found_match >= 0)
 	  {
-		s->recv_time = m->u.rc.saved_recv_time;
-		mpi_queue_update(s->arrival_queue, m->u.rc.ptr_match_op, m->u.rc.found_match);
-		remove_req_id(&s->completed_reqs, m->op->u.recv.req_id);
-		tw_rand_reverse_unif(lp->rng);
+		struct codes_workload_op* send_op = m->u.rc.ptr_match_elem->mpi_op;
+
+		mpi_queue_relink(s, s->arrival_queue, m->u.rc.ptr_match_elem);
+		if(is_rendezvous(send_op->u.send.num_bytes))
+		{
+			model_net_pull_event_rc(net_id, lp);
+			if(m->op->op_type == CODES_WK_IRECV)
+				tw_rand_reverse_unif(lp->rng);
+		}
+		else
+		{
+			if(m->op->op_type == CODES_WK_IRECV)
+				remove_req_id(&s->completed_reqs, m->op->u.recv.req_id);
+			tw_rand_reverse_unif(lp->rng);
+		}
 	  }
 	else if(m->u.rc.found_match < 0)
 	    {
-		mpi_queue_remove_tail(lp->gid, s->pending_recvs_queue);
+		mpi_queue_remove_tail(s, s->pending_recvs_queue);
 		if(m->op->op_type == CODES_WK_IRECV)
 			tw_rand_reverse_unif(lp->rng);
 	    }
@@ -908,7 +1203,7 @@ static void codes_exec_mpi_recv(nw_state* s, nw_message* m, tw_lp* lp)
 	if(found_matching_sends < 0)
 	  {
 		m->u.rc.found_match = -1;
-		mpi_pending_queue_insert_op(s->pending_recvs_queue, mpi_op);
+		mpi_pending_queue_insert_op(s, s->pending_recvs_queue, mpi_op);
 
 	       /* for mpi irecvs, this is a non-blocking receive so just post it and move on with the trace read. */
 		if(mpi_op->op_type == CODES_WK_IRECV)
@@ -927,7 +1222,10 @@ static void codes_exec_mpi_recv(nw_state* s, nw_message* m, tw_lp* lp)
 		//int count_after = numQueue(s->arrival_queue);
 		//assert(count_before == (count_after+1));
 	   	m->u.rc.found_match = found_matching_sends;
-		codes_issue_next_event(lp);
+		/* a blocking receive of a rendezvous send waits for the data */
+		if(mpi_op->op_type == CODES_WK_IRECV ||
+		    !is_rendezvous(m->u.rc.ptr_match_elem->mpi_op->u.send.num_bytes))
+			codes_issue_next_event(lp);
 	 }
 }
 
@@ -967,11 +1265,11 @@ static void codes_exec_mpi_send(nw_state* s, nw_message * m, tw_lp* lp)
 	codes_mapping_get_lp_info(lp->gid, lp_group_name, &mapping_grp_id,
 	    lp_type_name, &mapping_type_id, annotation, &mapping_rep_id, &mapping_offset);
 
-	if(net_id == DRAGONFLY) /* special handling for the dragonfly case */
+	if(net_id == DRAGONFLY || net_id == SLIMFLY) /* special handling for the dragonfly and slim fly cases */
 	{
 		int num_routers, lps_per_rep, factor;
 		num_routers = codes_mapping_get_lp_count("MODELNET_GRP", 1,
-                  "dragonfly_router", NULL, 1);
+                  net_id == DRAGONFLY ? "dragonfly_router" : "slimfly_router", NULL, 1);
 	 	lps_per_rep = (2 * num_nw_lps) + num_routers;
 		factor = mpi_op->u.send.dest_rank / num_nw_lps;
 		dest_rank = (lps_per_rep * factor) + (mpi_op->u.send.dest_rank % num_nw_lps);
@@ -1001,8 +1299,14 @@ static void codes_exec_mpi_send(nw_state* s, nw_message * m, tw_lp* lp)
         memcpy(remote_m, local_m, sizeof(nw_message));
 	remote_m->msg_type = MPI_SEND_ARRIVED;
 
-	model_net_event(net_id, "test", dest_rank, mpi_op->u.send.num_bytes, 0.0,
-	    sizeof(nw_message), (const void*)remote_m, sizeof(nw_message), (const void*)local_m, lp);
+	/* a rendezvous send only posts a request to send, the receiver pulls the data once
+	 * the receive is matched and sends back the local completion of the send */
+	if(is_rendezvous(mpi_op->u.send.num_bytes))
+		model_net_event(net_id, "test", dest_rank, MPI_CTRL_MSG_SIZE, 0.0,
+		    sizeof(nw_message), (const void*)remote_m, 0, NULL, lp);
+	else
+		model_net_event(net_id, "test", dest_rank, mpi_op->u.send.num_bytes, 0.0,
+		    sizeof(nw_message), (const void*)remote_m, sizeof(nw_message), (const void*)local_m, lp);
 
 	/*if(TRACE == lp->gid)
 		printf("\n !!! %lf send req id %d dest %d nw_message %d ", tw_now(lp), (int)mpi_op->u.send.req_id, (int)dest_rank, sizeof(nw_message));
@@ -1012,12 +1316,521 @@ static void codes_exec_mpi_send(nw_state* s, nw_message * m, tw_lp* lp)
 	   codes_issue_next_event(lp);
 }
 
-/* MPI collective operations */
-static void codes_exec_mpi_col(nw_state* s, nw_message* m, tw_lp* lp)
+/* returns the collective with a configurable algorithm an MPI operation belongs to, or -1 */
+static int col_index(int op_type)
+{
+	switch(op_type)
+	{
+		case CODES_WK_BCAST:
+			return COL_BCAST;
+		case CODES_WK_REDUCE:
+			return COL_REDUCE;
+		case CODES_WK_ALLREDUCE:
+			return COL_ALLREDUCE;
+		case CODES_WK_ALLGATHER:
+		case CODES_WK_ALLGATHERV:
+			return COL_ALLGATHER;
+		case CODES_WK_ALLTOALL:
+		case CODES_WK_ALLTOALLV:
+			return COL_ALLTOALL;
+		default:
+			return -1;
+	}
+}
+
+/* number of ranks taking part in the collectives of the LP (the ranks of its job) */
+static int col_num_ranks(nw_state* s)
+{
+	return num_traces_of_job[s->app_id];
+}
+
+static int is_pow2(int n)
+{
+	return n > 0 && !(n & (n - 1));
+}
+
+/* smallest k such that 2^k >= n */
+static int ceil_log2(int n)
+{
+	int k = 0;
+	while((1 << k) < n)
+		k++;
+	return k;
+}
+
+/* largest power of 2 not greater than n */
+static int floor_pow2(int n)
 {
+	int p = 1;
+	while(2 * p <= n)
+		p *= 2;
+	return p;
+}
+
+/* picks the algorithm of a collective from its tuning table */
+static int col_select_algo(nw_state* s, int col, int num_bytes)
+{
+	const struct col_tuning* t = &col_tunings[col];
+	int i, algo = t->algo[t->num_entries - 1];
+
+	for(i = 0; i < t->num_entries; i++)
+		if(t->max_bytes[i] < 0 || num_bytes <= t->max_bytes[i])
+		{
+			algo = t->algo[i];
+			break;
+		}
+
+	/* recursive doubling allgather needs a power of 2 number of ranks */
+	if(col == COL_ALLGATHER && algo == COL_RECURSIVE_DOUBLING && !is_pow2(col_num_ranks(s)))
+		algo = COL_RING;
+	return algo;
+}
+
+/* number of rounds of the collective in progress */
+static int col_get_num_rounds(nw_state* s)
+{
+	int p = col_num_ranks(s);
+	int pof2 = floor_pow2(p);
+
+	switch(s->col_algo)
+	{
+		case COL_BINOMIAL:
+		case COL_BRUCK:
+			return ceil_log2(p);
+		case COL_RECURSIVE_DOUBLING:
+			if(s->col_type == CODES_WK_ALLREDUCE)
+				return ceil_log2(pof2) + (p > pof2 ? 2 : 0);
+			return ceil_log2(p);
+		case COL_RING:
+			return s->col_type == CODES_WK_ALLREDUCE ? 2 * (p - 1) : p - 1;
+		case COL_PAIRWISE:
+			return p - 1;
+		default:
+			tw_error(TW_LOC, "\n Invalid collective algorithm %d ", s->col_algo);
+			return 0;
+	}
+}
+
+/* fills in the send and receive of a round of the collective in progress. Ranks are
+ * the ranks of the job, the root of rooted collectives is rank 0. */
+static void col_get_step(nw_state* s, int round, struct col_step* step)
+{
+	int r = s->local_rank;
+	int p = col_num_ranks(s);
+	int n = s->col_bytes;
+	int mask = 1 << round;
+
+	step->send_to = -1;
+	step->recv_from = -1;
+	step->send_bytes = n;
+
+	switch(s->col_algo)
+	{
+		case COL_BINOMIAL:
+			if(s->col_type == CODES_WK_BCAST)
+			{
+				/* ranks below 2^round have the data and pass it on */
+				if(r < mask && r + mask < p)
+					step->send_to = r + mask;
+				else if(r >= mask && r < 2 * mask)
+					step->recv_from = r - mask;
+			}
+			else
+			{
+				/* reduce: the subtree of rank r is complete once the bits below its lowest set bit are done */
+				if((r & (2 * mask - 1)) == mask)
+					step->send_to = r - mask;
+				else if(!(r & (2 * mask - 1)) && r + mask < p)
+					step->recv_from = r + mask;
+			}
+		break;
+
+		case COL_RECURSIVE_DOUBLING:
+			if(s->col_type == CODES_WK_ALLREDUCE)
+			{
+				/* with a non power of 2 number of ranks, the first 2 * rem ranks pair up
+				 * before and after the exchanges, as in MPICH */
+				int pof2 = floor_pow2(p);
+				int rem = p - pof2;
+				int newrank, peer;
+
+				if(rem && (round == 0 || round == col_get_num_rounds(s) - 1))
+				{
+					if(r >= 2 * rem)
+						break;
+					/* even ranks hand their data to r + 1 and get the result back from it */
+					if(round == 0)
+					{
+						if(r % 2 == 0)
+							step->send_to = r + 1;
+						else
+							step->recv_from = r - 1;
+					}
+					else
+					{
+						if(r % 2 == 0)
+							step->recv_from = r + 1;
+						else
+							step->send_to = r - 1;
+					}
+					break;
+				}
+				if(rem)
+					mask = 1 << (round - 1);
+
+				if(r < 2 * rem)
+					newrank = (r % 2) ? r / 2 : -1;
+				else
+					newrank = r - rem;
+				if(newrank < 0)
+					break;
+
+				peer = newrank ^ mask;
+				peer = (peer < rem) ? 2 * peer + 1 : peer + rem;
+				step->send_to = peer;
+				step->recv_from = peer;
+			}
+			else
+			{
+				/* allgather: the data held doubles every round */
+				step->send_to = r ^ mask;
+				step->recv_from = r ^ mask;
+				step->send_bytes = n * mask;
+			}
+		break;
+
+		case COL_RING:
+			step->send_to = (r + 1) % p;
+			step->recv_from = (r - 1 + p) % p;
+			/* allreduce moves one block of the vector per round */
+			if(s->col_type == CODES_WK_ALLREDUCE)
+				step->send_bytes = (n + p - 1) / p;
+		break;
+
+		case COL_PAIRWISE:
+			if(is_pow2(p))
+			{
+				step->send_to = r ^ (round + 1);
+				step->recv_from = r ^ (round + 1);
+			}
+			else
+			{
+				step->send_to = (r + round + 1) % p;
+				step->recv_from = (r - round - 1 + p) % p;
+			}
+		break;
+
+		case COL_BRUCK:
+		{
+			/* the blocks whose index has bit 'round' set are sent */
+			int blocks = ((p >> (round + 1)) << round);
+			int rest = (p & (2 * mask - 1)) - mask;
+
+			if(rest > 0)
+				blocks += rest;
+			step->send_to = (r + mask) % p;
+			step->recv_from = (r - mask + p) % p;
+			step->send_bytes = n * blocks;
+		}
+		break;
+	}
+
+	/* model-net transfers at least one byte */
+	if(step->send_bytes < 1)
+		step->send_bytes = 1;
+}
+
+/* entry counting the messages of a collective round that have already arrived, or NULL */
+static struct col_arrival* col_arrival_find(nw_state* s, int col_seq, int col_round)
+{
+	struct col_arrival* tmp;
+
+	qlist_for_each_entry(tmp, &s->col_arrivals, link)
+		if(tmp->col_seq == col_seq && tmp->col_round == col_round)
+			return tmp;
+	return NULL;
+}
+
+static void col_arrival_add(nw_state* s, int col_seq, int col_round)
+{
+	struct col_arrival* elem = col_arrival_find(s, col_seq, col_round);
+
+	if(!elem)
+	{
+		elem = malloc(sizeof(struct col_arrival));
+		assert(elem);
+		elem->col_seq = col_seq;
+		elem->col_round = col_round;
+		elem->count = 0;
+		qlist_add_tail(&elem->link, &s->col_arrivals);
+	}
+	elem->count++;
+}
+
+static void col_arrival_remove(nw_state* s, int col_seq, int col_round)
+{
+	struct col_arrival* elem = col_arrival_find(s, col_seq, col_round);
+
+	if(!elem)
+		tw_error(TW_LOC, "\n Collective %d round %d has no arrived message ", col_seq, col_round);
+	if(--elem->count)
+		return;
+	qlist_del(&elem->link);
+	free(elem);
+}
+
+/* sends the message of the current round of the collective, if any */
+static void col_start_round(nw_state* s, tw_lp* lp)
+{
+	struct col_step step;
+	struct codes_jobmap_id lid;
+	nw_message local_m, remote_m;
+
+	col_get_step(s, s->col_round, &step);
+	s->col_sends_pending = 0;
+	if(step.send_to < 0)
+		return;
+
+	lid.job = s->app_id;
+	lid.rank = step.send_to;
+	tw_lpid dest_lp = rank_to_lpid(codes_jobmap_to_global_id(lid, jobmap_ctx));
+
+	memset(&local_m, 0, sizeof(local_m));
+	local_m.u.msg_info.sim_start_time = tw_now(lp);
+	local_m.u.msg_info.src_rank = s->local_rank;
+	local_m.u.msg_info.dest_rank = step.send_to;
+	local_m.u.msg_info.num_bytes = step.send_bytes;
+	local_m.u.msg_info.op_type = s->col_type;
+	local_m.u.msg_info.col_seq = s->col_seq;
+	local_m.u.msg_info.col_round = s->col_round;
+	local_m.msg_type = MPI_COL_POSTED;
+
+	memcpy(&remote_m, &local_m, sizeof(nw_message));
+	remote_m.msg_type = MPI_COL_ARRIVED;
+
+	model_net_event(net_id, "collective", dest_lp, step.send_bytes, 0.0,
+	    sizeof(nw_message), (const void*)&remote_m, sizeof(nw_message), (const void*)&local_m, lp);
+	num_bytes_sent += step.send_bytes;
+	s->col_sends_pending = 1;
+}
+
+static void col_start_round_rc(nw_state* s, tw_lp* lp)
+{
+	struct col_step step;
+
+	col_get_step(s, s->col_round, &step);
+	if(step.send_to >= 0)
+	{
+		model_net_event_rc(net_id, lp, step.send_bytes);
+		num_bytes_sent -= step.send_bytes;
+	}
+	s->col_sends_pending = 0;
+}
+
+/* the collective in progress is over, move on with the trace */
+static void col_finish(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	m->u.rc.saved_col_time = s->col_time;
+	s->col_time += tw_now(lp) - s->col_start_time;
+	s->col_active = 0;
 	codes_issue_next_event(lp);
 }
 
+static void col_finish_rc(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	s->col_time = m->u.rc.saved_col_time;
+	s->col_active = 1;
+	tw_rand_reverse_unif(lp->rng);
+}
+
+/* the current round is done once its send has completed and its message has arrived */
+static int col_round_done(nw_state* s)
+{
+	struct col_step step;
+
+	if(s->col_sends_pending)
+		return 0;
+	col_get_step(s, s->col_round, &step);
+	return step.recv_from < 0 || col_arrival_find(s, s->col_seq, s->col_round) != NULL;
+}
+
+/* starts the next rounds of the collective in progress as long as their
+ * predecessors are done. The number of completed rounds is kept in the message. */
+static void col_advance(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	struct col_step step;
+
+	m->u.rc.col_rounds = 0;
+	if(!s->col_active || s->col_algo == COL_NETWORK)
+		return;
+
+	while(col_round_done(s))
+	{
+		col_get_step(s, s->col_round, &step);
+		if(step.recv_from >= 0)
+			col_arrival_remove(s, s->col_seq, s->col_round);
+
+		s->col_round++;
+		m->u.rc.col_rounds++;
+		if(s->col_round == s->col_num_rounds)
+		{
+			col_finish(s, m, lp);
+			return;
+		}
+		col_start_round(s, lp);
+	}
+}
+
+static void col_advance_rc(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	struct col_step step;
+	int i;
+
+	for(i = 0; i < m->u.rc.col_rounds; i++)
+	{
+		/* only the last round completed by the event can have finished the collective */
+		if(!s->col_active)
+			col_finish_rc(s, m, lp);
+		else
+			col_start_round_rc(s, lp);
+
+		s->col_round--;
+		col_get_step(s, s->col_round, &step);
+		if(step.recv_from >= 0)
+			col_arrival_add(s, s->col_seq, s->col_round);
+		s->col_sends_pending = 0;
+	}
+}
+
+/* reverse of MPI collective operations */
+static void codes_exec_mpi_col_rc(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	if(col_index(m->op->op_type) < 0)
+	{
+		tw_rand_reverse_unif(lp->rng);
+		return;
+	}
+
+	if(s->col_algo == COL_NETWORK)
+		model_net_event_collective_rc(net_id, m->op->u.collective.num_bytes, lp);
+	else if(!s->col_num_rounds)
+		col_finish_rc(s, m, lp);
+	else
+	{
+		col_advance_rc(s, m, lp);
+		col_start_round_rc(s, lp);
+	}
+	s->col_active = 0;
+	s->col_seq--;
+	s->col_type = m->u.rc.saved_col_type;
+	s->col_algo = m->u.rc.saved_col_algo;
+	s->col_bytes = m->u.rc.saved_col_bytes;
+	s->col_round = m->u.rc.saved_col_round;
+	s->col_num_rounds = m->u.rc.saved_col_num_rounds;
+	s->col_sends_pending = m->u.rc.saved_col_sends_pending;
+	s->col_start_time = m->u.rc.saved_col_start_time;
+}
+
+/* MPI collective operations. The collectives are decomposed into rounds of
+ * point-to-point messages; a round starts once the send of the previous round has
+ * completed and its message has arrived. All ranks of a job go through the same
+ * sequence of collectives, so messages are matched by the number of the collective
+ * and the round. */
+static void codes_exec_mpi_col(nw_state* s, nw_message* m, tw_lp* lp)
+{
+	int col = col_index(m->op->op_type);
+
+	/* other collectives are not simulated */
+	if(col < 0)
+	{
+		codes_issue_next_event(lp);
+		return;
+	}
+
+	m->u.rc.saved_col_type = s->col_type;
+	m->u.rc.saved_col_algo = s->col_algo;
+	m->u.rc.saved_col_bytes = s->col_bytes;
+	m->u.rc.saved_col_round = s->col_round;
+	m->u.rc.saved_col_num_rounds = s->col_num_rounds;
+	m->u.rc.saved_col_sends_pending = s->col_sends_pending;
+	m->u.rc.saved_col_start_time = s->col_start_time;
+
+	s->col_seq++;
+	s->col_active = 1;
+	s->col_type = m->op->op_type;
+	s->col_bytes = m->op->u.collective.num_bytes;
+	s->col_algo = col_select_algo(s, col, s->col_bytes);
+	s->col_round = 0;
+	s->col_sends_pending = 0;
+	s->col_start_time = tw_now(lp);
+
+	if(s->col_algo == COL_NETWORK)
+	{
+		nw_message remote_m;
+
+		memset(&remote_m, 0, sizeof(remote_m));
+		remote_m.msg_type = MPI_COL_COMPLETED;
+		remote_m.u.msg_info.col_seq = s->col_seq;
+		model_net_event_collective(net_id, "collective", s->col_bytes,
+		    sizeof(nw_message), (const void*)&remote_m, lp);
+		return;
+	}
+
+	s->col_num_rounds = col_get_num_rounds(s);
+	if(!s->col_num_rounds)
+	{
+		col_finish(s, m, lp);
+		return;
+	}
+	col_start_round(s, lp);
+	col_advance(s, m, lp);
+}
+
+/* a message of a collective round has arrived */
+static void update_col_arrival(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	num_bytes_recvd += m->u.msg_info.num_bytes;
+	col_arrival_add(s, m->u.msg_info.col_seq, m->u.msg_info.col_round);
+
+	m->u.rc.col_rounds = 0;
+	if(s->col_active && s->col_seq == m->u.msg_info.col_seq)
+		col_advance(s, m, lp);
+}
+
+static void update_col_arrival_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	col_advance_rc(s, m, lp);
+	col_arrival_remove(s, m->u.msg_info.col_seq, m->u.msg_info.col_round);
+	num_bytes_recvd -= m->u.msg_info.num_bytes;
+}
+
+/* the send of the current round of the collective has completed */
+static void update_col_send_completion(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	s->col_sends_pending--;
+	col_advance(s, m, lp);
+}
+
+static void update_col_send_completion_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	col_advance_rc(s, m, lp);
+	s->col_sends_pending++;
+}
+
+/* the network model has completed the collective */
+static void update_col_completion(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	if(!s->col_active || s->col_seq != m->u.msg_info.col_seq)
+		tw_error(TW_LOC, "\n LP %llu: completion of collective %d, collective %d in progress ",
+		    lp->gid, m->u.msg_info.col_seq, s->col_active ? s->col_seq : -1);
+	col_finish(s, m, lp);
+}
+
+static void update_col_completion_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	col_finish_rc(s, m, lp);
+}
+
 /* convert seconds to ns */
 static tw_stime s_to_ns(tw_stime ns)
 {
@@ -1045,7 +1858,7 @@ static void update_send_completion_queue(nw_state* s, tw_bf * bf, nw_message * m
 		printf("\n %lf isend operation completed req id %d ", tw_now(lp), m->u.msg_info.req_id);
 	if(m->u.msg_info.op_type == CODES_WK_ISEND)
 	   {
-		mpi_completed_queue_insert_op(&s->completed_reqs, m->u.msg_info.req_id);
+		insert_req_id(&s->completed_reqs, m->u.msg_info.req_id);
 	   	notify_waits(s, bf, lp, m, m->u.msg_info.req_id);
 	   }
 
@@ -1056,30 +1869,53 @@ static void update_send_completion_queue(nw_state* s, tw_bf * bf, nw_message * m
 	 return;
 }
 
+/* callback to the sender of a message for computing message time */
+static void send_arrived_callback(nw_message* m, tw_lp* lp)
+{
+        tw_event *e_callback =
+            tw_event_new(rank_to_lpid(m->u.msg_info.src_rank),
+                    codes_local_latency(lp), lp);
+        nw_message *m_callback = tw_event_data(e_callback);
+        m_callback->msg_type = MPI_SEND_ARRIVED_CB;
+        m_callback->u.msg_info.msg_send_time = tw_now(lp) - m->u.msg_info.sim_start_time;
+        tw_event_send(e_callback);
+}
+
 /* reverse handler for updating arrival queue function */
 static void update_arrival_queue_rc(nw_state* s, tw_bf * bf, nw_message * m, tw_lp * lp)
 {
+	int rendezvous = is_rendezvous(m->u.msg_info.num_bytes);
+
 	s->recv_time = m->u.rc.saved_recv_time;
 
-        codes_local_latency_reverse(lp);
+	if(!rendezvous)
+		codes_local_latency_reverse(lp);
 
-	if(m->u.rc.found_match >= 0)
+	if(m->u.rc.found_match >= 0 && rendezvous)
+	{
+		model_net_pull_event_rc(net_id, lp);
+		mpi_queue_relink(s, s->pending_recvs_queue, m->u.rc.ptr_match_elem);
+	}
+	else if(m->u.rc.found_match >= 0)
 	{
-		// TODO: Modify for recvs
 		if(lp->gid == TRACE)
 			printf("\n %lf reverse-- update arrival queue req ID %d", tw_now(lp), (int) m->u.rc.saved_matched_req);
-		dumpi_req_id req_id = m->u.rc.saved_matched_req;
-		notify_waits_rc(s, bf, lp, m, m->u.rc.saved_matched_req);
+		if(m->u.rc.ptr_match_elem->mpi_op->op_type == CODES_WK_RECV)
+			tw_rand_reverse_unif(lp->rng);
+		else
+		{
+			notify_waits_rc(s, bf, lp, m, m->u.rc.saved_matched_req);
+			remove_req_id(&s->completed_reqs, m->u.rc.saved_matched_req);
+		}
 		//int count = numQueue(s->pending_recvs_queue);
-		mpi_queue_update(s->pending_recvs_queue, m->u.rc.ptr_match_op, m->u.rc.found_match);
-		remove_req_id(&s->completed_reqs, m->u.rc.saved_matched_req);
+		mpi_queue_relink(s, s->pending_recvs_queue, m->u.rc.ptr_match_elem);
 
 		/*if(lp->gid == TRACE)
 			printf("\n Reverse: after adding pending recvs queue %d ", s->pending_recvs_queue->num_elems);*/
 	}
 	else if(m->u.rc.found_match < 0)
 	{
-		mpi_queue_remove_tail(lp->gid, s->arrival_queue);
+		mpi_queue_remove_tail(s, s->arrival_queue);
 		/*if(lp->gid == TRACE)
 			printf("\n Reverse: after removing arrivals queue %d ", s->arrival_queue->num_elems);*/
 	}
@@ -1091,16 +1927,14 @@ static void update_arrival_queue(nw_state* s, tw_bf * bf, nw_message * m, tw_lp
 	//int count_before = numQueue(s->pending_recvs_queue);
 	int is_blocking = 0; /* checks if the recv operation was blocking or not */
 
+	/* for a rendezvous send, this is the request to send. The data comes later. */
+	int rendezvous = is_rendezvous(m->u.msg_info.num_bytes);
+
 	m->u.rc.saved_recv_time = s->recv_time;
 
         // send a callback to the sender to increment times
-        tw_event *e_callback =
-            tw_event_new(rank_to_lpid(m->u.msg_info.src_rank),
-                    codes_local_latency(lp), lp);
-        nw_message *m_callback = tw_event_data(e_callback);
-        m_callback->msg_type = MPI_SEND_ARRIVED_CB;
-        m_callback->u.msg_info.msg_send_time = tw_now(lp) - m->u.msg_info.sim_start_time;
-        tw_event_send(e_callback);
+        if(!rendezvous)
+            send_arrived_callback(m, lp);
 
         /*NOTE: this computes send time with respect to the receiver, not the
          * sender
@@ -1125,15 +1959,69 @@ static void update_arrival_queue(nw_state* s, tw_bf * bf, nw_message * m, tw_lp
 	if(found_matching_recv < 0)
 	 {
 		m->u.rc.found_match = -1;
-		mpi_pending_queue_insert_op(s->arrival_queue, m->op);
+		mpi_pending_queue_insert_op(s, s->arrival_queue, m->op);
 	}
 	else
 	  {
 		m->u.rc.found_match = found_matching_recv;
-	   	notify_waits(s, bf, lp, m, m->u.rc.saved_matched_req);
+		if(rendezvous)
+			return;
+		/* a blocking receive posted before the message arrived is done */
+		if(m->u.rc.ptr_match_elem->mpi_op->op_type == CODES_WK_RECV)
+			codes_issue_next_event(lp);
+		else
+	   		notify_waits(s, bf, lp, m, m->u.rc.saved_matched_req);
 	  }
 }
 
+/* the data of a rendezvous send has arrived: the receive is done and the completion
+ * of the send is returned to the sender */
+static void update_rendezvous_arrival(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	dumpi_req_id req_id = m->u.msg_info.recv_req_id;
+	nw_message fin_m;
+
+	m->u.rc.saved_recv_time = s->recv_time;
+	s->recv_time += tw_now(lp) - m->u.msg_info.recv_start_time;
+
+	send_arrived_callback(m, lp);
+
+	memset(&fin_m, 0, sizeof(fin_m));
+	fin_m.msg_type = MPI_SEND_POSTED;
+	fin_m.u.msg_info.op_type = m->u.msg_info.op_type;
+	fin_m.u.msg_info.src_rank = m->u.msg_info.src_rank;
+	fin_m.u.msg_info.dest_rank = m->u.msg_info.dest_rank;
+	fin_m.u.msg_info.num_bytes = m->u.msg_info.num_bytes;
+	fin_m.u.msg_info.tag = m->u.msg_info.tag;
+	fin_m.u.msg_info.req_id = m->u.msg_info.req_id;
+	model_net_event(net_id, "test", rank_to_lpid(m->u.msg_info.src_rank), MPI_CTRL_MSG_SIZE,
+	    0.0, sizeof(nw_message), (const void*)&fin_m, 0, NULL, lp);
+
+	if(m->u.msg_info.recv_op_type == CODES_WK_RECV)
+		codes_issue_next_event(lp);
+	else
+	{
+		insert_req_id(&s->completed_reqs, req_id);
+		notify_waits(s, bf, lp, m, req_id);
+	}
+}
+
+static void update_rendezvous_arrival_rc(nw_state* s, tw_bf* bf, nw_message* m, tw_lp* lp)
+{
+	dumpi_req_id req_id = m->u.msg_info.recv_req_id;
+
+	if(m->u.msg_info.recv_op_type == CODES_WK_RECV)
+		tw_rand_reverse_unif(lp->rng);
+	else
+	{
+		notify_waits_rc(s, bf, lp, m, req_id);
+		remove_req_id(&s->completed_reqs, req_id);
+	}
+	model_net_event_rc(net_id, lp, MPI_CTRL_MSG_SIZE);
+	codes_local_latency_reverse(lp);
+	s->recv_time = m->u.rc.saved_recv_time;
+}
+
 static void update_message_time(
         nw_state * s,
         tw_bf * bf,
@@ -1165,8 +2053,13 @@ void nw_test_init(nw_state* s, tw_lp* lp)
 
    memset(s, 0, sizeof(*s));
    s->nw_id = (mapping_rep_id * num_nw_lps) + mapping_offset;
-   s->completed_reqs = NULL;
+   INIT_QLIST_HEAD(&s->retired_elems);
+   INIT_QLIST_HEAD(&s->free_elems);
+   mpi_queue_state_saving = g_tw_synchronization_protocol != SEQUENTIAL &&
+       g_tw_synchronization_protocol != CONSERVATIVE;
+   req_table_init(&s->completed_reqs);
    s->pending_waits = NULL;
+   INIT_QLIST_HEAD(&s->col_arrivals);
 
    struct codes_jobmap_id lid;
    lid = codes_jobmap_to_local_id(s->nw_id, jobmap_ctx);
@@ -1222,6 +2115,22 @@ void nw_test_event_handler(nw_state* s, tw_bf * bf, nw_message * m, tw_lp * lp)
 		case MPI_OP_GET_NEXT:
 			get_next_mpi_operation(s, bf, m, lp);
 		break;
+
+		case MPI_COL_ARRIVED:
+			update_col_arrival(s, bf, m, lp);
+		break;
+
+		case MPI_COL_POSTED:
+			update_col_send_completion(s, bf, m, lp);
+		break;
+
+		case MPI_COL_COMPLETED:
+			update_col_completion(s, bf, m, lp);
+		break;
+
+		case MPI_REND_ARRIVED:
+			update_rendezvous_arrival(s, bf, m, lp);
+		break;
 	}
 }
 
@@ -1238,7 +2147,8 @@ static void get_next_mpi_operation_rc(nw_state* s, tw_bf * bf, nw_message * m, t
 		{
 			if(lp->gid == TRACE)
 				printf("\n %lf reverse send req %d ", tw_now(lp), (int)m->op->u.send.req_id);
-			model_net_event_rc(net_id, lp, m->op->u.send.num_bytes);
+			model_net_event_rc(net_id, lp, is_rendezvous(m->op->u.send.num_bytes) ?
+			    MPI_CTRL_MSG_SIZE : m->op->u.send.num_bytes);
 			if(m->op->op_type == CODES_WK_ISEND)
 				tw_rand_reverse_unif(lp->rng);
 			s->num_sends--;
@@ -1270,9 +2180,10 @@ static void get_next_mpi_operation_rc(nw_state* s, tw_bf * bf, nw_message * m, t
 		case CODES_WK_REDUCE:
 		case CODES_WK_ALLREDUCE:
 		case CODES_WK_COL:
+		case CODES_WK_WAITANY:
 		{
 			s->num_cols--;
-			tw_rand_reverse_unif(lp->rng);
+			codes_exec_mpi_col_rc(s, m, lp);
 		}
 		break;
 
@@ -1282,19 +2193,13 @@ static void get_next_mpi_operation_rc(nw_state* s, tw_bf * bf, nw_message * m, t
 			codes_exec_mpi_wait_rc(s, bf, m, lp);
 		}
 		break;
+		case CODES_WK_WAITSOME:
 		case CODES_WK_WAITALL:
 		{
 			s->num_waitall--;
 			codes_exec_mpi_wait_all_rc(s, bf, m, lp);
 		}
 		break;
-		case CODES_WK_WAITSOME:
-		case CODES_WK_WAITANY:
-		{
-			s->num_waitsome--;
-			tw_rand_reverse_unif(lp->rng);
-		}
-		break;
 		default:
 			printf("\n Invalid op type %d ", m->op->op_type);
 	}
@@ -1399,11 +2304,15 @@ void nw_test_finalize(nw_state* s, tw_lp* lp)
 		if(s->recv_time > max_recv_time)
 			max_recv_time = s->recv_time;
 
+		if(s->col_time > max_col_time)
+			max_col_time = s->col_time;
+
 		avg_time += s->elapsed_time;
 		avg_comm_time += (s->elapsed_time - s->compute_time);
 		avg_wait_time += s->wait_time;
 		avg_send_time += s->send_time;
 		 avg_recv_time += s->recv_time;
+		avg_col_time += s->col_time;
 
 		//printf("\n LP %ld Time spent in communication %llu ", lp->gid, total_time - s->compute_time);
 		free(s->arrival_queue);
@@ -1430,6 +2339,22 @@ void nw_test_event_handler_rc(nw_state* s, tw_bf * bf, nw_message * m, tw_lp * l
 		case MPI_OP_GET_NEXT:
 			get_next_mpi_operation_rc(s, bf, m, lp);
 		break;
+
+		case MPI_COL_ARRIVED:
+			update_col_arrival_rc(s, bf, m, lp);
+		break;
+
+		case MPI_COL_POSTED:
+			update_col_send_completion_rc(s, bf, m, lp);
+		break;
+
+		case MPI_COL_COMPLETED:
+			update_col_completion_rc(s, bf, m, lp);
+		break;
+
+		case MPI_REND_ARRIVED:
+			update_rendezvous_arrival_rc(s, bf, m, lp);
+		break;
 	}
 }
 
@@ -1466,6 +2391,65 @@ static void nw_add_lp_type()
   lp_type_register("nw-lp", nw_get_lp_type());
 }
 
+/* reads the algorithm selection of the collectives. PARAMS:mpi_<collective>_algorithm is a
+ * comma separated list of algorithm:max_bytes entries, the last entry may leave out
+ * max_bytes. Collectives run over the network model (network) only if it implements
+ * them (torus, dragonfly) and a single job spans all of its nodes. */
+static void col_read_config()
+{
+	char key[MAX_NAME_LENGTH];
+	char algo_str[MAX_NAME_LENGTH];
+	int i, j;
+	int network_cols = (net_id == TORUS || net_id == DRAGONFLY) && num_jobs == 1 &&
+	    num_traces_of_job[0] == num_net_lps;
+
+	for(i = 0; i < NUM_COLS; i++)
+	{
+		struct col_tuning* t = &col_tunings[i];
+
+		sprintf(key, "mpi_%s_algorithm", col_names[i]);
+		algo_str[0] = '\0';
+		configuration_get_value(&config, "PARAMS", key, NULL, algo_str, MAX_NAME_LENGTH);
+		if(!strlen(algo_str))
+			strcpy(algo_str, col_default_algos[i]);
+
+		t->num_entries = 0;
+		char* token = strtok(algo_str, ",");
+		while(token != NULL)
+		{
+			char* sep = strchr(token, ':');
+			long long max_bytes = -1;
+
+			if(t->num_entries == MAX_COL_ALGOS)
+				tw_error(TW_LOC, "PARAMS:%s has more than %d entries\n", key, MAX_COL_ALGOS);
+			if(sep)
+			{
+				if(sscanf(sep + 1, "%lld", &max_bytes) != 1 || max_bytes < 0)
+					tw_error(TW_LOC, "Invalid entry in PARAMS:%s: %s (expected "
+					    "algorithm:bytes)\n", key, token);
+				*sep = '\0';
+			}
+			for(j = 0; j <= COL_NETWORK; j++)
+				if(!strcmp(token, col_algo_names[j]))
+					break;
+			if(j > COL_NETWORK || !(col_valid_algos[i] & (1 << j)))
+				tw_error(TW_LOC, "Invalid algorithm %s in PARAMS:%s\n", token, key);
+			if(j == COL_NETWORK && !network_cols)
+			{
+				if(!g_tw_mynode)
+					printf("\n %s: the network model does not run collectives of this "
+					    "job, using %s instead ", key, col_algo_names[col_fallback_algos[i]]);
+				j = col_fallback_algos[i];
+			}
+
+			t->algo[t->num_entries] = j;
+			t->max_bytes[t->num_entries] = max_bytes;
+			t->num_entries++;
+			token = strtok(NULL, ",");
+		}
+	}
+}
+
 int main( int argc, char** argv )
 {
   int rank, nprocs;
@@ -1506,6 +2490,7 @@ int main( int argc, char** argv )
           }
       }
       fclose(name_file);
+      num_jobs = i;
 
   }
 
@@ -1542,6 +2527,9 @@ int main( int argc, char** argv )
 
    num_nw_lps = codes_mapping_get_lp_count("MODELNET_GRP", 1,
 			"nw-lp", NULL, 1);
+   col_read_config();
+   configuration_get_value_longint(&config, "PARAMS", "mpi_eager_threshold", NULL,
+           &eager_threshold);
    tw_run();
 
     long long total_bytes_sent, total_bytes_recvd;
@@ -1550,6 +2538,7 @@ int main( int argc, char** argv )
     double total_avg_send_time, total_max_send_time;
      double total_avg_wait_time, total_max_wait_time;
      double total_avg_recv_time, total_max_recv_time;
+     double total_avg_col_time, total_max_col_time;
 
     MPI_Reduce(&num_bytes_sent, &total_bytes_sent, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
     MPI_Reduce(&num_bytes_recvd, &total_bytes_recvd, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
@@ -1564,14 +2553,17 @@ int main( int argc, char** argv )
    MPI_Reduce(&max_recv_time, &total_max_recv_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
    MPI_Reduce(&avg_wait_time, &total_avg_wait_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
    MPI_Reduce(&avg_send_time, &total_avg_send_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+   MPI_Reduce(&max_col_time, &total_max_col_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+   MPI_Reduce(&avg_col_time, &total_avg_col_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
    if(!g_tw_mynode)
-	printf("\n Total bytes sent %lld recvd %lld \n max runtime %lf ns avg runtime %lf \n max comm time %lf avg comm time %lf \n max send time %lf avg send time %lf \n max recv time %lf avg recv time %lf \n max wait time %lf avg wait time %lf \n", total_bytes_sent, total_bytes_recvd,
+	printf("\n Total bytes sent %lld recvd %lld \n max runtime %lf ns avg runtime %lf \n max comm time %lf avg comm time %lf \n max send time %lf avg send time %lf \n max recv time %lf avg recv time %lf \n max wait time %lf avg wait time %lf \n max collective time %lf avg collective time %lf \n", total_bytes_sent, total_bytes_recvd,
 			max_run_time, avg_run_time/num_net_traces,
 			max_comm_run_time, avg_comm_run_time/num_net_traces,
 			total_max_send_time, total_avg_send_time/num_net_traces,
 			total_max_recv_time, total_avg_recv_time/num_net_traces,
-			total_max_wait_time, total_avg_wait_time/num_net_traces);
+			total_max_wait_time, total_avg_wait_time/num_net_traces,
+			total_max_col_time, total_avg_col_time/num_net_traces);
    tw_end();
 
   return 0;
@@ -6,7 +6,7 @@
 
 /*
 * The test program generates some synthetic traffic patterns for the model-net network models.
-* currently it only support the dragonfly network model uniform random and nearest neighbor traffic patterns.
+* currently it only support the dragonfly and slim fly network models uniform random and nearest neighbor traffic patterns.
 */
 
 #include "codes/model-net.h"
@@ -177,7 +177,7 @@ static void handle_kickoff_event(
     memcpy(m_remote, m_local, sizeof(svr_msg));
     m_remote->svr_event_type = REMOTE;
 
-    assert(net_id == DRAGONFLY); /* only supported for dragonfly model right now. */
+    assert(net_id == DRAGONFLY || net_id == SLIMFLY); /* only supported for dragonfly and slim fly models right now. */
 
     ns->start_ts = tw_now(lp);
     
@@ -350,19 +350,36 @@ int main(
     net_id = *net_ids;
     free(net_ids);
 
-    if(net_id != DRAGONFLY)
+    if(net_id != DRAGONFLY && net_id != SLIMFLY)
     {
-	printf("\n The test works with dragonfly model configuration only! ");
+	printf("\n The test works with dragonfly and slim fly model configurations only! ");
         MPI_Finalize();
         return 0;
     }
     num_servers_per_rep = codes_mapping_get_lp_count("MODELNET_GRP", 1, "server",
             NULL, 1);
-    configuration_get_value_int(&config, "PARAMS", "num_routers", anno, &num_routers_per_grp);
-    
-    num_groups = (num_routers_per_grp * (num_routers_per_grp/2) + 1);
-    num_nodes = num_groups * num_routers_per_grp * (num_routers_per_grp / 2);
-    num_nodes_per_grp = num_routers_per_grp * (num_routers_per_grp / 2);
+    if(net_id == DRAGONFLY)
+    {
+        configuration_get_value_int(&config, "PARAMS", "num_routers", anno, &num_routers_per_grp);
+
+        num_groups = (num_routers_per_grp * (num_routers_per_grp/2) + 1);
+        num_nodes = num_groups * num_routers_per_grp * (num_routers_per_grp / 2);
+        num_nodes_per_grp = num_routers_per_grp * (num_routers_per_grp / 2);
+    }
+    else
+    {
+        /* a slim fly group is a row of q routers (s, x, *) of the MMS graph */
+        int field_size = 0;
+        configuration_get_value_int(&config, "PARAMS", "field_size", anno, &field_size);
+        if(field_size <= 0)
+            field_size = 5;
+
+        num_routers_per_grp = field_size;
+        num_groups = 2 * field_size;
+        num_nodes = codes_mapping_get_lp_count("MODELNET_GRP", 0, "server",
+                NULL, 1);
+        num_nodes_per_grp = num_nodes / num_groups;
+    }
 
     if(lp_io_prepare("modelnet-test", LP_IO_UNIQ_SUFFIX, &handle, MPI_COMM_WORLD) < 0)
     {
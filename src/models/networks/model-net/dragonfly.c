@@ -12,6 +12,8 @@
 
 #include "codes/codes_mapping.h"
 #include "codes/jenkins-hash.h"
+#include "codes/quicklist.h"
+#include "codes/lp-io.h"
 #include "codes/codes.h"
 #include "codes/model-net.h"
 #include "codes/model-net-method.h"
@@ -22,12 +24,11 @@
 #define MEAN_PROCESS 1.0
 
 /* collective specific parameters */
-#define TREE_DEGREE 4
-#define LEVEL_DELAY 1000
 #define DRAGONFLY_COLLECTIVE_DEBUG 0
-#define NUM_COLLECTIVES  1
-#define COLLECTIVE_COMPUTATION_DELAY 5700
-#define DRAGONFLY_FAN_OUT_DELAY 20.0
+/* max. number of collectives in flight at a node (ids are reused modulo) */
+#define NUM_COLLECTIVES  8
+/* levels of the collective tree: terminal, router column, router row, group */
+#define COLLECTIVE_TREE_LEVELS 4
 #define WINDOW_LENGTH 0
 
 // debugging parameters
@@ -38,7 +39,26 @@
 #define LP_CONFIG_NM (model_net_lp_config_names[DRAGONFLY])
 #define LP_METHOD_NM (model_net_method_names[DRAGONFLY])
 
+/* alignment of the per-port state blocks */
+#define DRAGONFLY_CACHE_LINE 64
+
 static double maxd(double a, double b) { return a < b ? b : a; }
+/* rounds a size up to a whole number of cache lines */
+static size_t cache_align(size_t sz)
+{
+    return (sz + DRAGONFLY_CACHE_LINE - 1) &
+        ~(size_t)(DRAGONFLY_CACHE_LINE - 1);
+}
+/* allocates a zeroed, cache-line aligned block for the per-port state of an
+ * LP; the arrays of the state are carved out of it */
+static char * alloc_port_block(size_t sz)
+{
+    char * block;
+    if(posix_memalign((void**)&block, DRAGONFLY_CACHE_LINE, sz) != 0)
+        tw_error(TW_LOC, "dragonfly: unable to allocate port state\n");
+    memset(block, 0, sz);
+    return block;
+}
 
 // arrival rate
 static double MEAN_INTERVAL=200.0;
@@ -72,7 +92,13 @@ struct dragonfly_param
 {
     // configuration parameters
     int num_routers; /*Number of routers in a group*/
+    int intra_grp_topo; /* fully connected or 2D (rows x columns) group */
+    int intra_grp_routing; /* minimal, non-minimal or adaptive within a group */
+    int num_router_rows; /* rows of the router grid in a 2D group */
+    int num_router_cols; /* columns of the router grid in a 2D group */
     double local_bandwidth;/* bandwidth of the router-router channels within a group */
+    double local_row_bandwidth; /* bandwidth of the row channels in a 2D group */
+    double local_col_bandwidth; /* bandwidth of the column channels in a 2D group */
     double global_bandwidth;/* bandwidth of the inter-group router connections */
     double cn_bandwidth;/* bandwidth of the compute node channels connected to routers */
     int num_vcs; /* number of virtual channels */
@@ -80,9 +106,25 @@ struct dragonfly_param
     int global_vc_size; /* buffer size of the global channels */
     int cn_vc_size; /* buffer size of the compute node channels */
     int chunk_size; /* full-sized packets are broken into smaller chunks.*/
+    int num_injection_queues; /* injection queues (traffic classes) per terminal */
+    int injection_queue_size; /* capacity of an injection queue in chunks */
+    int injection_arbitration; /* round-robin or priority between the queues */
+    int collective_tree_degree; /* children per node at each level of the tree */
+    double collective_level_delay; /* delay of a fan-in step */
+    double collective_computation_delay; /* reduction at the root */
+    double collective_fan_out_delay; /* delay of a fan-out step */
+    /* packets of at least this many bytes skip the chunk pipeline and are
+     * routed analytically (0: never), per category overrides come first */
+    uint64_t analytic_threshold;
+    int num_analytic_categories;
+    char analytic_category[CATEGORY_MAX][CATEGORY_NAME_MAX];
+    uint64_t analytic_category_threshold[CATEGORY_MAX];
 
     // derived parameters
     int num_cn;
+    int num_local_channels; /* local ports per router */
+    int num_local_neighbours; /* routers reachable in one local hop */
+    int local_diameter; /* max number of local hops within a group */
     int num_groups;
     int radix;
     int total_routers;
@@ -95,6 +137,19 @@ typedef enum event_t event_t;
 
 typedef struct terminal_state terminal_state;
 typedef struct router_state router_state;
+typedef struct terminal_injq_item terminal_injq_item;
+typedef struct dragonfly_port_stats dragonfly_port_stats;
+typedef struct dragonfly_port_record dragonfly_port_record;
+
+/* a packet waiting in one of the injection queues of a terminal */
+struct terminal_injq_item
+{
+   /* chunk_id is the next chunk to be sent */
+   terminal_message msg;
+   /* remote and local events of the packet */
+   void * edata;
+   struct qlist_head ql;
+};
 
 /* dragonfly compute node data structure */
 struct terminal_state
@@ -105,42 +160,58 @@ struct terminal_state
    tw_lpid router_id;
    tw_lpid terminal_id;
 
-   // Each terminal will have an input and output channel with the router
+   // Each terminal will have an input and output channel with the router.
+   // The VC and injection queue arrays share one block (see terminal_init)
    int* vc_occupancy; // NUM_VC
    int* output_vc_state;
    tw_stime terminal_available_time;
    tw_stime next_credit_available_time;
+
+   /* injection queues, one per traffic class. Queue i uses the virtual
+    * channel i % num_vcs of the terminal-router link */
+   struct qlist_head *injq;
+   int* injq_occupancy; /* queued chunks */
+   int last_injq; /* last queue served (round-robin arbitration) */
+   int in_send_loop; /* a T_SEND event is pending */
+   int sched_blocked; /* scheduler waits for room in the injection queues */
 // Terminal generate, sends and arrival T_SEND, T_ARRIVAL, T_GENERATE
 // Router-Router Intra-group sends and receives RR_LSEND, RR_LARRIVE
 // Router-Router Inter-group sends and receives RR_GSEND, RR_GARRIVE
-   struct mn_stats dragonfly_stats_array[CATEGORY_MAX];
-  /* collective init time */
-  tw_stime collective_init_time;
+   /* collective state, indexed by collective id % NUM_COLLECTIVES */
+   /* collective init time */
+   tw_stime collective_init_time[NUM_COLLECTIVES];
+
+   /* messages sent & received in collectives may get interchanged several times so we have to save the 
+     origin server information in the node's state */
+   tw_lpid origin_svr[NUM_COLLECTIVES];
+
+   /* to maintain a count of the contributions (own and children) that have fanned in at the
+      node during the collective fan-in phase*/
+   int num_fan_nodes[NUM_COLLECTIVES];
+
+   /* id of the next collective started at this node */
+   int collective_seq;
 
   /* node ID in the tree */ 
    tw_lpid node_id;
 
-   /* messages sent & received in collectives may get interchanged several times so we have to save the 
-     origin server information in the node's state */
-   tw_lpid origin_svr; 
-  
-  /* parent node ID of the current node */
-   tw_lpid parent_node_id;
-   /* array of children to be allocated in terminal_init*/
+  /* LP gid of the parent node of the current node */
+   tw_lpid parent_gid;
+   /* LP gids of the children, allocated in dragonfly_collective_init */
    tw_lpid* children;
 
-   /* children of a node can be less than or equal to the tree degree */
+   /* children of a node over all the levels of the tree */
    int num_children;
 
    short is_root;
    short is_leaf;
 
-   /* to maintain a count of child nodes that have fanned in at the parent during the collective
-      fan-in phase*/
-   int num_fan_nodes;
-
    const char * anno;
    const dragonfly_param *params;
+
+   /* kept last so that it stays off the cache lines of the fields touched
+      on every chunk */
+   struct mn_stats dragonfly_stats_array[CATEGORY_MAX];
 };
 
 /* terminal event type (1-4) */
@@ -150,9 +221,11 @@ enum event_t
   T_ARRIVE,
   T_SEND,
   T_BUFFER,
+  T_ANALYTIC_ARRIVE,
   R_SEND,
   R_ARRIVE,
   R_BUFFER,
+  R_ANALYTIC,
   D_COLLECTIVE_INIT,
   D_COLLECTIVE_FAN_IN,
   D_COLLECTIVE_FAN_OUT
@@ -166,6 +239,21 @@ enum vc_status
    VC_CREDIT
 };
 
+/* connectivity of the routers within a group: all-to-all, or a 2D grid with
+ * all-to-all links along each row and each column (Cray Cascade) */
+enum intra_grp_topo
+{
+   INTRA_GRP_FULL,
+   INTRA_GRP_2D
+};
+
+/* arbitration between the injection queues of a terminal */
+enum injection_arbitration
+{
+   INJ_ARB_RR,
+   INJ_ARB_PRIO
+};
+
 /* whether the last hop of a packet was global, local or a terminal */
 enum last_hop
 {
@@ -185,11 +273,40 @@ enum ROUTING_ALGO
     PROG_ADAPTIVE
 };
 
+/* traffic counters of a router output port */
+struct dragonfly_port_stats
+{
+   uint64_t bytes; /* bytes forwarded */
+   uint64_t chunks; /* chunks forwarded */
+   tw_stime blocked_time; /* time spent waiting for credits (VC_CREDIT) */
+   int peak_occupancy; /* maximum vc_occupancy over the port's VCs */
+};
+
+/* on-disk layout of the per-port counters, one record per router port,
+ * written to the "dragonfly-router-ports" lp-io file. port_type is one of
+ * GLOBAL, LOCAL or TERMINAL (enum last_hop). Keep misc/dragonfly-port-stats.py
+ * in sync with this struct. */
+struct dragonfly_port_record
+{
+   int32_t group_id;
+   int32_t router_id; /* router index within the group */
+   int32_t port_type;
+   int32_t port_index;
+   uint64_t bytes;
+   uint64_t chunks;
+   double blocked_time;
+   int32_t peak_occupancy;
+   int32_t pad;
+};
+
 struct router_state
 {
    unsigned int router_id;
    unsigned int group_id;
-  
+
+   /* all of the arrays below are carved out of one cache-line aligned block
+      allocated in router_setup, based at next_output_available_time. The
+      radix-sized arrays are indexed by port * num_vcs + vc */
    int* global_channel; 
    
    tw_stime* next_output_available_time;
@@ -204,6 +321,10 @@ struct router_state
 
    int* prev_hist_num;
    int* cur_hist_num;
+
+   /* per-port counters and the time each VC entered VC_CREDIT */
+   dragonfly_port_stats* port_stats;
+   tw_stime* credit_start_time;
 };
 
 static short routing = MINIMAL;
@@ -286,6 +407,91 @@ static void dragonfly_read_config(const char * anno, dragonfly_param *params){
         fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
     }
 
+    configuration_get_value_int(&config, "PARAMS", "num_injection_queues", anno,
+            &p->num_injection_queues);
+    if(p->num_injection_queues <= 0)
+        p->num_injection_queues = 1;
+
+    configuration_get_value_int(&config, "PARAMS", "injection_queue_size", anno,
+            &p->injection_queue_size);
+    if(p->injection_queue_size <= 0)
+        p->injection_queue_size = p->cn_vc_size;
+
+    char arb_str[MAX_NAME_LENGTH];
+    arb_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "injection_arbitration", anno,
+            arb_str, MAX_NAME_LENGTH);
+    if(arb_str[0] == '\0' || strcmp(arb_str, "round-robin") == 0)
+        p->injection_arbitration = INJ_ARB_RR;
+    else if(strcmp(arb_str, "priority") == 0)
+        p->injection_arbitration = INJ_ARB_PRIO;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:injection_arbitration: %s "
+                "(expected round-robin or priority)\n", arb_str);
+
+    char topo_str[MAX_NAME_LENGTH];
+    topo_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "intra_group_topology", anno,
+            topo_str, MAX_NAME_LENGTH);
+    if(topo_str[0] == '\0' || strcmp(topo_str, "all-to-all") == 0 ||
+            strcmp(topo_str, "fully-connected") == 0)
+        p->intra_grp_topo = INTRA_GRP_FULL;
+    else if(strcmp(topo_str, "2d") == 0 || strcmp(topo_str, "cascade") == 0)
+        p->intra_grp_topo = INTRA_GRP_2D;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:intra_group_topology: %s "
+                "(expected all-to-all or 2d)\n", topo_str);
+
+    p->num_router_rows = 1;
+    p->num_router_cols = p->num_routers;
+    p->local_row_bandwidth = p->local_bandwidth;
+    p->local_col_bandwidth = p->local_bandwidth;
+    if(p->intra_grp_topo == INTRA_GRP_2D)
+    {
+        p->num_router_rows = 0;
+        p->num_router_cols = 0;
+        configuration_get_value_int(&config, "PARAMS", "num_router_rows", anno,
+                &p->num_router_rows);
+        configuration_get_value_int(&config, "PARAMS", "num_router_cols", anno,
+                &p->num_router_cols);
+        if(p->num_router_rows <= 0 && p->num_router_cols > 0)
+            p->num_router_rows = p->num_routers / p->num_router_cols;
+        else if(p->num_router_cols <= 0 && p->num_router_rows > 0)
+            p->num_router_cols = p->num_routers / p->num_router_rows;
+
+        if(p->num_router_rows <= 0 || p->num_router_cols <= 0 ||
+                p->num_router_rows * p->num_router_cols != p->num_routers)
+            tw_error(TW_LOC, "Config error: num_router_rows (%d) * "
+                    "num_router_cols (%d) must equal num_routers (%d) for a "
+                    "2d intra-group topology\n", p->num_router_rows,
+                    p->num_router_cols, p->num_routers);
+
+        configuration_get_value_double(&config, "PARAMS", "local_row_bandwidth",
+                anno, &p->local_row_bandwidth);
+        if(p->local_row_bandwidth <= 0)
+            p->local_row_bandwidth = p->local_bandwidth;
+
+        configuration_get_value_double(&config, "PARAMS", "local_col_bandwidth",
+                anno, &p->local_col_bandwidth);
+        if(p->local_col_bandwidth <= 0)
+            p->local_col_bandwidth = p->local_bandwidth;
+    }
+
+    char intra_routing_str[MAX_NAME_LENGTH];
+    intra_routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "intra_group_routing", anno,
+            intra_routing_str, MAX_NAME_LENGTH);
+    if(intra_routing_str[0] == '\0' || strcmp(intra_routing_str, "minimal") == 0)
+        p->intra_grp_routing = MINIMAL;
+    else if(strcmp(intra_routing_str, "nonminimal") == 0 ||
+            strcmp(intra_routing_str, "non-minimal") == 0)
+        p->intra_grp_routing = NON_MINIMAL;
+    else if(strcmp(intra_routing_str, "adaptive") == 0)
+        p->intra_grp_routing = ADAPTIVE;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:intra_group_routing: %s\n",
+                intra_routing_str);
+
 
 
     char routing_str[MAX_NAME_LENGTH];
@@ -306,12 +512,78 @@ static void dragonfly_read_config(const char * anno, dragonfly_param *params){
         routing = -1;
     }
 
+    configuration_get_value_int(&config, "PARAMS", "collective_tree_degree",
+            anno, &p->collective_tree_degree);
+    if(p->collective_tree_degree <= 0)
+        p->collective_tree_degree = 4;
+
+    p->collective_level_delay = 1000.0;
+    configuration_get_value_double(&config, "PARAMS", "collective_level_delay",
+            anno, &p->collective_level_delay);
+    p->collective_computation_delay = 5700.0;
+    configuration_get_value_double(&config, "PARAMS",
+            "collective_computation_delay", anno,
+            &p->collective_computation_delay);
+    p->collective_fan_out_delay = 20.0;
+    configuration_get_value_double(&config, "PARAMS",
+            "collective_fan_out_delay", anno, &p->collective_fan_out_delay);
+
+    long analytic_threshold = 0;
+    configuration_get_value_longint(&config, "PARAMS", "analytic_threshold",
+            anno, &analytic_threshold);
+    if(analytic_threshold < 0)
+        tw_error(TW_LOC, "PARAMS:analytic_threshold must be >= 0 (got %ld)\n",
+                analytic_threshold);
+    p->analytic_threshold = analytic_threshold;
+
+    /* per category thresholds, e.g. "ckpt:65536,halo:0" (0 keeps the category
+     * on the chunk pipeline) */
+    char cat_str[MAX_NAME_LENGTH];
+    cat_str[0] = '\0';
+    p->num_analytic_categories = 0;
+    configuration_get_value(&config, "PARAMS", "analytic_category_threshold",
+            anno, cat_str, MAX_NAME_LENGTH);
+    char* cat_token = strtok(cat_str, ",");
+    while(cat_token != NULL)
+    {
+        char* sep = strchr(cat_token, ':');
+        unsigned long long cat_threshold;
+        int i = p->num_analytic_categories;
+        if(i == CATEGORY_MAX)
+            tw_error(TW_LOC, "PARAMS:analytic_category_threshold has more "
+                    "than %d categories\n", CATEGORY_MAX);
+        if(sep == NULL || sep == cat_token ||
+                sep - cat_token >= CATEGORY_NAME_MAX ||
+                sscanf(sep + 1, "%llu", &cat_threshold) != 1)
+            tw_error(TW_LOC, "Invalid entry in "
+                    "PARAMS:analytic_category_threshold: %s (expected "
+                    "category:bytes)\n", cat_token);
+        *sep = '\0';
+        strcpy(p->analytic_category[i], cat_token);
+        p->analytic_category_threshold[i] = cat_threshold;
+        p->num_analytic_categories++;
+        cat_token = strtok(NULL, ",");
+    }
+
     // set the derived parameters
     p->num_cn = p->num_routers/2;
     p->num_global_channels = p->num_routers/2;
     p->num_groups = p->num_routers * p->num_cn + 1;
+    if(p->intra_grp_topo == INTRA_GRP_2D)
+    {
+        /* one row port per column and one column port per row */
+        p->num_local_channels = p->num_router_cols + p->num_router_rows;
+        p->num_local_neighbours = p->num_router_cols + p->num_router_rows - 2;
+        p->local_diameter = (p->num_router_rows > 1 && p->num_router_cols > 1) ? 2 : 1;
+    }
+    else
+    {
+        p->num_local_channels = p->num_routers;
+        p->num_local_neighbours = p->num_routers - 1;
+        p->local_diameter = 1;
+    }
     p->radix = p->num_vcs *
-        (p->num_cn + p->num_global_channels + p->num_routers);
+        (p->num_cn + p->num_global_channels + p->num_local_channels);
     p->total_routers = p->num_groups * p->num_routers;
 
 
@@ -367,57 +639,81 @@ static void dragonfly_report_stats()
    return;
 }
 
+/* The collective tree follows the topology: the terminals of a router
+ * gather at the first terminal of the router, the routers of a row at the
+ * first router of the row, the rows at the first router of the group and the
+ * groups at group 0. Each level is a tree of degree collective_tree_degree
+ * (a fully connected group is a single row). Parent and children are kept as
+ * LP gids so the fan-in and fan-out phases do no mapping lookups. */
 void dragonfly_collective_init(terminal_state * s,
            		   tw_lp * lp)
 {
-    // TODO: be annotation-aware
-    codes_mapping_get_lp_info(lp->gid, lp_group_name, &mapping_grp_id, NULL,
-            &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
-    int num_lps = codes_mapping_get_lp_count(lp_group_name, 1, LP_CONFIG_NM,
-            NULL, 1);
-    int num_reps = codes_mapping_get_group_reps(lp_group_name);
-    s->node_id = (mapping_rep_id * num_lps) + mapping_offset;
-
-    int i;
-   /* handle collective operations by forming a tree of all the LPs */
-   /* special condition for root of the tree */
-   if( s->node_id == 0)
+    const dragonfly_param *p = s->params;
+    int degree = p->collective_tree_degree;
+    int dims[COLLECTIVE_TREE_LEVELS] = {p->num_cn, p->num_router_cols,
+        p->num_router_rows, p->num_groups};
+    int coords[COLLECTIVE_TREE_LEVELS];
+    int children[COLLECTIVE_TREE_LEVELS * degree];
+    int parent = -1;
+    int i, j, k;
+
+    s->node_id = s->terminal_id;
+    int id = (int)s->terminal_id;
+    for( k = 0; k < COLLECTIVE_TREE_LEVELS; k++ )
     {
-        s->parent_node_id = -1;
-        s->is_root = 1;
-   }
-   else
-   {
-       s->parent_node_id = (s->node_id - ((s->node_id - 1) % TREE_DEGREE)) / TREE_DEGREE;
-       s->is_root = 0;
-   }
-   s->children = (tw_lpid*)malloc(TREE_DEGREE * sizeof(tw_lpid));
-
-   /* set the isleaf to zero by default */
-   s->is_leaf = 1;
-   s->num_children = 0;
-
-   /* calculate the children of the current node. If its a leaf, no need to set children,
-      only set isleaf and break the loop*/
+        coords[k] = id % dims[k];
+        id /= dims[k];
+    }
 
-   for( i = 0; i < TREE_DEGREE; i++ )
+    /* a node leads its level-k subtree only if its coordinates below k are
+     * zero, so walk up the levels until the node becomes a child */
+    s->num_children = 0;
+    for( k = 0; k < COLLECTIVE_TREE_LEVELS; k++ )
     {
-        tw_lpid next_child = (TREE_DEGREE * s->node_id) + i + 1;
-        if(next_child < (num_lps * num_reps))
+        int stride = 1;
+        for( j = 0; j < k; j++ )
+            stride *= dims[j];
+
+        for( j = 1; j <= degree; j++ )
         {
-            s->num_children++;
-            s->is_leaf = 0;
-            s->children[i] = next_child;
+            int child = degree * coords[k] + j;
+            if(child >= dims[k])
+                break;
+            children[s->num_children++] = (int)s->node_id +
+                (child - coords[k]) * stride;
         }
-        else
-           s->children[i] = -1;
+        if(coords[k] != 0)
+        {
+            parent = (int)s->node_id +
+                ((coords[k] - 1) / degree - coords[k]) * stride;
+            break;
+        }
+    }
+
+    s->is_root = (parent < 0);
+    s->is_leaf = (s->num_children == 0);
+    s->parent_gid = s->is_root ? lp->gid :
+        codes_mapping_get_lpid_from_relative(parent, NULL, LP_CONFIG_NM,
+                s->anno, 1);
+    s->children = (tw_lpid*)malloc((s->num_children ? s->num_children : 1) *
+            sizeof(tw_lpid));
+    for( i = 0; i < s->num_children; i++ )
+        s->children[i] = codes_mapping_get_lpid_from_relative(children[i],
+                NULL, LP_CONFIG_NM, s->anno, 1);
+
+    s->collective_seq = 0;
+    for( i = 0; i < NUM_COLLECTIVES; i++ )
+    {
+        s->collective_init_time[i] = 0.0;
+        s->origin_svr[i] = 0;
+        s->num_fan_nodes[i] = 0;
     }
 
 #if DRAGONFLY_COLLECTIVE_DEBUG == 1
-   printf("\n LP %ld parent node id ", s->node_id);
+   printf("\n LP %ld parent node id %d ", s->node_id, parent);
 
-   for( i = 0; i < TREE_DEGREE; i++ )
-        printf(" child node ID %ld ", s->children[i]);
+   for( i = 0; i < s->num_children; i++ )
+        printf(" child node ID %d ", children[i]);
    printf("\n");
 
    if(s->is_leaf)
@@ -449,6 +745,8 @@ static tw_stime dragonfly_packet_event(char const * category, tw_lpid final_dest
     msg->is_pull = is_pull;
     msg->pull_size = pull_size;
     msg->chunk_id = 0;
+    /* mapped to an injection queue by packet_generate */
+    msg->traffic_class = sched_params->prio;
 
     if(is_last_pckt) /* Its the last packet so pass in remote and local event information*/
       {
@@ -469,6 +767,25 @@ static tw_stime dragonfly_packet_event(char const * category, tw_lpid final_dest
     return xfer_to_nic_time;
 }
 
+/* whether the packet of msg skips the chunk pipeline: it is routed
+ * analytically when it reaches the threshold of its category (or the global
+ * one if the category has none) */
+static int is_analytic(const dragonfly_param *p, const terminal_message *msg)
+{
+    uint64_t threshold = p->analytic_threshold;
+    int i;
+
+    for(i = 0; i < p->num_analytic_categories; i++)
+    {
+        if(strcmp(p->analytic_category[i], msg->category) == 0)
+        {
+            threshold = p->analytic_category_threshold[i];
+            break;
+        }
+    }
+    return threshold > 0 && msg->packet_size >= threshold;
+}
+
 /* dragonfly packet event reverse handler */
 static void dragonfly_packet_event_rc(tw_lp *sender)
 {
@@ -504,6 +821,147 @@ tw_lpid getRouterFromGroupID(int dest_gid,
   return router_id;
 }	
 
+/* given two routers of the same group, returns the local port of src_router_id
+ * that connects to dest_router_id. In a fully connected group the port is the
+ * index of the destination router within the group; in a 2D group the row
+ * ports (indexed by column) come first, followed by the column ports (indexed
+ * by row) */
+static int get_local_port(const dragonfly_param *p,
+        int src_router_id,
+        int dest_router_id)
+{
+    int dest_local = dest_router_id % p->num_routers;
+
+    if(p->intra_grp_topo != INTRA_GRP_2D)
+        return dest_local;
+
+    int src_local = src_router_id % p->num_routers;
+    int src_row = src_local / p->num_router_cols;
+    int dest_row = dest_local / p->num_router_cols;
+    int dest_col = dest_local % p->num_router_cols;
+
+    if(src_row == dest_row)
+        return dest_col;
+
+    assert(src_local % p->num_router_cols == dest_col);
+    return p->num_router_cols + dest_row;
+}
+
+/* number of local hops between two routers of the same group */
+static int get_local_hops(const dragonfly_param *p,
+        int src_router_id,
+        int dest_router_id)
+{
+    int src_local = src_router_id % p->num_routers;
+    int dest_local = dest_router_id % p->num_routers;
+
+    if(src_local == dest_local)
+        return 0;
+
+    if(p->intra_grp_topo != INTRA_GRP_2D)
+        return 1;
+
+    if(src_local / p->num_router_cols == dest_local / p->num_router_cols ||
+            src_local % p->num_router_cols == dest_local % p->num_router_cols)
+        return 1;
+
+    return 2;
+}
+
+/* bandwidth of the link attached to the given output port of a router */
+static double get_port_bandwidth(const dragonfly_param *p, int output_port)
+{
+    if(output_port < p->num_local_channels)
+    {
+        if(p->intra_grp_topo == INTRA_GRP_2D)
+            return output_port < p->num_router_cols ?
+                p->local_row_bandwidth : p->local_col_bandwidth;
+        return p->local_bandwidth;
+    }
+    if(output_port < p->num_local_channels + p->num_global_channels)
+        return p->global_bandwidth;
+
+    return p->cn_bandwidth;
+}
+
+/* number of bytes carried by the chunk of msg */
+static uint64_t get_chunk_bytes(const dragonfly_param *p,
+        const terminal_message *msg)
+{
+    uint64_t offset = (uint64_t)msg->chunk_id * p->chunk_size;
+
+    if(offset >= msg->packet_size)
+        return 0;
+    if(msg->packet_size - offset < (uint64_t)p->chunk_size)
+        return msg->packet_size - offset;
+    return p->chunk_size;
+}
+
+/* selects the next router on the way to dest_router_id (a router in the
+ * current group) for a 2D group. Minimal paths go along the row first and
+ * then along the column. Non-minimal paths take a detour through a randomly
+ * selected one-hop neighbour (intm_sel) when the packet enters the group and
+ * route minimally from there on. Adaptive routing picks the detour when the
+ * minimal output port is more congested, weighted by the number of hops. */
+static int get_intra_group_hop(router_state * s,
+        terminal_message * msg,
+        int dest_router_id,
+        int intm_sel)
+{
+    const dragonfly_param *p = s->params;
+    int grp_begin = s->group_id * p->num_routers;
+    int src_local = s->router_id % p->num_routers;
+    int dest_local = dest_router_id % p->num_routers;
+    int src_row = src_local / p->num_router_cols;
+    int src_col = src_local % p->num_router_cols;
+    int min_hop;
+
+    if(src_local == dest_local)
+        return dest_router_id;
+
+    if(src_row == dest_local / p->num_router_cols ||
+            src_col == dest_local % p->num_router_cols)
+        min_hop = dest_router_id;
+    else
+        min_hop = grp_begin + src_row * p->num_router_cols +
+            (dest_local % p->num_router_cols);
+
+    if(p->intra_grp_routing == MINIMAL || msg->last_hop == LOCAL ||
+            intm_sel < 0 || p->num_local_neighbours < 2)
+        return min_hop;
+
+    /* the one-hop neighbours are the other routers of the row followed by
+     * the other routers of the column */
+    int intm_local;
+    if(intm_sel < p->num_router_cols - 1)
+    {
+        int col = intm_sel < src_col ? intm_sel : intm_sel + 1;
+        intm_local = src_row * p->num_router_cols + col;
+    }
+    else
+    {
+        int row = intm_sel - (p->num_router_cols - 1);
+        row = row < src_row ? row : row + 1;
+        intm_local = row * p->num_router_cols + src_col;
+    }
+    if(intm_local == dest_local)
+        return min_hop;
+
+    int nonmin_hop = grp_begin + intm_local;
+    if(p->intra_grp_routing == ADAPTIVE)
+    {
+        int min_port = get_local_port(p, s->router_id, min_hop);
+        int nonmin_port = get_local_port(p, s->router_id, nonmin_hop);
+        int min_hops = get_local_hops(p, s->router_id, dest_router_id);
+        int nonmin_hops = 1 + get_local_hops(p, nonmin_hop, dest_router_id);
+
+        if(min_hops * s->vc_occupancy[min_port * p->num_vcs] <=
+                nonmin_hops * s->vc_occupancy[nonmin_port * p->num_vcs])
+            return min_hop;
+    }
+    return nonmin_hop;
+}
+
 /*When a packet is sent from the current router and a buffer slot becomes available, a credit is sent back to schedule another packet event*/
 void router_credit_send(router_state * s, tw_bf * bf, terminal_message * msg, tw_lp * lp)
 {
@@ -536,9 +994,10 @@ void router_credit_send(router_state * s, tw_bf * bf, terminal_message * msg, tw
    }
     else if(msg->last_hop == LOCAL)
      {
+        int local_port = get_local_port(p, s->router_id, msg->local_id);
         dest = msg->intm_lp_id;
-        sender_radix = p->num_cn + p->num_global_channels + (msg->local_id % p->num_routers);
-     	credit_delay = (1/p->local_bandwidth) * CREDIT_SIZE;
+        sender_radix = p->num_cn + p->num_global_channels + local_port;
+     	credit_delay = (1/get_port_bandwidth(p, local_port)) * CREDIT_SIZE;
      }
     else
       printf("\n Invalid message type");
@@ -573,16 +1032,82 @@ void router_credit_send(router_state * s, tw_bf * bf, terminal_message * msg, tw
     return;
 }
 
+/* returns 1 if every injection queue of the terminal is below its capacity,
+ * i.e. the model-net scheduler can hand over another packet */
+static int terminal_injq_has_room(terminal_state * s)
+{
+    int i;
+    for(i = 0; i < s->params->num_injection_queues; i++)
+    {
+        if(s->injq_occupancy[i] >= s->params->injection_queue_size)
+            return 0;
+    }
+    return 1;
+}
+
+/* picks the injection queue to be served next on the terminal-router link.
+ * Only queues whose virtual channel has buffer space at the router are
+ * eligible. Returns -1 if no queue can send. */
+static int terminal_injq_select(terminal_state * s)
+{
+    const dragonfly_param *p = s->params;
+    int i, q;
+
+    for(i = 0; i < p->num_injection_queues; i++)
+    {
+        if(p->injection_arbitration == INJ_ARB_PRIO)
+            q = i;
+        else
+            q = (s->last_injq + 1 + i) % p->num_injection_queues;
+
+        if(!qlist_empty(&s->injq[q]) &&
+                s->vc_occupancy[q % p->num_vcs] < p->cn_vc_size)
+            return q;
+    }
+    return -1;
+}
+
+/* schedules the next send on the terminal-router link once the link is free */
+static void terminal_start_send_loop(terminal_state * s, tw_lp * lp)
+{
+    tw_event *e;
+    terminal_message *m;
+    tw_stime ts;
+
+    s->in_send_loop = 1;
+    ts = maxd(s->terminal_available_time - tw_now(lp), 0.0) +
+        codes_local_latency(lp);
+    e = model_net_method_event_new(lp->gid, ts, lp, DRAGONFLY,
+            (void**)&m, NULL);
+    m->type = T_SEND;
+    m->magic = terminal_magic_num;
+    tw_event_send(e);
+}
+
 static void packet_generate_rc(terminal_state * s, 
 			    tw_bf * bf, 
 			    terminal_message * msg, 
 			    tw_lp * lp)
 {
-    int i;
     tw_rand_reverse_unif(lp->rng);
 
+    int q = msg->traffic_class;
+    struct qlist_head *ent = qlist_pop_back(&s->injq[q]);
+    assert(ent);
+    terminal_injq_item *item = qlist_entry(ent, terminal_injq_item, ql);
+    free(item->edata);
+    free(item);
+    s->injq_occupancy[q] -= msg->num_chunks;
+
     if(bf->c1)
-       tw_rand_reverse_unif(lp->rng);
+    {
+        s->in_send_loop = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c2)
+        codes_local_latency_reverse(lp);
+    if(bf->c3)
+        s->sched_blocked = 0;
 	 
      mn_stats* stat;
      stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
@@ -590,118 +1115,78 @@ static void packet_generate_rc(terminal_state * s,
      stat->send_bytes -= msg->packet_size;
      stat->send_time -= (1/s->params->cn_bandwidth) * msg->packet_size;
 }
-/* generates packet at the current dragonfly compute node */
+/* generates packet at the current dragonfly compute node and places it into
+ * the injection queue of its traffic class */
 static void packet_generate(terminal_state * s, 
 			    tw_bf * bf, 
 			    terminal_message * msg, 
 			    tw_lp * lp)
 {
-       const dragonfly_param *p = s->params;
-
-	tw_stime ts;
-	tw_event *e;
-	terminal_message *m;
-	int i, total_event_size;
+    const dragonfly_param *p = s->params;
+    int total_event_size;
 
-	int chunk_id = msg->chunk_id;
-	uint64_t num_chunks = msg->packet_size / p->chunk_size;
-	if (msg->packet_size % s->params->chunk_size)
-	  num_chunks++;
-
-	if(!num_chunks)
-	   num_chunks = 1;
-
-	msg->num_chunks = num_chunks;
-	msg->packet_ID = lp->gid + g_tw_nlp * s->packet_counter + tw_rand_integer(lp->rng, 0, lp->gid + g_tw_nlp * s->packet_counter);
-	msg->travel_start_time = tw_now(lp);
+    uint64_t num_chunks = msg->packet_size / p->chunk_size;
+    if (msg->packet_size % p->chunk_size)
+        num_chunks++;
 
-	ts = codes_local_latency(lp);
+    if(!num_chunks)
+        num_chunks = 1;
+
+    msg->num_chunks = num_chunks;
+    msg->packet_ID = lp->gid + g_tw_nlp * s->packet_counter + tw_rand_integer(lp->rng, 0, lp->gid + g_tw_nlp * s->packet_counter);
+    msg->travel_start_time = tw_now(lp);
+
+    /* map the message priority to an injection queue, default priority (-1)
+     * and priorities beyond the number of queues go to the last one */
+    if(msg->traffic_class < 0 || msg->traffic_class >= p->num_injection_queues)
+        msg->traffic_class = p->num_injection_queues - 1;
+
+    /* copy the packet along with its remote and local events into the
+     * injection queue, chunks are sent out of the queue by packet_send */
+    int q = msg->traffic_class;
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    terminal_injq_item *item = malloc(sizeof(terminal_injq_item));
+    assert(item);
+    memcpy(&item->msg, msg, sizeof(terminal_message));
+    item->msg.chunk_id = 0;
+    item->edata = NULL;
+    if(edata_size > 0)
+    {
+        item->edata = malloc(edata_size);
+        memcpy(item->edata, model_net_method_get_edata(DRAGONFLY, msg),
+                edata_size);
+    }
+    qlist_add_tail(&item->ql, &s->injq[q]);
+    s->injq_occupancy[q] += num_chunks;
 
-	int chan = -1, j;
-	for(j = 0; j < p->num_vcs; j++)
-	 {
-	     if(s->vc_occupancy[j] < p->cn_vc_size * num_chunks)
-	      {
-	       chan=j;
-	       break;
-	      }
-	 }
-	// this is a terminal event, so use the method-event version
-       void * m_data;
-       e = model_net_method_event_new(lp->gid, ts, lp, DRAGONFLY,
-	       (void**)&m, &m_data);
-       memcpy(m, msg, sizeof(terminal_message));
-       void * m_data_src = model_net_method_get_edata(DRAGONFLY, msg);
-       if (msg->remote_event_size_bytes){
-	    memcpy(m_data, m_data_src, msg->remote_event_size_bytes);
-       }
-       if (msg->local_event_size_bytes){ 
-	    memcpy((char*)m_data + msg->remote_event_size_bytes,
-		    (char*)m_data_src + msg->remote_event_size_bytes,
-		    msg->local_event_size_bytes);
-       }
-       m->intm_group_id = -1;
-       m->saved_vc=0;
-       m->chunk_id = msg->chunk_id;
-       m->magic = terminal_magic_num;
-      /* if(msg->packet_ID == TRACK && msg->chunk_id == num_chunks-1)
-	 printf("\n packet generated %lld at terminal %d chunk id %d ", msg->packet_ID, (int)lp->gid, i);
-       */
-       m->output_chan = -1;
-       if(chan != -1) // If the input queue is available
-	{
-	    // Send the packet out
-	     m->type = T_SEND;
-	     tw_event_send(e);
-	}
-      else
-	 {
-	  printf("\n Exceeded queue size, exitting %d", s->vc_occupancy[0]);
-	  MPI_Finalize();
-	  exit(-1);
-	} //else
+    if(!s->in_send_loop)
+    {
+        bf->c1 = 1;
+        terminal_start_send_loop(s, lp);
+    }
 
-        /* Now schedule another packet generate event */
-	if(chunk_id < num_chunks - 1)
-	{
-	     bf->c1 = 1;
-	     /* Issue another packet generate event */
-	     tw_event * e_gen;
-	     terminal_message * m_gen;
-	     void * m_gen_data;
-
-	     /* Keep the packet generate event a little behind packet send */
-	     ts = ts + codes_local_latency(lp);
-
-	     e_gen = model_net_method_event_new(lp->gid, ts, lp, DRAGONFLY, (void**)&m_gen,(void**)&m_gen_data); 
-
-	     void *m_gen_data_src = model_net_method_get_edata(DRAGONFLY, msg);
-	     memcpy(m_gen, msg, sizeof(terminal_message));
-
-	     m_gen->chunk_id = ++chunk_id;
-             m_gen->type = T_GENERATE;
-
-	      if (msg->remote_event_size_bytes){
-		memcpy(m_gen_data, m_gen_data_src,
-			msg->remote_event_size_bytes);
-		m_gen_data = (char*)m_gen_data + msg->remote_event_size_bytes;
-		m_gen_data_src = (char*)m_gen_data_src + msg->remote_event_size_bytes;
-	      }
-	    if (msg->local_event_size_bytes)
-		memcpy(m_gen_data, m_gen_data_src, msg->local_event_size_bytes);
-     
-           tw_event_send(e_gen); 
-       }
+    /* ask the scheduler for the next packet as long as the injection queues
+     * have room, otherwise wait until packet_send drains them */
+    if(terminal_injq_has_room(s))
+    {
+        bf->c2 = 1;
+        model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->sched_blocked = 1;
+    }
 
-	total_event_size = model_net_get_msg_sz(DRAGONFLY) + 
-	msg->remote_event_size_bytes + msg->local_event_size_bytes;
-	mn_stats* stat;
-	stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
-	stat->send_count++;
-	stat->send_bytes += msg->packet_size;
-	stat->send_time += (1/p->cn_bandwidth) * msg->packet_size;
-	if(stat->max_event_size < total_event_size)
-	  stat->max_event_size = total_event_size;
+    total_event_size = model_net_get_msg_sz(DRAGONFLY) + 
+        msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/p->cn_bandwidth) * msg->packet_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
 
   return;
 }
@@ -711,19 +1196,57 @@ static void packet_send_rc(terminal_state * s,
 			terminal_message * msg, 
 			tw_lp * lp)
 {
+   if(bf->c1)
+   {
+       s->in_send_loop = 1;
+       return;
+   }
+
+   int q = msg->saved_queue;
+   int vc = q % s->params->num_vcs;
+
+   s->last_injq = msg->saved_last_injq;
    s->terminal_available_time = msg->saved_available_time;
    tw_rand_reverse_unif(lp->rng);
-   int vc = msg->saved_vc;
    s->vc_occupancy[vc]--;
    s->packet_counter--;
    s->output_vc_state[vc] = VC_IDLE;
+   s->injq_occupancy[q]++;
 
-   if (msg->chunk_id == (msg->num_chunks)-1){
-     codes_local_latency_reverse(lp);
+   if(bf->c2)
+   {
+       /* the last chunk was sent, put the packet back at the queue head */
+       int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+       terminal_injq_item *item = malloc(sizeof(terminal_injq_item));
+       assert(item);
+       memcpy(&item->msg, msg, sizeof(terminal_message));
+       item->edata = NULL;
+       if(edata_size > 0)
+       {
+           item->edata = malloc(edata_size);
+           memcpy(item->edata, model_net_method_get_edata(DRAGONFLY, msg),
+                   edata_size);
+       }
+       qlist_add(&item->ql, &s->injq[q]);
+   }
+   else
+   {
+       terminal_injq_item *item = qlist_entry(s->injq[q].next,
+               terminal_injq_item, ql);
+       item->msg.chunk_id--;
    }
 
+   if(bf->c3)
+   {
+       s->sched_blocked = 1;
+       codes_local_latency_reverse(lp);
+   }
+   if(bf->c4)
+       s->in_send_loop = 1;
 }
-/* sends the packet from the current dragonfly compute node to the attached router */
+/* sends the next chunk of the selected injection queue from the current
+ * dragonfly compute node to the attached router. Chunks are paced by the
+ * bandwidth of the terminal-router link. */
 static void packet_send(terminal_state * s, 
 			tw_bf * bf, 
 			terminal_message * msg, 
@@ -733,11 +1256,27 @@ static void packet_send(terminal_state * s,
   tw_event *e;
   terminal_message *m;
   tw_lpid router_id;
-  /* Route the packet to its source router */ 
-   int vc=msg->saved_vc;
+
+  int q = terminal_injq_select(s);
+  if(q == -1)
+  {
+      /* nothing to send or no buffer space at the router, the loop is
+       * restarted by a new packet or a credit */
+      bf->c1 = 1;
+      s->in_send_loop = 0;
+      return;
+  }
+
+  terminal_injq_item *item = qlist_entry(s->injq[q].next,
+          terminal_injq_item, ql);
+  terminal_message *pkt = &item->msg;
+  int vc = q % s->params->num_vcs;
+
+   int saved_last_injq = s->last_injq;
+   tw_stime saved_available_time = s->terminal_available_time;
+   s->last_injq = q;
 
    //  Each packet is broken into chunks and then sent over the channel
-   msg->saved_available_time = s->terminal_available_time;
    double head_delay = (1/s->params->cn_bandwidth) * s->params->chunk_size;
    ts = head_delay + tw_rand_exponential(lp->rng, (double)head_delay/200);
    s->terminal_available_time = maxd(s->terminal_available_time, tw_now(lp));
@@ -753,13 +1292,10 @@ static void packet_send(terminal_state * s,
    // we are sending an event to the router, so no method_event here
    e = tw_event_new(router_id, s->terminal_available_time - tw_now(lp), lp);
 
-   //if(msg->packet_ID == TRACK && msg->chunk_id == num_chunks-1)
-   //  printf("\n terminal %d packet %lld chunk %d being sent to router %d router id %d ", (int)lp->gid, (long long)msg->packet_ID, msg->chunk_id, (int)router_id, s->router_id);
    m = tw_event_data(e);
-   memcpy(m, msg, sizeof(terminal_message));
-   if (msg->remote_event_size_bytes){
-        memcpy(m+1, model_net_method_get_edata(DRAGONFLY, msg),
-                msg->remote_event_size_bytes);
+   memcpy(m, pkt, sizeof(terminal_message));
+   if (pkt->remote_event_size_bytes){
+        memcpy(m+1, item->edata, pkt->remote_event_size_bytes);
    }
    m->magic = router_magic_num;
    m->origin_router_id = s->router_id;
@@ -773,35 +1309,79 @@ static void packet_send(terminal_state * s,
    m->local_id = s->terminal_id;
    tw_event_send(e);
 
-   if(msg->chunk_id == msg->num_chunks - 1) 
+   if(pkt->chunk_id == pkt->num_chunks - 1) 
     {
-      // now that message is sent, issue an "idle" event to tell the scheduler
-      // when I'm next available
-      model_net_method_idle_event(codes_local_latency(lp) +
-              s->terminal_available_time - tw_now(lp), 0, lp);
-
+      bf->c2 = 1;
       /* local completion message */
-      if(msg->local_event_size_bytes > 0)
+      if(pkt->local_event_size_bytes > 0)
 	 {
            tw_event* e_new;
 	   terminal_message* m_new;
 	   void* local_event = 
-               (char*)model_net_method_get_edata(DRAGONFLY, msg) + 
-               msg->remote_event_size_bytes;
-	   ts = g_tw_lookahead + (1/s->params->cn_bandwidth) * msg->local_event_size_bytes;
-	   e_new = tw_event_new(msg->sender_lp, ts, lp);
+               (char*)item->edata + pkt->remote_event_size_bytes;
+	   ts = g_tw_lookahead + (1/s->params->cn_bandwidth) * pkt->local_event_size_bytes;
+	   e_new = tw_event_new(pkt->sender_lp, ts, lp);
 	   m_new = tw_event_data(e_new);
-	   memcpy(m_new, local_event, msg->local_event_size_bytes);
+	   memcpy(m_new, local_event, pkt->local_event_size_bytes);
 	   tw_event_send(e_new);
 	}
+
+      /* the packet leaves the queue, keep a copy in the event for reverse
+       * computation */
+      int edata_size = pkt->remote_event_size_bytes + pkt->local_event_size_bytes;
+      qlist_pop(&s->injq[q]);
+      memcpy(msg, pkt, sizeof(terminal_message));
+      if(edata_size > 0)
+          memcpy(model_net_method_get_edata(DRAGONFLY, msg), item->edata,
+                  edata_size);
+      msg->type = T_SEND;
+      msg->magic = terminal_magic_num;
+      free(item->edata);
+      free(item);
     }
+   else
+      pkt->chunk_id++;
+
+   msg->saved_queue = q;
+   msg->saved_last_injq = saved_last_injq;
+   msg->saved_available_time = saved_available_time;
    
    s->packet_counter++;
    s->vc_occupancy[vc]++;
+   s->injq_occupancy[q]--;
 
    if(s->vc_occupancy[vc] >= s->params->cn_vc_size)
       s->output_vc_state[vc] = VC_CREDIT;
-   
+
+   /* the queues drained enough for the scheduler to hand over more packets */
+   if(s->sched_blocked && terminal_injq_has_room(s))
+   {
+       bf->c3 = 1;
+       s->sched_blocked = 0;
+       model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+   }
+
+   /* keep sending at the link rate while there are queued chunks */
+   int i;
+   for(i = 0; i < s->params->num_injection_queues; i++)
+   {
+       if(!qlist_empty(&s->injq[i]))
+           break;
+   }
+   if(i < s->params->num_injection_queues)
+   {
+       e = model_net_method_event_new(lp->gid,
+               s->terminal_available_time - tw_now(lp), lp, DRAGONFLY,
+               (void**)&m, NULL);
+       m->type = T_SEND;
+       m->magic = terminal_magic_num;
+       tw_event_send(e);
+   }
+   else
+   {
+       bf->c4 = 1;
+       s->in_send_loop = 0;
+   }
    return;
 }
 
@@ -949,6 +1529,178 @@ if( msg->packet_ID == TRACK && msg->chunk_id == num_chunks-1)
   return;
 }
 
+/* generates a packet that is routed analytically. Instead of going through an
+ * injection queue, the whole packet reserves the terminal-router link and is
+ * handed to the router once its head is on the link, so the scheduler can go
+ * on right away. Queued chunks are sent after the reservation */
+static void analytic_generate(terminal_state * s,
+			    tw_bf * bf,
+			    terminal_message * msg,
+			    tw_lp * lp)
+{
+    const dragonfly_param *p = s->params;
+    tw_event *e;
+    terminal_message *m;
+    tw_lpid router_id;
+    tw_stime start;
+
+    uint64_t num_chunks = msg->packet_size / p->chunk_size;
+    if (msg->packet_size % p->chunk_size)
+        num_chunks++;
+    if(!num_chunks)
+        num_chunks = 1;
+
+    msg->num_chunks = num_chunks;
+    msg->packet_ID = lp->gid + g_tw_nlp * s->packet_counter + tw_rand_integer(lp->rng, 0, lp->gid + g_tw_nlp * s->packet_counter);
+    msg->travel_start_time = tw_now(lp);
+
+    msg->saved_available_time = s->terminal_available_time;
+    start = maxd(s->terminal_available_time, tw_now(lp));
+    s->terminal_available_time = start +
+        (1/p->cn_bandwidth) * msg->packet_size;
+
+    //TODO: be annotation-aware
+    codes_mapping_get_lp_info(lp->gid, lp_group_name, &mapping_grp_id, NULL,
+            &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
+    codes_mapping_get_lp_id(lp_group_name, "dragonfly_router", NULL, 1,
+            s->router_id/num_routers_per_mgrp, s->router_id % num_routers_per_mgrp, &router_id);
+
+    // we are sending an event to the router, so no method_event here
+    e = tw_event_new(router_id, start - tw_now(lp) +
+            (1/p->cn_bandwidth) * p->chunk_size, lp);
+    m = tw_event_data(e);
+    memcpy(m, msg, sizeof(terminal_message));
+    if (msg->remote_event_size_bytes){
+        memcpy(m+1, model_net_method_get_edata(DRAGONFLY, msg),
+                msg->remote_event_size_bytes);
+    }
+    m->magic = router_magic_num;
+    m->origin_router_id = s->router_id;
+    m->type = R_ANALYTIC;
+    m->src_terminal_id = lp->gid;
+    m->last_hop = TERMINAL;
+    m->intm_group_id = -1;
+    m->path_type = MINIMAL;
+    m->local_event_size_bytes = 0;
+    m->local_id = s->terminal_id;
+    m->analytic_tail_time = s->terminal_available_time;
+    tw_event_send(e);
+
+    /* local completion message, once the tail has left the terminal */
+    if(msg->local_event_size_bytes > 0)
+    {
+        void* local_event = (char*)model_net_method_get_edata(DRAGONFLY, msg) +
+            msg->remote_event_size_bytes;
+        e = tw_event_new(msg->sender_lp, g_tw_lookahead +
+                s->terminal_available_time - tw_now(lp), lp);
+        m = tw_event_data(e);
+        memcpy(m, local_event, msg->local_event_size_bytes);
+        tw_event_send(e);
+    }
+
+    model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+
+    int total_event_size = model_net_get_msg_sz(DRAGONFLY) +
+        msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/p->cn_bandwidth) * msg->packet_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
+}
+
+static void analytic_generate_rc(terminal_state * s,
+			    tw_bf * bf,
+			    terminal_message * msg,
+			    tw_lp * lp)
+{
+    tw_rand_reverse_unif(lp->rng);
+    s->terminal_available_time = msg->saved_available_time;
+    codes_local_latency_reverse(lp);
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
+    stat->send_count--;
+    stat->send_bytes -= msg->packet_size;
+    stat->send_time -= (1/s->params->cn_bandwidth) * msg->packet_size;
+}
+
+/* an analytically routed packet arrives at the destination terminal. The
+ * remote event is delivered when the tail of the packet has arrived; no
+ * credit is returned since the packet took no buffer space */
+static void analytic_arrive(terminal_state * s,
+		   tw_bf * bf,
+                   terminal_message * msg,
+                   tw_lp * lp)
+{
+    tw_stime arrival = maxd(msg->analytic_tail_time, tw_now(lp));
+    tw_stime latency = arrival - msg->travel_start_time;
+
+    mn_stats* stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
+    stat->recv_count++;
+    stat->recv_bytes += msg->packet_size;
+    stat->recv_time += latency;
+
+    N_finished_packets++;
+    dragonfly_total_time += latency;
+    if (dragonfly_max_latency < latency)
+    {
+        bf->c3 = 1;
+        msg->saved_available_time = dragonfly_max_latency;
+        dragonfly_max_latency = latency;
+    }
+
+    if(msg->remote_event_size_bytes)
+    {
+        void * tmp_ptr = model_net_method_get_edata(DRAGONFLY, msg);
+        tw_stime ts = arrival - tw_now(lp) + g_tw_lookahead + 0.1 +
+            (1/s->params->cn_bandwidth) * msg->remote_event_size_bytes;
+        if (msg->is_pull){
+            struct codes_mctx mc_dst =
+                codes_mctx_set_global_direct(msg->sender_mn_lp);
+            struct codes_mctx mc_src =
+                codes_mctx_set_global_direct(lp->gid);
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_mctx(net_id, &mc_src, &mc_dst, msg->category,
+                    msg->sender_lp, msg->pull_size, ts,
+                    msg->remote_event_size_bytes, tmp_ptr, 0, NULL, lp);
+        }
+        else{
+            tw_event *e = tw_event_new(msg->final_dest_gid, ts, lp);
+            terminal_message *m = tw_event_data(e);
+            memcpy(m, tmp_ptr, msg->remote_event_size_bytes);
+            tw_event_send(e);
+        }
+    }
+}
+
+static void analytic_arrive_rc(terminal_state * s,
+		   tw_bf * bf,
+                   terminal_message * msg,
+                   tw_lp * lp)
+{
+    tw_stime latency = maxd(msg->analytic_tail_time, tw_now(lp)) -
+        msg->travel_start_time;
+
+    mn_stats* stat = model_net_find_stats(msg->category, s->dragonfly_stats_array);
+    stat->recv_count--;
+    stat->recv_bytes -= msg->packet_size;
+    stat->recv_time -= latency;
+
+    N_finished_packets--;
+    dragonfly_total_time -= latency;
+    if(bf->c3)
+        dragonfly_max_latency = msg->saved_available_time;
+
+    if(msg->remote_event_size_bytes && msg->is_pull)
+    {
+        int net_id = model_net_get_id(LP_METHOD_NM);
+        model_net_event_rc(net_id, lp, msg->pull_size);
+    }
+}
+
 /* initialize a dragonfly compute node terminal */
 void 
 terminal_init( terminal_state * s, 
@@ -984,14 +1736,25 @@ terminal_init( terminal_state * s,
    s->terminal_available_time = 0.0;
    s->packet_counter = 0;
 
-   s->vc_occupancy = (int*)malloc(s->params->num_vcs * sizeof(int));
-   s->output_vc_state = (int*)malloc(s->params->num_vcs * sizeof(int));
+   // VC state and injection queues share one cache-line aligned block
+   size_t vc_sz = cache_align(s->params->num_vcs * sizeof(int));
+   size_t injq_sz = cache_align(s->params->num_injection_queues * sizeof(int));
+   char * block = alloc_port_block(2 * vc_sz + injq_sz +
+           s->params->num_injection_queues * sizeof(struct qlist_head));
+
+   s->vc_occupancy = (int*)block;
+   s->output_vc_state = (int*)(block + vc_sz);
+   s->injq_occupancy = (int*)(block + 2 * vc_sz);
+   s->injq = (struct qlist_head*)(block + 2 * vc_sz + injq_sz);
 
    for( i = 0; i < s->params->num_vcs; i++ )
-    {
-      s->vc_occupancy[i]=0;
       s->output_vc_state[i]=VC_IDLE;
-    }
+
+   for( i = 0; i < s->params->num_injection_queues; i++ )
+      INIT_QLIST_HEAD(&s->injq[i]);
+   s->last_injq = s->params->num_injection_queues - 1;
+   s->in_send_loop = 0;
+   s->sched_blocked = 0;
 //   printf("\n Terminal ID %d Router ID %d ", s->terminal_id, s->router_id);
    dragonfly_collective_init(s, lp);
    return;
@@ -1052,7 +1815,8 @@ static void send_remote_event(terminal_state * s,
             tw_stime ts;
             terminal_message * m;
             ts = (1/s->params->cn_bandwidth) * msg->remote_event_size_bytes;
-            e = codes_event_new(s->origin_svr, ts, lp);
+            e = codes_event_new(s->origin_svr[msg->collective_id % NUM_COLLECTIVES],
+                    ts, lp);
             m = tw_event_data(e);
             char* tmp_ptr = (char*)msg;
             tmp_ptr += dragonfly_get_msg_sz();
@@ -1061,148 +1825,99 @@ static void send_remote_event(terminal_state * s,
      }
 }
 
-static void node_collective_init(terminal_state * s,
-                        tw_bf * bf,
+/* sends a collective message (with the remote event of msg) to a tree node */
+static void send_collective_event(terminal_state * s,
                         terminal_message * msg,
+                        tw_lpid dest_gid,
+                        tw_stime ts,
+                        event_t type,
                         tw_lp * lp)
 {
-        tw_event * e_new;
-        tw_lpid parent_nic_id;
-        tw_stime xfer_to_nic_time;
-        terminal_message * msg_new;
-        int num_lps;
-
-        msg->saved_collective_init_time = s->collective_init_time;
-        s->collective_init_time = tw_now(lp);
-	s->origin_svr = msg->sender_svr;
-	
-        if(s->is_leaf)
-        {
-            //printf("\n LP %ld sending message to parent %ld ", s->node_id, s->parent_node_id);
-            /* get the global LP ID of the parent node */
-            // TODO: be annotation-aware
-            codes_mapping_get_lp_info(lp->gid, lp_group_name, &mapping_grp_id,
-                    NULL, &mapping_type_id, NULL, &mapping_rep_id,
-                    &mapping_offset);
-            num_lps = codes_mapping_get_lp_count(lp_group_name, 1, LP_CONFIG_NM,
-                    s->anno, 0);
-            codes_mapping_get_lp_id(lp_group_name, LP_CONFIG_NM, s->anno, 0,
-                    s->parent_node_id/num_lps, (s->parent_node_id % num_lps),
-                    &parent_nic_id);
-
-           /* send a message to the parent that the LP has entered the collective operation */
-            xfer_to_nic_time = g_tw_lookahead + LEVEL_DELAY;
-            //e_new = codes_event_new(parent_nic_id, xfer_to_nic_time, lp);
-	    void* m_data;
-	    e_new = model_net_method_event_new(parent_nic_id, xfer_to_nic_time,
-            	lp, DRAGONFLY, (void**)&msg_new, (void**)&m_data);
-	    	
-            memcpy(msg_new, msg, sizeof(terminal_message));
-	    if (msg->remote_event_size_bytes){
-        	memcpy(m_data, model_net_method_get_edata(DRAGONFLY, msg),
-                	msg->remote_event_size_bytes);
-      	    }
-	    
-            msg_new->type = D_COLLECTIVE_FAN_IN;
-            msg_new->sender_node = s->node_id;
-
-            tw_event_send(e_new);
-        }
-        return;
+    tw_event * e_new;
+    terminal_message * msg_new;
+    void * m_data;
+
+    e_new = model_net_method_event_new(dest_gid, ts, lp, DRAGONFLY,
+            (void**)&msg_new, &m_data);
+    memcpy(msg_new, msg, sizeof(terminal_message));
+    if (msg->remote_event_size_bytes){
+        memcpy(m_data, model_net_method_get_edata(DRAGONFLY, msg),
+                msg->remote_event_size_bytes);
+    }
+    msg_new->type = type;
+    msg_new->sender_node = s->node_id;
+    tw_event_send(e_new);
 }
 
-static void node_collective_fan_in(terminal_state * s,
+/* a contribution (the node's own or a child's) has reached the node. Once all
+ * of them are in, signal the parent or, at the root, start the fan-out */
+static void node_collective_arrive(terminal_state * s,
                         tw_bf * bf,
                         terminal_message * msg,
                         tw_lp * lp)
 {
         int i;
-        s->num_fan_nodes++;
+        int slot = msg->collective_id % NUM_COLLECTIVES;
+        const dragonfly_param *p = s->params;
 
-        codes_mapping_get_lp_info(lp->gid, lp_group_name, &mapping_grp_id,
-                NULL, &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
-        int num_lps = codes_mapping_get_lp_count(lp_group_name, 1, LP_CONFIG_NM,
-                s->anno, 0);
+        s->num_fan_nodes[slot]++;
 
-        tw_event* e_new;
-        terminal_message * msg_new;
-        tw_stime xfer_to_nic_time;
+        if(s->num_fan_nodes[slot] < s->num_children + 1)
+            return;
 
-        bf->c1 = 0;
-        bf->c2 = 0;
+        msg->saved_fan_nodes = s->num_fan_nodes[slot]-1;
+        s->num_fan_nodes[slot] = 0;
 
-        /* if the number of fanned in nodes have completed at the current node then signal the parent */
-        if((s->num_fan_nodes == s->num_children) && !s->is_root)
+        /* signal the parent that the subtree has entered the collective operation */
+        if(!s->is_root)
         {
             bf->c1 = 1;
-            msg->saved_fan_nodes = s->num_fan_nodes-1;
-            s->num_fan_nodes = 0;
-            tw_lpid parent_nic_id;
-            xfer_to_nic_time = g_tw_lookahead + LEVEL_DELAY;
-
-            /* get the global LP ID of the parent node */
-            codes_mapping_get_lp_id(lp_group_name, LP_CONFIG_NM, s->anno, 0,
-                    s->parent_node_id/num_lps, (s->parent_node_id % num_lps),
-                    &parent_nic_id);
-
-           /* send a message to the parent that the LP has entered the collective operation */
-            //e_new = codes_event_new(parent_nic_id, xfer_to_nic_time, lp);
-            //msg_new = tw_event_data(e_new);
-	    void * m_data;
-      	    e_new = model_net_method_event_new(parent_nic_id,
-              xfer_to_nic_time,
-              lp, DRAGONFLY, (void**)&msg_new, &m_data);
-	    
-            memcpy(msg_new, msg, sizeof(terminal_message));
-            msg_new->type = D_COLLECTIVE_FAN_IN;
-            msg_new->sender_node = s->node_id;
-
-            if (msg->remote_event_size_bytes){
-	        memcpy(m_data, model_net_method_get_edata(DRAGONFLY, msg),
-        	        msg->remote_event_size_bytes);
-      	   }
-	    
-            tw_event_send(e_new);
-      }
+            send_collective_event(s, msg, s->parent_gid,
+                    g_tw_lookahead + p->collective_level_delay,
+                    D_COLLECTIVE_FAN_IN, lp);
+            return;
+        }
 
-      /* root node starts off with the fan-out phase */
-      if(s->is_root && (s->num_fan_nodes == s->num_children))
-      {
-           bf->c2 = 1;
-           msg->saved_fan_nodes = s->num_fan_nodes-1;
-           s->num_fan_nodes = 0;
-           send_remote_event(s, bf, msg, lp);
+        /* root node starts off with the fan-out phase */
+        bf->c2 = 1;
+        send_remote_event(s, bf, msg, lp);
 
-           for( i = 0; i < s->num_children; i++ )
-           {
-                tw_lpid child_nic_id;
-                /* Do some computation and fan out immediate child nodes from the collective */
-                xfer_to_nic_time = g_tw_lookahead + COLLECTIVE_COMPUTATION_DELAY + LEVEL_DELAY + tw_rand_exponential(lp->rng, (double)LEVEL_DELAY/50);
-
-                /* get global LP ID of the child node */
-                codes_mapping_get_lp_id(lp_group_name, LP_CONFIG_NM, NULL, 1,
-                        s->children[i]/num_lps, (s->children[i] % num_lps),
-                        &child_nic_id);
-                //e_new = codes_event_new(child_nic_id, xfer_to_nic_time, lp);
-
-                //msg_new = tw_event_data(e_new);
-                void * m_data;
-	        e_new = model_net_method_event_new(child_nic_id,
-                xfer_to_nic_time,
-		lp, DRAGONFLY, (void**)&msg_new, &m_data);
-
-		memcpy(msg_new, msg, sizeof(terminal_message));
-	        if (msg->remote_event_size_bytes){
-	                memcpy(m_data, model_net_method_get_edata(DRAGONFLY, msg),
-        	               msg->remote_event_size_bytes);
-      		}
-		
-                msg_new->type = D_COLLECTIVE_FAN_OUT;
-                msg_new->sender_node = s->node_id;
-
-                tw_event_send(e_new);
-           }
-      }
+        for( i = 0; i < s->num_children; i++ )
+        {
+            /* Do some computation and fan out immediate child nodes from the collective */
+            send_collective_event(s, msg, s->children[i],
+                    g_tw_lookahead + p->collective_computation_delay +
+                    p->collective_level_delay +
+                    tw_rand_exponential(lp->rng, p->collective_level_delay/50),
+                    D_COLLECTIVE_FAN_OUT, lp);
+        }
+}
+
+static void node_collective_init(terminal_state * s,
+                        tw_bf * bf,
+                        terminal_message * msg,
+                        tw_lp * lp)
+{
+        int slot;
+
+        /* collectives are started in the same order on every node, so the
+         * per-node sequence number identifies the collective */
+        msg->collective_id = s->collective_seq++;
+        slot = msg->collective_id % NUM_COLLECTIVES;
+
+        msg->saved_collective_init_time = s->collective_init_time[slot];
+        s->collective_init_time[slot] = tw_now(lp);
+	s->origin_svr[slot] = msg->sender_svr;
+
+        node_collective_arrive(s, bf, msg, lp);
+}
+
+static void node_collective_fan_in(terminal_state * s,
+                        tw_bf * bf,
+                        terminal_message * msg,
+                        tw_lp * lp)
+{
+        node_collective_arrive(s, bf, msg, lp);
 }
 
 static void node_collective_fan_out(terminal_state * s,
@@ -1211,57 +1926,27 @@ static void node_collective_fan_out(terminal_state * s,
                         tw_lp * lp)
 {
         int i;
-        int num_lps = codes_mapping_get_lp_count(lp_group_name, 1, LP_CONFIG_NM,
-                NULL, 1);
-        bf->c1 = 0;
-        bf->c2 = 0;
+        int slot = msg->collective_id % NUM_COLLECTIVES;
+        const dragonfly_param *p = s->params;
 
         send_remote_event(s, bf, msg, lp);
 
         if(!s->is_leaf)
         {
-            bf->c1 = 1;
-            tw_event* e_new;
-            terminal_message * msg_new;
-            tw_stime xfer_to_nic_time;
-
+           bf->c1 = 1;
            for( i = 0; i < s->num_children; i++ )
            {
-                xfer_to_nic_time = g_tw_lookahead + DRAGONFLY_FAN_OUT_DELAY + tw_rand_exponential(lp->rng, (double)DRAGONFLY_FAN_OUT_DELAY/10);
-
-                if(s->children[i] > 0)
-                {
-                        tw_lpid child_nic_id;
-
-                        /* get global LP ID of the child node */
-                        codes_mapping_get_lp_id(lp_group_name, LP_CONFIG_NM,
-                                s->anno, 0, s->children[i]/num_lps,
-                                (s->children[i] % num_lps), &child_nic_id);
-                        //e_new = codes_event_new(child_nic_id, xfer_to_nic_time, lp);
-                        //msg_new = tw_event_data(e_new);
-                        //memcpy(msg_new, msg, sizeof(nodes_message) + msg->remote_event_size_bytes);
-			void* m_data;
-			e_new = model_net_method_event_new(child_nic_id,
-							xfer_to_nic_time,
-					                lp, DRAGONFLY, (void**)&msg_new, &m_data);
-		        memcpy(msg_new, msg, sizeof(terminal_message));
-		        if (msg->remote_event_size_bytes){
-			        memcpy(m_data, model_net_method_get_edata(DRAGONFLY, msg),
-			                msg->remote_event_size_bytes);
-      			}
-
-
-                        msg_new->type = D_COLLECTIVE_FAN_OUT;
-                        msg_new->sender_node = s->node_id;
-                        tw_event_send(e_new);
-                }
+                send_collective_event(s, msg, s->children[i],
+                        g_tw_lookahead + p->collective_fan_out_delay +
+                        tw_rand_exponential(lp->rng, p->collective_fan_out_delay/10),
+                        D_COLLECTIVE_FAN_OUT, lp);
            }
          }
 	//printf("\n Fan out phase completed %ld ", lp->gid);
-        if(max_collective < tw_now(lp) - s->collective_init_time )
+        if(max_collective < tw_now(lp) - s->collective_init_time[slot] )
           {
               bf->c2 = 1;
-              max_collective = tw_now(lp) - s->collective_init_time;
+              max_collective = tw_now(lp) - s->collective_init_time[slot];
           }
 }
 
@@ -1275,6 +1960,12 @@ terminal_buf_update_rc(terminal_state * s,
     s->vc_occupancy[msg_indx]++;
     if(s->vc_occupancy[msg_indx] == s->params->cn_vc_size)
        s->output_vc_state[msg_indx] = VC_CREDIT;
+
+    if(bf->c1)
+    {
+       s->in_send_loop = 0;
+       codes_local_latency_reverse(lp);
+    }
 }
 
 /* update the compute node-router channel buffer */
@@ -1291,6 +1982,12 @@ terminal_buf_update(terminal_state * s,
     assert(s->vc_occupancy[msg_indx] >= 0);
     s->output_vc_state[msg_indx] = VC_IDLE;
 
+    /* restart sending if the injection queues were blocked on credits */
+    if(!s->in_send_loop && terminal_injq_select(s) != -1)
+    {
+       bf->c1 = 1;
+       terminal_start_send_loop(s, lp);
+    }
     return;
 }
 
@@ -1305,7 +2002,14 @@ terminal_event( terminal_state * s,
   switch(msg->type)
     {
     case T_GENERATE:
-       packet_generate(s,bf,msg,lp);
+       if(is_analytic(s->params, msg))
+          analytic_generate(s,bf,msg,lp);
+       else
+          packet_generate(s,bf,msg,lp);
+    break;
+    
+    case T_ANALYTIC_ARRIVE:
+        analytic_arrive(s,bf,msg,lp);
     break;
     
     case T_ARRIVE:
@@ -1347,18 +2051,61 @@ dragonfly_terminal_final( terminal_state * s,
 void dragonfly_router_final(router_state * s,
 		tw_lp * lp)
 {
-   free(s->global_channel);
+   const dragonfly_param *p = s->params;
+   int num_ports = p->radix / p->num_vcs;
+   int i, ret;
+
+   dragonfly_port_record *rec = calloc(num_ports, sizeof(*rec));
+   assert(rec);
+   for(i = 0; i < num_ports; i++)
+   {
+      rec[i].group_id = s->group_id;
+      rec[i].router_id = s->router_id % p->num_routers;
+      if(i < p->num_local_channels)
+      {
+         rec[i].port_type = LOCAL;
+         rec[i].port_index = i;
+      }
+      else if(i < p->num_local_channels + p->num_global_channels)
+      {
+         rec[i].port_type = GLOBAL;
+         rec[i].port_index = i - p->num_local_channels;
+      }
+      else
+      {
+         rec[i].port_type = TERMINAL;
+         rec[i].port_index = i - p->num_local_channels - p->num_global_channels;
+      }
+      rec[i].bytes = s->port_stats[i].bytes;
+      rec[i].chunks = s->port_stats[i].chunks;
+      rec[i].blocked_time = s->port_stats[i].blocked_time;
+      rec[i].peak_occupancy = s->port_stats[i].peak_occupancy;
+   }
+   /* account for VCs that are still waiting for credits */
+   for(i = 0; i < p->radix; i++)
+   {
+      if(s->output_vc_state[i] == VC_CREDIT)
+         rec[i / p->num_vcs].blocked_time += tw_now(lp) - s->credit_start_time[i];
+   }
+
+   ret = lp_io_write(lp->gid, "dragonfly-router-ports",
+           num_ports * sizeof(*rec), rec);
+   assert(ret == 0);
+
+   free(rec);
+   /* base of the per-port block */
+   free(s->next_output_available_time);
 }
 
 /* Get the number of hops for this particular path source and destination groups */
-int get_num_hops(int local_router_id,
+int get_num_hops(const dragonfly_param *p,
+		 int local_router_id,
 		 int dest_router_id,
-		 int num_routers,
 		 int non_min)
 {
+   int num_routers = p->num_routers;
    int local_grp_id = local_router_id / num_routers;
    int dest_group_id = dest_router_id / num_routers;
-   int num_hops = 4;
 
    /* Already at the destination router */
    if(local_router_id == dest_router_id)
@@ -1367,21 +2114,18 @@ int get_num_hops(int local_router_id,
     }
    else if(local_grp_id == dest_group_id)
     {
-		return 2; /* in the same group, each router is connected so 2 additional hops to traverse (source and dest routers). */		
+		/* in the same group, the local hops plus the destination router */
+		return 1 + get_local_hops(p, local_router_id, dest_router_id);
     }	
 
-     /* if the router in the source group has direct connection to the destination group */
+     /* local hops to the router in the source group that has a direct connection to the destination group */
      tw_lpid src_connecting_router = getRouterFromGroupID(dest_group_id, local_grp_id, num_routers);
 
-     if(src_connecting_router == local_router_id)		
-		num_hops--;
-
+     /* local hops from the router in the destination group that connects to the source group */
      tw_lpid dest_connecting_router = getRouterFromGroupID(local_grp_id, dest_group_id, num_routers);	
 
-     if(dest_connecting_router == dest_router_id)	
-			num_hops--;
-
-     return num_hops;
+     return 2 + get_local_hops(p, local_router_id, src_connecting_router) +
+         get_local_hops(p, dest_connecting_router, dest_router_id);
 }
 
 /* get the next stop for the current packet
@@ -1394,7 +2138,8 @@ get_next_stop(router_state * s,
 		      tw_lp * lp, 
 		      int path,
 		      int dest_router_id,
-		      int intm_id)
+		      int intm_id,
+		      int intm_rtr_sel)
 {
    int dest_lp;
    tw_lpid router_dest_id = -1;
@@ -1458,6 +2203,11 @@ get_next_stop(router_state * s,
           }
       }
    }
+  /* routers of a 2D group are not all directly connected, find the next
+   * router within the group on the way to dest_lp */
+  if(s->params->intra_grp_topo == INTRA_GRP_2D &&
+          dest_lp / s->params->num_routers == s->group_id)
+      dest_lp = get_intra_group_hop(s, msg, dest_lp, intm_rtr_sel);
   codes_mapping_get_lp_id(lp_group_name, "dragonfly_router", s->anno, 0, dest_lp/num_routers_per_mgrp,
           dest_lp % num_routers_per_mgrp, &router_dest_id);
   return router_dest_id;
@@ -1479,7 +2229,7 @@ get_output_port( router_state * s,
 
   if(next_stop == msg->dest_terminal_id)
    {
-      output_port = s->params->num_routers + s->params->num_global_channels +
+      output_port = s->params->num_local_channels + s->params->num_global_channels +
           ( terminal_id % s->params->num_cn);
     }
     else
@@ -1494,12 +2244,12 @@ get_output_port( router_state * s,
         for(i=0; i < s->params->num_global_channels; i++)
          {
            if(s->global_channel[i] == local_router_id)
-             output_port = s->params->num_routers + i;
+             output_port = s->params->num_local_channels + i;
           }
       }
       else
        {
-        output_port = local_router_id % s->params->num_routers;
+        output_port = get_local_port(s->params, s->router_id, local_router_id);
        }
 //	      printf("\n output port not found %d next stop %d local router id %d group id %d intm grp id %d %d", output_port, next_stop, local_router_id, s->group_id, intm_grp_id, local_router_id%num_routers);
     }
@@ -1513,15 +2263,16 @@ static int do_adaptive_routing( router_state * s,
 				 terminal_message * msg,
 				 tw_lp * lp,
 				 int dest_router_id,
-				 int intm_id)
+				 int intm_id,
+				 int intm_rtr_sel)
 {
     int next_stop;
     int minimal_out_port = -1, nonmin_out_port = -1;
      // decide which routing to take
     // get the queue occupancy of both the minimal and non-minimal output ports 
-    int minimal_next_stop=get_next_stop(s, bf, msg, lp, MINIMAL, dest_router_id, -1);
+    int minimal_next_stop=get_next_stop(s, bf, msg, lp, MINIMAL, dest_router_id, -1, intm_rtr_sel);
     minimal_out_port = get_output_port(s, bf, msg, lp, minimal_next_stop);
-    int nonmin_next_stop = get_next_stop(s, bf, msg, lp, NON_MINIMAL, dest_router_id, intm_id);
+    int nonmin_next_stop = get_next_stop(s, bf, msg, lp, NON_MINIMAL, dest_router_id, intm_id, intm_rtr_sel);
     nonmin_out_port = get_output_port(s, bf, msg, lp, nonmin_next_stop);
     int nonmin_port_count = s->vc_occupancy[nonmin_out_port];
     int min_port_count = s->vc_occupancy[minimal_out_port];
@@ -1531,14 +2282,14 @@ static int do_adaptive_routing( router_state * s,
 //    printf("\n min output port %d nonmin output port %d ", minimal_next_stop, nonmin_next_stop);
     // Now get the expected number of hops to be traversed for both routes 
     int dest_group_id = dest_router_id / s->params->num_routers;
-    int num_min_hops = get_num_hops(s->router_id, dest_router_id, s->params->num_routers, 0);
+    int num_min_hops = get_num_hops(s->params, s->router_id, dest_router_id, 0);
 
     int intm_router_id = getRouterFromGroupID(intm_id, s->router_id / s->params->num_routers, s->params->num_routers);
 
     //printf("\n source %d Intm router id is %d dest router id %d ", s->router_id, intm_router_id, dest_router_id);
-    int num_nonmin_hops = get_num_hops(s->router_id, intm_router_id, s->params->num_routers, 1) + get_num_hops(intm_router_id, dest_router_id, s->params->num_routers, 1);
+    int num_nonmin_hops = get_num_hops(s->params, s->router_id, intm_router_id, 1) + get_num_hops(s->params, intm_router_id, dest_router_id, 1);
 
-    assert(num_nonmin_hops <= 6);
+    assert(num_nonmin_hops <= 3 * (1 + s->params->local_diameter));
 
    /* average the local queues of the router */
    unsigned int q_avg = 0;
@@ -1589,6 +2340,11 @@ static void router_packet_send_rc( router_state * s,
 		     	    terminal_message * msg, 
 			    tw_lp * lp)
 {
+	/* intermediate group and intra-group detour selection */
+	tw_rand_reverse_unif(lp->rng);
+	if(s->params->intra_grp_topo == INTRA_GRP_2D)
+	   tw_rand_reverse_unif(lp->rng);
+
 	if(bf->c1)
 	   return;
 	   
@@ -1611,6 +2367,14 @@ static void router_packet_send_rc( router_state * s,
 	s->next_output_available_time[output_port] = msg->saved_available_time;
 	s->vc_occupancy[output_chan]--;
 	s->output_vc_state[output_chan]=VC_IDLE;
+
+	dragonfly_port_stats *ps = &s->port_stats[output_port];
+	ps->bytes -= get_chunk_bytes(s->params, msg);
+	ps->chunks--;
+	if(bf->c4)
+	   ps->peak_occupancy = msg->saved_peak_occupancy;
+	if(bf->c5)
+	   s->credit_start_time[output_chan] = msg->saved_credit_start;
 }
 
 /* routes the current packet to the next stop */
@@ -1635,7 +2399,7 @@ static void router_packet_send( router_state * s,
    terminal_message *m;
 
    int next_stop = -1, output_port = -1, output_chan = -1;
-   float bandwidth = s->params->local_bandwidth;
+   float bandwidth;
 
    uint64_t num_chunks = msg->packet_size/s->params->chunk_size;
    if(msg->packet_size % s->params->chunk_size)
@@ -1652,16 +2416,22 @@ static void router_packet_send( router_state * s,
    if(intm_id == local_grp_id) 
 	intm_id = (local_grp_id + 2) % s->params->num_groups;
 
+   /* one-hop neighbour for a non-minimal path within a 2D group */
+   int intm_rtr_sel = -1;
+   if(s->params->intra_grp_topo == INTRA_GRP_2D)
+	intm_rtr_sel = tw_rand_integer(lp->rng, 0,
+		s->params->num_local_neighbours > 0 ? s->params->num_local_neighbours - 1 : 0);
+
 /* progressive adaptive routing makes a check at every node/router at the source group to sense congestion. Once it does and decides on taking non-minimal path, it does not check any longer. */
    if(routing == PROG_ADAPTIVE
 	 && msg->path_type != NON_MINIMAL
 	 && local_grp_id == ( msg->origin_router_id / s->params->num_routers))
 	{
-		next_stop = do_adaptive_routing(s, bf, msg, lp, dest_router_id, intm_id);	
+		next_stop = do_adaptive_routing(s, bf, msg, lp, dest_router_id, intm_id, intm_rtr_sel);	
 	}
    else if(msg->last_hop == TERMINAL && routing == ADAPTIVE)
 	{
-		next_stop = do_adaptive_routing(s, bf, msg, lp, dest_router_id, intm_id);
+		next_stop = do_adaptive_routing(s, bf, msg, lp, dest_router_id, intm_id, intm_rtr_sel);
 	}
   else
    {
@@ -1670,7 +2440,7 @@ static void router_packet_send( router_state * s,
 
 	if(routing == MINIMAL || routing == NON_MINIMAL)	
 		msg->path_type = routing; /*defaults to the routing algorithm if we don't have adaptive routing here*/
-   	next_stop = get_next_stop(s, bf, msg, lp, msg->path_type, dest_router_id, intm_id);
+   	next_stop = get_next_stop(s, bf, msg, lp, msg->path_type, dest_router_id, intm_id, intm_rtr_sel);
    }
    output_port = get_output_port(s, bf, msg, lp, next_stop); 
    output_chan = output_port * s->params->num_vcs;
@@ -1679,15 +2449,15 @@ static void router_packet_send( router_state * s,
 
    assert(output_port != -1 && output_chan != -1 && output_port < s->params->radix);
    // Allocate output Virtual Channel
-  if(output_port >= s->params->num_routers && 
-          output_port < s->params->num_routers + s->params->num_global_channels)
+   bandwidth = get_port_bandwidth(s->params, output_port);
+  if(output_port >= s->params->num_local_channels && 
+          output_port < s->params->num_local_channels + s->params->num_global_channels)
   {
-	 bandwidth = s->params->global_bandwidth;
 	 global = 1;
 	 buf_size = s->params->global_vc_size;
   }
 
-  if(output_port >= s->params->num_routers + s->params->num_global_channels)
+  if(output_port >= s->params->num_local_channels + s->params->num_global_channels)
 	buf_size = s->params->cn_vc_size;
    
    if(s->vc_occupancy[output_chan] >= buf_size)
@@ -1731,6 +2501,17 @@ static void router_packet_send( router_state * s,
 	  m->intm_lp_id = lp->gid;
 	  s->vc_occupancy[output_chan]++;
 
+	  int was_blocked = (s->output_vc_state[output_chan] == VC_CREDIT);
+	  dragonfly_port_stats *ps = &s->port_stats[output_port];
+	  ps->bytes += get_chunk_bytes(s->params, msg);
+	  ps->chunks++;
+	  if(s->vc_occupancy[output_chan] > ps->peak_occupancy)
+	  {
+		bf->c4 = 1;
+		msg->saved_peak_occupancy = ps->peak_occupancy;
+		ps->peak_occupancy = s->vc_occupancy[output_chan];
+	  }
+
 	  if(routing == PROG_ADAPTIVE)
 	  {
 		  if(tw_now(lp) - s->cur_hist_start_time[output_chan] >= WINDOW_LENGTH)
@@ -1778,6 +2559,13 @@ static void router_packet_send( router_state * s,
 		s->output_vc_state[output_chan] = VC_CREDIT;
 	    }
 	  }
+	  /* start of a wait for credits */
+	  if(!was_blocked && s->output_vc_state[output_chan] == VC_CREDIT)
+	  {
+		bf->c5 = 1;
+		msg->saved_credit_start = s->credit_start_time[output_chan];
+		s->credit_start_time[output_chan] = tw_now(lp);
+	  }
 	  tw_event_send(e);
 	  return;
 }
@@ -1832,6 +2620,96 @@ static void router_packet_receive( router_state * s,
     return;
 }
 
+/* one hop of an analytically routed packet: the output port of the minimal
+ * path is reserved for the serialization time of the whole packet and the
+ * packet moves on once its head has crossed the link. Chunks routed to the
+ * port later queue up behind the reservation */
+static void router_analytic_send( router_state * s,
+			tw_bf * bf,
+			terminal_message * msg,
+			tw_lp * lp )
+{
+   const dragonfly_param *p = s->params;
+   tw_event *e;
+   terminal_message *m;
+   void *m_data;
+
+   codes_mapping_get_lp_info(msg->dest_terminal_id, lp_group_name,
+           &mapping_grp_id, NULL, &mapping_type_id, NULL, &mapping_rep_id,
+           &mapping_offset);
+   int num_lps = codes_mapping_get_lp_count(lp_group_name, 1, LP_CONFIG_NM,
+           s->anno, 0);
+   int dest_router_id = (mapping_offset + (mapping_rep_id * num_lps)) / p->num_routers;
+
+   int next_stop = get_next_stop(s, bf, msg, lp, MINIMAL, dest_router_id, -1, -1);
+   int output_port = get_output_port(s, bf, msg, lp, next_stop);
+   assert(output_port >= 0 && output_port < p->radix);
+   double bandwidth = get_port_bandwidth(p, output_port);
+
+   total_hops++;
+   msg->old_vc = output_port * p->num_vcs;
+   msg->saved_available_time = s->next_output_available_time[output_port];
+   tw_stime start = maxd(s->next_output_available_time[output_port], tw_now(lp));
+   s->next_output_available_time[output_port] = start +
+       (1/bandwidth) * msg->packet_size;
+
+   dragonfly_port_stats *ps = &s->port_stats[output_port];
+   ps->bytes += msg->packet_size;
+   ps->chunks += msg->num_chunks;
+
+   tw_stime ts = start - tw_now(lp) + g_tw_lookahead + 0.1 +
+       (1/bandwidth) * p->chunk_size;
+   // dest can be a router or a terminal, so we must check
+   if (next_stop == msg->dest_terminal_id){
+       e = model_net_method_event_new(next_stop, ts, lp, DRAGONFLY,
+               (void**)&m, &m_data);
+   }
+   else{
+       e = tw_event_new(next_stop, ts, lp);
+       m = tw_event_data(e);
+       m_data = m+1;
+   }
+   memcpy(m, msg, sizeof(terminal_message));
+   if (msg->remote_event_size_bytes){
+       memcpy(m_data, msg+1, msg->remote_event_size_bytes);
+   }
+
+   if(output_port >= p->num_local_channels &&
+           output_port < p->num_local_channels + p->num_global_channels)
+       m->last_hop = GLOBAL;
+   else
+       m->last_hop = LOCAL;
+   m->local_id = s->router_id;
+   m->intm_lp_id = lp->gid;
+   m->analytic_tail_time = s->next_output_available_time[output_port];
+   if(next_stop == msg->dest_terminal_id)
+   {
+       m->type = T_ANALYTIC_ARRIVE;
+       m->magic = terminal_magic_num;
+   }
+   else
+   {
+       m->type = R_ANALYTIC;
+       m->magic = router_magic_num;
+   }
+   tw_event_send(e);
+}
+
+static void router_analytic_send_rc( router_state * s,
+			tw_bf * bf,
+			terminal_message * msg,
+			tw_lp * lp )
+{
+   int output_port = msg->old_vc / s->params->num_vcs;
+
+   total_hops--;
+   s->next_output_available_time[output_port] = msg->saved_available_time;
+
+   dragonfly_port_stats *ps = &s->port_stats[output_port];
+   ps->bytes -= msg->packet_size;
+   ps->chunks -= msg->num_chunks;
+}
+
 /* sets up the router virtual channels, global channels, local channels, compute node channels */
 void router_setup(router_state * r, tw_lp * lp)
 {
@@ -1873,26 +2751,37 @@ void router_setup(router_state * r, tw_lp * lp)
    int i;
    int router_offset=(r->router_id % p->num_routers) * (p->num_global_channels / 2) + 1;
 
-   r->global_channel = (int*)malloc(p->num_global_channels * sizeof(int));
-   r->next_output_available_time = (tw_stime*)malloc(p->radix * sizeof(tw_stime));
-   r->next_credit_available_time = (tw_stime*)malloc(p->radix * sizeof(tw_stime));
-   r->cur_hist_start_time = (tw_stime*)malloc(p->radix * sizeof(tw_stime));
-   r->vc_occupancy = (int*)malloc(p->radix * sizeof(int));
-   r->output_vc_state = (int*)malloc(p->radix * sizeof(int));
-   r->cur_hist_num = (int*)malloc(p->radix * sizeof(int));
-   r->prev_hist_num = (int*)malloc(p->radix * sizeof(int));
-  
+   // one block for the per-port state, the arrays used when forwarding a
+   // chunk first, each starting on its own cache line
+   size_t times_sz = cache_align(p->radix * sizeof(tw_stime));
+   size_t ints_sz = cache_align(p->radix * sizeof(int));
+   size_t chan_sz = cache_align(p->num_global_channels * sizeof(int));
+   char * block = alloc_port_block(4 * times_sz + 4 * ints_sz + chan_sz +
+           (p->radix / p->num_vcs) * sizeof(dragonfly_port_stats));
+
+   r->next_output_available_time = (tw_stime*)block;
+   block += times_sz;
+   r->next_credit_available_time = (tw_stime*)block;
+   block += times_sz;
+   r->vc_occupancy = (int*)block;
+   block += ints_sz;
+   r->output_vc_state = (int*)block;
+   block += ints_sz;
+   r->cur_hist_start_time = (tw_stime*)block;
+   block += times_sz;
+   r->cur_hist_num = (int*)block;
+   block += ints_sz;
+   r->prev_hist_num = (int*)block;
+   block += ints_sz;
+   r->credit_start_time = (tw_stime*)block;
+   block += times_sz;
+   r->global_channel = (int*)block;
+   block += chan_sz;
+   r->port_stats = (dragonfly_port_stats*)block;
+
+   // credits, occupancy and history start zeroed
    for(i=0; i < p->radix; i++)
-    {
-       // Set credit & router occupancy
-	r->next_output_available_time[i]=0;
-        r->next_credit_available_time[i]=0;
-	r->cur_hist_start_time[i] = 0;
-        r->vc_occupancy[i]=0;
-	r->cur_hist_num[i] = 0;
-	r->prev_hist_num[i] = 0;
         r->output_vc_state[i]= VC_IDLE;
-    }
 
 #if DEBUG == 1
    printf("\n LP ID %d VC occupancy radix %d Router %d is connected to ", lp->gid, p->radix, r->router_id);
@@ -1930,22 +2819,16 @@ void router_buf_update_rc(
 	terminal_message * msg,
 	tw_lp * lp)
 {
-	uint64_t num_chunks = msg->packet_size/s->params->chunk_size;
-	if(msg->packet_size % s->params->chunk_size)
-	    num_chunks++;
-	
 	int msg_indx = msg->vc_index;
 	s->vc_occupancy[msg_indx]++;
 
-	int buf = s->params->local_vc_size;
-
-	if(msg->last_hop == GLOBAL)
-	 buf = s->params->global_vc_size;
-	else if(msg->last_hop == TERMINAL)
-	 buf = s->params->cn_vc_size;
-
-	if(s->vc_occupancy[msg_indx] >= buf * num_chunks)
+	/* the credit released a VC that was waiting in VC_CREDIT */
+	if(bf->c1)
+	{
+	  s->port_stats[msg_indx / s->params->num_vcs].blocked_time -=
+	      tw_now(lp) - s->credit_start_time[msg_indx];
 	  s->output_vc_state[msg_indx] = VC_CREDIT;
+	}
 }
 /* Update the buffer space associated with this router LP */
 void router_buf_update(router_state * s, tw_bf * bf, terminal_message * msg, tw_lp * lp)
@@ -1961,6 +2844,12 @@ void router_buf_update(router_state * s, tw_bf * bf, terminal_message * msg, tw_
 		printf(" %d ", s->vc_occupancy[i]);
 	}
     //assert(s->vc_occupancy[msg_indx] > 0);
+    if(s->output_vc_state[msg_indx] == VC_CREDIT)
+    {
+        bf->c1 = 1;
+        s->port_stats[msg_indx / s->params->num_vcs].blocked_time +=
+            tw_now(lp) - s->credit_start_time[msg_indx];
+    }
     s->vc_occupancy[msg_indx]--;
     s->output_vc_state[msg_indx] = VC_IDLE;
     return;
@@ -1983,6 +2872,10 @@ void router_event(router_state * s, tw_bf * bf, terminal_message * msg, tw_lp *
 	        router_buf_update(s, bf, msg, lp);
 	   break;
 
+	   case R_ANALYTIC:
+	        router_analytic_send(s, bf, msg, lp);
+	   break;
+
 	   default:
 		  printf("\n (%lf) [Router %d] Router Message type not supported %d dest terminal id %d packet ID %d ", tw_now(lp), (int)lp->gid, msg->type, (int)msg->dest_terminal_id, (int)msg->packet_ID);
 	   break;
@@ -1995,7 +2888,14 @@ void terminal_rc_event_handler(terminal_state * s, tw_bf * bf, terminal_message
    switch(msg->type)
    {
 	   case T_GENERATE:
-	        packet_generate_rc(s, bf, msg, lp);
+	        if(is_analytic(s->params, msg))
+	           analytic_generate_rc(s, bf, msg, lp);
+	        else
+	           packet_generate_rc(s, bf, msg, lp);
+           break;
+
+	   case T_ANALYTIC_ARRIVE:
+                analytic_arrive_rc(s, bf, msg, lp);
            break;
 	   
 	   case T_SEND:
@@ -2012,21 +2912,24 @@ void terminal_rc_event_handler(terminal_state * s, tw_bf * bf, terminal_message
 	
           case D_COLLECTIVE_INIT:
                 {
-                    s->collective_init_time = msg->saved_collective_init_time;
+                   int slot = msg->collective_id % NUM_COLLECTIVES;
+                   s->collective_seq--;
+                   s->collective_init_time[slot] = msg->saved_collective_init_time;
                 }
-          break;
-
+          /* fall through: the node's own contribution is undone like a
+             child's */
           case D_COLLECTIVE_FAN_IN:
                 {
                    int i;
-                   s->num_fan_nodes--;
+                   int slot = msg->collective_id % NUM_COLLECTIVES;
+                   s->num_fan_nodes[slot]--;
                    if(bf->c1)
                     {
-                        s->num_fan_nodes = msg->saved_fan_nodes;
+                        s->num_fan_nodes[slot] = msg->saved_fan_nodes;
                     }
                    if(bf->c2)
                      {
-                        s->num_fan_nodes = msg->saved_fan_nodes;
+                        s->num_fan_nodes[slot] = msg->saved_fan_nodes;
                         for( i = 0; i < s->num_children; i++ )
                             tw_rand_reverse_unif(lp->rng);
                      }
@@ -2064,6 +2967,10 @@ void router_rc_event_handler(router_state * s, tw_bf * bf, terminal_message * ms
 	    case R_BUFFER:
 	    	 router_buf_update_rc(s, bf, msg, lp);
 	    break;
+
+	    case R_ANALYTIC:
+	    	 router_analytic_send_rc(s, bf, msg, lp);
+	    break;
 	  
     }
 }
@@ -0,0 +1,1585 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Fat-tree (folded Clos) network model.
+ *
+ * The topology is a k-ary n-level fat-tree, generalized so that the switches
+ * of each level can have fewer up ports than down ports (oversubscription).
+ * Every switch has k down ports. A switch of level l < n has k / o_l up
+ * ports, where o_l is the oversubscription ratio of the level; the switches
+ * of the top level n only have down ports. Terminals attach to level 1.
+ *
+ * Switches are identified by the subtree they span (prefix, the terminals
+ * prefix * k^l ... (prefix + 1) * k^l - 1) and by the up ports taken on the
+ * way up from level 1 (lower, a mixed-radix number with one digit per level
+ * below). A packet goes up until it reaches a switch whose subtree contains
+ * the destination and then follows the unique path down.
+ *
+ * Packets are forwarded with virtual cut-through at packet granularity:
+ * a packet reaches the next hop once chunk_size bytes have been serialized,
+ * while the output port stays busy for the whole packet. Each switch input
+ * port has switch_buffer_size bytes of buffer space, tracked by the upstream
+ * port with credits that are returned once a packet has left the buffer. */
+
+#include <ross.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/jenkins-hash.h"
+#include "codes/quicklist.h"
+#include "codes/lp-io.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "codes/net/fattree.h"
+
+#define CREDIT_SIZE 8
+
+#define LP_CONFIG_NM (model_net_lp_config_names[FATTREE])
+#define LP_METHOD_NM (model_net_method_names[FATTREE])
+#define LP_SWITCH_NM "fattree_switch"
+
+/* alignment of the per-port state blocks */
+#define FATTREE_CACHE_LINE 64
+
+static double maxd(double a, double b) { return a < b ? b : a; }
+/* rounds a size up to a whole number of cache lines */
+static size_t cache_align(size_t sz)
+{
+    return (sz + FATTREE_CACHE_LINE - 1) & ~(size_t)(FATTREE_CACHE_LINE - 1);
+}
+
+typedef struct fattree_param fattree_param;
+/* annotation-specific parameters (unannotated entry occurs at the
+ * last index) */
+static uint64_t                  num_params = 0;
+static fattree_param           * all_params = NULL;
+static const config_anno_map_t * anno_map   = NULL;
+
+/* terminal and switch magic numbers */
+static int terminal_magic_num = 0;
+static int switch_magic_num = 0;
+
+/* routing of the packets on their way up */
+enum fattree_routing
+{
+    FT_ROUTE_DMODK, /* up port selected by the destination */
+    FT_ROUTE_ECMP, /* up port selected by a hash of source and destination */
+    FT_ROUTE_ADAPTIVE /* least occupied up port */
+};
+
+struct fattree_param
+{
+    // configuration parameters
+    int num_levels; /* switch levels (n) */
+    int switch_radix; /* down ports of a switch (k) */
+    double link_bandwidth; /* bandwidth of the switch-switch links */
+    double cn_bandwidth; /* bandwidth of the terminal-switch links */
+    double link_latency; /* latency of a link (ns) */
+    int chunk_size; /* bytes serialized before a packet reaches the next hop */
+    uint64_t switch_buffer_size; /* bytes of buffer per switch input port */
+    uint64_t injection_buffer_size; /* bytes queued at a terminal */
+    int routing;
+
+    // derived parameters, the per-level arrays are indexed by level 0..n
+    int *num_up; /* up ports of a switch of the level */
+    int *lower_count; /* combinations of up ports taken below the level */
+    int *level_offset; /* id of the first switch of the level */
+    int total_terminals;
+    int total_switches;
+
+    /* routing tables, indexed by level * total_terminals + destination:
+     * the subtree of the level containing the destination, the down port
+     * towards it and its destination-mod-k up port */
+    int *route_prefix;
+    int *route_down;
+    int *route_up;
+};
+
+typedef struct ft_queue_item ft_queue_item;
+typedef struct ft_terminal_state ft_terminal_state;
+typedef struct ft_switch_state ft_switch_state;
+typedef struct fattree_port_stats fattree_port_stats;
+typedef struct fattree_port_record fattree_port_record;
+
+/* a packet waiting for an output link, at a terminal or a switch port */
+struct ft_queue_item
+{
+    fattree_message msg;
+    /* remote and local events of the packet */
+    void * edata;
+    struct qlist_head ql;
+};
+
+/* fat-tree compute node data structure */
+struct ft_terminal_state
+{
+    unsigned long long packet_counter;
+    int terminal_id;
+
+    /* level 1 switch the terminal is attached to, and the down port of that
+     * switch leading to the terminal */
+    tw_lpid switch_gid;
+    int switch_port;
+
+    /* packets waiting for the terminal-switch link */
+    struct qlist_head injq;
+    uint64_t injq_bytes;
+    /* bytes sent to the switch which have not left its buffer yet */
+    uint64_t credit_used;
+    tw_stime terminal_available_time;
+    int in_send_loop; /* a T_SEND event is pending */
+    int sched_blocked; /* scheduler waits for room in the injection queue */
+
+    const char * anno;
+    const fattree_param *params;
+
+    struct mn_stats fattree_stats_array[CATEGORY_MAX];
+};
+
+/* traffic counters of a switch output port */
+struct fattree_port_stats
+{
+    uint64_t bytes; /* bytes forwarded */
+    uint64_t packets; /* packets forwarded */
+    tw_stime blocked_time; /* time spent waiting for credits */
+    uint64_t peak_queue_bytes; /* maximum bytes queued for the port */
+};
+
+/* on-disk layout of the per-port counters, one record per switch port,
+ * written to the "fattree-switch-ports" lp-io file. port_type is 0 for down
+ * ports and 1 for up ports */
+struct fattree_port_record
+{
+    int32_t level;
+    int32_t switch_index; /* switch index within the level */
+    int32_t port_type;
+    int32_t port_index;
+    uint64_t bytes;
+    uint64_t packets;
+    double blocked_time;
+    uint64_t peak_queue_bytes;
+};
+
+struct ft_switch_state
+{
+    int switch_id;
+    int level;
+    int prefix; /* subtree spanned by the switch */
+    int lower; /* up ports taken below the switch */
+    int num_ports; /* k down ports followed by the up ports */
+
+    /* all of the per-port arrays below are carved out of one cache-line
+       aligned block allocated in switch_init, based at next_available_time */
+    tw_stime *next_available_time;
+    tw_stime *blocked_start; /* start of a wait for credits, -1 if none */
+    uint64_t *credit_used; /* bytes in flight to or buffered downstream */
+    uint64_t *queue_bytes; /* bytes queued for the port */
+    int *in_send_loop; /* an S_SEND event is pending for the port */
+    int *peer_port; /* port of the neighbour the port is linked to */
+    tw_lpid *port_gid; /* neighbour (switch or terminal) of the port */
+    struct qlist_head *queue;
+    fattree_port_stats *port_stats;
+
+    const char * anno;
+    const fattree_param *params;
+};
+
+/* terminal and switch event types */
+enum ft_event_t
+{
+    T_GENERATE=1,
+    T_ARRIVE,
+    T_SEND,
+    T_BUFFER,
+    S_ARRIVE,
+    S_SEND,
+    S_BUFFER
+};
+
+static tw_stime         fattree_total_time = 0;
+static tw_stime         fattree_max_latency = 0;
+
+static long long       total_hops = 0;
+static long long       N_finished_packets = 0;
+
+/* returns the fattree message size */
+static int fattree_get_msg_sz(void)
+{
+    return sizeof(fattree_message);
+}
+
+/* parses a comma separated list of positive integers into vals (at most n
+ * entries), returns the number of entries read */
+static int parse_int_list(char * str, int * vals, int n)
+{
+    int i = 0;
+    char * token = strtok(str, ",");
+    while(token != NULL && i < n)
+    {
+        vals[i++] = atoi(token);
+        token = strtok(NULL, ",");
+    }
+    return i;
+}
+
+/* builds the per-level routing tables shared by all switches of a rank */
+static void fattree_build_tables(fattree_param *p)
+{
+    int k = p->switch_radix;
+    int n = p->num_levels;
+    int N = p->total_terminals;
+    int l, d, span = 1;
+
+    p->route_prefix = malloc((n + 1) * N * sizeof(int));
+    p->route_down = malloc((n + 1) * N * sizeof(int));
+    p->route_up = malloc((n + 1) * N * sizeof(int));
+    assert(p->route_prefix && p->route_down && p->route_up);
+
+    for(l = 0; l <= n; l++)
+    {
+        for(d = 0; d < N; d++)
+        {
+            p->route_prefix[l * N + d] = d / (span * (l ? k : 1));
+            p->route_down[l * N + d] = l ? (d / span) % k : 0;
+            p->route_up[l * N + d] = p->num_up[l] ?
+                (d / p->lower_count[l]) % p->num_up[l] : -1;
+        }
+        if(l)
+            span *= k;
+    }
+}
+
+static void fattree_read_config(const char * anno, fattree_param *params){
+    // shorthand
+    fattree_param *p = params;
+    char list_str[MAX_NAME_LENGTH];
+    int l;
+
+    configuration_get_value_int(&config, "PARAMS", "num_levels", anno,
+            &p->num_levels);
+    if(p->num_levels <= 0) {
+        p->num_levels = 2;
+        fprintf(stderr, "Number of fat-tree levels not specified, setting to %d\n",
+                p->num_levels);
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "switch_radix", anno,
+            &p->switch_radix);
+    if(p->switch_radix <= 0) {
+        p->switch_radix = 4;
+        fprintf(stderr, "Fat-tree switch radix not specified, setting to %d\n",
+                p->switch_radix);
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "chunk_size", anno,
+            &p->chunk_size);
+    if(p->chunk_size <= 0) {
+        p->chunk_size = 64;
+        fprintf(stderr, "Chunk size for packets is not specified, setting to %d\n", p->chunk_size);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_bandwidth", anno,
+            &p->link_bandwidth);
+    if(p->link_bandwidth <= 0) {
+        p->link_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of switch links not specified, setting to %lf\n", p->link_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "cn_bandwidth", anno,
+            &p->cn_bandwidth);
+    if(p->cn_bandwidth <= 0) {
+        p->cn_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_latency", anno,
+            &p->link_latency);
+    if(p->link_latency < 0)
+        p->link_latency = 0;
+
+    long buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "switch_buffer_size",
+            anno, &buf);
+    if(buf <= 0) {
+        buf = 32768;
+        fprintf(stderr, "Buffer size of switch ports not specified, setting to %ld\n", buf);
+    }
+    p->switch_buffer_size = buf;
+
+    buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "injection_buffer_size",
+            anno, &buf);
+    if(buf <= 0)
+        buf = p->switch_buffer_size;
+    p->injection_buffer_size = buf;
+
+    char routing_str[MAX_NAME_LENGTH];
+    routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "routing", anno, routing_str,
+            MAX_NAME_LENGTH);
+    if(routing_str[0] == '\0' || strcmp(routing_str, "d-mod-k") == 0 ||
+            strcmp(routing_str, "dmodk") == 0)
+        p->routing = FT_ROUTE_DMODK;
+    else if(strcmp(routing_str, "ecmp") == 0)
+        p->routing = FT_ROUTE_ECMP;
+    else if(strcmp(routing_str, "adaptive") == 0)
+        p->routing = FT_ROUTE_ADAPTIVE;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:routing: %s "
+                "(expected d-mod-k, ecmp or adaptive)\n", routing_str);
+
+    // per-level up ports from the oversubscription ratios of the levels
+    // below the top, a single ratio applies to all of them
+    int k = p->switch_radix;
+    int n = p->num_levels;
+    int *ratio = malloc((n + 1) * sizeof(int));
+    p->num_up = malloc((n + 1) * sizeof(int));
+    p->lower_count = malloc((n + 2) * sizeof(int));
+    p->level_offset = malloc((n + 2) * sizeof(int));
+    assert(ratio && p->num_up && p->lower_count && p->level_offset);
+    for(l = 0; l <= n; l++)
+        ratio[l] = 1;
+
+    list_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "oversubscription", anno,
+            list_str, MAX_NAME_LENGTH);
+    if(list_str[0] != '\0' && n > 1)
+    {
+        int cnt = parse_int_list(list_str, &ratio[1], n - 1);
+        if(cnt == 1)
+            for(l = 2; l < n; l++)
+                ratio[l] = ratio[1];
+        else if(cnt != n - 1)
+            tw_error(TW_LOC, "PARAMS:oversubscription needs one ratio or one "
+                    "per level below the top (%d)\n", n - 1);
+    }
+
+    // a terminal has a single link to its level 1 switch
+    p->num_up[0] = 1;
+    for(l = 1; l <= n; l++)
+    {
+        if(l == n)
+        {
+            p->num_up[l] = 0;
+            continue;
+        }
+        if(ratio[l] <= 0 || k % ratio[l] != 0)
+            tw_error(TW_LOC, "oversubscription %d of level %d must divide the "
+                    "switch radix %d\n", ratio[l], l, k);
+        p->num_up[l] = k / ratio[l];
+    }
+    free(ratio);
+
+    // set the derived parameters
+    p->total_terminals = 1;
+    for(l = 0; l < n; l++)
+        p->total_terminals *= k;
+
+    int subtrees = p->total_terminals;
+    p->lower_count[0] = 1;
+    p->level_offset[0] = 0;
+    p->level_offset[1] = 0;
+    for(l = 1; l <= n; l++)
+    {
+        p->lower_count[l] = p->lower_count[l-1] * p->num_up[l-1];
+        subtrees /= k;
+        p->level_offset[l+1] = p->level_offset[l] +
+            subtrees * p->lower_count[l];
+    }
+    p->total_switches = p->level_offset[n+1];
+
+    fattree_build_tables(p);
+
+    printf("\n Fat-tree: total nodes %d switches %d levels %d radix %d ",
+            p->total_terminals, p->total_switches, n, k);
+}
+
+static void fattree_configure(){
+    anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
+    assert(anno_map);
+    num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
+    all_params = calloc(num_params, sizeof(*all_params));
+
+    for (uint64_t i = 0; i < anno_map->num_annos; i++){
+        const char * anno = anno_map->annotations[i].ptr;
+        fattree_read_config(anno, &all_params[i]);
+    }
+    if (anno_map->has_unanno_lp > 0){
+        fattree_read_config(NULL, &all_params[anno_map->num_annos]);
+    }
+}
+
+/* report fat-tree statistics like average and maximum packet latency,
+ * average number of hops traversed */
+static void fattree_report_stats()
+{
+    long long avg_hops, total_finished_packets;
+    tw_stime avg_time, max_time;
+
+    MPI_Reduce( &total_hops, &avg_hops, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &N_finished_packets, &total_finished_packets, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &fattree_total_time, &avg_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &fattree_max_latency, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    /* print statistics */
+    if(!g_tw_mynode && total_finished_packets)
+    {
+        printf("\n total finished packets %lld ", total_finished_packets);
+        printf(" Average number of hops traversed %f average message latency %lf us maximum message latency %lf us \n",
+                (float)avg_hops/total_finished_packets,
+                avg_time/(total_finished_packets*1000), max_time/1000);
+    }
+}
+
+/* collectives are not supported by the fat-tree model */
+static void fattree_collective()
+{
+    return;
+}
+
+static void fattree_collective_rc()
+{
+    return;
+}
+
+/* fattree packet event, generates a fat-tree packet on the compute node */
+static tw_stime fattree_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
+{
+    tw_event * e_new;
+    tw_stime xfer_to_nic_time;
+    fattree_message * msg;
+    char* tmp_ptr;
+
+    xfer_to_nic_time = codes_local_latency(sender);
+    e_new = model_net_method_event_new(sender->gid, xfer_to_nic_time+offset,
+            sender, FATTREE, (void**)&msg, (void**)&tmp_ptr);
+    strcpy(msg->category, category);
+    msg->final_dest_gid = final_dest_lp;
+    msg->dest_terminal_gid = dest_mn_lp;
+    msg->sender_lp = src_lp;
+    msg->sender_mn_lp = sender->gid;
+    msg->packet_size = packet_size;
+    msg->remote_event_size_bytes = 0;
+    msg->local_event_size_bytes = 0;
+    msg->type = T_GENERATE;
+    msg->magic = terminal_magic_num;
+    msg->is_pull = is_pull;
+    msg->pull_size = pull_size;
+
+    if(is_last_pckt) /* Its the last packet so pass in remote and local event information*/
+    {
+        if(remote_event_size > 0)
+        {
+            msg->remote_event_size_bytes = remote_event_size;
+            memcpy(tmp_ptr, remote_event, remote_event_size);
+            tmp_ptr += remote_event_size;
+        }
+        if(self_event_size > 0)
+        {
+            msg->local_event_size_bytes = self_event_size;
+            memcpy(tmp_ptr, self_event, self_event_size);
+            tmp_ptr += self_event_size;
+        }
+    }
+    tw_event_send(e_new);
+    return xfer_to_nic_time;
+}
+
+/* fattree packet event reverse handler */
+static void fattree_packet_event_rc(tw_lp *sender)
+{
+    codes_local_latency_reverse(sender);
+    return;
+}
+
+/* copies a packet and its events into a new queue item */
+static ft_queue_item * queue_item_new(const fattree_message *msg,
+        const void *edata, int edata_size)
+{
+    ft_queue_item *item = malloc(sizeof(ft_queue_item));
+    assert(item);
+    memcpy(&item->msg, msg, sizeof(fattree_message));
+    item->edata = NULL;
+    if(edata_size > 0)
+    {
+        item->edata = malloc(edata_size);
+        assert(item->edata);
+        memcpy(item->edata, edata, edata_size);
+    }
+    return item;
+}
+
+static void queue_item_free(ft_queue_item *item)
+{
+    free(item->edata);
+    free(item);
+}
+
+/* bandwidth of the link attached to a switch port */
+static double get_port_bandwidth(const ft_switch_state *s, int port)
+{
+    if(s->level == 1 && port < s->params->switch_radix)
+        return s->params->cn_bandwidth;
+    return s->params->link_bandwidth;
+}
+
+/* time until the head of a packet has been serialized on a link */
+static tw_stime get_head_delay(const fattree_param *p, uint64_t size,
+        double bandwidth)
+{
+    uint64_t head = size < (uint64_t)p->chunk_size ? size : p->chunk_size;
+    return (1/bandwidth) * head;
+}
+
+/* schedules the next send on the terminal-switch link once the link is free */
+static void terminal_start_send_loop(ft_terminal_state * s, tw_lp * lp)
+{
+    tw_event *e;
+    fattree_message *m;
+    tw_stime ts;
+
+    s->in_send_loop = 1;
+    ts = maxd(s->terminal_available_time - tw_now(lp), 0.0) +
+        codes_local_latency(lp);
+    e = model_net_method_event_new(lp->gid, ts, lp, FATTREE,
+            (void**)&m, NULL);
+    m->type = T_SEND;
+    m->magic = terminal_magic_num;
+    tw_event_send(e);
+}
+
+static void packet_generate_rc(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    struct qlist_head *ent = qlist_pop_back(&s->injq);
+    assert(ent);
+    queue_item_free(qlist_entry(ent, ft_queue_item, ql));
+    s->injq_bytes -= msg->packet_size;
+    s->packet_counter--;
+
+    if(bf->c1)
+    {
+        s->in_send_loop = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c2)
+        codes_local_latency_reverse(lp);
+    if(bf->c3)
+        s->sched_blocked = 0;
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->fattree_stats_array);
+    stat->send_count--;
+    stat->send_bytes -= msg->packet_size;
+    stat->send_time -= (1/s->params->cn_bandwidth) * msg->packet_size;
+}
+
+/* generates a packet at the current fat-tree compute node and places it into
+ * the injection queue */
+static void packet_generate(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    const fattree_param *p = s->params;
+    int total_event_size;
+    uint32_t flow[2];
+
+    msg->packet_ID = s->packet_counter * p->total_terminals + s->terminal_id;
+    s->packet_counter++;
+    msg->travel_start_time = tw_now(lp);
+    msg->src_terminal_id = s->terminal_id;
+    msg->dest_terminal_id =
+        codes_mapping_get_lp_relative_id(msg->dest_terminal_gid, 0, 0);
+    msg->my_N_hop = 0;
+
+    /* all packets of a source-destination pair hash to the same up ports */
+    flow[0] = msg->src_terminal_id;
+    flow[1] = msg->dest_terminal_id;
+    msg->flow_hash = bj_hashlittle(flow, sizeof(flow), 0);
+
+    /* copy the packet along with its remote and local events into the
+     * injection queue, it is sent out of the queue by packet_send */
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    ft_queue_item *item = queue_item_new(msg,
+            model_net_method_get_edata(FATTREE, msg), edata_size);
+    qlist_add_tail(&item->ql, &s->injq);
+    s->injq_bytes += msg->packet_size;
+
+    if(!s->in_send_loop)
+    {
+        bf->c1 = 1;
+        terminal_start_send_loop(s, lp);
+    }
+
+    /* ask the scheduler for the next packet as long as the injection queue
+     * has room, otherwise wait until packet_send drains it */
+    if(s->injq_bytes < p->injection_buffer_size)
+    {
+        bf->c2 = 1;
+        model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->sched_blocked = 1;
+    }
+
+    total_event_size = model_net_get_msg_sz(FATTREE) +
+        msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->fattree_stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/p->cn_bandwidth) * msg->packet_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
+}
+
+static void packet_send_rc(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    if(bf->c1)
+    {
+        s->in_send_loop = 1;
+        return;
+    }
+
+    s->terminal_available_time = msg->saved_available_time;
+    s->credit_used -= msg->packet_size;
+    s->injq_bytes += msg->packet_size;
+
+    /* put the packet back at the queue head */
+    ft_queue_item *item = queue_item_new(msg,
+            model_net_method_get_edata(FATTREE, msg),
+            msg->remote_event_size_bytes + msg->local_event_size_bytes);
+    qlist_add(&item->ql, &s->injq);
+
+    if(bf->c2)
+    {
+        s->sched_blocked = 1;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c3)
+        s->in_send_loop = 1;
+}
+
+/* sends the packet at the head of the injection queue to the attached switch
+ * if the switch has buffer space for it */
+static void packet_send(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    const fattree_param *p = s->params;
+    tw_stime start, ts;
+    tw_event *e;
+    fattree_message *m;
+
+    ft_queue_item *item = qlist_empty(&s->injq) ? NULL :
+        qlist_entry(s->injq.next, ft_queue_item, ql);
+    if(item == NULL || (s->credit_used > 0 &&
+                s->credit_used + item->msg.packet_size > p->switch_buffer_size))
+    {
+        /* nothing to send or no buffer space at the switch, the loop is
+         * restarted by a new packet or a credit */
+        bf->c1 = 1;
+        s->in_send_loop = 0;
+        return;
+    }
+
+    /* the packet leaves the queue, keep a copy in the event for reverse
+     * computation */
+    qlist_pop(&s->injq);
+    memcpy(msg, &item->msg, sizeof(fattree_message));
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    if(edata_size > 0)
+        memcpy(model_net_method_get_edata(FATTREE, msg), item->edata,
+                edata_size);
+    msg->type = T_SEND;
+    msg->magic = terminal_magic_num;
+    msg->saved_available_time = s->terminal_available_time;
+
+    start = maxd(s->terminal_available_time, tw_now(lp));
+    s->terminal_available_time = start +
+        (1/p->cn_bandwidth) * msg->packet_size;
+    s->credit_used += msg->packet_size;
+    s->injq_bytes -= msg->packet_size;
+
+    // we are sending an event to the switch, so no method_event here
+    ts = start - tw_now(lp) + p->link_latency + g_tw_lookahead +
+        get_head_delay(p, msg->packet_size, p->cn_bandwidth);
+    e = tw_event_new(s->switch_gid, ts, lp);
+    m = tw_event_data(e);
+    memcpy(m, msg, sizeof(fattree_message));
+    if(msg->remote_event_size_bytes)
+        memcpy(m+1, item->edata, msg->remote_event_size_bytes);
+    m->type = S_ARRIVE;
+    m->magic = switch_magic_num;
+    m->in_port = s->switch_port;
+    m->local_event_size_bytes = 0;
+    tw_event_send(e);
+
+    /* local completion message, once the packet has left the terminal */
+    if(msg->local_event_size_bytes > 0)
+    {
+        e = tw_event_new(msg->sender_lp,
+                s->terminal_available_time - tw_now(lp), lp);
+        memcpy(tw_event_data(e),
+                (char*)item->edata + msg->remote_event_size_bytes,
+                msg->local_event_size_bytes);
+        tw_event_send(e);
+    }
+    queue_item_free(item);
+
+    /* the queue drained enough for the scheduler to hand over more packets */
+    if(s->sched_blocked && s->injq_bytes < p->injection_buffer_size)
+    {
+        bf->c2 = 1;
+        s->sched_blocked = 0;
+        model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+    }
+
+    /* keep sending at the link rate while there are queued packets */
+    if(!qlist_empty(&s->injq))
+    {
+        e = model_net_method_event_new(lp->gid,
+                s->terminal_available_time - tw_now(lp), lp, FATTREE,
+                (void**)&m, NULL);
+        m->type = T_SEND;
+        m->magic = terminal_magic_num;
+        tw_event_send(e);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->in_send_loop = 0;
+    }
+}
+
+static void packet_arrive_rc(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->fattree_stats_array);
+    stat->recv_count--;
+    stat->recv_bytes -= msg->packet_size;
+    stat->recv_time -= tw_now(lp) - msg->travel_start_time;
+
+    N_finished_packets--;
+    total_hops -= msg->my_N_hop;
+    fattree_total_time -= tw_now(lp) - msg->travel_start_time;
+    if(bf->c3)
+        fattree_max_latency = msg->saved_available_time;
+
+    codes_local_latency_reverse(lp);
+    if(msg->remote_event_size_bytes)
+    {
+        codes_local_latency_reverse(lp);
+        if(msg->is_pull)
+        {
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_rc(net_id, lp, msg->pull_size);
+        }
+    }
+}
+
+/* packet arrives at the destination terminal */
+static void packet_arrive(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    tw_event *e;
+    fattree_message *m;
+    tw_stime ts;
+
+    mn_stats* stat = model_net_find_stats(msg->category, s->fattree_stats_array);
+    stat->recv_count++;
+    stat->recv_bytes += msg->packet_size;
+    stat->recv_time += tw_now(lp) - msg->travel_start_time;
+
+    N_finished_packets++;
+    total_hops += msg->my_N_hop;
+    fattree_total_time += tw_now(lp) - msg->travel_start_time;
+    if(fattree_max_latency < tw_now(lp) - msg->travel_start_time)
+    {
+        bf->c3 = 1;
+        msg->saved_available_time = fattree_max_latency;
+        fattree_max_latency = tw_now(lp) - msg->travel_start_time;
+    }
+
+    /* the terminal consumes the packet right away, return the buffer space
+     * to the switch */
+    ts = (1/s->params->cn_bandwidth) * CREDIT_SIZE + s->params->link_latency +
+        codes_local_latency(lp);
+    e = tw_event_new(s->switch_gid, ts, lp);
+    m = tw_event_data(e);
+    m->magic = switch_magic_num;
+    m->type = S_BUFFER;
+    m->port = s->switch_port;
+    m->credit_bytes = msg->packet_size;
+    tw_event_send(e);
+
+    // Trigger an event on receiving server
+    if(msg->remote_event_size_bytes)
+    {
+        void * tmp_ptr = model_net_method_get_edata(FATTREE, msg);
+        ts = codes_local_latency(lp);
+        if (msg->is_pull){
+            struct codes_mctx mc_dst =
+                codes_mctx_set_global_direct(msg->sender_mn_lp);
+            struct codes_mctx mc_src =
+                codes_mctx_set_global_direct(lp->gid);
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_mctx(net_id, &mc_src, &mc_dst, msg->category,
+                    msg->sender_lp, msg->pull_size, ts,
+                    msg->remote_event_size_bytes, tmp_ptr, 0, NULL, lp);
+        }
+        else{
+            e = tw_event_new(msg->final_dest_gid, ts, lp);
+            memcpy(tw_event_data(e), tmp_ptr, msg->remote_event_size_bytes);
+            tw_event_send(e);
+        }
+    }
+}
+
+static void terminal_buf_update_rc(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    s->credit_used += msg->credit_bytes;
+    if(bf->c1)
+    {
+        s->in_send_loop = 0;
+        codes_local_latency_reverse(lp);
+    }
+}
+
+/* the switch has forwarded a packet of the terminal, freeing buffer space */
+static void terminal_buf_update(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    s->credit_used -= msg->credit_bytes;
+
+    /* restart sending if the injection queue was blocked on credits */
+    if(!s->in_send_loop && !qlist_empty(&s->injq))
+    {
+        bf->c1 = 1;
+        terminal_start_send_loop(s, lp);
+    }
+}
+
+/* initialize a fat-tree compute node terminal */
+static void terminal_init(ft_terminal_state * s,
+        tw_lp * lp)
+{
+    uint32_t h1 = 0, h2 = 0;
+    bj_hashlittle2(LP_METHOD_NM, strlen(LP_METHOD_NM), &h1, &h2);
+    terminal_magic_num = h1 + h2;
+
+    const char * anno = codes_mapping_get_annotation_by_lpid(lp->gid);
+    if (anno == NULL){
+        s->anno = NULL;
+        s->params = &all_params[num_params-1];
+    }
+    else{
+        s->anno = anno;
+        int id = configuration_get_annotation_index(anno, anno_map);
+        s->params = &all_params[id];
+    }
+    const fattree_param *p = s->params;
+
+    int num_terminals = codes_mapping_get_lp_count(NULL, 0, LP_CONFIG_NM,
+            NULL, 1);
+    if(num_terminals != p->total_terminals)
+        tw_error(TW_LOC, "Config error: %d fat-tree terminals configured, the "
+                "fat-tree with %d levels and radix %d has %d\n",
+                num_terminals, p->num_levels, p->switch_radix,
+                p->total_terminals);
+
+    s->terminal_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    s->switch_port = s->terminal_id % p->switch_radix;
+    s->switch_gid = codes_mapping_get_lpid_from_relative(
+            p->level_offset[1] + s->terminal_id / p->switch_radix, NULL,
+            LP_SWITCH_NM, NULL, 1);
+
+    s->packet_counter = 0;
+    s->terminal_available_time = 0.0;
+    s->injq_bytes = 0;
+    s->credit_used = 0;
+    s->in_send_loop = 0;
+    s->sched_blocked = 0;
+    INIT_QLIST_HEAD(&s->injq);
+}
+
+static void terminal_event(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == terminal_magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive(s, bf, msg, lp);
+            break;
+        case T_SEND:
+            packet_send(s, bf, msg, lp);
+            break;
+        case T_BUFFER:
+            terminal_buf_update(s, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n LP %d Terminal message type not supported %d ",
+                    (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a terminal event */
+static void terminal_rc_event_handler(ft_terminal_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate_rc(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive_rc(s, bf, msg, lp);
+            break;
+        case T_SEND:
+            packet_send_rc(s, bf, msg, lp);
+            break;
+        case T_BUFFER:
+            terminal_buf_update_rc(s, bf, msg, lp);
+            break;
+    }
+}
+
+static void fattree_terminal_final(ft_terminal_state * s,
+        tw_lp * lp)
+{
+    model_net_print_stats(lp->gid, s->fattree_stats_array);
+}
+
+/* returns 1 if the neighbour of the port has buffer space for the packet at
+ * the head of the port's queue. An empty buffer always takes a packet */
+static int switch_port_has_credit(const ft_switch_state * s, int port)
+{
+    ft_queue_item *item = qlist_entry(s->queue[port].next, ft_queue_item, ql);
+    return s->credit_used[port] == 0 ||
+        s->credit_used[port] + item->msg.packet_size <=
+        s->params->switch_buffer_size;
+}
+
+/* selects the output port of a packet from the routing tables */
+static int switch_route(const ft_switch_state * s,
+        const fattree_message * msg)
+{
+    const fattree_param *p = s->params;
+    int idx = s->level * p->total_terminals + msg->dest_terminal_id;
+    int num_up = p->num_up[s->level];
+    int up, i;
+
+    /* the destination is below this switch */
+    if(p->route_prefix[idx] == s->prefix)
+        return p->route_down[idx];
+
+    assert(num_up > 0);
+    switch(p->routing)
+    {
+        case FT_ROUTE_ECMP:
+            up = (msg->flow_hash / p->lower_count[s->level]) % num_up;
+            break;
+        case FT_ROUTE_ADAPTIVE:
+        {
+            /* least occupied up port, ties go to the destination-mod-k
+             * port and the ones following it */
+            int start = p->route_up[idx];
+            uint64_t best_load = 0;
+            up = -1;
+            for(i = 0; i < num_up; i++)
+            {
+                int u = (start + i) % num_up;
+                int port = p->switch_radix + u;
+                uint64_t load = s->credit_used[port] + s->queue_bytes[port];
+                if(up < 0 || load < best_load)
+                {
+                    up = u;
+                    best_load = load;
+                }
+            }
+            break;
+        }
+        default:
+            up = p->route_up[idx];
+            break;
+    }
+    return p->switch_radix + up;
+}
+
+/* schedules the next send on an output port once the port is free */
+static void switch_start_send_loop(ft_switch_state * s, int port, tw_lp * lp)
+{
+    tw_event *e;
+    fattree_message *m;
+    tw_stime ts;
+
+    s->in_send_loop[port] = 1;
+    ts = maxd(s->next_available_time[port] - tw_now(lp), 0.0) +
+        codes_local_latency(lp);
+    // switch self message - no need for method_event
+    e = tw_event_new(lp->gid, ts, lp);
+    m = tw_event_data(e);
+    m->type = S_SEND;
+    m->magic = switch_magic_num;
+    m->port = port;
+    tw_event_send(e);
+}
+
+static void switch_packet_arrive_rc(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+    struct qlist_head *ent = qlist_pop_back(&s->queue[port]);
+    assert(ent);
+    queue_item_free(qlist_entry(ent, ft_queue_item, ql));
+    s->queue_bytes[port] -= msg->packet_size;
+
+    if(bf->c1)
+        s->port_stats[port].peak_queue_bytes = msg->saved_peak_bytes;
+    if(bf->c2)
+    {
+        s->in_send_loop[port] = 0;
+        codes_local_latency_reverse(lp);
+    }
+}
+
+/* a packet arrives at the switch and is queued for its output port */
+static void switch_packet_arrive(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    int port = switch_route(s, msg);
+    msg->port = port;
+
+    ft_queue_item *item = queue_item_new(msg, msg+1,
+            msg->remote_event_size_bytes);
+    item->msg.my_N_hop++;
+    qlist_add_tail(&item->ql, &s->queue[port]);
+    s->queue_bytes[port] += msg->packet_size;
+
+    fattree_port_stats *ps = &s->port_stats[port];
+    if(s->queue_bytes[port] > ps->peak_queue_bytes)
+    {
+        bf->c1 = 1;
+        msg->saved_peak_bytes = ps->peak_queue_bytes;
+        ps->peak_queue_bytes = s->queue_bytes[port];
+    }
+
+    if(!s->in_send_loop[port])
+    {
+        bf->c2 = 1;
+        switch_start_send_loop(s, port, lp);
+    }
+}
+
+static void switch_packet_send_rc(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+
+    if(bf->c1)
+    {
+        s->in_send_loop[port] = 1;
+        return;
+    }
+    if(bf->c2)
+    {
+        s->in_send_loop[port] = 1;
+        s->blocked_start[port] = msg->saved_blocked_start;
+        return;
+    }
+
+    s->next_available_time[port] = msg->saved_available_time;
+    s->credit_used[port] -= msg->packet_size;
+    s->queue_bytes[port] += msg->packet_size;
+    s->port_stats[port].bytes -= msg->packet_size;
+    s->port_stats[port].packets--;
+    if(bf->c4)
+    {
+        s->blocked_start[port] = msg->saved_blocked_start;
+        s->port_stats[port].blocked_time -=
+            tw_now(lp) - msg->saved_blocked_start;
+    }
+
+    /* put the packet back at the queue head */
+    ft_queue_item *item = queue_item_new(msg, msg+1,
+            msg->remote_event_size_bytes);
+    qlist_add(&item->ql, &s->queue[port]);
+
+    if(bf->c3)
+        s->in_send_loop[port] = 1;
+}
+
+/* forwards the packet at the head of an output port's queue to the next hop
+ * and returns the buffer space it used to the previous hop */
+static void switch_packet_send(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    const fattree_param *p = s->params;
+    int port = msg->port;
+    tw_stime start, xmit, ts;
+    tw_event *e;
+    fattree_message *m;
+    void *m_data;
+
+    if(qlist_empty(&s->queue[port]))
+    {
+        bf->c1 = 1;
+        s->in_send_loop[port] = 0;
+        return;
+    }
+    if(!switch_port_has_credit(s, port))
+    {
+        /* wait for a credit from the next hop, which restarts the loop */
+        bf->c2 = 1;
+        s->in_send_loop[port] = 0;
+        msg->saved_blocked_start = s->blocked_start[port];
+        if(s->blocked_start[port] < 0)
+            s->blocked_start[port] = tw_now(lp);
+        return;
+    }
+
+    /* the packet leaves the queue, keep a copy in the event for reverse
+     * computation */
+    struct qlist_head *ent = qlist_pop(&s->queue[port]);
+    ft_queue_item *item = qlist_entry(ent, ft_queue_item, ql);
+    memcpy(msg, &item->msg, sizeof(fattree_message));
+    if(msg->remote_event_size_bytes)
+        memcpy(msg+1, item->edata, msg->remote_event_size_bytes);
+    queue_item_free(item);
+    msg->type = S_SEND;
+    msg->magic = switch_magic_num;
+    msg->port = port;
+    msg->saved_available_time = s->next_available_time[port];
+
+    /* the port is sending again, close a wait for credits that was not
+     * ended by the credit that restarted the loop */
+    if(s->blocked_start[port] >= 0)
+    {
+        bf->c4 = 1;
+        msg->saved_blocked_start = s->blocked_start[port];
+        s->port_stats[port].blocked_time +=
+            tw_now(lp) - s->blocked_start[port];
+        s->blocked_start[port] = -1;
+    }
+
+    double bandwidth = get_port_bandwidth(s, port);
+    start = maxd(s->next_available_time[port], tw_now(lp));
+    xmit = (1/bandwidth) * msg->packet_size;
+    s->next_available_time[port] = start + xmit;
+    s->credit_used[port] += msg->packet_size;
+    s->queue_bytes[port] -= msg->packet_size;
+    s->port_stats[port].bytes += msg->packet_size;
+    s->port_stats[port].packets++;
+
+    /* the next hop can be a switch or a terminal, the terminal only sees the
+     * packet once all of it has arrived */
+    if(s->level == 1 && port < p->switch_radix)
+    {
+        ts = start - tw_now(lp) + xmit + p->link_latency + g_tw_lookahead;
+        e = model_net_method_event_new(s->port_gid[port], ts, lp, FATTREE,
+                (void**)&m, &m_data);
+        memcpy(m, msg, sizeof(fattree_message));
+        m->type = T_ARRIVE;
+        m->magic = terminal_magic_num;
+    }
+    else
+    {
+        ts = start - tw_now(lp) + p->link_latency + g_tw_lookahead +
+            get_head_delay(p, msg->packet_size, bandwidth);
+        e = tw_event_new(s->port_gid[port], ts, lp);
+        m = tw_event_data(e);
+        m_data = m+1;
+        memcpy(m, msg, sizeof(fattree_message));
+        m->type = S_ARRIVE;
+        m->magic = switch_magic_num;
+        m->in_port = s->peer_port[port];
+    }
+    if(msg->remote_event_size_bytes)
+        memcpy(m_data, msg+1, msg->remote_event_size_bytes);
+    tw_event_send(e);
+
+    /* the packet has left the input buffer once it is fully transmitted */
+    int in = msg->in_port;
+    ts = start - tw_now(lp) + xmit + p->link_latency + g_tw_lookahead +
+        (1/get_port_bandwidth(s, in)) * CREDIT_SIZE;
+    if(s->level == 1 && in < p->switch_radix)
+    {
+        e = model_net_method_event_new(s->port_gid[in], ts, lp, FATTREE,
+                (void**)&m, NULL);
+        m->type = T_BUFFER;
+        m->magic = terminal_magic_num;
+    }
+    else
+    {
+        e = tw_event_new(s->port_gid[in], ts, lp);
+        m = tw_event_data(e);
+        m->type = S_BUFFER;
+        m->magic = switch_magic_num;
+    }
+    m->port = s->peer_port[in];
+    m->credit_bytes = msg->packet_size;
+    tw_event_send(e);
+
+    /* keep sending at the link rate while there are queued packets */
+    if(!qlist_empty(&s->queue[port]))
+    {
+        e = tw_event_new(lp->gid, s->next_available_time[port] - tw_now(lp),
+                lp);
+        m = tw_event_data(e);
+        m->type = S_SEND;
+        m->magic = switch_magic_num;
+        m->port = port;
+        tw_event_send(e);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->in_send_loop[port] = 0;
+    }
+}
+
+static void switch_buf_update_rc(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+
+    s->credit_used[port] += msg->credit_bytes;
+    if(bf->c1)
+    {
+        s->in_send_loop[port] = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c2)
+    {
+        s->blocked_start[port] = msg->saved_blocked_start;
+        s->port_stats[port].blocked_time -=
+            tw_now(lp) - msg->saved_blocked_start;
+    }
+}
+
+/* the next hop has freed buffer space, restart a port waiting for it */
+static void switch_buf_update(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+
+    assert(s->credit_used[port] >= msg->credit_bytes);
+    s->credit_used[port] -= msg->credit_bytes;
+
+    if(!s->in_send_loop[port] && !qlist_empty(&s->queue[port]) &&
+            switch_port_has_credit(s, port))
+    {
+        bf->c1 = 1;
+        switch_start_send_loop(s, port, lp);
+
+        if(s->blocked_start[port] >= 0)
+        {
+            bf->c2 = 1;
+            msg->saved_blocked_start = s->blocked_start[port];
+            s->port_stats[port].blocked_time +=
+                tw_now(lp) - s->blocked_start[port];
+            s->blocked_start[port] = -1;
+        }
+    }
+}
+
+/* sets up the ports of a switch and the neighbours they are linked to */
+static void switch_init(ft_switch_state * s, tw_lp * lp)
+{
+    uint32_t h1 = 0, h2 = 0;
+    bj_hashlittle2(LP_METHOD_NM, strlen(LP_METHOD_NM), &h1, &h2);
+    switch_magic_num = h1 + h2;
+
+    const char * anno = codes_mapping_get_annotation_by_lpid(lp->gid);
+    if (anno == NULL){
+        s->anno = NULL;
+        s->params = &all_params[num_params-1];
+    }
+    else{
+        s->anno = anno;
+        int id = configuration_get_annotation_index(anno, anno_map);
+        s->params = &all_params[id];
+    }
+
+    // shorthand
+    const fattree_param *p = s->params;
+    int k = p->switch_radix;
+    int i, l;
+
+    /* Checking for consistency of configuration */
+    int num_switches = codes_mapping_get_lp_count(NULL, 0, LP_SWITCH_NM,
+            NULL, 1);
+    if(num_switches != p->total_switches)
+        tw_error(TW_LOC, "Config error: %d fat-tree switches configured, the "
+                "fat-tree with %d levels and radix %d has %d\n",
+                num_switches, p->num_levels, k, p->total_switches);
+
+    s->switch_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    for(l = 1; s->switch_id >= p->level_offset[l+1]; l++)
+        ;
+    s->level = l;
+    int index = s->switch_id - p->level_offset[l];
+    s->prefix = index / p->lower_count[l];
+    s->lower = index % p->lower_count[l];
+    s->num_ports = k + p->num_up[l];
+
+    // one block for the per-port state, each array starting on its own
+    // cache line
+    int n = s->num_ports;
+    size_t times_sz = cache_align(n * sizeof(tw_stime));
+    size_t u64_sz = cache_align(n * sizeof(uint64_t));
+    size_t ints_sz = cache_align(n * sizeof(int));
+    size_t gid_sz = cache_align(n * sizeof(tw_lpid));
+    size_t queue_sz = cache_align(n * sizeof(struct qlist_head));
+    char * block;
+    if(posix_memalign((void**)&block, FATTREE_CACHE_LINE, 2 * times_sz +
+                2 * u64_sz + 2 * ints_sz + gid_sz + queue_sz +
+                n * sizeof(fattree_port_stats)) != 0)
+        tw_error(TW_LOC, "fattree: unable to allocate port state\n");
+
+    s->next_available_time = (tw_stime*)block;
+    block += times_sz;
+    s->blocked_start = (tw_stime*)block;
+    block += times_sz;
+    s->credit_used = (uint64_t*)block;
+    block += u64_sz;
+    s->queue_bytes = (uint64_t*)block;
+    block += u64_sz;
+    s->in_send_loop = (int*)block;
+    block += ints_sz;
+    s->peer_port = (int*)block;
+    block += ints_sz;
+    s->port_gid = (tw_lpid*)block;
+    block += gid_sz;
+    s->queue = (struct qlist_head*)block;
+    block += queue_sz;
+    s->port_stats = (fattree_port_stats*)block;
+
+    for(i = 0; i < n; i++)
+    {
+        s->next_available_time[i] = 0.0;
+        s->blocked_start[i] = -1;
+        s->credit_used[i] = 0;
+        s->queue_bytes[i] = 0;
+        s->in_send_loop[i] = 0;
+        INIT_QLIST_HEAD(&s->queue[i]);
+        memset(&s->port_stats[i], 0, sizeof(fattree_port_stats));
+    }
+
+    /* down ports: child c spans the subtree prefix * k + c and took the same
+     * up ports below this level, it reaches us through its up port given by
+     * our digit of lower */
+    for(i = 0; i < k; i++)
+    {
+        int child = s->prefix * k + i;
+        if(l == 1)
+        {
+            s->port_gid[i] = codes_mapping_get_lpid_from_relative(child,
+                    NULL, LP_CONFIG_NM, NULL, 1);
+            s->peer_port[i] = 0;
+        }
+        else
+        {
+            int lower = p->lower_count[l-1];
+            s->port_gid[i] = codes_mapping_get_lpid_from_relative(
+                    p->level_offset[l-1] + child * lower + s->lower % lower,
+                    NULL, LP_SWITCH_NM, NULL, 1);
+            s->peer_port[i] = k + s->lower / lower;
+        }
+    }
+    /* up ports: parent u spans our subtree's parent and adds u as the most
+     * significant digit of lower */
+    for(i = 0; i < p->num_up[l]; i++)
+    {
+        int parent_lower = i * p->lower_count[l] + s->lower;
+        s->port_gid[k + i] = codes_mapping_get_lpid_from_relative(
+                p->level_offset[l+1] + (s->prefix / k) * p->lower_count[l+1] +
+                parent_lower, NULL, LP_SWITCH_NM, NULL, 1);
+        s->peer_port[k + i] = s->prefix % k;
+    }
+}
+
+static void switch_event(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == switch_magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case S_ARRIVE:
+            switch_packet_arrive(s, bf, msg, lp);
+            break;
+        case S_SEND:
+            switch_packet_send(s, bf, msg, lp);
+            break;
+        case S_BUFFER:
+            switch_buf_update(s, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n (%lf) [Switch %d] Switch message type not supported %d ",
+                    tw_now(lp), (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a switch event */
+static void switch_rc_event_handler(ft_switch_state * s,
+        tw_bf * bf,
+        fattree_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case S_ARRIVE:
+            switch_packet_arrive_rc(s, bf, msg, lp);
+            break;
+        case S_SEND:
+            switch_packet_send_rc(s, bf, msg, lp);
+            break;
+        case S_BUFFER:
+            switch_buf_update_rc(s, bf, msg, lp);
+            break;
+    }
+}
+
+static void fattree_switch_final(ft_switch_state * s,
+        tw_lp * lp)
+{
+    const fattree_param *p = s->params;
+    int i, ret;
+
+    fattree_port_record *rec = calloc(s->num_ports, sizeof(*rec));
+    assert(rec);
+    for(i = 0; i < s->num_ports; i++)
+    {
+        rec[i].level = s->level;
+        rec[i].switch_index = s->switch_id - p->level_offset[s->level];
+        rec[i].port_type = i >= p->switch_radix;
+        rec[i].port_index = i < p->switch_radix ? i : i - p->switch_radix;
+        rec[i].bytes = s->port_stats[i].bytes;
+        rec[i].packets = s->port_stats[i].packets;
+        rec[i].blocked_time = s->port_stats[i].blocked_time;
+        /* account for ports that are still waiting for credits */
+        if(s->blocked_start[i] >= 0)
+            rec[i].blocked_time += tw_now(lp) - s->blocked_start[i];
+        rec[i].peak_queue_bytes = s->port_stats[i].peak_queue_bytes;
+
+        while(!qlist_empty(&s->queue[i]))
+            queue_item_free(qlist_entry(qlist_pop(&s->queue[i]),
+                        ft_queue_item, ql));
+    }
+
+    ret = lp_io_write(lp->gid, "fattree-switch-ports",
+            s->num_ports * sizeof(*rec), rec);
+    assert(ret == 0);
+
+    free(rec);
+    /* base of the per-port block */
+    free(s->next_available_time);
+}
+
+/* fat-tree compute node and switch LP types */
+static tw_lptype fattree_lps[] =
+{
+    // Terminal handling functions
+    {
+        (init_f)terminal_init,
+        (pre_run_f) NULL,
+        (event_f) terminal_event,
+        (revent_f) terminal_rc_event_handler,
+        (final_f) fattree_terminal_final,
+        (map_f) codes_mapping,
+        sizeof(ft_terminal_state)
+    },
+    {
+        (init_f) switch_init,
+        (pre_run_f) NULL,
+        (event_f) switch_event,
+        (revent_f) switch_rc_event_handler,
+        (final_f) fattree_switch_final,
+        (map_f) codes_mapping,
+        sizeof(ft_switch_state),
+    },
+    {0},
+};
+
+/* returns the fattree lp type for lp registration */
+static const tw_lptype* fattree_get_cn_lp_type(void)
+{
+    return(&fattree_lps[0]);
+}
+
+static void fattree_register(tw_lptype *base_type) {
+    lp_type_register(LP_CONFIG_NM, base_type);
+    lp_type_register(LP_SWITCH_NM, &fattree_lps[1]);
+}
+
+/* data structure for fat-tree statistics */
+struct model_net_method fattree_method =
+{
+    .mn_configure = fattree_configure,
+    .mn_register = fattree_register,
+    .model_net_method_packet_event = fattree_packet_event,
+    .model_net_method_packet_event_rc = fattree_packet_event_rc,
+    .model_net_method_recv_msg_event = NULL,
+    .model_net_method_recv_msg_event_rc = NULL,
+    .mn_get_lp_type = fattree_get_cn_lp_type,
+    .mn_get_msg_sz = fattree_get_msg_sz,
+    .mn_report_stats = fattree_report_stats,
+    .mn_collective_call = fattree_collective,
+    .mn_collective_call_rc = fattree_collective_rc
+};
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
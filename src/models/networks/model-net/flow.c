@@ -0,0 +1,1383 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* flow-level (fluid) network model.
+ *
+ * Each packet handed to the model, a whole message with the fcfs-full
+ * scheduler, becomes a flow over the links of its path: the injection link
+ * of the source, the torus or dragonfly links of a minimal route and the
+ * ejection link of the destination. The flows share the link bandwidth with
+ * max-min fairness. The number of events of a flow does not depend on its
+ * size: a start event, a completion event per change of its rate and the
+ * arrival at the destination.
+ *
+ * All of the links and flows are kept by a single flow controller LP. When a
+ * flow starts or ends only the rates of the flows connected to it through
+ * shared links (the connected component of the flow-link graph) can change,
+ * so the controller recomputes the max-min rates of that component by
+ * progressive filling and reschedules the completion of the flows whose rate
+ * changed. A completion event carries the rate generation of its flow and is
+ * ignored once the rate has changed again.
+ *
+ * Rate changes are not reversible in floating point, so in optimistic mode
+ * the controller saves the previous rate and progress of each flow it
+ * changes, and the flows it retires, in an undo log. A rollback replays the
+ * log backwards, and entries older than GVT are dropped (freeing the retired
+ * flows) as the simulation advances. */
+
+#include <ross.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/jenkins-hash.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "codes/net/flow.h"
+
+#define LP_CONFIG_NM (model_net_lp_config_names[FLOW])
+#define LP_METHOD_NM (model_net_method_names[FLOW])
+#define LP_CONTROLLER_NM "flow_controller"
+
+#define FLOW_MAX_DIMS 16
+/* lower bound on a flow rate, keeps rounding errors of the progressive
+ * filling from stalling a flow */
+#define FLOW_MIN_RATE 1e-9
+
+static double maxd(double a, double b) { return a < b ? b : a; }
+
+typedef struct flow_param flow_param;
+/* annotation-specific parameters (unannotated entry occurs at the
+ * last index) */
+static uint64_t                  num_params = 0;
+static flow_param              * all_params = NULL;
+static const config_anno_map_t * anno_map   = NULL;
+
+/* terminal and controller magic numbers */
+static int terminal_magic_num = 0;
+static int controller_magic_num = 0;
+
+enum flow_topology
+{
+    FLOW_TORUS,
+    FLOW_DRAGONFLY
+};
+
+struct flow_param
+{
+    // configuration parameters
+    int topology;
+    double cn_bandwidth; /* bandwidth of the injection and ejection links */
+    double link_latency; /* latency of a link (ns) */
+
+    /* torus */
+    int n_dims;
+    int dim_length[FLOW_MAX_DIMS];
+    double dim_bandwidth[FLOW_MAX_DIMS];
+
+    /* dragonfly */
+    int num_routers; /* routers per group */
+    double local_bandwidth;
+    double global_bandwidth;
+
+    // derived parameters
+    int num_cn; /* compute nodes per router (dragonfly) */
+    int num_global_channels; /* global channels per router (dragonfly) */
+    int num_groups;
+    int total_routers; /* routers, or torus nodes */
+    int total_terminals;
+    int num_links;
+    int max_path; /* links of the longest route */
+};
+
+typedef struct fl_flow fl_flow;
+typedef struct fl_link fl_link;
+typedef struct fl_log_entry fl_log_entry;
+typedef struct flow_terminal_state flow_terminal_state;
+typedef struct flow_controller_state flow_controller_state;
+
+/* a flow and the packet it carries */
+struct fl_flow
+{
+    uint64_t id;
+    int slot;
+    int active; /* attached to the links of its path */
+
+    int num_hops;
+    int *path;
+
+    /* bytes sent by last_update and the rate since then, the completion
+     * scheduled for the current rate carries gen */
+    double size;
+    double sent;
+    double rate;
+    tw_stime last_update;
+    uint32_t gen;
+
+    /* scratch state of a rate computation */
+    unsigned stamp;
+    double new_rate;
+
+    /* the packet, delivered to the destination on completion */
+    flow_message msg;
+    void *edata;
+};
+
+/* a unidirectional link */
+struct fl_link
+{
+    double capacity;
+    /* slots of the flows crossing the link, in no particular order */
+    int num_flows;
+    int max_flows;
+    int *flows;
+
+    /* scratch state of a rate computation */
+    unsigned stamp;
+    double residual;
+    int unfrozen;
+};
+
+enum fl_log_kind
+{
+    FL_LOG_RATE, /* rate and progress of a flow before a rate change */
+    FL_LOG_RETIRE /* a completed flow, freed once the entry is older than GVT */
+};
+
+struct fl_log_entry
+{
+    tw_stime time;
+    int kind;
+    int slot;
+    double rate;
+    double sent;
+    tw_stime last_update;
+    uint32_t gen;
+};
+
+/* flow compute node data structure */
+struct flow_terminal_state
+{
+    int terminal_id;
+    tw_lpid controller_gid;
+
+    const char * anno;
+    const flow_param *params;
+
+    struct mn_stats flow_stats_array[CATEGORY_MAX];
+};
+
+struct flow_controller_state
+{
+    const char * anno;
+    const flow_param *params;
+
+    fl_link *links;
+
+    /* flow table, slots of completed flows are reused */
+    fl_flow **flows;
+    int num_slots;
+    int max_slots;
+    int *free_slots;
+    int num_free;
+    uint64_t next_flow_id;
+
+    /* scratch space of a rate computation */
+    unsigned stamp;
+    int *comp_links;
+    fl_flow **comp_flows;
+    fl_flow **link_flows;
+    int max_comp_flows;
+
+    /* undo log, used in optimistic mode only. The indices are absolute:
+     * log[0] holds entry log_first, the live entries are log_head ..
+     * log_end - 1 */
+    int state_saving;
+    fl_log_entry *log;
+    uint64_t log_first;
+    uint64_t log_head;
+    uint64_t log_end;
+    uint64_t max_log;
+};
+
+/* terminal and controller event types */
+enum flow_event_t
+{
+    T_GENERATE=1,
+    T_ARRIVE,
+    F_START,
+    F_DONE
+};
+
+static tw_stime         flow_total_time = 0;
+static tw_stime         flow_max_latency = 0;
+
+static long long       total_hops = 0;
+static long long       N_finished_packets = 0;
+static long long       N_rate_updates = 0;
+static long long       total_comp_flows = 0;
+
+/* returns the flow message size */
+static int flow_get_msg_sz(void)
+{
+    return sizeof(flow_message);
+}
+
+/* parses a comma separated list of up to n values, a single value applies
+ * to all of them. Returns the number of values read */
+static int read_dim_list(char *str, double *vals, int n)
+{
+    int i = 0;
+    char *token = strtok(str, ",");
+    while(token != NULL && i < n)
+    {
+        sscanf(token, "%lf", &vals[i++]);
+        token = strtok(NULL, ",");
+    }
+    if(token != NULL)
+        return -1;
+    if(i == 1)
+        for(; i < n; i++)
+            vals[i] = vals[0];
+    return i;
+}
+
+static void flow_read_torus_config(const char * anno, flow_param *p)
+{
+    char str[MAX_NAME_LENGTH];
+    double vals[FLOW_MAX_DIMS];
+    int i;
+
+    configuration_get_value_int(&config, "PARAMS", "n_dims", anno,
+            &p->n_dims);
+    if(p->n_dims <= 0 || p->n_dims > FLOW_MAX_DIMS)
+        tw_error(TW_LOC, "PARAMS:n_dims must be 1 .. %d, got %d\n",
+                FLOW_MAX_DIMS, p->n_dims);
+
+    str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "dim_length", anno, str,
+            MAX_NAME_LENGTH);
+    if(str[0] == '\0' || read_dim_list(str, vals, p->n_dims) != p->n_dims)
+        tw_error(TW_LOC, "PARAMS:dim_length needs n_dims (%d) values\n",
+                p->n_dims);
+    p->total_routers = 1;
+    p->max_path = 2;
+    for(i = 0; i < p->n_dims; i++)
+    {
+        p->dim_length[i] = (int)vals[i];
+        if(p->dim_length[i] <= 0)
+            tw_error(TW_LOC, "Invalid torus dimension specified "
+                    "(%d at pos %d)\n", p->dim_length[i], i);
+        p->total_routers *= p->dim_length[i];
+        p->max_path += p->dim_length[i] / 2;
+    }
+
+    /* link_bandwidth is either one value for all the dimensions or one value
+     * per dimension, as in the torus model */
+    str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "link_bandwidth", anno, str,
+            MAX_NAME_LENGTH);
+    if(str[0] == '\0') {
+        for(i = 0; i < p->n_dims; i++)
+            p->dim_bandwidth[i] = 2.0;
+        fprintf(stderr, "Link bandwidth not specified, setting to %lf\n",
+                p->dim_bandwidth[0]);
+    }
+    else if(read_dim_list(str, p->dim_bandwidth, p->n_dims) != p->n_dims)
+        tw_error(TW_LOC, "PARAMS:link_bandwidth needs 1 or n_dims (%d) "
+                "values\n", p->n_dims);
+    for(i = 0; i < p->n_dims; i++)
+        if(p->dim_bandwidth[i] <= 0)
+            tw_error(TW_LOC, "Invalid torus link bandwidth specified "
+                    "(%lf at pos %d)\n", p->dim_bandwidth[i], i);
+
+    if(p->cn_bandwidth <= 0)
+        for(i = 0; i < p->n_dims; i++)
+            p->cn_bandwidth = maxd(p->cn_bandwidth, p->dim_bandwidth[i]);
+
+    p->total_terminals = p->total_routers;
+    /* two links per dimension and node, plus injection and ejection */
+    p->num_links = p->total_routers * 2 * p->n_dims + 2 * p->total_terminals;
+}
+
+static void flow_read_dragonfly_config(const char * anno, flow_param *p)
+{
+    configuration_get_value_int(&config, "PARAMS", "num_routers", anno,
+            &p->num_routers);
+    if(p->num_routers <= 0) {
+        p->num_routers = 4;
+        fprintf(stderr, "Number of routers per group not specified, setting to %d\n",
+                p->num_routers);
+    }
+    if(p->num_routers < 2)
+        tw_error(TW_LOC, "PARAMS:num_routers must be at least 2, got %d\n",
+                p->num_routers);
+
+    configuration_get_value_double(&config, "PARAMS", "local_bandwidth", anno,
+            &p->local_bandwidth);
+    if(p->local_bandwidth <= 0) {
+        p->local_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of local channels not specified, setting to %lf\n", p->local_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "global_bandwidth", anno,
+            &p->global_bandwidth);
+    if(p->global_bandwidth <= 0) {
+        p->global_bandwidth = 4.7;
+        fprintf(stderr, "Bandwidth of global channels not specified, setting to %lf\n", p->global_bandwidth);
+    }
+
+    if(p->cn_bandwidth <= 0) {
+        p->cn_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
+    }
+
+    /* same balanced configuration as the dragonfly model */
+    p->num_cn = p->num_routers / 2;
+    p->num_global_channels = p->num_routers / 2;
+    p->num_groups = p->num_routers * p->num_global_channels + 1;
+    p->total_routers = p->num_groups * p->num_routers;
+    p->total_terminals = p->total_routers * p->num_cn;
+    /* local link to every router of the group (the one to the router itself
+     * is unused), global channels, injection and ejection */
+    p->num_links = 2 * p->total_terminals +
+        p->total_routers * (p->num_routers + p->num_global_channels);
+    p->max_path = 5;
+}
+
+static void flow_read_config(const char * anno, flow_param *params){
+    // shorthand
+    flow_param *p = params;
+
+    char topo_str[MAX_NAME_LENGTH];
+    topo_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "flow_topology", anno,
+            topo_str, MAX_NAME_LENGTH);
+    if(topo_str[0] == '\0' || strcmp(topo_str, "torus") == 0)
+        p->topology = FLOW_TORUS;
+    else if(strcmp(topo_str, "dragonfly") == 0)
+        p->topology = FLOW_DRAGONFLY;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:flow_topology: %s "
+                "(expected torus or dragonfly)\n", topo_str);
+
+    configuration_get_value_double(&config, "PARAMS", "link_latency", anno,
+            &p->link_latency);
+    if(p->link_latency < 0)
+        p->link_latency = 0;
+
+    configuration_get_value_double(&config, "PARAMS", "cn_bandwidth", anno,
+            &p->cn_bandwidth);
+
+    if(p->topology == FLOW_TORUS)
+        flow_read_torus_config(anno, p);
+    else
+        flow_read_dragonfly_config(anno, p);
+
+    printf("\n flow: %s total nodes %d links %d ",
+            p->topology == FLOW_TORUS ? "torus" : "dragonfly",
+            p->total_terminals, p->num_links);
+}
+
+static void flow_configure(){
+    anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
+    assert(anno_map);
+    num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
+    all_params = calloc(num_params, sizeof(*all_params));
+
+    for (uint64_t i = 0; i < anno_map->num_annos; i++){
+        const char * anno = anno_map->annotations[i].ptr;
+        flow_read_config(anno, &all_params[i]);
+    }
+    if (anno_map->has_unanno_lp > 0){
+        flow_read_config(NULL, &all_params[anno_map->num_annos]);
+    }
+}
+
+/* report flow statistics like average and maximum message latency,
+ * average number of links traversed */
+static void flow_report_stats()
+{
+    long long avg_hops, total_finished_packets;
+    long long total_rate_updates, total_comp;
+    tw_stime avg_time, max_time;
+
+    MPI_Reduce( &total_hops, &avg_hops, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &N_finished_packets, &total_finished_packets, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &N_rate_updates, &total_rate_updates, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &total_comp_flows, &total_comp, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &flow_total_time, &avg_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &flow_max_latency, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    /* print statistics */
+    if(!g_tw_mynode && total_finished_packets)
+    {
+        printf("\n total finished flows %lld ", total_finished_packets);
+        printf(" Average number of links traversed %f average message latency %lf us maximum message latency %lf us \n",
+                (float)avg_hops/total_finished_packets,
+                avg_time/(total_finished_packets*1000), max_time/1000);
+        if(total_rate_updates)
+            printf("\n RATE STATS: %lld rate computations, %f flows per computation ",
+                    total_rate_updates, (float)total_comp/total_rate_updates);
+    }
+}
+
+/* collectives are not supported by the flow model */
+static void flow_collective()
+{
+    return;
+}
+
+static void flow_collective_rc()
+{
+    return;
+}
+
+/* flow packet event, generates a flow on the compute node */
+static tw_stime flow_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
+{
+    tw_event * e_new;
+    tw_stime xfer_to_nic_time;
+    flow_message * msg;
+    char* tmp_ptr;
+
+    xfer_to_nic_time = codes_local_latency(sender);
+    e_new = model_net_method_event_new(sender->gid, xfer_to_nic_time+offset,
+            sender, FLOW, (void**)&msg, (void**)&tmp_ptr);
+    strcpy(msg->category, category);
+    msg->final_dest_gid = final_dest_lp;
+    msg->dest_terminal_gid = dest_mn_lp;
+    msg->sender_lp = src_lp;
+    msg->sender_mn_lp = sender->gid;
+    msg->packet_size = packet_size;
+    msg->remote_event_size_bytes = 0;
+    msg->local_event_size_bytes = 0;
+    msg->type = T_GENERATE;
+    msg->magic = terminal_magic_num;
+    msg->is_pull = is_pull;
+    msg->pull_size = pull_size;
+
+    if(is_last_pckt) /* Its the last packet so pass in remote and local event information*/
+    {
+        if(remote_event_size > 0)
+        {
+            msg->remote_event_size_bytes = remote_event_size;
+            memcpy(tmp_ptr, remote_event, remote_event_size);
+            tmp_ptr += remote_event_size;
+        }
+        if(self_event_size > 0)
+        {
+            msg->local_event_size_bytes = self_event_size;
+            memcpy(tmp_ptr, self_event, self_event_size);
+            tmp_ptr += self_event_size;
+        }
+    }
+    tw_event_send(e_new);
+    return xfer_to_nic_time;
+}
+
+/* flow packet event reverse handler */
+static void flow_packet_event_rc(tw_lp *sender)
+{
+    codes_local_latency_reverse(sender);
+    return;
+}
+
+/* returns the links of the minimal route from terminal src to terminal dst
+ * in path, and their number */
+static int flow_route(const flow_param *p, int src, int dst, int *path)
+{
+    int n = 0;
+    int T = p->total_terminals;
+
+    if(p->topology == FLOW_TORUS)
+    {
+        /* dimension-ordered, the shorter way around each ring. Link
+         * node * 2 n_dims + 2 dim + dir leaves the node in the positive
+         * (dir 0) or negative direction of the dimension */
+        int net_links = p->total_routers * 2 * p->n_dims;
+        int cur = src, stride = 1, d;
+
+        path[n++] = net_links + src;
+        for(d = 0; d < p->n_dims; d++)
+        {
+            int len = p->dim_length[d];
+            int c = (cur / stride) % len;
+            int t = (dst / stride) % len;
+            int delta = (t - c + len) % len;
+            int dir = delta <= len / 2 ? 0 : 1;
+            int steps = dir == 0 ? delta : len - delta;
+            while(steps-- > 0)
+            {
+                int next = dir == 0 ? (c + 1) % len : (c - 1 + len) % len;
+                path[n++] = cur * 2 * p->n_dims + 2 * d + dir;
+                cur += (next - c) * stride;
+                c = next;
+            }
+            stride *= len;
+        }
+        path[n++] = net_links + T + dst;
+    }
+    else
+    {
+        /* local - global - local. Global channel j = r * h + k of a group
+         * (router r, channel k) leads to the group j + 1 positions further,
+         * and arrives at its channel a h - 1 - j */
+        int a = p->num_routers;
+        int h = p->num_global_channels;
+        int g = p->num_groups;
+        int local_base = 2 * T;
+        int global_base = local_base + p->total_routers * a;
+        int cur = src / p->num_cn;
+        int dr = dst / p->num_cn;
+        int sg = cur / a, dg = dr / a;
+
+        path[n++] = src;
+        if(sg != dg)
+        {
+            int j = (dg - sg - 1 + g) % g;
+            int gw = sg * a + j / h;
+            if(cur != gw)
+                path[n++] = local_base + cur * a + gw % a;
+            path[n++] = global_base + gw * h + j % h;
+            cur = dg * a + (a * h - 1 - j) / h;
+        }
+        if(cur != dr)
+            path[n++] = local_base + cur * a + dr % a;
+        path[n++] = T + dst;
+    }
+    assert(n <= p->max_path);
+    return n;
+}
+
+/* returns the capacity of a link */
+static double flow_link_capacity(const flow_param *p, int l)
+{
+    int T = p->total_terminals;
+
+    if(p->topology == FLOW_TORUS)
+    {
+        int net_links = p->total_routers * 2 * p->n_dims;
+        if(l >= net_links)
+            return p->cn_bandwidth;
+        return p->dim_bandwidth[(l % (2 * p->n_dims)) / 2];
+    }
+    if(l < 2 * T)
+        return p->cn_bandwidth;
+    if(l < 2 * T + p->total_routers * p->num_routers)
+        return p->local_bandwidth;
+    return p->global_bandwidth;
+}
+
+static void link_add_flow(fl_link *l, int slot)
+{
+    if(l->num_flows == l->max_flows)
+    {
+        l->max_flows = l->max_flows ? 2 * l->max_flows : 4;
+        l->flows = realloc(l->flows, l->max_flows * sizeof(int));
+        assert(l->flows);
+    }
+    l->flows[l->num_flows++] = slot;
+}
+
+static void link_remove_flow(fl_link *l, int slot)
+{
+    int i;
+    for(i = 0; i < l->num_flows; i++)
+        if(l->flows[i] == slot)
+        {
+            l->flows[i] = l->flows[--l->num_flows];
+            return;
+        }
+    assert(0);
+}
+
+static void flow_attach(flow_controller_state *c, fl_flow *f)
+{
+    int i;
+    for(i = 0; i < f->num_hops; i++)
+        link_add_flow(&c->links[f->path[i]], f->slot);
+    f->active = 1;
+}
+
+static void flow_detach(flow_controller_state *c, fl_flow *f)
+{
+    int i;
+    for(i = 0; i < f->num_hops; i++)
+        link_remove_flow(&c->links[f->path[i]], f->slot);
+    f->active = 0;
+}
+
+static void flow_free(flow_controller_state *c, fl_flow *f)
+{
+    c->flows[f->slot] = NULL;
+    free(f->path);
+    free(f->edata);
+    free(f);
+}
+
+/* appends an entry to the undo log */
+static void log_push(flow_controller_state *c, tw_lp *lp, int kind,
+        const fl_flow *f)
+{
+    if(!c->state_saving)
+        return;
+    if(c->log_end - c->log_first == c->max_log)
+    {
+        c->max_log *= 2;
+        c->log = realloc(c->log, c->max_log * sizeof(*c->log));
+        assert(c->log);
+    }
+    fl_log_entry *e = &c->log[c->log_end - c->log_first];
+    e->time = tw_now(lp);
+    e->kind = kind;
+    e->slot = f->slot;
+    e->rate = f->rate;
+    e->sent = f->sent;
+    e->last_update = f->last_update;
+    e->gen = f->gen;
+    c->log_end++;
+}
+
+/* undoes the log entries from the end back to entry upto */
+static void log_undo(flow_controller_state *c, uint64_t upto)
+{
+    while(c->log_end > upto)
+    {
+        fl_log_entry *e = &c->log[--c->log_end - c->log_first];
+        fl_flow *f = c->flows[e->slot];
+        if(e->kind == FL_LOG_RETIRE)
+            flow_attach(c, f);
+        else
+        {
+            f->rate = e->rate;
+            f->sent = e->sent;
+            f->last_update = e->last_update;
+            f->gen = e->gen;
+        }
+    }
+}
+
+/* drops the log entries of events older than GVT, which can't be rolled
+ * back anymore, and frees the flows they retired */
+static void log_fossil_collect(flow_controller_state *c, tw_lp *lp)
+{
+    tw_stime gvt = lp->pe->GVT;
+
+    while(c->log_head < c->log_end &&
+            c->log[c->log_head - c->log_first].time < gvt)
+    {
+        fl_log_entry *e = &c->log[c->log_head - c->log_first];
+        if(e->kind == FL_LOG_RETIRE)
+        {
+            flow_free(c, c->flows[e->slot]);
+            c->free_slots[c->num_free++] = e->slot;
+        }
+        c->log_head++;
+    }
+    /* move the live entries to the front once half of the log is dead */
+    if(c->log_head - c->log_first > c->max_log / 2)
+    {
+        memmove(c->log, &c->log[c->log_head - c->log_first],
+                (c->log_end - c->log_head) * sizeof(*c->log));
+        c->log_first = c->log_head;
+    }
+}
+
+static int compare_flow_id(const void *a, const void *b)
+{
+    const fl_flow *fa = *(fl_flow * const *)a;
+    const fl_flow *fb = *(fl_flow * const *)b;
+    return fa->id < fb->id ? -1 : fa->id > fb->id;
+}
+
+static int compare_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* makes room for n flows in the scratch arrays */
+static void reserve_comp(flow_controller_state *c, int n)
+{
+    if(n <= c->max_comp_flows)
+        return;
+    while(c->max_comp_flows < n)
+        c->max_comp_flows *= 2;
+    c->comp_flows = realloc(c->comp_flows,
+            c->max_comp_flows * sizeof(fl_flow*));
+    c->link_flows = realloc(c->link_flows,
+            c->max_comp_flows * sizeof(fl_flow*));
+    assert(c->comp_flows && c->link_flows);
+}
+
+/* recomputes the max-min fair rates of the flows connected to the links of
+ * seed and reschedules the completion of the flows whose rate changed.
+ * The flows and links are processed in id order so that a computation
+ * repeated after a rollback gives the same rates. Returns the number of
+ * flows of the component */
+static int flow_update_rates(flow_controller_state *c, const fl_flow *seed,
+        tw_lp *lp)
+{
+    int num_links = 0, num_flows = 0, head = 0, i, j;
+    unsigned stamp = ++c->stamp;
+
+    /* breadth-first search over the links, through the flows sharing them */
+    for(i = 0; i < seed->num_hops; i++)
+    {
+        fl_link *l = &c->links[seed->path[i]];
+        if(l->stamp != stamp)
+        {
+            l->stamp = stamp;
+            c->comp_links[num_links++] = seed->path[i];
+        }
+    }
+    while(head < num_links)
+    {
+        fl_link *l = &c->links[c->comp_links[head++]];
+        for(i = 0; i < l->num_flows; i++)
+        {
+            fl_flow *f = c->flows[l->flows[i]];
+            if(f->stamp == stamp)
+                continue;
+            f->stamp = stamp;
+            reserve_comp(c, num_flows + 1);
+            c->comp_flows[num_flows++] = f;
+            for(j = 0; j < f->num_hops; j++)
+            {
+                fl_link *m = &c->links[f->path[j]];
+                if(m->stamp != stamp)
+                {
+                    m->stamp = stamp;
+                    c->comp_links[num_links++] = f->path[j];
+                }
+            }
+        }
+    }
+    qsort(c->comp_links, num_links, sizeof(int), compare_int);
+    qsort(c->comp_flows, num_flows, sizeof(fl_flow*), compare_flow_id);
+
+    /* progressive filling: the link with the smallest fair share fixes the
+     * rate of its remaining flows, which is taken off the other links */
+    for(i = 0; i < num_links; i++)
+    {
+        fl_link *l = &c->links[c->comp_links[i]];
+        l->residual = l->capacity;
+        l->unfrozen = l->num_flows;
+    }
+    for(i = 0; i < num_flows; i++)
+        c->comp_flows[i]->new_rate = -1;
+
+    int remaining = num_flows;
+    while(remaining > 0)
+    {
+        fl_link *best = NULL;
+        double share = 0;
+        for(i = 0; i < num_links; i++)
+        {
+            fl_link *l = &c->links[c->comp_links[i]];
+            if(l->unfrozen == 0)
+                continue;
+            double s = maxd(l->residual, 0) / l->unfrozen;
+            if(best == NULL || s < share)
+            {
+                best = l;
+                share = s;
+            }
+        }
+        assert(best);
+        share = maxd(share, FLOW_MIN_RATE);
+
+        int n = 0;
+        for(i = 0; i < best->num_flows; i++)
+        {
+            fl_flow *f = c->flows[best->flows[i]];
+            if(f->new_rate < 0)
+                c->link_flows[n++] = f;
+        }
+        qsort(c->link_flows, n, sizeof(fl_flow*), compare_flow_id);
+        for(i = 0; i < n; i++)
+        {
+            fl_flow *f = c->link_flows[i];
+            f->new_rate = share;
+            for(j = 0; j < f->num_hops; j++)
+            {
+                fl_link *m = &c->links[f->path[j]];
+                m->residual -= share;
+                m->unfrozen--;
+            }
+        }
+        remaining -= n;
+    }
+
+    /* bring the progress of the changed flows up to date and schedule their
+     * completion at the new rate */
+    for(i = 0; i < num_flows; i++)
+    {
+        fl_flow *f = c->comp_flows[i];
+        if(f->new_rate == f->rate)
+            continue;
+        log_push(c, lp, FL_LOG_RATE, f);
+        f->sent += f->rate * (tw_now(lp) - f->last_update);
+        f->last_update = tw_now(lp);
+        f->rate = f->new_rate;
+        f->gen++;
+
+        tw_event *e = tw_event_new(lp->gid,
+                maxd(f->size - f->sent, 0) / f->rate, lp);
+        flow_message *m = tw_event_data(e);
+        m->type = F_DONE;
+        m->magic = controller_magic_num;
+        m->slot = f->slot;
+        m->flow_id = f->id;
+        m->gen = f->gen;
+        tw_event_send(e);
+    }
+
+    N_rate_updates++;
+    total_comp_flows += num_flows;
+    return num_flows;
+}
+
+static void packet_generate_rc(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    codes_local_latency_reverse(lp);
+    codes_local_latency_reverse(lp);
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->flow_stats_array);
+    stat->send_count--;
+    stat->send_bytes -= msg->packet_size;
+    stat->send_time -= (1/s->params->cn_bandwidth) * msg->packet_size;
+}
+
+/* hands a new flow over to the controller and asks the scheduler for the
+ * next packet right away, the bandwidth of the compute node is shared by
+ * its flows through the injection link */
+static void packet_generate(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    const flow_param *p = s->params;
+    int total_event_size;
+    tw_event *e;
+    flow_message *m;
+
+    msg->travel_start_time = tw_now(lp);
+    msg->src_terminal_id = s->terminal_id;
+    msg->dest_terminal_id =
+        codes_mapping_get_lp_relative_id(msg->dest_terminal_gid, 0, 0);
+
+    e = tw_event_new(s->controller_gid, codes_local_latency(lp), lp);
+    m = tw_event_data(e);
+    memcpy(m, msg, sizeof(flow_message));
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    if(edata_size > 0)
+        memcpy(m+1, model_net_method_get_edata(FLOW, msg), edata_size);
+    m->type = F_START;
+    m->magic = controller_magic_num;
+    tw_event_send(e);
+
+    model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+
+    total_event_size = model_net_get_msg_sz(FLOW) +
+        msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->flow_stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/p->cn_bandwidth) * msg->packet_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
+}
+
+static void packet_arrive_rc(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->flow_stats_array);
+    stat->recv_count--;
+    stat->recv_bytes -= msg->packet_size;
+    stat->recv_time -= tw_now(lp) - msg->travel_start_time;
+
+    N_finished_packets--;
+    total_hops -= msg->num_hops;
+    flow_total_time -= tw_now(lp) - msg->travel_start_time;
+    if(bf->c3)
+        flow_max_latency = msg->saved_max_latency;
+
+    if(msg->remote_event_size_bytes)
+    {
+        codes_local_latency_reverse(lp);
+        if(msg->is_pull)
+        {
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_rc(net_id, lp, msg->pull_size);
+        }
+    }
+}
+
+/* the last byte of a flow arrives at the destination terminal */
+static void packet_arrive(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    tw_event *e;
+    tw_stime ts;
+
+    mn_stats* stat = model_net_find_stats(msg->category, s->flow_stats_array);
+    stat->recv_count++;
+    stat->recv_bytes += msg->packet_size;
+    stat->recv_time += tw_now(lp) - msg->travel_start_time;
+
+    N_finished_packets++;
+    total_hops += msg->num_hops;
+    flow_total_time += tw_now(lp) - msg->travel_start_time;
+    if(flow_max_latency < tw_now(lp) - msg->travel_start_time)
+    {
+        bf->c3 = 1;
+        msg->saved_max_latency = flow_max_latency;
+        flow_max_latency = tw_now(lp) - msg->travel_start_time;
+    }
+
+    // Trigger an event on receiving server
+    if(msg->remote_event_size_bytes)
+    {
+        void * tmp_ptr = model_net_method_get_edata(FLOW, msg);
+        ts = codes_local_latency(lp);
+        if (msg->is_pull){
+            struct codes_mctx mc_dst =
+                codes_mctx_set_global_direct(msg->sender_mn_lp);
+            struct codes_mctx mc_src =
+                codes_mctx_set_global_direct(lp->gid);
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_mctx(net_id, &mc_src, &mc_dst, msg->category,
+                    msg->sender_lp, msg->pull_size, ts,
+                    msg->remote_event_size_bytes, tmp_ptr, 0, NULL, lp);
+        }
+        else{
+            e = tw_event_new(msg->final_dest_gid, ts, lp);
+            memcpy(tw_event_data(e), tmp_ptr, msg->remote_event_size_bytes);
+            tw_event_send(e);
+        }
+    }
+}
+
+/* looks up the flow parameters of an LP by its annotation */
+static const flow_param * flow_get_params(tw_lp * lp, const char ** anno_out)
+{
+    const char * anno = codes_mapping_get_annotation_by_lpid(lp->gid);
+    *anno_out = anno;
+    if (anno == NULL)
+        return &all_params[num_params-1];
+    return &all_params[configuration_get_annotation_index(anno, anno_map)];
+}
+
+/* initialize a flow compute node terminal */
+static void terminal_init(flow_terminal_state * s,
+        tw_lp * lp)
+{
+    uint32_t h1 = 0, h2 = 0;
+    bj_hashlittle2(LP_METHOD_NM, strlen(LP_METHOD_NM), &h1, &h2);
+    terminal_magic_num = h1 + h2;
+    h1 = h2 = 0;
+    bj_hashlittle2(LP_CONTROLLER_NM, strlen(LP_CONTROLLER_NM), &h1, &h2);
+    controller_magic_num = h1 + h2;
+
+    s->params = flow_get_params(lp, &s->anno);
+    const flow_param *p = s->params;
+
+    int num_terminals = codes_mapping_get_lp_count(NULL, 0, LP_CONFIG_NM,
+            NULL, 1);
+    if(num_terminals != p->total_terminals)
+        tw_error(TW_LOC, "Config error: %d flow terminals configured, the "
+                "%s has %d\n", num_terminals,
+                p->topology == FLOW_TORUS ? "torus" : "dragonfly",
+                p->total_terminals);
+    if(codes_mapping_get_lp_count(NULL, 0, LP_CONTROLLER_NM, NULL, 1) != 1)
+        tw_error(TW_LOC, "Config error: the flow model needs exactly one "
+                "%s LP\n", LP_CONTROLLER_NM);
+
+    s->terminal_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    s->controller_gid = codes_mapping_get_lpid_from_relative(0, NULL,
+            LP_CONTROLLER_NM, NULL, 1);
+}
+
+static void terminal_event(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == terminal_magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive(s, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n LP %d Terminal message type not supported %d ",
+                    (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a terminal event */
+static void terminal_rc_event_handler(flow_terminal_state * s,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate_rc(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive_rc(s, bf, msg, lp);
+            break;
+    }
+}
+
+static void flow_terminal_final(flow_terminal_state * s,
+        tw_lp * lp)
+{
+    model_net_print_stats(lp->gid, s->flow_stats_array);
+}
+
+static void flow_start_rc(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    fl_flow *f = c->flows[msg->slot];
+
+    log_undo(c, msg->saved_log_end);
+    flow_detach(c, f);
+    flow_free(c, f);
+    if(bf->c1)
+        c->free_slots[c->num_free++] = msg->slot;
+    else
+        c->num_slots--;
+    c->next_flow_id--;
+
+    N_rate_updates--;
+    total_comp_flows -= msg->saved_comp_flows;
+}
+
+/* a flow starts: it is routed, attached to its links and the rates of the
+ * flows it shares links with are recomputed */
+static void flow_start(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    const flow_param *p = c->params;
+    int slot;
+
+    if(c->state_saving)
+        log_fossil_collect(c, lp);
+    msg->saved_log_end = c->log_end;
+
+    if(c->num_free > 0)
+    {
+        bf->c1 = 1;
+        slot = c->free_slots[--c->num_free];
+    }
+    else
+    {
+        if(c->num_slots == c->max_slots)
+        {
+            c->max_slots *= 2;
+            c->flows = realloc(c->flows, c->max_slots * sizeof(fl_flow*));
+            c->free_slots = realloc(c->free_slots,
+                    c->max_slots * sizeof(int));
+            assert(c->flows && c->free_slots);
+        }
+        slot = c->num_slots++;
+    }
+    msg->slot = slot;
+
+    fl_flow *f = malloc(sizeof(fl_flow));
+    assert(f);
+    f->id = c->next_flow_id++;
+    f->slot = slot;
+    f->path = malloc(p->max_path * sizeof(int));
+    assert(f->path);
+    f->num_hops = flow_route(p, msg->src_terminal_id, msg->dest_terminal_id,
+            f->path);
+    f->size = msg->packet_size;
+    f->sent = 0;
+    f->rate = 0;
+    f->last_update = tw_now(lp);
+    f->gen = 0;
+    f->stamp = 0;
+    memcpy(&f->msg, msg, sizeof(flow_message));
+    f->edata = NULL;
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    if(edata_size > 0)
+    {
+        f->edata = malloc(edata_size);
+        assert(f->edata);
+        memcpy(f->edata, msg+1, edata_size);
+    }
+    c->flows[slot] = f;
+    flow_attach(c, f);
+
+    msg->saved_comp_flows = flow_update_rates(c, f, lp);
+}
+
+static void flow_done_rc(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    if(bf->c1)
+        return;
+    log_undo(c, msg->saved_log_end);
+    N_rate_updates--;
+    total_comp_flows -= msg->saved_comp_flows;
+}
+
+/* the completion of a flow at its current rate, delivers the flow to the
+ * destination and shares its bandwidth among the remaining flows */
+static void flow_done(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    const flow_param *p = c->params;
+    tw_event *e;
+    tw_stime ts;
+    flow_message *m;
+    void *m_data;
+
+    if(c->state_saving)
+        log_fossil_collect(c, lp);
+
+    fl_flow *f = msg->slot < c->num_slots ? c->flows[msg->slot] : NULL;
+    if(f == NULL || f->id != msg->flow_id || !f->active ||
+            f->gen != msg->gen)
+    {
+        /* the rate of the flow has changed since */
+        bf->c1 = 1;
+        return;
+    }
+    msg->saved_log_end = c->log_end;
+
+    /* the last byte reaches the destination after the latency of the path,
+     * a path without latency still needs a nonzero offset to another LP */
+    ts = f->num_hops * p->link_latency;
+    if(ts <= 0)
+        ts = g_tw_lookahead;
+    e = model_net_method_event_new(f->msg.dest_terminal_gid, ts, lp, FLOW,
+            (void**)&m, &m_data);
+    memcpy(m, &f->msg, sizeof(flow_message));
+    m->type = T_ARRIVE;
+    m->magic = terminal_magic_num;
+    m->num_hops = f->num_hops;
+    if(f->msg.remote_event_size_bytes)
+        memcpy(m_data, f->edata, f->msg.remote_event_size_bytes);
+    tw_event_send(e);
+
+    /* local completion message, the flow has left the source. It is due
+     * right away, the lookahead only keeps the offset nonzero */
+    if(f->msg.local_event_size_bytes > 0)
+    {
+        e = tw_event_new(f->msg.sender_lp, g_tw_lookahead, lp);
+        memcpy(tw_event_data(e),
+                (char*)f->edata + f->msg.remote_event_size_bytes,
+                f->msg.local_event_size_bytes);
+        tw_event_send(e);
+    }
+
+    flow_detach(c, f);
+    msg->saved_comp_flows = flow_update_rates(c, f, lp);
+
+    /* without rollbacks the flow can go right away */
+    if(c->state_saving)
+        log_push(c, lp, FL_LOG_RETIRE, f);
+    else
+    {
+        flow_free(c, f);
+        c->free_slots[c->num_free++] = msg->slot;
+    }
+}
+
+/* sets up the links of the topology */
+static void controller_init(flow_controller_state * c, tw_lp * lp)
+{
+    uint32_t h1 = 0, h2 = 0;
+    bj_hashlittle2(LP_CONTROLLER_NM, strlen(LP_CONTROLLER_NM), &h1, &h2);
+    controller_magic_num = h1 + h2;
+    h1 = h2 = 0;
+    bj_hashlittle2(LP_METHOD_NM, strlen(LP_METHOD_NM), &h1, &h2);
+    terminal_magic_num = h1 + h2;
+
+    c->params = flow_get_params(lp, &c->anno);
+    const flow_param *p = c->params;
+    int i;
+
+    c->links = calloc(p->num_links, sizeof(fl_link));
+    assert(c->links);
+    for(i = 0; i < p->num_links; i++)
+        c->links[i].capacity = flow_link_capacity(p, i);
+
+    c->max_slots = 64;
+    c->num_slots = 0;
+    c->flows = malloc(c->max_slots * sizeof(fl_flow*));
+    c->free_slots = malloc(c->max_slots * sizeof(int));
+    c->num_free = 0;
+    c->next_flow_id = 0;
+
+    c->stamp = 0;
+    c->comp_links = malloc(p->num_links * sizeof(int));
+    c->max_comp_flows = 64;
+    c->comp_flows = malloc(c->max_comp_flows * sizeof(fl_flow*));
+    c->link_flows = malloc(c->max_comp_flows * sizeof(fl_flow*));
+    assert(c->flows && c->free_slots && c->comp_links && c->comp_flows &&
+            c->link_flows);
+
+    c->state_saving = g_tw_synchronization_protocol != SEQUENTIAL &&
+        g_tw_synchronization_protocol != CONSERVATIVE;
+    c->max_log = 1024;
+    c->log = c->state_saving ? malloc(c->max_log * sizeof(*c->log)) : NULL;
+    c->log_first = c->log_head = c->log_end = 0;
+}
+
+static void controller_event(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == controller_magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case F_START:
+            flow_start(c, bf, msg, lp);
+            break;
+        case F_DONE:
+            flow_done(c, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n (%lf) [Controller %d] Controller message type not supported %d ",
+                    tw_now(lp), (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a controller event */
+static void controller_rc_event_handler(flow_controller_state * c,
+        tw_bf * bf,
+        flow_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case F_START:
+            flow_start_rc(c, bf, msg, lp);
+            break;
+        case F_DONE:
+            flow_done_rc(c, bf, msg, lp);
+            break;
+    }
+}
+
+static void flow_controller_final(flow_controller_state * c,
+        tw_lp * lp)
+{
+    const flow_param *p = c->params;
+    int i, active = 0;
+
+    for(i = 0; i < c->num_slots; i++)
+        if(c->flows[i] != NULL)
+        {
+            active += c->flows[i]->active;
+            flow_free(c, c->flows[i]);
+        }
+    if(active)
+        printf("\n flow: %d flows still active at the end of the simulation ",
+                active);
+
+    for(i = 0; i < p->num_links; i++)
+        free(c->links[i].flows);
+    free(c->links);
+    free(c->flows);
+    free(c->free_slots);
+    free(c->comp_links);
+    free(c->comp_flows);
+    free(c->link_flows);
+    free(c->log);
+}
+
+/* flow compute node and controller LP types */
+static tw_lptype flow_lps[] =
+{
+    // Terminal handling functions
+    {
+        (init_f)terminal_init,
+        (pre_run_f) NULL,
+        (event_f) terminal_event,
+        (revent_f) terminal_rc_event_handler,
+        (final_f) flow_terminal_final,
+        (map_f) codes_mapping,
+        sizeof(flow_terminal_state)
+    },
+    {
+        (init_f) controller_init,
+        (pre_run_f) NULL,
+        (event_f) controller_event,
+        (revent_f) controller_rc_event_handler,
+        (final_f) flow_controller_final,
+        (map_f) codes_mapping,
+        sizeof(flow_controller_state),
+    },
+    {0},
+};
+
+/* returns the flow lp type for lp registration */
+static const tw_lptype* flow_get_cn_lp_type(void)
+{
+    return(&flow_lps[0]);
+}
+
+static void flow_register(tw_lptype *base_type) {
+    lp_type_register(LP_CONFIG_NM, base_type);
+    lp_type_register(LP_CONTROLLER_NM, &flow_lps[1]);
+}
+
+/* data structure for flow statistics */
+struct model_net_method flow_method =
+{
+    .mn_configure = flow_configure,
+    .mn_register = flow_register,
+    .model_net_method_packet_event = flow_packet_event,
+    .model_net_method_packet_event_rc = flow_packet_event_rc,
+    .model_net_method_recv_msg_event = NULL,
+    .model_net_method_recv_msg_event_rc = NULL,
+    .mn_get_lp_type = flow_get_cn_lp_type,
+    .mn_get_msg_sz = flow_get_msg_sz,
+    .mn_report_stats = flow_report_stats,
+    .mn_collective_call = flow_collective,
+    .mn_collective_call_rc = flow_collective_rc
+};
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
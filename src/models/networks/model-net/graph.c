@@ -0,0 +1,711 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* graph network model.
+ *
+ * The switches and the links between them are read from a graph file, so any
+ * topology can be simulated without a model of its own. Each non-comment line
+ * of the file is either
+ *
+ *   L <switch> <switch> [<bandwidth> <latency> <buffer>]
+ *
+ * for a bidirectional link between two switches, or
+ *
+ *   T <terminal> <switch> [<bandwidth> <latency> <buffer>]
+ *
+ * for the link of a terminal (compute node) to its switch. Switches and
+ * terminals are numbered by their relative LP ids. Bandwidths are in GiB/sec,
+ * latencies in ns and buffers in bytes per virtual channel; missing values
+ * come from the PARAMS section.
+ *
+ * At configure time the links are stored as a compressed sparse row (CSR)
+ * adjacency, and a breadth-first search from every switch gives the
+ * all-pairs hop distances. The next-hop table, also in CSR form, holds for
+ * each pair of switches up to num_paths ports that start a shortest path.
+ * Both are built once per rank and shared by all switches of the rank.
+ *
+ * The terminals and switch ports are those of vct-router.c, which forward
+ * packets with virtual cut-through at packet granularity. A packet uses the
+ * virtual channel given by the number of switch to switch hops it has taken,
+ * one per hop of the longest shortest path, which keeps shortest-path routing
+ * on any graph free of deadlocks. */
+
+#include <ross.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/jenkins-hash.h"
+#include "codes/lp-io.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "codes/net/graph.h"
+#include "vct-router.h"
+
+#define LP_CONFIG_NM (model_net_lp_config_names[GRAPH])
+#define LP_SWITCH_NM "graph_switch"
+
+typedef struct graph_param graph_param;
+/* annotation-specific parameters (unannotated entry occurs at the
+ * last index) */
+static uint64_t                  num_params = 0;
+static graph_param           * all_params = NULL;
+static const config_anno_map_t * anno_map   = NULL;
+
+enum graph_routing
+{
+    GR_ROUTE_HASH, /* next hop selected by a hash of source and destination */
+    GR_ROUTE_ADAPTIVE /* least loaded next hop */
+};
+
+struct graph_param
+{
+    // configuration parameters
+    double link_bandwidth; /* default bandwidth of the switch-switch links */
+    double cn_bandwidth; /* default bandwidth of the compute node links */
+    double link_latency; /* default latency of a link (ns) */
+    uint64_t buffer_size; /* default bytes of buffer per virtual channel */
+    int chunk_size; /* bytes serialized before a packet reaches the next hop */
+    int num_paths; /* equal-cost next hops kept per switch pair */
+    int routing;
+
+    // derived parameters
+    int num_switches;
+    int total_terminals;
+    int num_vcs; /* longest shortest path between switches, at least 1 */
+    int max_hops;
+
+    /* CSR adjacency: the ports of switch s are port_ptr[s] ..
+     * port_ptr[s+1] - 1, all of the per-port arrays below are indexed by
+     * port_ptr[s] + local port. A port leads to a switch (peer is the switch
+     * and peer_port its local port linked back) or to a terminal (peer is
+     * the terminal, peer_port is -1) */
+    int *port_ptr;
+    int *peer;
+    int *peer_port;
+    double *port_bandwidth;
+    double *port_latency;
+    uint64_t *port_buffer;
+
+    /* switch and local switch port of each terminal */
+    int *cn_switch;
+    int *cn_port;
+
+    /* CSR next-hop table: the local ports starting a shortest path from
+     * switch s to switch d are route_port[route_ptr[s * num_switches + d]]
+     * .. route_port[route_ptr[s * num_switches + d + 1] - 1] */
+    int *route_ptr;
+    int *route_port;
+};
+
+typedef struct gr_switch_state gr_switch_state;
+typedef struct graph_port_record graph_port_record;
+
+/* on-disk layout of the per-port counters, one record per switch port,
+ * written to the "graph-switch-ports" lp-io file. port_type is 0 for
+ * switch ports and 1 for compute node ports, peer is the switch or terminal
+ * the port leads to */
+struct graph_port_record
+{
+    int32_t switch_id;
+    int32_t port_type;
+    int32_t port_index;
+    int32_t peer;
+    uint64_t bytes;
+    uint64_t packets;
+    double blocked_time;
+    uint64_t peak_queue_bytes;
+};
+
+struct gr_switch_state
+{
+    vct_router r;
+    /* first entry of the switch in the per-port parameter arrays */
+    int port_base;
+
+    const char * anno;
+    const graph_param *params;
+};
+
+/* returns the graph message size */
+static int graph_get_msg_sz(void)
+{
+    return sizeof(graph_message);
+}
+
+/* a link read from the graph file */
+struct gr_link
+{
+    int is_cn;
+    int from; /* switch, or terminal for compute node links */
+    int to; /* switch */
+    double bandwidth;
+    double latency;
+    uint64_t buffer;
+};
+
+/* reads the links of the graph file, returns their number */
+static int graph_read_file(const char *fname, const graph_param *p,
+        struct gr_link **links)
+{
+    char line[512];
+    int line_nr = 0, num = 0, cap = 64;
+
+    FILE *f = fopen(fname, "r");
+    if(!f)
+        tw_error(TW_LOC, "graph: unable to open %s\n", fname);
+
+    *links = malloc(cap * sizeof(**links));
+    assert(*links);
+    while(fgets(line, sizeof(line), f))
+    {
+        struct gr_link l;
+        char kind;
+        long buf = 0;
+        int ret;
+
+        line_nr++;
+        if(line[strspn(line, " \t")] == '#' ||
+                strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        l.bandwidth = -1;
+        l.latency = -1;
+        ret = sscanf(line, " %c %d %d %lf %lf %ld", &kind, &l.from, &l.to,
+                &l.bandwidth, &l.latency, &buf);
+        if((kind != 'L' && kind != 'T') || ret < 3)
+            tw_error(TW_LOC, "graph: malformed line %d of %s\n", line_nr,
+                    fname);
+        l.is_cn = kind == 'T';
+        if(l.bandwidth <= 0)
+            l.bandwidth = l.is_cn ? p->cn_bandwidth : p->link_bandwidth;
+        if(l.latency < 0)
+            l.latency = p->link_latency;
+        l.buffer = buf > 0 ? (uint64_t)buf : p->buffer_size;
+        if(l.from < 0 || l.to < 0 || (!l.is_cn && l.from == l.to))
+            tw_error(TW_LOC, "graph: invalid link %d-%d on line %d of %s\n",
+                    l.from, l.to, line_nr, fname);
+
+        if(num == cap)
+        {
+            cap *= 2;
+            *links = realloc(*links, cap * sizeof(**links));
+            assert(*links);
+        }
+        (*links)[num++] = l;
+    }
+    fclose(f);
+    return num;
+}
+
+/* builds the CSR adjacency of the graph file and the all-pairs next-hop
+ * table shared by all switches of a rank */
+static void graph_build_tables(const char *fname, graph_param *p)
+{
+    struct gr_link *links;
+    int num_links = graph_read_file(fname, p, &links);
+    int i, s, d, n;
+
+    p->num_switches = 0;
+    p->total_terminals = 0;
+    for(i = 0; i < num_links; i++)
+    {
+        if(links[i].to >= p->num_switches)
+            p->num_switches = links[i].to + 1;
+        if(!links[i].is_cn && links[i].from >= p->num_switches)
+            p->num_switches = links[i].from + 1;
+        if(links[i].is_cn && links[i].from >= p->total_terminals)
+            p->total_terminals = links[i].from + 1;
+    }
+    int N = p->num_switches;
+    if(N == 0 || p->total_terminals == 0)
+        tw_error(TW_LOC, "graph: %s holds no switches or terminals\n", fname);
+
+    /* count the ports of each switch, a switch link gives a port on both of
+     * its ends */
+    p->port_ptr = calloc(N + 1, sizeof(int));
+    assert(p->port_ptr);
+    for(i = 0; i < num_links; i++)
+    {
+        p->port_ptr[links[i].to + 1]++;
+        if(!links[i].is_cn)
+            p->port_ptr[links[i].from + 1]++;
+    }
+    for(s = 0; s < N; s++)
+        p->port_ptr[s + 1] += p->port_ptr[s];
+
+    int num_ports = p->port_ptr[N];
+    int *fill = calloc(N, sizeof(int));
+    p->peer = malloc(num_ports * sizeof(int));
+    p->peer_port = malloc(num_ports * sizeof(int));
+    p->port_bandwidth = malloc(num_ports * sizeof(double));
+    p->port_latency = malloc(num_ports * sizeof(double));
+    p->port_buffer = malloc(num_ports * sizeof(uint64_t));
+    p->cn_switch = malloc(p->total_terminals * sizeof(int));
+    p->cn_port = malloc(p->total_terminals * sizeof(int));
+    assert(fill && p->peer && p->peer_port && p->port_bandwidth &&
+            p->port_latency && p->port_buffer && p->cn_switch && p->cn_port);
+    for(i = 0; i < p->total_terminals; i++)
+        p->cn_switch[i] = -1;
+
+    /* ports are numbered in the order of the file */
+    for(i = 0; i < num_links; i++)
+    {
+        struct gr_link *l = &links[i];
+        int a = fill[l->to]++;
+        int ga = p->port_ptr[l->to] + a;
+        p->port_bandwidth[ga] = l->bandwidth;
+        p->port_latency[ga] = l->latency;
+        p->port_buffer[ga] = l->buffer;
+        p->peer[ga] = l->from;
+        if(l->is_cn)
+        {
+            if(p->cn_switch[l->from] >= 0)
+                tw_error(TW_LOC, "graph: terminal %d is attached twice in "
+                        "%s\n", l->from, fname);
+            p->cn_switch[l->from] = l->to;
+            p->cn_port[l->from] = a;
+            p->peer_port[ga] = -1;
+            continue;
+        }
+        int b = fill[l->from]++;
+        int gb = p->port_ptr[l->from] + b;
+        p->port_bandwidth[gb] = l->bandwidth;
+        p->port_latency[gb] = l->latency;
+        p->port_buffer[gb] = l->buffer;
+        p->peer[gb] = l->to;
+        p->peer_port[ga] = b;
+        p->peer_port[gb] = a;
+    }
+    for(i = 0; i < p->total_terminals; i++)
+        if(p->cn_switch[i] < 0)
+            tw_error(TW_LOC, "graph: terminal %d is not attached to a switch "
+                    "in %s\n", i, fname);
+    free(fill);
+    free(links);
+
+    /* hop distances from a breadth-first search from every switch, the
+     * links are bidirectional so dist[s * N + d] = dist[d * N + s] */
+    int *dist = malloc((size_t)N * N * sizeof(int));
+    int *bfsq = malloc(N * sizeof(int));
+    assert(dist && bfsq);
+    p->max_hops = 0;
+    for(s = 0; s < N; s++)
+    {
+        int *ds = &dist[(size_t)s * N];
+        int head = 0, tail = 0;
+        for(d = 0; d < N; d++)
+            ds[d] = -1;
+        ds[s] = 0;
+        bfsq[tail++] = s;
+        while(head < tail)
+        {
+            int u = bfsq[head++];
+            for(i = p->port_ptr[u]; i < p->port_ptr[u + 1]; i++)
+            {
+                if(p->peer_port[i] < 0 || ds[p->peer[i]] >= 0)
+                    continue;
+                ds[p->peer[i]] = ds[u] + 1;
+                bfsq[tail++] = p->peer[i];
+            }
+        }
+        if(tail != N)
+            tw_error(TW_LOC, "graph: the switches of %s are not connected\n",
+                    fname);
+        if(ds[bfsq[N - 1]] > p->max_hops)
+            p->max_hops = ds[bfsq[N - 1]];
+    }
+    free(bfsq);
+
+    /* next hops: the neighbours one hop closer to the destination, up to
+     * num_paths of them in port order */
+    p->route_ptr = malloc(((size_t)N * N + 1) * sizeof(int));
+    assert(p->route_ptr);
+    n = 0;
+    for(s = 0; s < N; s++)
+    {
+        for(d = 0; d < N; d++)
+        {
+            int k = 0;
+            p->route_ptr[(size_t)s * N + d] = n;
+            for(i = p->port_ptr[s]; s != d && i < p->port_ptr[s + 1] &&
+                    k < p->num_paths; i++)
+                if(p->peer_port[i] >= 0 &&
+                        dist[(size_t)p->peer[i] * N + d] == dist[(size_t)s * N + d] - 1)
+                    k++;
+            n += k;
+        }
+    }
+    p->route_ptr[(size_t)N * N] = n;
+    p->route_port = malloc((n > 0 ? n : 1) * sizeof(int));
+    assert(p->route_port);
+    n = 0;
+    for(s = 0; s < N; s++)
+    {
+        for(d = 0; d < N; d++)
+        {
+            int k = 0;
+            for(i = p->port_ptr[s]; s != d && i < p->port_ptr[s + 1] &&
+                    k < p->num_paths; i++)
+                if(p->peer_port[i] >= 0 &&
+                        dist[(size_t)p->peer[i] * N + d] == dist[(size_t)s * N + d] - 1)
+                {
+                    p->route_port[n++] = i - p->port_ptr[s];
+                    k++;
+                }
+        }
+    }
+    free(dist);
+
+    p->num_vcs = p->max_hops > 0 ? p->max_hops : 1;
+}
+
+static void graph_read_config(const char * anno, graph_param *params){
+    // shorthand
+    graph_param *p = params;
+    char graph_file[MAX_NAME_LENGTH];
+    int rc;
+
+    configuration_get_value_int(&config, "PARAMS", "chunk_size", anno,
+            &p->chunk_size);
+    if(p->chunk_size <= 0) {
+        p->chunk_size = 64;
+        fprintf(stderr, "Chunk size for packets is not specified, setting to %d\n", p->chunk_size);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_bandwidth", anno,
+            &p->link_bandwidth);
+    if(p->link_bandwidth <= 0) {
+        p->link_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of switch links not specified, setting to %lf\n", p->link_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "cn_bandwidth", anno,
+            &p->cn_bandwidth);
+    if(p->cn_bandwidth <= 0) {
+        p->cn_bandwidth = p->link_bandwidth;
+        fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_latency", anno,
+            &p->link_latency);
+    if(p->link_latency < 0)
+        p->link_latency = 0;
+
+    long buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "buffer_size", anno,
+            &buf);
+    if(buf <= 0) {
+        buf = 8192;
+        fprintf(stderr, "Buffer size of switch virtual channels not specified, setting to %ld\n", buf);
+    }
+    p->buffer_size = buf;
+
+    configuration_get_value_int(&config, "PARAMS", "num_paths", anno,
+            &p->num_paths);
+    if(p->num_paths <= 0)
+        p->num_paths = 1;
+
+    char routing_str[MAX_NAME_LENGTH];
+    routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "routing", anno, routing_str,
+            MAX_NAME_LENGTH);
+    if(routing_str[0] == '\0' || strcmp(routing_str, "hash") == 0 ||
+            strcmp(routing_str, "ecmp") == 0)
+        p->routing = GR_ROUTE_HASH;
+    else if(strcmp(routing_str, "adaptive") == 0)
+        p->routing = GR_ROUTE_ADAPTIVE;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:routing: %s "
+                "(expected hash or adaptive)\n", routing_str);
+
+    rc = configuration_get_value_relpath(&config, "PARAMS", "graph_file",
+            anno, graph_file, MAX_NAME_LENGTH);
+    if(rc <= 0)
+    {
+        if(anno == NULL)
+            tw_error(TW_LOC, "graph: unable to read PARAMS:graph_file\n");
+        else
+            tw_error(TW_LOC, "graph: unable to read PARAMS:graph_file@%s\n",
+                    anno);
+    }
+    graph_build_tables(graph_file, p);
+
+    printf("\n graph: total nodes %d switches %d links %d diameter %d ",
+            p->total_terminals, p->num_switches,
+            (p->port_ptr[p->num_switches] - p->total_terminals) / 2,
+            p->max_hops);
+}
+
+static void graph_configure(){
+    anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
+    assert(anno_map);
+    num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
+    all_params = calloc(num_params, sizeof(*all_params));
+
+    for (uint64_t i = 0; i < anno_map->num_annos; i++){
+        const char * anno = anno_map->annotations[i].ptr;
+        graph_read_config(anno, &all_params[i]);
+    }
+    if (anno_map->has_unanno_lp > 0){
+        graph_read_config(NULL, &all_params[anno_map->num_annos]);
+    }
+}
+
+/* returns the parameters of the annotation of an LP */
+static const graph_param * get_params(tw_lpid gid, const char ** anno)
+{
+    *anno = codes_mapping_get_annotation_by_lpid(gid);
+    if (*anno == NULL)
+        return &all_params[num_params-1];
+    return &all_params[configuration_get_annotation_index(*anno, anno_map)];
+}
+
+/* all packets of a source-destination pair hash to the same next hops */
+static void graph_packet_init(const vct_terminal * t, vct_message * msg)
+{
+    uint32_t flow[2];
+
+    flow[0] = msg->src_terminal_id;
+    flow[1] = msg->dest_terminal_id;
+    ((graph_message*)msg)->flow_hash = bj_hashlittle(flow, sizeof(flow), 0);
+}
+
+/* selects the output port of a packet at a switch among the next hops of
+ * the routing table: by the flow hash of the packet, or the least loaded one
+ * with ties going to the hashed port. The hash is mixed with the switch so
+ * that consecutive hops don't pick correlated ports */
+static int switch_route(vct_router * r,
+        tw_bf * bf,
+        vct_message * pkt,
+        tw_lp * lp)
+{
+    const graph_param *p = ((gr_switch_state*)r)->params;
+    int dest_switch = p->cn_switch[pkt->dest_terminal_id];
+
+    if(dest_switch == r->router_id)
+        return p->cn_port[pkt->dest_terminal_id];
+
+    size_t pair = (size_t)r->router_id * p->num_switches + dest_switch;
+    const int *next = &p->route_port[p->route_ptr[pair]];
+    int n = p->route_ptr[pair + 1] - p->route_ptr[pair];
+    assert(n > 0);
+    if(n == 1)
+        return next[0];
+
+    uint32_t h = bj_hashlittle(&r->router_id, sizeof(r->router_id),
+            ((graph_message*)pkt)->flow_hash);
+    int port = next[h % n];
+    if(p->routing == GR_ROUTE_ADAPTIVE)
+    {
+        uint64_t best = vct_port_load(r, port);
+        int i;
+        for(i = 0; i < n; i++)
+        {
+            uint64_t load = vct_port_load(r, next[i]);
+            if(load < best)
+            {
+                best = load;
+                port = next[i];
+            }
+        }
+    }
+    return port;
+}
+
+/* one virtual channel per switch to switch hop */
+static int switch_select_vc(const vct_router * r, const vct_message * pkt,
+        int port)
+{
+    return vct_is_cn_port(r, port) ? 0 : pkt->my_N_hop - 1;
+}
+
+static vct_model graph_vct =
+{
+    .net_id = GRAPH,
+    .msg_size = sizeof(graph_message),
+    .packet_init = graph_packet_init,
+    .route = switch_route,
+    .select_vc = switch_select_vc,
+};
+
+/* report graph statistics like average and maximum packet latency,
+ * average number of hops traversed */
+static void graph_report_stats()
+{
+    vct_report_stats(&graph_vct);
+}
+
+/* collectives are not supported by the graph model */
+static void graph_collective()
+{
+    return;
+}
+
+static void graph_collective_rc()
+{
+    return;
+}
+
+/* graph packet event, generates a graph packet on the compute node */
+static tw_stime graph_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
+{
+    return vct_packet_event(&graph_vct, category, final_dest_lp,
+            dest_mn_lp, packet_size, is_pull, pull_size, offset,
+            remote_event_size, remote_event, self_event_size, self_event,
+            src_lp, sender, is_last_pckt);
+}
+
+/* initialize a graph compute node terminal */
+static void terminal_init(vct_terminal * s,
+        tw_lp * lp)
+{
+    const char * anno;
+    const graph_param *p = get_params(lp->gid, &anno);
+
+    int num_terminals = codes_mapping_get_lp_count(NULL, 0, LP_CONFIG_NM,
+            NULL, 1);
+    if(num_terminals != p->total_terminals)
+        tw_error(TW_LOC, "Config error: %d graph terminals configured, the "
+                "graph file attaches %d\n", num_terminals,
+                p->total_terminals);
+
+    vct_terminal_init(s, &graph_vct, lp);
+    int sw = p->cn_switch[s->terminal_id];
+    int g = p->port_ptr[sw] + p->cn_port[s->terminal_id];
+    s->total_terminals = p->total_terminals;
+    s->router_port = p->cn_port[s->terminal_id];
+    s->router_gid = codes_mapping_get_lpid_from_relative(sw, NULL,
+            LP_SWITCH_NM, NULL, 1);
+    s->bandwidth = p->port_bandwidth[g];
+    s->latency = p->port_latency[g];
+    s->buffer_size = p->port_buffer[g];
+    s->chunk_size = p->chunk_size;
+}
+
+/* sets up the ports of a switch and the neighbours they are linked to */
+static void switch_init(gr_switch_state * s, tw_lp * lp)
+{
+    s->params = get_params(lp->gid, &s->anno);
+
+    // shorthand
+    const graph_param *p = s->params;
+    vct_router *r = &s->r;
+    int i;
+
+    /* Checking for consistency of configuration */
+    int num_switches = codes_mapping_get_lp_count(NULL, 0, LP_SWITCH_NM,
+            NULL, 1);
+    if(num_switches != p->num_switches)
+        tw_error(TW_LOC, "Config error: %d graph switches configured, the "
+                "graph file has %d\n", num_switches, p->num_switches);
+
+    int id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    s->port_base = p->port_ptr[id];
+    vct_router_init(r, &graph_vct, p->port_ptr[id + 1] - s->port_base,
+            p->num_vcs, p->chunk_size, lp);
+
+    for(i = 0; i < r->num_ports; i++)
+    {
+        int g = s->port_base + i;
+        r->peer_port[i] = p->peer_port[g];
+        r->port_gid[i] = codes_mapping_get_lpid_from_relative(p->peer[g],
+                NULL, vct_is_cn_port(r, i) ? LP_CONFIG_NM : LP_SWITCH_NM,
+                NULL, 1);
+        r->bandwidth[i] = p->port_bandwidth[g];
+        r->latency[i] = p->port_latency[g];
+        r->buffer_size[i] = p->port_buffer[g];
+    }
+}
+
+static void graph_switch_final(gr_switch_state * s,
+        tw_lp * lp)
+{
+    const graph_param *p = s->params;
+    vct_router *r = &s->r;
+    int i, ret;
+
+    graph_port_record *rec = calloc(r->num_ports, sizeof(*rec));
+    assert(rec);
+    for(i = 0; i < r->num_ports; i++)
+    {
+        rec[i].switch_id = r->router_id;
+        rec[i].port_type = vct_is_cn_port(r, i);
+        rec[i].port_index = i;
+        rec[i].peer = p->peer[s->port_base + i];
+        rec[i].bytes = r->port_stats[i].bytes;
+        rec[i].packets = r->port_stats[i].packets;
+        rec[i].blocked_time = vct_port_blocked_time(r, i, lp);
+        rec[i].peak_queue_bytes = r->port_stats[i].peak_queue_bytes;
+    }
+
+    ret = lp_io_write(lp->gid, "graph-switch-ports",
+            r->num_ports * sizeof(*rec), rec);
+    assert(ret == 0);
+
+    free(rec);
+    vct_router_free(r);
+}
+
+/* graph compute node and switch LP types */
+static tw_lptype graph_lps[] =
+{
+    // Terminal handling functions
+    {
+        (init_f)terminal_init,
+        (pre_run_f) NULL,
+        (event_f) vct_terminal_event,
+        (revent_f) vct_terminal_rc_event_handler,
+        (final_f) vct_terminal_final,
+        (map_f) codes_mapping,
+        sizeof(vct_terminal)
+    },
+    {
+        (init_f) switch_init,
+        (pre_run_f) NULL,
+        (event_f) vct_router_event,
+        (revent_f) vct_router_rc_event_handler,
+        (final_f) graph_switch_final,
+        (map_f) codes_mapping,
+        sizeof(gr_switch_state),
+    },
+    {0},
+};
+
+/* returns the graph lp type for lp registration */
+static const tw_lptype* graph_get_cn_lp_type(void)
+{
+    return(&graph_lps[0]);
+}
+
+static void graph_register(tw_lptype *base_type) {
+    lp_type_register(LP_CONFIG_NM, base_type);
+    lp_type_register(LP_SWITCH_NM, &graph_lps[1]);
+}
+
+/* data structure for graph statistics */
+struct model_net_method graph_method =
+{
+    .mn_configure = graph_configure,
+    .mn_register = graph_register,
+    .model_net_method_packet_event = graph_packet_event,
+    .model_net_method_packet_event_rc = vct_packet_event_rc,
+    .model_net_method_recv_msg_event = NULL,
+    .model_net_method_recv_msg_event_rc = NULL,
+    .mn_get_lp_type = graph_get_cn_lp_type,
+    .mn_get_msg_sz = graph_get_msg_sz,
+    .mn_report_stats = graph_report_stats,
+    .mn_collective_call = graph_collective,
+    .mn_collective_call_rc = graph_collective_rc
+};
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -0,0 +1,724 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* HyperX (flattened butterfly) network model.
+ *
+ * The routers form an L-dimensional lattice of S_0 x S_1 x ... x S_(L-1)
+ * routers in which each router is linked to all of the routers that differ
+ * from it in exactly one coordinate. Each of these links is made of K_i
+ * parallel trunk links in dimension i, so a router has sum_i (S_i - 1) K_i
+ * router ports followed by the ports of its compute nodes.
+ *
+ * A packet reaches any coordinate of a dimension in a single hop. The
+ * dimensions the packet still has to correct travel with it as a bit mask,
+ * and the ports leading from one coordinate to another are looked up in
+ * per-dimension tables built at configure time, so a routing decision does
+ * not depend on the size of the network. The model supports
+ * dimension-ordered routing (DOR), dimensionally-adaptive load-balanced
+ * routing (DAL), which corrects the unaligned dimensions in any order and may
+ * take one non-minimal hop per dimension, and Valiant routing through a
+ * random intermediate router.
+ *
+ * The terminals and router ports are those of vct-router.c, which forward
+ * packets with virtual cut-through at packet granularity. DOR is deadlock
+ * free on its own. DAL and Valiant use one virtual channel per router to
+ * router hop, at most 2L of them. */
+
+#include <ross.h>
+#include <strings.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/lp-io.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "codes/model-net-inspect.h"
+#include "codes/net/hyperx.h"
+#include "vct-router.h"
+
+/* dimensions are tracked in 32-bit masks of the message */
+#define HYPERX_MAX_DIMS 16
+
+#define LP_CONFIG_NM (model_net_lp_config_names[HYPERX])
+#define LP_ROUTER_NM "hyperx_router"
+
+typedef struct hyperx_param hyperx_param;
+/* annotation-specific parameters (unannotated entry occurs at the
+ * last index) */
+static uint64_t                  num_params = 0;
+static hyperx_param            * all_params = NULL;
+static const config_anno_map_t * anno_map   = NULL;
+
+enum hyperx_routing
+{
+    HX_ROUTE_DOR, /* dimension-ordered, minimal */
+    HX_ROUTE_DAL, /* dimensionally-adaptive, load-balanced */
+    HX_ROUTE_VALIANT /* DOR to and from a random router */
+};
+
+struct hyperx_param
+{
+    // configuration parameters
+    int n_dims; /* L */
+    int *dim_length; /* routers per dimension (S_i) */
+    int *trunking; /* parallel links between two routers (K_i) */
+    int num_cn; /* compute nodes per router */
+    double link_bandwidth; /* bandwidth of a router-router trunk link */
+    double cn_bandwidth; /* bandwidth of the compute node channels */
+    double link_latency; /* latency of a link (ns) */
+    int chunk_size; /* bytes serialized before a packet reaches the next hop */
+    uint64_t vc_size; /* bytes of buffer per router input virtual channel */
+    uint64_t cn_vc_size; /* bytes of buffer of the compute node channels */
+    int routing;
+
+    // derived parameters
+    int num_vcs; /* virtual channels per router port */
+    int num_routers;
+    int router_radix; /* router ports of a router */
+    int total_terminals;
+
+    /* coordinates of the routers, indexed by router * n_dims + dimension */
+    int *coord;
+    /* per dimension, indexed by from * S_i + to: the first of the K_i
+     * trunk ports leading from coordinate from to coordinate to, -1 if the
+     * coordinates are the same */
+    int **dim_port;
+    /* per router port: its dimension and the rank of the coordinate it leads
+     * to among the other coordinates of the dimension */
+    int *port_dim;
+    int *port_rank;
+};
+
+
+typedef struct hx_router_state hx_router_state;
+typedef struct hyperx_port_record hyperx_port_record;
+
+/* on-disk layout of the per-port counters, one record per router port,
+ * written to the "hyperx-router-ports" lp-io file. port_type is 0 for
+ * router ports and 1 for compute node ports. A router port leads to
+ * coordinate port_index of dimension dim over trunk link trunk, a compute
+ * node port to compute node port_index of the router (dim and trunk are -1) */
+struct hyperx_port_record
+{
+    int32_t router;
+    int32_t port_type;
+    int32_t dim;
+    int32_t port_index;
+    int32_t trunk;
+    int32_t pad;
+    uint64_t bytes;
+    uint64_t packets;
+    double blocked_time;
+    uint64_t peak_queue_bytes;
+};
+
+struct hx_router_state
+{
+    /* router ports followed by the compute node ports */
+    vct_router r;
+    int coord[HYPERX_MAX_DIMS]; /* coordinates of the router */
+
+    const char * anno;
+    const hyperx_param *params;
+};
+
+/* returns the hyperx message size */
+static int hyperx_get_msg_sz(void)
+{
+    return sizeof(hyperx_message);
+}
+
+/* parses a comma separated list of positive integers into vals (at most n
+ * entries), returns the number of entries read */
+static int parse_int_list(char * str, int * vals, int n)
+{
+    int i = 0;
+    char * token = strtok(str, ",");
+    while(token != NULL && i < n)
+    {
+        vals[i++] = atoi(token);
+        token = strtok(NULL, ",");
+    }
+    return i;
+}
+
+/* builds the router coordinates and the port tables shared by all routers
+ * of a rank */
+static void hyperx_build_tables(hyperx_param *p)
+{
+    int L = p->n_dims;
+    int r, i, a, b, t;
+
+    p->coord = malloc(p->num_routers * L * sizeof(int));
+    p->dim_port = malloc(L * sizeof(int*));
+    p->port_dim = malloc(p->router_radix * sizeof(int));
+    p->port_rank = malloc(p->router_radix * sizeof(int));
+    assert(p->coord && p->dim_port && p->port_dim && p->port_rank);
+
+    for(r = 0; r < p->num_routers; r++)
+        model_net_torus_get_dim_id(r, L, p->dim_length, &p->coord[r * L]);
+
+    /* the ports of dimension i follow those of the dimensions below it, the
+     * K_i trunk ports of each other coordinate in increasing order */
+    int base = 0;
+    for(i = 0; i < L; i++)
+    {
+        int S = p->dim_length[i];
+        int K = p->trunking[i];
+        p->dim_port[i] = malloc(S * S * sizeof(int));
+        assert(p->dim_port[i]);
+        for(a = 0; a < S; a++)
+            for(b = 0; b < S; b++)
+                p->dim_port[i][a * S + b] = (a == b) ? -1 :
+                    base + (b < a ? b : b - 1) * K;
+        for(b = 0; b < S - 1; b++)
+            for(t = 0; t < K; t++)
+            {
+                p->port_dim[base + b * K + t] = i;
+                p->port_rank[base + b * K + t] = b;
+            }
+        base += (S - 1) * K;
+    }
+    assert(base == p->router_radix);
+}
+
+static void hyperx_read_config(const char * anno, hyperx_param *params){
+    // shorthand
+    hyperx_param *p = params;
+    char list_str[MAX_NAME_LENGTH];
+    int i;
+
+    configuration_get_value_int(&config, "PARAMS", "n_dims", anno,
+            &p->n_dims);
+    if(p->n_dims <= 0) {
+        p->n_dims = 2;
+        fprintf(stderr, "Number of HyperX dimensions not specified, setting to %d\n",
+                p->n_dims);
+    }
+    if(p->n_dims > HYPERX_MAX_DIMS)
+        tw_error(TW_LOC, "HyperX supports up to %d dimensions, got %d\n",
+                HYPERX_MAX_DIMS, p->n_dims);
+
+    p->dim_length = malloc(p->n_dims * sizeof(int));
+    p->trunking = malloc(p->n_dims * sizeof(int));
+    assert(p->dim_length && p->trunking);
+
+    list_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "dim_length", anno, list_str,
+            MAX_NAME_LENGTH);
+    if(parse_int_list(list_str, p->dim_length, p->n_dims) != p->n_dims)
+        tw_error(TW_LOC, "PARAMS:dim_length needs one length per dimension "
+                "(%d)\n", p->n_dims);
+
+    /* a single trunking value applies to all dimensions */
+    for(i = 0; i < p->n_dims; i++)
+        p->trunking[i] = 1;
+    list_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "trunking", anno, list_str,
+            MAX_NAME_LENGTH);
+    if(list_str[0] != '\0')
+    {
+        int cnt = parse_int_list(list_str, p->trunking, p->n_dims);
+        if(cnt == 1)
+            for(i = 1; i < p->n_dims; i++)
+                p->trunking[i] = p->trunking[0];
+        else if(cnt != p->n_dims)
+            tw_error(TW_LOC, "PARAMS:trunking needs one value or one per "
+                    "dimension (%d)\n", p->n_dims);
+    }
+
+    p->num_routers = 1;
+    p->router_radix = 0;
+    for(i = 0; i < p->n_dims; i++)
+    {
+        if(p->dim_length[i] < 2 || p->trunking[i] < 1)
+            tw_error(TW_LOC, "Invalid HyperX dimension %d: length %d "
+                    "trunking %d\n", i, p->dim_length[i], p->trunking[i]);
+        p->num_routers *= p->dim_length[i];
+        p->router_radix += (p->dim_length[i] - 1) * p->trunking[i];
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "num_cn", anno,
+            &p->num_cn);
+    if(p->num_cn <= 0) {
+        p->num_cn = 1;
+        fprintf(stderr, "Number of compute nodes per router not specified, setting to %d\n",
+                p->num_cn);
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "chunk_size", anno,
+            &p->chunk_size);
+    if(p->chunk_size <= 0) {
+        p->chunk_size = 64;
+        fprintf(stderr, "Chunk size for packets is not specified, setting to %d\n", p->chunk_size);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_bandwidth", anno,
+            &p->link_bandwidth);
+    if(p->link_bandwidth <= 0) {
+        p->link_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of router links not specified, setting to %lf\n", p->link_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "cn_bandwidth", anno,
+            &p->cn_bandwidth);
+    if(p->cn_bandwidth <= 0) {
+        p->cn_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_latency", anno,
+            &p->link_latency);
+    if(p->link_latency < 0)
+        p->link_latency = 0;
+
+    long buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "vc_size", anno, &buf);
+    if(buf <= 0) {
+        buf = 8192;
+        fprintf(stderr, "Buffer size of router virtual channels not specified, setting to %ld\n", buf);
+    }
+    p->vc_size = buf;
+
+    buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "cn_vc_size", anno,
+            &buf);
+    if(buf <= 0)
+        buf = p->vc_size;
+    p->cn_vc_size = buf;
+
+    char routing_str[MAX_NAME_LENGTH];
+    routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "routing", anno, routing_str,
+            MAX_NAME_LENGTH);
+    if(routing_str[0] == '\0' || strcmp(routing_str, "dor") == 0 ||
+            strcmp(routing_str, "dimension-order") == 0)
+        p->routing = HX_ROUTE_DOR;
+    else if(strcmp(routing_str, "dal") == 0 ||
+            strcmp(routing_str, "adaptive") == 0)
+        p->routing = HX_ROUTE_DAL;
+    else if(strcmp(routing_str, "valiant") == 0)
+        p->routing = HX_ROUTE_VALIANT;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:routing: %s "
+                "(expected dor, dal or valiant)\n", routing_str);
+
+    /* DAL takes up to two hops per dimension and Valiant corrects every
+     * dimension twice */
+    p->num_vcs = (p->routing == HX_ROUTE_DOR) ? 1 : 2 * p->n_dims;
+    p->total_terminals = p->num_routers * p->num_cn;
+
+    hyperx_build_tables(p);
+
+    printf("\n HyperX: total nodes %d routers %d router radix %d ",
+            p->total_terminals, p->num_routers, p->router_radix);
+}
+
+static void hyperx_configure(){
+    anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
+    assert(anno_map);
+    num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
+    all_params = calloc(num_params, sizeof(*all_params));
+
+    for (uint64_t i = 0; i < anno_map->num_annos; i++){
+        const char * anno = anno_map->annotations[i].ptr;
+        hyperx_read_config(anno, &all_params[i]);
+    }
+    if (anno_map->has_unanno_lp > 0){
+        hyperx_read_config(NULL, &all_params[anno_map->num_annos]);
+    }
+}
+
+/* returns the parameters of the annotation of an LP */
+static const hyperx_param * get_params(tw_lpid gid, const char ** anno)
+{
+    *anno = codes_mapping_get_annotation_by_lpid(gid);
+    if (*anno == NULL)
+        return &all_params[num_params-1];
+    return &all_params[configuration_get_annotation_index(*anno, anno_map)];
+}
+
+static void hyperx_packet_init(const vct_terminal * t, vct_message * msg)
+{
+    ((hyperx_message*)msg)->intm_router = -1;
+}
+
+/* picks a random intermediate router other than the source and destination
+ * routers */
+static int pick_intm_router(const hx_router_state * s, int dest_router,
+        tw_lp * lp)
+{
+    int lo = s->r.router_id < dest_router ? s->r.router_id : dest_router;
+    int hi = s->r.router_id < dest_router ? dest_router : s->r.router_id;
+    int r = tw_rand_integer(lp->rng, 0, s->params->num_routers - 3);
+    if(r >= lo)
+        r++;
+    if(r >= hi)
+        r++;
+    return r;
+}
+
+/* returns the dimensions in which the coordinates of two routers differ */
+static uint32_t get_dim_mask(const hyperx_param *p, int a, int b)
+{
+    uint32_t mask = 0;
+    int i;
+    for(i = 0; i < p->n_dims; i++)
+        if(p->coord[a * p->n_dims + i] != p->coord[b * p->n_dims + i])
+            mask |= 1u << i;
+    return mask;
+}
+
+/* returns the port leading to coordinate to of a dimension. Oblivious
+ * routing spreads the flows over the trunk links by source and destination,
+ * adaptive routing takes the least loaded trunk link */
+static int pick_trunk(const hx_router_state * s, const vct_message * pkt,
+        int dim, int to, int adaptive)
+{
+    const hyperx_param *p = s->params;
+    int S = p->dim_length[dim];
+    int K = p->trunking[dim];
+    int base = p->dim_port[dim][s->coord[dim] * S + to];
+    int best = base, t;
+
+    if(K == 1)
+        return base;
+    if(!adaptive)
+        return base + (pkt->src_terminal_id + pkt->dest_terminal_id) % K;
+    for(t = 1; t < K; t++)
+        if(vct_port_load(&s->r, base + t) < vct_port_load(&s->r, best))
+            best = base + t;
+    return best;
+}
+
+/* selects the output port of a packet at a router. The source router sets up
+ * the dimensions to correct (and the intermediate router of a Valiant path),
+ * each hop then corrects one of them. Sets bf->c3 if a random number was
+ * drawn */
+static int hyperx_route(vct_router * r,
+        tw_bf * bf,
+        vct_message * pkt,
+        tw_lp * lp)
+{
+    hx_router_state *s = (hx_router_state*)r;
+    hyperx_message *hx = (hyperx_message*)pkt;
+    const hyperx_param *p = s->params;
+    int L = p->n_dims;
+    int dest_router = pkt->dest_terminal_id / p->num_cn;
+    int dim, port;
+
+    if(pkt->my_N_hop == 1)
+    {
+        hx->derouted_mask = 0;
+        if(p->routing == HX_ROUTE_VALIANT && dest_router != r->router_id &&
+                p->num_routers > 2)
+        {
+            bf->c3 = 1;
+            hx->intm_router = pick_intm_router(s, dest_router, lp);
+            pkt->path_type = VCT_PATH_NON_MINIMAL;
+            hx->dim_mask = get_dim_mask(p, r->router_id, hx->intm_router);
+        }
+        else
+            hx->dim_mask = get_dim_mask(p, r->router_id, dest_router);
+    }
+    if(hx->intm_router == r->router_id)
+    {
+        hx->intm_router = -1;
+        hx->dim_mask = get_dim_mask(p, r->router_id, dest_router);
+    }
+    if(hx->dim_mask == 0)
+        return p->router_radix + pkt->dest_terminal_id % p->num_cn;
+
+    const int *to = &p->coord[(hx->intm_router >= 0 ?
+            hx->intm_router : dest_router) * L];
+
+    if(p->routing != HX_ROUTE_DAL)
+    {
+        /* lowest unaligned dimension first */
+        dim = ffs(hx->dim_mask) - 1;
+        hx->dim_mask &= ~(1u << dim);
+        return pick_trunk(s, pkt, dim, to[dim], 0);
+    }
+
+    /* DAL: the least loaded minimal port of the unaligned dimensions */
+    int best_dim = -1, best_port = -1;
+    uint64_t best_load = 0;
+    uint32_t mask = hx->dim_mask;
+    while(mask)
+    {
+        dim = ffs(mask) - 1;
+        mask &= mask - 1;
+        port = pick_trunk(s, pkt, dim, to[dim], 1);
+        uint64_t load = vct_port_load(&s->r, port);
+        if(best_port < 0 || load < best_load)
+        {
+            best_dim = dim;
+            best_port = port;
+            best_load = load;
+        }
+    }
+
+    /* a dimension may be derouted once, to a random coordinate other than
+     * the current and the target one, if that port is loaded less than half
+     * as much as the minimal one */
+    int S = p->dim_length[best_dim];
+    if(!(hx->derouted_mask & (1u << best_dim)) && S > 2 && best_load > 0)
+    {
+        bf->c3 = 1;
+        int lo = s->coord[best_dim] < to[best_dim] ? s->coord[best_dim] :
+            to[best_dim];
+        int hi = s->coord[best_dim] < to[best_dim] ? to[best_dim] :
+            s->coord[best_dim];
+        int c = tw_rand_integer(lp->rng, 0, S - 3);
+        if(c >= lo)
+            c++;
+        if(c >= hi)
+            c++;
+        port = pick_trunk(s, pkt, best_dim, c, 1);
+        if(2 * vct_port_load(&s->r, port) < best_load)
+        {
+            hx->derouted_mask |= 1u << best_dim;
+            pkt->path_type = VCT_PATH_NON_MINIMAL;
+            return port;
+        }
+    }
+    hx->dim_mask &= ~(1u << best_dim);
+    return best_port;
+}
+
+
+/* one virtual channel per router to router hop, DOR only needs one */
+static int hyperx_select_vc(const vct_router * r, const vct_message * pkt,
+        int port)
+{
+    return (vct_is_cn_port(r, port) || r->num_vcs == 1) ? 0 :
+        pkt->my_N_hop - 1;
+}
+
+static vct_model hyperx_vct =
+{
+    .net_id = HYPERX,
+    .msg_size = sizeof(hyperx_message),
+    .packet_init = hyperx_packet_init,
+    .route = hyperx_route,
+    .select_vc = hyperx_select_vc,
+};
+
+/* report HyperX statistics like average and maximum packet latency,
+ * average number of hops traversed */
+static void hyperx_report_stats()
+{
+    vct_report_stats(&hyperx_vct);
+}
+
+/* collectives are not supported by the HyperX model */
+static void hyperx_collective()
+{
+    return;
+}
+
+static void hyperx_collective_rc()
+{
+    return;
+}
+
+/* hyperx packet event, generates a HyperX packet on the compute node */
+static tw_stime hyperx_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
+{
+    return vct_packet_event(&hyperx_vct, category, final_dest_lp,
+            dest_mn_lp, packet_size, is_pull, pull_size, offset,
+            remote_event_size, remote_event, self_event_size, self_event,
+            src_lp, sender, is_last_pckt);
+}
+
+/* initialize a HyperX compute node terminal */
+static void terminal_init(vct_terminal * s,
+        tw_lp * lp)
+{
+    const char * anno;
+    const hyperx_param *p = get_params(lp->gid, &anno);
+
+    int num_terminals = codes_mapping_get_lp_count(NULL, 0, LP_CONFIG_NM,
+            NULL, 1);
+    if(num_terminals != p->total_terminals)
+        tw_error(TW_LOC, "Config error: %d HyperX terminals configured, the "
+                "HyperX of %d routers with %d compute nodes per router "
+                "has %d\n", num_terminals, p->num_routers, p->num_cn,
+                p->total_terminals);
+
+    vct_terminal_init(s, &hyperx_vct, lp);
+    s->total_terminals = p->total_terminals;
+    s->router_port = p->router_radix + s->terminal_id % p->num_cn;
+    s->router_gid = codes_mapping_get_lpid_from_relative(
+            s->terminal_id / p->num_cn, NULL, LP_ROUTER_NM, NULL, 1);
+    s->bandwidth = p->cn_bandwidth;
+    s->latency = p->link_latency;
+    s->buffer_size = p->cn_vc_size;
+    s->chunk_size = p->chunk_size;
+}
+
+/* sets up the ports of a router and the neighbours they are linked to */
+static void router_init(hx_router_state * s, tw_lp * lp)
+{
+    s->params = get_params(lp->gid, &s->anno);
+
+    // shorthand
+    const hyperx_param *p = s->params;
+    vct_router *r = &s->r;
+    int i;
+
+    /* Checking for consistency of configuration */
+    int num_routers = codes_mapping_get_lp_count(NULL, 0, LP_ROUTER_NM,
+            NULL, 1);
+    if(num_routers != p->num_routers)
+        tw_error(TW_LOC, "Config error: %d HyperX routers configured, the "
+                "HyperX has %d\n", num_routers, p->num_routers);
+
+    vct_router_init(r, &hyperx_vct, p->router_radix + p->num_cn,
+            p->num_vcs, p->chunk_size, lp);
+    model_net_torus_get_dim_id(r->router_id, p->n_dims, p->dim_length,
+            s->coord);
+
+    for(i = 0; i < r->num_ports; i++)
+    {
+        if(i < p->router_radix)
+        {
+            /* the router with our coordinates except for the one of the
+             * port's dimension, which links back over the same trunk */
+            int dim = p->port_dim[i];
+            int S = p->dim_length[dim];
+            int my = s->coord[dim];
+            int to = p->port_rank[i] < my ? p->port_rank[i] :
+                p->port_rank[i] + 1;
+            int trunk = i - p->dim_port[dim][my * S + to];
+            int nbr_coord[HYPERX_MAX_DIMS];
+
+            memcpy(nbr_coord, s->coord, p->n_dims * sizeof(int));
+            nbr_coord[dim] = to;
+            int nbr = model_net_torus_get_flat_id(p->n_dims, p->dim_length,
+                    nbr_coord);
+            r->port_gid[i] = codes_mapping_get_lpid_from_relative(nbr, NULL,
+                    LP_ROUTER_NM, NULL, 1);
+            r->peer_port[i] = p->dim_port[dim][to * S + my] + trunk;
+            r->bandwidth[i] = p->link_bandwidth;
+            r->buffer_size[i] = p->vc_size;
+        }
+        else
+        {
+            r->port_gid[i] = codes_mapping_get_lpid_from_relative(
+                    r->router_id * p->num_cn + i - p->router_radix, NULL,
+                    LP_CONFIG_NM, NULL, 1);
+            r->bandwidth[i] = p->cn_bandwidth;
+            r->buffer_size[i] = p->cn_vc_size;
+        }
+        r->latency[i] = p->link_latency;
+    }
+}
+
+static void hyperx_router_final(hx_router_state * s,
+        tw_lp * lp)
+{
+    const hyperx_param *p = s->params;
+    vct_router *r = &s->r;
+    int i, ret;
+
+    hyperx_port_record *rec = calloc(r->num_ports, sizeof(*rec));
+    assert(rec);
+    for(i = 0; i < r->num_ports; i++)
+    {
+        rec[i].router = r->router_id;
+        rec[i].port_type = vct_is_cn_port(r, i);
+        if(vct_is_cn_port(r, i))
+        {
+            rec[i].dim = -1;
+            rec[i].port_index = i - p->router_radix;
+            rec[i].trunk = -1;
+        }
+        else
+        {
+            int dim = p->port_dim[i];
+            int my = s->coord[dim];
+            rec[i].dim = dim;
+            rec[i].port_index = p->port_rank[i] < my ? p->port_rank[i] :
+                p->port_rank[i] + 1;
+            rec[i].trunk = i -
+                p->dim_port[dim][my * p->dim_length[dim] + rec[i].port_index];
+        }
+        rec[i].bytes = r->port_stats[i].bytes;
+        rec[i].packets = r->port_stats[i].packets;
+        rec[i].blocked_time = vct_port_blocked_time(r, i, lp);
+        rec[i].peak_queue_bytes = r->port_stats[i].peak_queue_bytes;
+    }
+
+    ret = lp_io_write(lp->gid, "hyperx-router-ports",
+            r->num_ports * sizeof(*rec), rec);
+    assert(ret == 0);
+
+    free(rec);
+    vct_router_free(r);
+}
+
+/* HyperX compute node and router LP types */
+static tw_lptype hyperx_lps[] =
+{
+    // Terminal handling functions
+    {
+        (init_f)terminal_init,
+        (pre_run_f) NULL,
+        (event_f) vct_terminal_event,
+        (revent_f) vct_terminal_rc_event_handler,
+        (final_f) vct_terminal_final,
+        (map_f) codes_mapping,
+        sizeof(vct_terminal)
+    },
+    {
+        (init_f) router_init,
+        (pre_run_f) NULL,
+        (event_f) vct_router_event,
+        (revent_f) vct_router_rc_event_handler,
+        (final_f) hyperx_router_final,
+        (map_f) codes_mapping,
+        sizeof(hx_router_state),
+    },
+    {0},
+};
+
+/* returns the hyperx lp type for lp registration */
+static const tw_lptype* hyperx_get_cn_lp_type(void)
+{
+    return(&hyperx_lps[0]);
+}
+
+static void hyperx_register(tw_lptype *base_type) {
+    lp_type_register(LP_CONFIG_NM, base_type);
+    lp_type_register(LP_ROUTER_NM, &hyperx_lps[1]);
+}
+
+/* data structure for HyperX statistics */
+struct model_net_method hyperx_method =
+{
+    .mn_configure = hyperx_configure,
+    .mn_register = hyperx_register,
+    .model_net_method_packet_event = hyperx_packet_event,
+    .model_net_method_packet_event_rc = vct_packet_event_rc,
+    .model_net_method_recv_msg_event = NULL,
+    .model_net_method_recv_msg_event_rc = NULL,
+    .mn_get_lp_type = hyperx_get_cn_lp_type,
+    .mn_get_msg_sz = hyperx_get_msg_sz,
+    .mn_report_stats = hyperx_report_stats,
+    .mn_collective_call = hyperx_collective,
+    .mn_collective_call_rc = hyperx_collective_rc
+};
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
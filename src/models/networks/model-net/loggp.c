@@ -37,6 +37,8 @@
 #endif
 
 
+static double maxd(double a, double b) { return a < b ? b : a; }
+
 /*Define loggp data types and structs*/
 typedef struct loggp_state loggp_state;
 
@@ -54,15 +56,42 @@ struct param_table_entry
     double g;
     double G;
     double lsqu_gG;
+    /* L, o_s, o_r, g and G scaled to nanoseconds when the table is read */
+    double L_ns;
+    double o_s_ns;
+    double o_r_ns;
+    double g_ns;
+    double G_ns;
 };
 typedef struct param_table_entry param_table_entry;
 
+/* loggp costs (in ns) applied to a message of a given size */
+struct loggp_costs
+{
+    double L;
+    double o_s;
+    double o_r;
+    double g;
+    double G;
+};
+
 typedef struct loggp_param loggp_param;
 // loggp parameters
 struct loggp_param
 {
     int table_size;
-    param_table_entry table[100];
+    /* rows sorted by increasing message size */
+    param_table_entry *table;
+    /* interpolate linearly between rows rather than using the next size up
+     * (PARAMS:net_config_interpolate) */
+    int interpolate;
+    /* LogGOPS mode: charge the o_s/o_r overheads and the per-byte overhead
+     * O (ns/byte) to the host (PARAMS:loggp_overhead, loggp_O) */
+    int loggops;
+    double O;
+    /* messages larger than this use a rendezvous (RTS/CTS) handshake before
+     * the data is sent, 0 disables (PARAMS:loggp_rendezvous_threshold) */
+    uint64_t rendezvous_threshold;
 };
 
 
@@ -71,6 +100,8 @@ struct loggp_state
     /* next idle times for network card, both inbound and outbound */
     tw_stime net_send_next_idle;
     tw_stime net_recv_next_idle;
+    /* next idle time of the host CPU (LogGOPS mode) */
+    tw_stime host_next_idle;
     const char * anno;
     const loggp_param *params;
     struct mn_stats loggp_stats_array[CATEGORY_MAX];
@@ -106,6 +137,7 @@ static void loggp_collective_rc();
 /* sets up the loggp parameters through modelnet interface */
 static void loggp_configure();
 
+static void loggp_read_config(const char * anno, loggp_param * params);
 static void loggp_set_params(const char * config_file, loggp_param * params);
 
 /* Issues a loggp packet event call */
@@ -144,9 +176,10 @@ void loggp_recv_msg_event_rc(tw_lp *sender);
 
 static void loggp_report_stats();
 
-static const struct param_table_entry* find_params(
+static void find_params(
         uint64_t msg_size,
-        const loggp_param *params);
+        const loggp_param *params,
+        struct loggp_costs *costs);
 
 /* data structure for model-net statistics */
 struct model_net_method loggp_method =
@@ -211,6 +244,21 @@ static void handle_msg_start_event(
     tw_bf * b,
     loggp_message * m,
     tw_lp * lp);
+static void handle_msg_rts_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp);
+static void handle_msg_cts_rev_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp);
+static void handle_msg_cts_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp);
 
 /* returns pointer to LP information for loggp module */
 static const tw_lptype* loggp_get_lp_type()
@@ -256,6 +304,7 @@ static void loggp_init(
     /* all devices are idle to begin with */
     ns->net_send_next_idle = tw_now(lp);
     ns->net_recv_next_idle = tw_now(lp);
+    ns->host_next_idle = tw_now(lp);
 
     ns->anno = codes_mapping_get_annotation_by_lpid(lp->gid);
     if (ns->anno == NULL)
@@ -288,6 +337,12 @@ static void loggp_event(
         case LG_MSG_READY:
             handle_msg_ready_event(ns, b, m, lp);
             break;
+        case LG_MSG_RTS:
+            handle_msg_rts_event(ns, b, m, lp);
+            break;
+        case LG_MSG_CTS:
+            handle_msg_cts_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -310,6 +365,12 @@ static void loggp_rev_event(
         case LG_MSG_READY:
             handle_msg_ready_rev_event(ns, b, m, lp);
             break;
+        case LG_MSG_RTS:
+            /* nothing to undo */
+            break;
+        case LG_MSG_CTS:
+            handle_msg_cts_rev_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -331,6 +392,22 @@ int loggp_get_magic()
   return loggp_magic;
 }
 
+/* LogGOPS: occupies the host CPU for o + O * size, starting when the host is
+ * next idle but not before ready. Returns the delay from now until the host
+ * is done */
+static tw_stime host_overhead(
+    loggp_state * ns,
+    loggp_message * m,
+    tw_stime ready,
+    double o,
+    tw_lp * lp)
+{
+    m->host_next_idle_saved = ns->host_next_idle;
+    ns->host_next_idle = maxd(ready, ns->host_next_idle) + o +
+        ns->params->O * (double)m->net_msg_size_bytes;
+    return ns->host_next_idle - tw_now(lp);
+}
+
 /* reverse computation for msg ready event */
 static void handle_msg_ready_rev_event(
     loggp_state * ns,
@@ -348,6 +425,8 @@ static void handle_msg_ready_rev_event(
     struct mn_stats* stat;
 
     ns->net_recv_next_idle = m->net_recv_next_idle_saved;
+    if(ns->params->loggops)
+        ns->host_next_idle = m->host_next_idle_saved;
     
     stat = model_net_find_stats(m->category, ns->loggp_stats_array);
     stat->recv_count--;
@@ -380,13 +459,11 @@ static void handle_msg_ready_event(
     loggp_message *m_new;
     struct mn_stats* stat;
     double recv_time;
-    const struct param_table_entry *param;
+    struct loggp_costs param;
 
-    param = find_params(m->net_msg_size_bytes, ns->params);
+    find_params(m->net_msg_size_bytes, ns->params, &param);
 
-    recv_time = ((double)(m->net_msg_size_bytes-1)*param->G);
-    /* scale to nanoseconds */
-    recv_time *= 1000.0;
+    recv_time = ((double)(m->net_msg_size_bytes-1)*param.G);
     m->recv_time_saved = recv_time;
 
     //printf("handle_msg_ready_event(), lp %llu.\n", (unsigned long long)lp->gid);
@@ -406,7 +483,7 @@ static void handle_msg_ready_event(
 
     /* bump up input queue idle time accordingly, include gap (g) parameter */
     m->net_recv_next_idle_saved = ns->net_recv_next_idle;
-    ns->net_recv_next_idle = recv_queue_time + tw_now(lp) + param->g*1000.0;
+    ns->net_recv_next_idle = recv_queue_time + tw_now(lp) + param.g;
 
     dprintf("%lu (mn): ready msg    %lu->%lu, size %lu (%3s last)\n"
             "          now:%0.3le, idle[prev:%0.3le, next:%0.3le], "
@@ -416,6 +493,11 @@ static void handle_msg_ready_event(
             tw_now(lp), m->net_recv_next_idle_saved, ns->net_recv_next_idle,
             recv_queue_time);
 
+    /* the receive completes once the host has processed the message */
+    if(ns->params->loggops)
+        recv_queue_time = host_overhead(ns, m, tw_now(lp) + recv_queue_time,
+                param.o_r, lp);
+
     // if we're using a recv-side queue, then we need to tell the scheduler we
     // are idle
 #if USE_RECV_QUEUE
@@ -454,27 +536,21 @@ static void handle_msg_ready_event(
     return;
 }
 
-/* reverse computation for msg start event */
-static void handle_msg_start_rev_event(
+/* reverse computation for msg_transmit */
+static void msg_transmit_rc(
     loggp_state * ns,
-    tw_bf * b,
     loggp_message * m,
+    int notify_sched,
     tw_lp * lp)
 {
-
-    dprintf("%lu (mn): start msg rc %lu->%lu, size %lu (%3s last)\n"
-            "          now:%0.3le, idle[now:%0.3le, prev:%0.3le]\n",
-            lp->gid, m->src_gid, m->final_dest_gid, m->net_msg_size_bytes,
-            m->event_size_bytes+m->local_event_size_bytes > 0 ? "is" : "not",
-            tw_now(lp), ns->net_send_next_idle, m->net_send_next_idle_saved);
-
     ns->net_send_next_idle = m->net_send_next_idle_saved;
 
 #if USE_RECV_QUEUE
     model_net_method_send_msg_recv_event_rc(lp);
 #endif
 
-    codes_local_latency_reverse(lp);
+    if(notify_sched)
+        codes_local_latency_reverse(lp);
 
     if(m->local_event_size_bytes > 0)
     {
@@ -486,40 +562,32 @@ static void handle_msg_start_rev_event(
     stat->send_count--;
     stat->send_bytes -= m->net_msg_size_bytes;
     stat->send_time -= m->xmit_time_saved;
-
-    return;
 }
 
-/* handler for msg start event; this indicates that the caller is trying to
- * transmit a message through this NIC
+/* puts the message on the wire once the host is done with it (host_delay
+ * from now) and the NIC is idle. notify_sched tells the send scheduler when
+ * the NIC is next available
  */
-static void handle_msg_start_event(
+static void msg_transmit(
     loggp_state * ns,
-    tw_bf * b,
     loggp_message * m,
+    const struct loggp_costs * param,
+    tw_stime host_delay,
+    int notify_sched,
     tw_lp * lp)
 {
     tw_event *e_new;
     loggp_message *m_new;
     tw_stime send_queue_time = 0;
+    tw_stime xmit_start;
     mn_stats* stat;
     int total_event_size;
     double xmit_time;
-    const struct param_table_entry *param;
-
-    param = find_params(m->net_msg_size_bytes, ns->params);
 
     total_event_size = model_net_get_msg_sz(LOGGP) + m->event_size_bytes +
         m->local_event_size_bytes;
 
-    /* NOTE: we do not use the o_s or o_r parameters here; as indicated in
-     * the netgauge paper those are typically overlapping with L (and the
-     * msg xfer as well) and therefore are more important for overlapping
-     * computation rather than simulating communication time.
-     */
     xmit_time = ((double)(m->net_msg_size_bytes-1)*param->G);
-    /* scale to nanoseconds */
-    xmit_time *= 1000.0;
     m->xmit_time_saved = xmit_time;
 
     //printf("handle_msg_start_event(), lp %llu.\n", (unsigned long long)lp->gid);
@@ -532,19 +600,17 @@ static void handle_msg_start_event(
         stat->max_event_size = total_event_size;
 
     /* calculate send time stamp */
-    send_queue_time = (param->L)*1000.0; 
-    /* bump up time if the NIC send queue isn't idle right now */
-    if(ns->net_send_next_idle > tw_now(lp))
-        send_queue_time += ns->net_send_next_idle - tw_now(lp);
+    send_queue_time = param->L;
+    /* bump up time if the host or the NIC send queue isn't idle right now */
+    xmit_start = maxd(tw_now(lp) + host_delay, ns->net_send_next_idle);
+    send_queue_time += xmit_start - tw_now(lp);
 
     /* move the next idle time ahead to after this transmission is
      * _complete_ from the sender's perspective, include gap paramater (g)
      * at this point. 
      */ 
     m->net_send_next_idle_saved = ns->net_send_next_idle;
-    if(ns->net_send_next_idle < tw_now(lp))
-        ns->net_send_next_idle = tw_now(lp);
-    ns->net_send_next_idle += xmit_time + param->g*1000.0;
+    ns->net_send_next_idle = xmit_start + xmit_time + param->g;
 
     dprintf("%lu (mn): start msg    %lu->%lu, size %lu (%3s last)\n"
             "          now:%0.3le, idle[prev:%0.3le, next:%0.3le], "
@@ -579,8 +645,9 @@ static void handle_msg_start_event(
 
     // now that message is sent, issue an "idle" event to tell the scheduler
     // when I'm next available
-    model_net_method_idle_event(codes_local_latency(lp) +
-            ns->net_send_next_idle - tw_now(lp), 0, lp);
+    if(notify_sched)
+        model_net_method_idle_event(codes_local_latency(lp) +
+                ns->net_send_next_idle - tw_now(lp), 0, lp);
 
     /* if there is a local event to handle, then create an event for it as
      * well
@@ -600,9 +667,138 @@ static void handle_msg_start_event(
         memcpy(m_new, m_loc, m->local_event_size_bytes);
         tw_event_send(e_new);
     }
+}
+
+/* sends a copy of m, including the remote and local event data, to the
+ * loggp LP dest as a rendezvous control message of the given type */
+static void send_ctrl_msg(
+    loggp_message * m,
+    tw_lpid dest,
+    tw_stime offset,
+    enum loggp_event_type type,
+    tw_lp * lp)
+{
+    tw_event *e_new;
+    loggp_message *m_new;
+    void *m_data;
+
+    e_new = model_net_method_event_new(dest, offset, lp, LOGGP,
+            (void**)&m_new, &m_data);
+    memcpy(m_new, m, sizeof(loggp_message));
+    if (m->event_size_bytes + m->local_event_size_bytes > 0){
+        memcpy(m_data, model_net_method_get_edata(LOGGP, m),
+                m->event_size_bytes + m->local_event_size_bytes);
+    }
+    m_new->event_type = type;
+    tw_event_send(e_new);
+}
+
+/* reverse computation for msg start event */
+static void handle_msg_start_rev_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp)
+{
+
+    dprintf("%lu (mn): start msg rc %lu->%lu, size %lu (%3s last)\n"
+            "          now:%0.3le, idle[now:%0.3le, prev:%0.3le]\n",
+            lp->gid, m->src_gid, m->final_dest_gid, m->net_msg_size_bytes,
+            m->event_size_bytes+m->local_event_size_bytes > 0 ? "is" : "not",
+            tw_now(lp), ns->net_send_next_idle, m->net_send_next_idle_saved);
+
+    if(ns->params->loggops)
+        ns->host_next_idle = m->host_next_idle_saved;
+
+    if(b->c1)
+    {
+        /* rendezvous: only the RTS was sent */
+        codes_local_latency_reverse(lp);
+        return;
+    }
+
+    msg_transmit_rc(ns, m, 1, lp);
+
     return;
 }
 
+/* handler for msg start event; this indicates that the caller is trying to
+ * transmit a message through this NIC
+ */
+static void handle_msg_start_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp)
+{
+    struct loggp_costs param;
+    tw_stime host_delay = 0;
+
+    find_params(m->net_msg_size_bytes, ns->params, &param);
+
+    /* NOTE: by default we do not use the o_s or o_r parameters here; as
+     * indicated in the netgauge paper those are typically overlapping with
+     * L (and the msg xfer as well) and therefore are more important for
+     * overlapping computation rather than simulating communication time.
+     * LogGOPS mode charges them to the host before the message can go out.
+     */
+    if(ns->params->loggops)
+        host_delay = host_overhead(ns, m, tw_now(lp), param.o_s, lp);
+
+    if(ns->params->rendezvous_threshold > 0 &&
+            m->net_msg_size_bytes > ns->params->rendezvous_threshold)
+    {
+        /* rendezvous: send a request-to-send to the receiving NIC; the data
+         * follows once its clear-to-send arrives. Control messages only pay
+         * the latency of the smallest message in the table */
+        b->c1 = 1;
+        send_ctrl_msg(m, m->dest_mn_lp,
+                host_delay + ns->params->table[0].L_ns, LG_MSG_RTS, lp);
+        model_net_method_idle_event(codes_local_latency(lp) + host_delay,
+                0, lp);
+        return;
+    }
+
+    msg_transmit(ns, m, &param, host_delay, 1, lp);
+    return;
+}
+
+/* handler for a request-to-send arriving at the receiving NIC: answer with a
+ * clear-to-send */
+static void handle_msg_rts_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp)
+{
+    send_ctrl_msg(m, m->src_mn_lp, ns->params->table[0].L_ns, LG_MSG_CTS,
+            lp);
+}
+
+/* reverse computation for clear-to-send event */
+static void handle_msg_cts_rev_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp)
+{
+    msg_transmit_rc(ns, m, 0, lp);
+}
+
+/* handler for a clear-to-send arriving back at the sending NIC: transmit the
+ * data. The scheduler was already told about the NIC when the RTS went out */
+static void handle_msg_cts_event(
+    loggp_state * ns,
+    tw_bf * b,
+    loggp_message * m,
+    tw_lp * lp)
+{
+    struct loggp_costs param;
+
+    find_params(m->net_msg_size_bytes, ns->params, &param);
+    msg_transmit(ns, m, &param, 0, 0, lp);
+}
+
 /* Model-net function calls */
 
 /*This method will serve as an intermediate layer between loggp and modelnet. 
@@ -723,39 +919,64 @@ void loggp_recv_msg_event_rc(tw_lp *sender){
     codes_local_latency_reverse(sender);
 }
 
-static void loggp_configure(){
+static void loggp_read_config(const char * anno, loggp_param * params){
     char config_file[MAX_NAME_LENGTH];
+    long int threshold = 0;
+
+    int rc = configuration_get_value_relpath(&config, "PARAMS",
+            "net_config_file", anno, config_file, MAX_NAME_LENGTH);
+    if (rc <= 0){
+        if (anno == NULL)
+            tw_error(TW_LOC, "unable to read PARAMS:net_config_file");
+        else
+            tw_error(TW_LOC, "unable to read PARAMS:net_config_file@%s",
+                    anno);
+    }
+    loggp_set_params(config_file, params);
+
+    params->interpolate = 0;
+    configuration_get_value_int(&config, "PARAMS", "net_config_interpolate",
+            anno, &params->interpolate);
+
+    params->loggops = 0;
+    configuration_get_value_int(&config, "PARAMS", "loggp_overhead", anno,
+            &params->loggops);
+    params->O = 0.0;
+    configuration_get_value_double(&config, "PARAMS", "loggp_O", anno,
+            &params->O);
+    configuration_get_value_longint(&config, "PARAMS",
+            "loggp_rendezvous_threshold", anno, &threshold);
+    if (threshold < 0)
+        tw_error(TW_LOC, "PARAMS:loggp_rendezvous_threshold must be >= 0");
+    params->rendezvous_threshold = (uint64_t)threshold;
+}
 
+static void loggp_configure(){
     anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
     assert(anno_map);
     num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
-    all_params = malloc(num_params * sizeof(*all_params));
+    all_params = calloc(num_params, sizeof(*all_params));
 
     for (uint64_t i = 0; i < anno_map->num_annos; i++){
-        const char * anno = anno_map->annotations[i].ptr;
-        int rc = configuration_get_value_relpath(&config, "PARAMS",
-                "net_config_file", anno, config_file, MAX_NAME_LENGTH);
-        if (rc <= 0){
-            tw_error(TW_LOC, "unable to read PARAMS:net_config_file@%s",
-                    anno);
-        }
-        loggp_set_params(config_file, &all_params[i]);
+        loggp_read_config(anno_map->annotations[i].ptr, &all_params[i]);
     }
     if (anno_map->has_unanno_lp > 0){
-        int rc = configuration_get_value_relpath(&config, "PARAMS",
-                "net_config_file", NULL, config_file, MAX_NAME_LENGTH);
-        if (rc <= 0){
-            tw_error(TW_LOC, "unable to read PARAMS:net_config_file");
-        }
-        loggp_set_params(config_file, &all_params[anno_map->num_annos]);
+        loggp_read_config(NULL, &all_params[anno_map->num_annos]);
     }
 }
 
+static int cmp_table_entry(const void *a, const void *b)
+{
+    const param_table_entry *ea = a, *eb = b;
+    return (ea->size > eb->size) - (ea->size < eb->size);
+}
+
 void loggp_set_params(const char * config_file, loggp_param * params){
     FILE *conf;
     int ret;
     char buffer[512];
     int line_nr = 0;
+    int table_cap = 64;
     printf("Loggp configured to use parameters from file %s\n", config_file);
 
     conf = fopen(config_file, "r");
@@ -766,32 +987,47 @@ void loggp_set_params(const char * config_file, loggp_param * params){
     }
 
     params->table_size = 0;
+    params->table = malloc(table_cap * sizeof(*params->table));
+    assert(params->table);
     while(fgets(buffer, 512, conf))
     {
+        param_table_entry *e;
+
         line_nr++;
         if(buffer[0] == '#')
             continue;
+        if(params->table_size == table_cap)
+        {
+            table_cap *= 2;
+            params->table = realloc(params->table,
+                    table_cap * sizeof(*params->table));
+            assert(params->table);
+        }
+        e = &params->table[params->table_size];
         ret = sscanf(buffer, "%llu %d %lf %lf %lf %lf %lf %lf %lf %lf %lf", 
-            &params->table[params->table_size].size,
-            &params->table[params->table_size].n,
-            &params->table[params->table_size].PRTT_10s,
-            &params->table[params->table_size].PRTT_n0s,
-            &params->table[params->table_size].PRTT_nPRTT_10ss,
-            &params->table[params->table_size].L,
-            &params->table[params->table_size].o_s,
-            &params->table[params->table_size].o_r,
-            &params->table[params->table_size].g,
-            &params->table[params->table_size].G,
-            &params->table[params->table_size].lsqu_gG);
+            &e->size, &e->n, &e->PRTT_10s, &e->PRTT_n0s,
+            &e->PRTT_nPRTT_10ss, &e->L, &e->o_s, &e->o_r, &e->g, &e->G,
+            &e->lsqu_gG);
         if(ret != 11)
         {
             fprintf(stderr, "Error: malformed line %d in %s\n", line_nr, 
                 config_file);
             assert(0);
         }
+        /* netgauge reports microseconds */
+        e->L_ns = e->L * 1000.0;
+        e->o_s_ns = e->o_s * 1000.0;
+        e->o_r_ns = e->o_r * 1000.0;
+        e->g_ns = e->g * 1000.0;
+        e->G_ns = e->G * 1000.0;
         params->table_size++;
     }
 
+    if(params->table_size == 0)
+        tw_error(TW_LOC, "no loggp table entries in %s\n", config_file);
+    qsort(params->table, params->table_size, sizeof(*params->table),
+            cmp_table_entry);
+
     printf("Parsed %d loggp table entries.\n", params->table_size);
 
     fclose(conf);
@@ -807,26 +1043,47 @@ static void loggp_packet_event_rc(tw_lp *sender)
 
 /* find the parameters corresponding to the message size we are transmitting
  */
-static const struct param_table_entry* find_params(
+static void find_params(
         uint64_t msg_size,
-        const loggp_param *params) {
-    int i;
+        const loggp_param *params,
+        struct loggp_costs *costs) {
+    const param_table_entry *t = params->table;
+    int lo = 0, hi = params->table_size;
 
-    /* pick parameters based on the next smallest size in the table, but
-     * default to beginning or end of table if we are out of range
-     */
+    /* binary search for the first entry larger than the message */
+    while(lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if(t[mid].size > msg_size)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
 
-    for(i=0; i < params->table_size; i++)
+    if(params->interpolate && lo > 0 && lo < params->table_size)
     {
-        if(params->table[i].size > msg_size)
-        {
-            break;
-        }
+        /* piecewise-linear between the surrounding rows */
+        const param_table_entry *a = &t[lo-1], *b = &t[lo];
+        double f = (double)(msg_size - a->size) / (double)(b->size - a->size);
+        costs->L = a->L_ns + f * (b->L_ns - a->L_ns);
+        costs->o_s = a->o_s_ns + f * (b->o_s_ns - a->o_s_ns);
+        costs->o_r = a->o_r_ns + f * (b->o_r_ns - a->o_r_ns);
+        costs->g = a->g_ns + f * (b->g_ns - a->g_ns);
+        costs->G = a->G_ns + f * (b->G_ns - a->G_ns);
+        return;
     }
-    if(i>=params->table_size)
-        i = params->table_size-1;
 
-    return(&params->table[i]);
+    /* pick parameters based on the next size up in the table, but
+     * default to the end of table if we are out of range
+     */
+    if(lo >= params->table_size)
+        lo = params->table_size-1;
+
+    costs->L = t[lo].L_ns;
+    costs->o_s = t[lo].o_s_ns;
+    costs->o_r = t[lo].o_r_ns;
+    costs->g = t[lo].g_ns;
+    costs->G = t[lo].G_ns;
 }
 
 /*
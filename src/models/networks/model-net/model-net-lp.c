@@ -5,6 +5,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 #include "codes/model-net.h"
 #include "codes/model-net-method.h"
@@ -43,12 +44,22 @@ typedef struct model_net_base_state {
     model_net_sched *sched_send, *sched_recv;
     // parameters
     const model_net_base_params * params;
-    // lp type and state of underlying model net method - cache here so we
-    // don't have to constantly look up
+    // lp type of underlying model net method - cache here so we don't have
+    // to constantly look up. The method's state itself lives inline after
+    // this struct (see MN_SUB_STATE)
     const tw_lptype *sub_type;
-    void *sub_state;
 } model_net_base_state;
 
+// the underlying method's state is placed directly after the base state,
+// starting on a cache line boundary, so dispatching an event doesn't chase a
+// separately allocated block. model_net_base_register sizes the LP state to
+// hold the largest configured method
+#define MN_CACHE_LINE 64
+#define MN_SUB_STATE_OFFSET \
+    ((sizeof(model_net_base_state) + MN_CACHE_LINE - 1) & \
+     ~(size_t)(MN_CACHE_LINE - 1))
+#define MN_SUB_STATE(_ns) ((void*)((char*)(_ns) + MN_SUB_STATE_OFFSET))
+
 
 /**** END SIMULATION DATA STRUCTURES ****/
 
@@ -110,6 +121,17 @@ tw_lptype model_net_base_lp = {
 /**** BEGIN IMPLEMENTATIONS ****/
 
 void model_net_base_register(int *do_config_nets){
+    // size the base lp state so any configured method's state fits inline
+    size_t max_sub_sz = 0;
+    for (int i = 0; i < MAX_NETS; i++){
+        if (do_config_nets[i]){
+            const tw_lptype *sub = method_array[i]->mn_get_lp_type();
+            if (sub->state_sz > max_sub_sz)
+                max_sub_sz = sub->state_sz;
+        }
+    }
+    model_net_base_lp.state_sz = MN_SUB_STATE_OFFSET + max_sub_sz;
+
     // here, we initialize ALL lp types to use the base type
     for (int i = 0; i < MAX_NETS; i++){
         if (do_config_nets[i]){
@@ -226,6 +248,16 @@ void model_net_base_configure(){
         offsetof(model_net_wrap_msg, msg.m_dfly);
     msg_offsets[LOGGP] =
         offsetof(model_net_wrap_msg, msg.m_loggp);
+    msg_offsets[FATTREE] =
+        offsetof(model_net_wrap_msg, msg.m_fattree);
+    msg_offsets[SLIMFLY] =
+        offsetof(model_net_wrap_msg, msg.m_slimfly);
+    msg_offsets[HYPERX] =
+        offsetof(model_net_wrap_msg, msg.m_hyperx);
+    msg_offsets[GRAPH] =
+        offsetof(model_net_wrap_msg, msg.m_graph);
+    msg_offsets[FLOW] =
+        offsetof(model_net_wrap_msg, msg.m_flow);
 
     // perform the configuration(s)
     // This part is tricky, as we basically have to look up all annotations that
@@ -310,10 +342,10 @@ void model_net_base_lp_init(
     ns->sub_type = model_net_get_lp_type(ns->net_id);
     // NOTE: some models actually expect LP state to be 0 initialized...
     // *cough anything that uses mn_stats_array cough*
-    ns->sub_state = calloc(1, ns->sub_type->state_sz);
+    memset(MN_SUB_STATE(ns), 0, ns->sub_type->state_sz);
 
     // initialize the model-net method
-    ns->sub_type->init(ns->sub_state, lp);
+    ns->sub_type->init(MN_SUB_STATE(ns), lp);
 }
 
 void model_net_base_event(
@@ -332,7 +364,7 @@ void model_net_base_event(
             break;
         case MN_BASE_PASS: ;
             void * sub_msg = ((char*)m)+msg_offsets[ns->net_id];
-            ns->sub_type->event(ns->sub_state, b, sub_msg, lp);
+            ns->sub_type->event(MN_SUB_STATE(ns), b, sub_msg, lp);
             break;
         /* ... */
         default:
@@ -357,7 +389,7 @@ void model_net_base_event_rc(
             break;
         case MN_BASE_PASS: ;
             void * sub_msg = ((char*)m)+msg_offsets[ns->net_id];
-            ns->sub_type->revent(ns->sub_state, b, sub_msg, lp);
+            ns->sub_type->revent(MN_SUB_STATE(ns), b, sub_msg, lp);
             break;
         /* ... */
         default:
@@ -371,8 +403,7 @@ void model_net_base_event_rc(
 void model_net_base_finalize(
         model_net_base_state * ns,
         tw_lp * lp){
-    ns->sub_type->final(ns->sub_state, lp);
-    free(ns->sub_state);
+    ns->sub_type->final(MN_SUB_STATE(ns), lp);
 }
 
 /// bitfields used:
@@ -456,7 +487,7 @@ void handle_sched_next(
     // callback-based scheduling loop (model_net_method_idle_event).
     // For all others, we need to schedule the next packet
     // immediately
-    else if (ns->net_id == SIMPLEP2P || ns->net_id == TORUS){
+    else if (ns->net_id == SIMPLEP2P){
         tw_event *e = codes_event_new(lp->gid, 
                 poffset+codes_local_latency(lp), lp);
         model_net_wrap_msg *m_wrap = tw_event_data(e);
@@ -482,7 +513,7 @@ void handle_sched_next_rc(
     if (b->c0){
         *in_sched_loop = 1;
     }
-    else if (ns->net_id == SIMPLEP2P || ns->net_id == TORUS){
+    else if (ns->net_id == SIMPLEP2P){
         codes_local_latency_reverse(lp);
     }
 }
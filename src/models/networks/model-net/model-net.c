@@ -22,6 +22,11 @@ extern struct model_net_method simplep2p_method;
 extern struct model_net_method torus_method;
 extern struct model_net_method dragonfly_method;
 extern struct model_net_method loggp_method;
+extern struct model_net_method fattree_method;
+extern struct model_net_method slimfly_method;
+extern struct model_net_method hyperx_method;
+extern struct model_net_method graph_method;
+extern struct model_net_method flow_method;
 
 #define X(a,b,c,d) b,
 char * model_net_lp_config_names[] = {
@@ -28,6 +28,10 @@ struct simplenet_param
 {
   double net_startup_ns; /*simplenet startup cost*/
   double net_bw_mbps; /*Link bandwidth per byte*/
+  /* optional single crossbar switch connecting all NICs */
+  int switch_mode;
+  double switch_port_bw_mbps; /* per output port bandwidth */
+  uint64_t switch_buffer_bytes; /* per output port buffer, 0 = unlimited */
 };
 typedef struct simplenet_param simplenet_param;
 
@@ -39,6 +43,9 @@ struct sn_state
     /* next idle times for network card, both inbound and outbound */
     tw_stime net_send_next_idle;
     tw_stime net_recv_next_idle;
+    /* in switch mode, the switch output port leading to this NIC is owned
+     * by this LP and replaces the inbound queue above */
+    tw_stime switch_port_next_idle;
     const char * anno;
     simplenet_param params;
     struct mn_stats sn_stats_array[CATEGORY_MAX];
@@ -177,6 +184,16 @@ static void handle_msg_start_event(
     tw_bf * b,
     sn_message * m,
     tw_lp * lp);
+static void handle_switch_ack_rev_event(
+    sn_state * ns,
+    tw_bf * b,
+    sn_message * m,
+    tw_lp * lp);
+static void handle_switch_ack_event(
+    sn_state * ns,
+    tw_bf * b,
+    sn_message * m,
+    tw_lp * lp);
 
 /* returns pointer to LP information for simplenet module */
 static const tw_lptype* sn_get_lp_type()
@@ -221,6 +238,7 @@ static void sn_init(
     /* all devices are idle to begin with */
     ns->net_send_next_idle = tw_now(lp);
     ns->net_recv_next_idle = tw_now(lp);
+    ns->switch_port_next_idle = tw_now(lp);
 
     ns->anno = codes_mapping_get_annotation_by_lpid(lp->gid);
     if (ns->anno == NULL)
@@ -253,6 +271,9 @@ static void sn_event(
         case SN_MSG_READY:
             handle_msg_ready_event(ns, b, m, lp);
             break;
+        case SN_SWITCH_ACK:
+            handle_switch_ack_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -275,6 +296,9 @@ static void sn_rev_event(
         case SN_MSG_READY:
             handle_msg_ready_rev_event(ns, b, m, lp);
             break;
+        case SN_SWITCH_ACK:
+            handle_switch_ack_rev_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -320,13 +344,18 @@ static void handle_msg_ready_rev_event(
 {
     struct mn_stats* stat;
 
-    ns->net_recv_next_idle = m->net_recv_next_idle_saved;
-    
     stat = model_net_find_stats(m->category, ns->sn_stats_array);
     stat->recv_count--;
     stat->recv_bytes -= m->net_msg_size_bytes;
     stat->recv_time = m->recv_time_saved;
 
+    if (ns->params.switch_mode){
+        ns->switch_port_next_idle = m->switch_port_next_idle_saved;
+        codes_local_latency_reverse(lp);
+    }
+    else
+        ns->net_recv_next_idle = m->net_recv_next_idle_saved;
+
     if (m->event_size_bytes && m->is_pull){
         int net_id = model_net_get_id(LP_METHOD_NM);
         model_net_event_rc(net_id, lp, m->pull_size);
@@ -335,6 +364,59 @@ static void handle_msg_ready_rev_event(
     return;
 }
 
+/* switch mode: the message has reached the switch output port leading to
+ * this NIC.  The port buffer is treated as a fluid queue draining at the
+ * port bandwidth, so its occupancy is the amount of data that has yet to
+ * leave the port.  If the message doesn't fit, it is held on the input side
+ * until enough has drained, and the sender is only acknowledged (and thus
+ * allowed to transmit again) once the message has been accepted.  Returns
+ * the delay until the message has been delivered to this NIC. */
+static tw_stime switch_port_enqueue(
+    sn_state * ns,
+    sn_message * m,
+    tw_lp * lp)
+{
+    tw_stime backlog = 0, stall = 0, delivery;
+    double bytes_per_ns = ns->params.switch_port_bw_mbps * 1024.0 * 1024.0 /
+        (1000.0 * 1000.0 * 1000.0);
+    uint64_t limit = ns->params.switch_buffer_bytes;
+
+    if (ns->switch_port_next_idle > tw_now(lp))
+        backlog = ns->switch_port_next_idle - tw_now(lp);
+
+    if (limit > 0){
+        double occupancy = backlog * bytes_per_ns;
+        /* a message larger than the buffer waits for the port to drain */
+        if (m->net_msg_size_bytes >= limit)
+            stall = backlog;
+        else if (occupancy + m->net_msg_size_bytes > limit)
+            stall = (occupancy + m->net_msg_size_bytes - limit) /
+                bytes_per_ns;
+    }
+
+    m->switch_port_next_idle_saved = ns->switch_port_next_idle;
+    delivery = backlog + rate_to_ns(m->net_msg_size_bytes,
+            ns->params.switch_port_bw_mbps);
+    ns->switch_port_next_idle = tw_now(lp) + delivery;
+
+    /* release the sender once its message is in the output buffer */
+    void *m_data;
+    sn_message *m_new;
+    tw_event *e_new = model_net_method_event_new(m->src_mn_lp,
+            stall + codes_local_latency(lp), lp, SIMPLENET, (void**)&m_new,
+            &m_data);
+    memcpy(m_new, m, sizeof(sn_message));
+    m_new->event_type = SN_SWITCH_ACK;
+    m_new->event_size_bytes = 0;
+    if (m->local_event_size_bytes > 0){
+        memcpy(m_data, (char*) model_net_method_get_edata(SIMPLENET, m) +
+                m->event_size_bytes, m->local_event_size_bytes);
+    }
+    tw_event_send(e_new);
+
+    return delivery;
+}
+
 /* handler for msg ready event.  This indicates that a message is available
  * to recv, but we haven't checked to see if the recv queue is available yet
  */
@@ -356,18 +438,22 @@ static void handle_msg_ready_event(
     stat->recv_time += rate_to_ns(m->net_msg_size_bytes,
             ns->params.net_bw_mbps);
 
-    /* are we available to recv the msg? */
-    /* were we available when the transmission was started? */
-    if(ns->net_recv_next_idle > tw_now(lp))
-        recv_queue_time += ns->net_recv_next_idle - tw_now(lp);
-
-    /* calculate transfer time based on msg size and bandwidth */
-    recv_queue_time += rate_to_ns(m->net_msg_size_bytes,
-            ns->params.net_bw_mbps);
-
-    /* bump up input queue idle time accordingly */
-    m->net_recv_next_idle_saved = ns->net_recv_next_idle;
-    ns->net_recv_next_idle = recv_queue_time + tw_now(lp);
+    if (ns->params.switch_mode)
+        recv_queue_time = switch_port_enqueue(ns, m, lp);
+    else{
+        /* are we available to recv the msg? */
+        /* were we available when the transmission was started? */
+        if(ns->net_recv_next_idle > tw_now(lp))
+            recv_queue_time += ns->net_recv_next_idle - tw_now(lp);
+
+        /* calculate transfer time based on msg size and bandwidth */
+        recv_queue_time += rate_to_ns(m->net_msg_size_bytes,
+                ns->params.net_bw_mbps);
+
+        /* bump up input queue idle time accordingly */
+        m->net_recv_next_idle_saved = ns->net_recv_next_idle;
+        ns->net_recv_next_idle = recv_queue_time + tw_now(lp);
+    }
 
     /* copy only the part of the message used by higher level */
     if(m->event_size_bytes)
@@ -409,11 +495,13 @@ static void handle_msg_start_rev_event(
 {
     ns->net_send_next_idle = m->net_send_next_idle_saved;
 
-    codes_local_latency_reverse(lp);
-
-    if(m->local_event_size_bytes > 0)
-    {
+    if (!ns->params.switch_mode){
         codes_local_latency_reverse(lp);
+
+        if(m->local_event_size_bytes > 0)
+        {
+            codes_local_latency_reverse(lp);
+        }
     }
 
     mn_stats* stat;
@@ -485,6 +573,18 @@ static void handle_msg_start_event(
     
     //print_base_from(SIMPLENET, m_new);
     //print_msg(m_new);
+
+    /* in switch mode the sender is released by the switch acknowledgement,
+     * which also carries the local completion event */
+    if (ns->params.switch_mode){
+        if (m->local_event_size_bytes > 0){
+            memcpy((char*)m_data + m->event_size_bytes,
+                    (char*) model_net_method_get_edata(SIMPLENET, m) +
+                    m->event_size_bytes, m->local_event_size_bytes);
+        }
+        tw_event_send(e_new);
+        return;
+    }
     tw_event_send(e_new);
 
     // now that message is sent, issue an "idle" event to tell the scheduler
@@ -515,6 +615,56 @@ static void handle_msg_start_event(
     return;
 }
 
+/* reverse computation for switch ack event */
+static void handle_switch_ack_rev_event(
+    sn_state * ns,
+    tw_bf * b,
+    sn_message * m,
+    tw_lp * lp)
+{
+    ns->net_send_next_idle = m->net_send_next_idle_saved;
+
+    codes_local_latency_reverse(lp);
+
+    if(m->local_event_size_bytes > 0)
+    {
+        codes_local_latency_reverse(lp);
+    }
+
+    return;
+}
+
+/* handler for switch ack event (switch mode only); the switch output buffer
+ * has accepted our message, so the NIC may move on to the next one.  If the
+ * message was held back by a full buffer, the NIC has been blocked until
+ * now */
+static void handle_switch_ack_event(
+    sn_state * ns,
+    tw_bf * b,
+    sn_message * m,
+    tw_lp * lp)
+{
+    tw_event *e_new;
+
+    m->net_send_next_idle_saved = ns->net_send_next_idle;
+    if(ns->net_send_next_idle < tw_now(lp))
+        ns->net_send_next_idle = tw_now(lp);
+
+    model_net_method_idle_event(codes_local_latency(lp) +
+            ns->net_send_next_idle - tw_now(lp), 0, lp);
+
+    if(m->local_event_size_bytes > 0)
+    {
+        e_new = tw_event_new(m->src_gid, codes_local_latency(lp), lp);
+        memcpy(tw_event_data(e_new),
+                model_net_method_get_edata(SIMPLENET, m),
+                m->local_event_size_bytes);
+        tw_event_send(e_new);
+    }
+
+    return;
+}
+
 /* Model-net function calls */
 
 /*This method will serve as an intermediate layer between simplenet and modelnet. 
@@ -578,6 +728,42 @@ static tw_stime simplenet_packet_event(
      return xfer_to_nic_time;
 }
 
+static void sn_read_config(const char * anno, simplenet_param *p)
+{
+    int rc;
+    memset(p, 0, sizeof(*p));
+    rc = configuration_get_value_double(&config, "PARAMS", "net_startup_ns",
+            anno, &p->net_startup_ns);
+    if (rc != 0){
+        tw_error(TW_LOC, "simplenet: unable to read PARAMS:net_startup_ns@%s",
+                anno);
+    }
+    rc = configuration_get_value_double(&config, "PARAMS", "net_bw_mbps",
+            anno, &p->net_bw_mbps);
+    if (rc != 0){
+        tw_error(TW_LOC, "simplenet: unable to read PARAMS:net_bw_mbps@%s",
+                anno);
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "net_switch", anno,
+            &p->switch_mode);
+    if (p->switch_mode){
+        long buffer = 0;
+        rc = configuration_get_value_double(&config, "PARAMS",
+                "net_switch_port_bw_mbps", anno, &p->switch_port_bw_mbps);
+        if (rc != 0)
+            p->switch_port_bw_mbps = p->net_bw_mbps;
+        configuration_get_value_longint(&config, "PARAMS",
+                "net_switch_buffer_bytes", anno, &buffer);
+        if (p->switch_port_bw_mbps <= 0.0 || buffer < 0){
+            tw_error(TW_LOC, "simplenet: net_switch needs a positive "
+                    "PARAMS:net_switch_port_bw_mbps@%s and a non-negative "
+                    "PARAMS:net_switch_buffer_bytes@%s", anno, anno);
+        }
+        p->switch_buffer_bytes = buffer;
+    }
+}
+
 static void sn_configure()
 {
     anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
@@ -585,35 +771,10 @@ static void sn_configure()
     num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
     all_params = malloc(num_params * sizeof(*all_params));
     for (uint64_t i = 0; i < anno_map->num_annos; i++){
-        const char * anno = anno_map->annotations[i].ptr;
-        int rc;
-        rc = configuration_get_value_double(&config, "PARAMS",
-                "net_startup_ns", anno, &all_params[i].net_startup_ns);
-        if (rc != 0){
-            tw_error(TW_LOC,
-                    "simplenet: unable to read PARAMS:net_startup_ns@%s",
-                    anno);
-        }
-        rc = configuration_get_value_double(&config, "PARAMS", "net_bw_mbps",
-                anno, &all_params[i].net_bw_mbps);
-        if (rc != 0){
-            tw_error(TW_LOC, "simplenet: unable to read PARAMS:net_bw_mbps@%s",
-                    anno);
-        }
+        sn_read_config(anno_map->annotations[i].ptr, &all_params[i]);
     }
     if (anno_map->has_unanno_lp > 0){
-        int rc;
-        rc = configuration_get_value_double(&config, "PARAMS",
-                "net_startup_ns", NULL,
-                &all_params[num_params-1].net_startup_ns);
-        if (rc != 0){
-            tw_error(TW_LOC, "simplenet: unable to read PARAMS:net_startup_ns");
-        }
-        rc = configuration_get_value_double(&config, "PARAMS", "net_bw_mbps",
-                NULL, &all_params[num_params-1].net_bw_mbps);
-        if (rc != 0){
-            tw_error(TW_LOC, "simplenet: unable to read PARAMS:net_bw_mbps");
-        }
+        sn_read_config(NULL, &all_params[num_params-1]);
     }
 }
 
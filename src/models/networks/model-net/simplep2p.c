@@ -6,6 +6,10 @@
 
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <ross.h>
 
 #include "codes/lp-io.h"
@@ -15,6 +19,8 @@
 #include "codes/model-net-lp.h"
 #include "codes/codes_mapping.h"
 #include "codes/codes.h"
+#include "codes/quickhash.h"
+#include "codes/quicklist.h"
 #include "codes/net/simplep2p.h"
 
 #define CATEGORY_NAME_MAX 16
@@ -22,15 +28,78 @@
 
 #define SIMPLEP2P_DEBUG 0
 
+/* hash table sizes for the per-LP peer idle times and the link exceptions
+ * of a net_link_file */
+#define SP_PEER_HASH_SIZE 32
+#define SP_LINK_HASH_SIZE 1021
+
+/* binary link matrix (net_matrix_file) layout: a header, then the float32
+ * latency (ns) pairs followed by the float32 bandwidth (MiB/s) pairs. Each
+ * pair is egress, ingress. A full matrix stores N*N pairs row by row, a
+ * triangular one the N*(N-1)/2 pairs x:y with x < y (y:x mirrors x:y).
+ * misc/simplep2p-matrix-convert.py writes it from the text matrices */
+#define SP_MATRIX_MAGIC "SP2PMAT"
+#define SP_MATRIX_VERSION 1
+#define SP_MATRIX_TRI 0x1
+struct sp_matrix_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t num_lps;
+    uint32_t reserved[3];
+};
+
 #define LP_CONFIG_NM (model_net_lp_config_names[SIMPLEP2P])
 #define LP_METHOD_NM (model_net_method_names[SIMPLEP2P])
 
+/* sides of a NIC in fair sharing mode */
+#define SP_SEND 0
+#define SP_RECV 1
+
+static double maxd(double a, double b) { return a < b ? b : a; }
+
+/* latencies and bandwidths of a directed link, index 0 is the egress
+ * (outgoing) value and 1 the ingress (incoming) one */
+struct sp_link
+{
+    double latency_ns[2];
+    double bw_mbps[2];
+};
+
+/* a link of a net_link_file that differs from the default */
+struct sp_link_entry
+{
+    int from_id;
+    int to_id;
+    struct sp_link link;
+    struct qhash_head hash_link;
+};
+
 // parameters for simplep2p configuration
 struct simplep2p_param
 {
+    /* dense tables, read from net_latency_ns_file/net_bw_mbps_file */
     double * net_latency_ns_table;
     double * net_bw_mbps_table;
 
+    /* sparse store, read from net_link_file: every link not listed uses
+     * default_link */
+    int is_sparse;
+    struct sp_link default_link;
+    struct qhash_table * link_exceptions;
+
+    /* binary matrices, mapped read-only from net_matrix_file so that all
+     * ranks of a node share the page cache copy */
+    const float * mm_latency_ns;
+    const float * mm_bw_mbps;
+    int mm_is_tri;
+
+    /* fair sharing mode: each NIC has an aggregate send and recv capacity
+     * (MiB/s, indexed by SP_SEND/SP_RECV) shared by its active flows */
+    int fair_sharing;
+    double nic_bw_mbps[2];
+
     int mat_len;
     int num_lps;
 };
@@ -51,17 +120,58 @@ struct category_idles_s{
     char category[CATEGORY_NAME_MAX];
 };
 
+/* a message being transferred through one side of a NIC in fair sharing
+ * mode. The message's event data follows the struct */
+struct sp_flow
+{
+    sp_message msg;
+    /* virtual time at which the flow has been fully served */
+    double finish_tag;
+    struct qlist_head ql;
+};
+
+/* one side of a NIC in fair sharing mode. The active flows share the side's
+ * capacity equally (processor sharing); the share a flow can't use because
+ * of its link or its peer is not given to the others. vtime counts the bytes
+ * served to each active flow, so a flow is done once vtime reaches its finish
+ * tag, and only the first flow needs a completion event. Starting or
+ * finishing a flow changes the shares: the generation is bumped and a new
+ * completion event is scheduled, outdated ones are ignored */
+struct sp_fair_side
+{
+    double vtime;
+    tw_stime last_update;
+    int num_flows;
+    int generation;
+    /* sorted by finish tag */
+    struct qlist_head flows;
+};
+
+/* next idle times of the connection to a peer NIC, both inbound and
+ * outbound. Only peers that have been talked to have an entry */
+struct sp_peer_idle
+{
+    int peer_id;
+    tw_stime send_next_idle;
+    tw_stime recv_next_idle;
+    struct qhash_head hash_link;
+};
+
 struct sp_state
 {
-    /* next idle times for network card, both inbound and outbound */
-    tw_stime *send_next_idle;
-    tw_stime *recv_next_idle;
+    /* next idle times for network card, both inbound and outbound, per
+     * peer (struct sp_peer_idle) */
+    struct qhash_table *peer_idles;
 
     const char * anno;
     const simplep2p_param * params;
 
     int id; /* logical id for matrix lookups */
 
+    /* fair sharing mode: the send and recv sides of the NIC */
+    struct sp_fair_side fair[2];
+    uint64_t flow_seq;
+
     /* Each simplep2p "NIC" actually has N connections, so we need to track
      * idle times across all of them to correctly do stats.
      * Additionally need to track different idle times across different 
@@ -90,6 +200,7 @@ static const tw_lptype* sp_get_lp_type(void);
 static void sp_set_params(
         const char      * latency_fname,
         const char      * bw_fname,
+        int               is_tri_mat,
         simplep2p_param * params);
 
 static void sp_configure();
@@ -112,6 +223,20 @@ static double sp_get_table_ent(
         int      num_lps,
         double * table);
 
+/* looks up the bandwidth and latency of the link from_id -> to_id in either
+ * the dense tables or the sparse store */
+static void sp_get_link_params(
+        const simplep2p_param * params,
+        int      from_id,
+        int      to_id,
+        int      is_incoming,
+        double * bw,
+        double * latency);
+
+/* returns the idle times of the connection to peer_id, adding an entry if
+ * there is none yet */
+static struct sp_peer_idle* sp_get_peer_idle(sp_state * ns, int peer_id);
+
 /* category lookup */
 static category_idles* sp_get_category_idles(
         char * category, category_idles *idles);
@@ -208,6 +333,16 @@ static void handle_msg_start_event(
     tw_bf * b,
     sp_message * m,
     tw_lp * lp);
+static void handle_flow_done_rev_event(
+    sp_state * ns,
+    tw_bf * b,
+    sp_message * m,
+    tw_lp * lp);
+static void handle_flow_done_event(
+    sp_state * ns,
+    tw_bf * b,
+    sp_message * m,
+    tw_lp * lp);
 
 /* collective network calls */
 static void simple_wan_collective()
@@ -236,6 +371,33 @@ static int sp_get_msg_sz(void)
     return(sizeof(sp_message));
 }
 
+static int sp_peer_idle_compare(void *key, struct qhash_head *link)
+{
+    struct sp_peer_idle *p = qhash_entry(link, struct sp_peer_idle, hash_link);
+    return p->peer_id == *(int*)key;
+}
+
+static int sp_peer_idle_hash(void *key, int table_size)
+{
+    return *(int*)key % table_size;
+}
+
+/* keys of the link exceptions are {from_id, to_id} */
+static int sp_link_compare(void *key, struct qhash_head *link)
+{
+    struct sp_link_entry *e =
+        qhash_entry(link, struct sp_link_entry, hash_link);
+    int *ids = key;
+    return e->from_id == ids[0] && e->to_id == ids[1];
+}
+
+static int sp_link_hash(void *key, int table_size)
+{
+    int *ids = key;
+    return (int)(((unsigned)ids[0] * 2654435761u ^ (unsigned)ids[1]) %
+            (unsigned)table_size);
+}
+
 static double * parse_mat(char * buf, int *nvals_first, int *nvals_total, int is_tri_mat){
     int bufn = 128;
     double *vals = malloc(bufn*sizeof(double));
@@ -271,7 +433,7 @@ static double * parse_mat(char * buf, int *nvals_first, int *nvals_total, int is
         if (*nvals_first == 0) {
             *nvals_first = line_ct;
         }
-        else if (is_tri_mat && line_ct != line_ct_prev-1){
+        else if (is_tri_mat && line_ct != line_ct_prev-2){
             fprintf(stderr, "ERROR: tokens in line don't match triangular matrix format\n");
             exit(1);
         }
@@ -286,20 +448,24 @@ static double * parse_mat(char * buf, int *nvals_first, int *nvals_total, int is
     return vals;
 }
 
+/* expands the egress,ingress pairs of a triangular matrix into the full
+ * N x 2N layout */
 static void fill_tri_mat(int N, double *mat, double *tri){
     int i, j, p = 0;
     /* first fill in triangular mat entries */
     for (i = 0; i < N; i++){
-        double *row = mat + i*N;
-        row[i] = 0.0;
+        double *row = mat + 2*i*N;
+        row[2*i] = row[2*i+1] = 0.0;
         for (j = i+1; j < N; j++){
-            row[j] = tri[p++];
+            row[2*j] = tri[p++];
+            row[2*j+1] = tri[p++];
         }
     }
     /* now fill in remaining entries (basically a transpose) */
     for (i = 1; i < N; i++){
         for (j = 0; j < i; j++){
-            mat[i*N+j] = mat[j*N+i];
+            mat[2*(i*N+j)] = mat[2*(j*N+i)];
+            mat[2*(i*N+j)+1] = mat[2*(j*N+i)+1];
         }
     }
 }
@@ -308,10 +474,9 @@ static void fill_tri_mat(int N, double *mat, double *tri){
 static void sp_set_params(
         const char      * latency_fname,
         const char      * bw_fname,
+        int               is_tri_mat,
         simplep2p_param * params){
     long int fsize_s, fsize_b;
-    /* TODO: make this a run-time option */
-    int is_tri_mat = 0;
 
     /* slurp the files */
     FILE *sf = fopen(latency_fname, "r");
@@ -341,17 +506,17 @@ static void sp_set_params(
             &nvals_total_s, is_tri_mat);
     double *bw_tmp = parse_mat(bbuf, &nvals_first_b, &nvals_total_b, is_tri_mat);
 
-    /* convert tri mat into a regular mat */
+    /* convert tri mat into a regular mat (the first row of a triangular
+     * matrix lacks the 1:1 pair) */
     assert(nvals_first_s == nvals_first_b);
-    params->mat_len = nvals_first_s + ((is_tri_mat) ? 1 : 0);
+    params->mat_len = nvals_first_s + ((is_tri_mat) ? 2 : 0);
     if (is_tri_mat){
-        params->net_latency_ns_table = 
-            malloc(2*params->mat_len*params->mat_len*sizeof(double));
-	params->net_bw_mbps_table = 
-            malloc(2*params->mat_len*params->mat_len*sizeof(double));
+        int N = params->mat_len / 2;
+        params->net_latency_ns_table = malloc(2*N*N*sizeof(double));
+	params->net_bw_mbps_table = malloc(2*N*N*sizeof(double));
 
-	fill_tri_mat(params->mat_len, params->net_latency_ns_table, latency_tmp);
-        fill_tri_mat(params->mat_len, params->net_bw_mbps_table, bw_tmp);
+	fill_tri_mat(N, params->net_latency_ns_table, latency_tmp);
+        fill_tri_mat(N, params->net_bw_mbps_table, bw_tmp);
         free(latency_tmp);
         free(bw_tmp);
     }
@@ -362,6 +527,120 @@ static void sp_set_params(
     /* done */
 }
 
+/* reads the sparse link description used by large systems instead of the
+ * dense matrices. Each non-comment line is either
+ *   default <lat_out> <lat_in> <bw_out> <bw_in>
+ * or
+ *   <from> <to> <lat_out> <lat_in> <bw_out> <bw_in>
+ * for a directed link between relative ids from and to (0-based). Links that
+ * aren't listed use the default values */
+static void sp_set_link_params(
+        const char      * link_fname,
+        simplep2p_param * params){
+    char line[512];
+    int line_nr = 0;
+
+    FILE *lf = fopen(link_fname, "r");
+    if (!lf)
+        tw_error(TW_LOC, "simplep2p: unable to open %s", link_fname);
+
+    params->is_sparse = 1;
+    memset(&params->default_link, 0, sizeof(params->default_link));
+    params->link_exceptions = qhash_init(sp_link_compare, sp_link_hash,
+            SP_LINK_HASH_SIZE);
+    assert(params->link_exceptions);
+
+    while (fgets(line, sizeof(line), lf)){
+        struct sp_link l;
+        int from, to, ret;
+
+        line_nr++;
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        if (strncmp(line, "default", 7) == 0){
+            ret = sscanf(line + 7, "%lf %lf %lf %lf", &l.latency_ns[0],
+                    &l.latency_ns[1], &l.bw_mbps[0], &l.bw_mbps[1]);
+            if (ret != 4)
+                tw_error(TW_LOC, "simplep2p: malformed default on line %d "
+                        "of %s", line_nr, link_fname);
+            params->default_link = l;
+            continue;
+        }
+        ret = sscanf(line, "%d %d %lf %lf %lf %lf", &from, &to,
+                &l.latency_ns[0], &l.latency_ns[1], &l.bw_mbps[0],
+                &l.bw_mbps[1]);
+        if (ret != 6)
+            tw_error(TW_LOC, "simplep2p: malformed line %d of %s", line_nr,
+                    link_fname);
+        if (from < 0 || from >= params->num_lps || to < 0 ||
+                to >= params->num_lps)
+            tw_error(TW_LOC, "simplep2p: link %d->%d on line %d of %s is "
+                    "out of range (%d simplep2p LPs)", from, to, line_nr,
+                    link_fname, params->num_lps);
+
+        int key[2] = {from, to};
+        struct qhash_head *h = qhash_search(params->link_exceptions, key);
+        struct sp_link_entry *e;
+        if (h == NULL){
+            e = malloc(sizeof(*e));
+            assert(e);
+            e->from_id = from;
+            e->to_id = to;
+            qhash_add(params->link_exceptions, key, &e->hash_link);
+        }
+        else
+            e = qhash_entry(h, struct sp_link_entry, hash_link);
+        e->link = l;
+    }
+    fclose(lf);
+}
+
+/* maps a binary matrix file (see struct sp_matrix_header) read-only */
+static void sp_set_bin_params(
+        const char      * matrix_fname,
+        simplep2p_param * params){
+    struct stat st;
+    const struct sp_matrix_header *hdr;
+    uint64_t num_pairs;
+
+    int fd = open(matrix_fname, O_RDONLY);
+    if (fd < 0)
+        tw_error(TW_LOC, "simplep2p: unable to open %s", matrix_fname);
+    if (fstat(fd, &st) != 0)
+        tw_error(TW_LOC, "simplep2p: unable to stat %s", matrix_fname);
+    if ((size_t)st.st_size < sizeof(*hdr))
+        tw_error(TW_LOC, "simplep2p: %s is too small for a matrix file",
+                matrix_fname);
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        tw_error(TW_LOC, "simplep2p: unable to map %s", matrix_fname);
+    /* the mapping stays valid after the descriptor is closed */
+    close(fd);
+
+    hdr = base;
+    if (memcmp(hdr->magic, SP_MATRIX_MAGIC, sizeof(SP_MATRIX_MAGIC)) != 0 ||
+            hdr->version != SP_MATRIX_VERSION)
+        tw_error(TW_LOC, "simplep2p: %s is not a version %d matrix file",
+                matrix_fname, SP_MATRIX_VERSION);
+    if ((int)hdr->num_lps != params->num_lps)
+        tw_error(TW_LOC, "simplep2p matrix file %s doesn't match the number "
+                "of simplep2p LPs (%u vs. %d)\n", matrix_fname, hdr->num_lps,
+                params->num_lps);
+
+    params->mm_is_tri = (hdr->flags & SP_MATRIX_TRI) != 0;
+    num_pairs = params->mm_is_tri ?
+        (uint64_t)hdr->num_lps * (hdr->num_lps - 1) / 2 :
+        (uint64_t)hdr->num_lps * hdr->num_lps;
+    if ((uint64_t)st.st_size != sizeof(*hdr) + 2 * 2 * num_pairs * sizeof(float))
+        tw_error(TW_LOC, "simplep2p: size of %s doesn't match its header",
+                matrix_fname);
+
+    params->mm_latency_ns = (const float*)(hdr + 1);
+    params->mm_bw_mbps = params->mm_latency_ns + 2 * num_pairs;
+    params->mat_len = 2 * params->num_lps;
+}
+
 /* report network statistics */
 static void sp_report_stats()
 {
@@ -390,17 +669,15 @@ static void sp_init(
     /* inititalize global logical ID w.r.t. annotation */
     ns->id = codes_mapping_get_lp_relative_id(lp->gid, 0, 1);
 
-    /* all devices are idle to begin with */
-    ns->send_next_idle = malloc(ns->params->num_lps * 
-            sizeof(ns->send_next_idle));
-    ns->recv_next_idle = malloc(ns->params->num_lps * 
-            sizeof(ns->recv_next_idle));
-    tw_stime st = tw_now(lp);
+    /* all devices are idle to begin with: peers get an entry (idle at
+     * time 0) when they are first talked to */
+    ns->peer_idles = qhash_init(sp_peer_idle_compare, sp_peer_idle_hash,
+            SP_PEER_HASH_SIZE);
+    assert(ns->peer_idles);
     int i;
-    for (i = 0; i < ns->params->num_lps; i++){
-        ns->send_next_idle[i] = st;
-        ns->recv_next_idle[i] = st;
-    }
+
+    for (i = 0; i < 2; i++)
+        INIT_QLIST_HEAD(&ns->fair[i].flows);
 
     for (i = 0; i < CATEGORY_MAX; i++){
         ns->idle_times_cat[i].send_next_idle_all = 0.0;
@@ -429,6 +706,9 @@ static void sp_event(
         case SP_MSG_READY:
             handle_msg_ready_event(ns, b, m, lp);
             break;
+        case SP_FLOW_DONE:
+            handle_flow_done_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -451,6 +731,9 @@ static void sp_rev_event(
         case SP_MSG_READY:
             handle_msg_ready_rev_event(ns, b, m, lp);
             break;
+        case SP_FLOW_DONE:
+            handle_flow_done_rev_event(ns, b, m, lp);
+            break;
         default:
             assert(0);
             break;
@@ -499,6 +782,177 @@ static tw_stime rate_to_ns(uint64_t bytes, double MB_p_s)
     return(time);
 }
 
+/* bytes per ns served on a side of the NIC in fair sharing mode */
+static double sp_fair_rate(const sp_state * ns, int dir)
+{
+    return ns->params->nic_bw_mbps[dir] * 1024.0 * 1024.0 / 1.0e9;
+}
+
+/* moves the virtual time of a NIC side up to now, saving it in m */
+static void sp_fair_advance(
+    sp_state * ns,
+    int dir,
+    sp_message * m,
+    tw_lp * lp)
+{
+    struct sp_fair_side *f = &ns->fair[dir];
+
+    m->vtime_saved = f->vtime;
+    m->vtime_update_saved = f->last_update;
+    if (f->num_flows > 0)
+        f->vtime += (tw_now(lp) - f->last_update) * sp_fair_rate(ns, dir) /
+            f->num_flows;
+    f->last_update = tw_now(lp);
+}
+
+static void sp_fair_advance_rc(sp_state * ns, int dir, sp_message * m)
+{
+    ns->fair[dir].vtime = m->vtime_saved;
+    ns->fair[dir].last_update = m->vtime_update_saved;
+}
+
+/* expected end of a new flow of the given size on a NIC side, at the share
+ * it gets right now */
+static tw_stime sp_fair_estimate(
+    const sp_state * ns,
+    int dir,
+    uint64_t bytes,
+    tw_lp * lp)
+{
+    return tw_now(lp) + (double)bytes * (ns->fair[dir].num_flows + 1) /
+        sp_fair_rate(ns, dir);
+}
+
+/* schedules the completion of the first flow of a NIC side */
+static void sp_fair_schedule(sp_state * ns, int dir, tw_lp * lp)
+{
+    struct sp_fair_side *f = &ns->fair[dir];
+    struct sp_flow *first;
+    sp_message *m_new;
+    void *m_data;
+    tw_stime dt;
+
+    if (qlist_empty(&f->flows))
+        return;
+
+    first = qlist_entry(f->flows.next, struct sp_flow, ql);
+    dt = (first->finish_tag - f->vtime) * f->num_flows / sp_fair_rate(ns, dir);
+    if (dt < 0.0)
+        dt = 0.0;
+
+    tw_event *e = model_net_method_event_new(lp->gid, dt, lp, SIMPLEP2P,
+            (void**)&m_new, &m_data);
+    m_new->magic = sp_magic;
+    m_new->event_type = SP_FLOW_DONE;
+    m_new->fair_dir = dir;
+    m_new->fair_gen = f->generation;
+    tw_event_send(e);
+}
+
+/* adds m, whose flow_id is set, as a new flow of a NIC side */
+static void sp_fair_add(sp_state * ns, int dir, sp_message * m, tw_lp * lp)
+{
+    struct sp_fair_side *f = &ns->fair[dir];
+    int edata_sz = m->event_size_bytes + m->local_event_size_bytes;
+    struct sp_flow *fl, *pos;
+
+    sp_fair_advance(ns, dir, m, lp);
+
+    fl = malloc(sizeof(*fl) + edata_sz);
+    assert(fl);
+    fl->msg = *m;
+    if (edata_sz > 0)
+        memcpy(fl+1, model_net_method_get_edata(SIMPLEP2P, m), edata_sz);
+    fl->finish_tag = f->vtime + (double)m->net_msg_size_bytes;
+
+    /* insert before the first flow finishing later */
+    qlist_for_each_entry(pos, &f->flows, ql){
+        if (pos->finish_tag > fl->finish_tag)
+            break;
+    }
+    qlist_add_tail(&fl->ql, &pos->ql);
+
+    f->num_flows++;
+    f->generation++;
+    sp_fair_schedule(ns, dir, lp);
+}
+
+static void sp_fair_add_rc(sp_state * ns, int dir, sp_message * m)
+{
+    struct sp_fair_side *f = &ns->fair[dir];
+    struct sp_flow *fl;
+
+    qlist_for_each_entry(fl, &f->flows, ql){
+        if (fl->msg.flow_id == m->flow_id)
+            break;
+    }
+    assert(&fl->ql != &f->flows);
+    qlist_del(&fl->ql);
+    free(fl);
+
+    f->num_flows--;
+    f->generation--;
+    sp_fair_advance_rc(ns, dir, m);
+}
+
+/* hands a received message to its destination delay ns from now */
+static void sp_deliver(sp_message * m, tw_stime delay, tw_lp * lp)
+{
+    tw_event *e_new;
+
+    /* copy only the part of the message used by higher level */
+    if(m->event_size_bytes)
+    {
+        //char* tmp_ptr = (char*)m;
+        //tmp_ptr += sp_get_msg_sz();
+        void *tmp_ptr = model_net_method_get_edata(SIMPLEP2P, m);
+        if (m->is_pull){
+            struct codes_mctx mc_dst =
+                codes_mctx_set_global_direct(m->src_mn_lp);
+            struct codes_mctx mc_src =
+                codes_mctx_set_global_direct(lp->gid);
+            int net_id = model_net_get_id(LP_METHOD_NM);
+            model_net_event_mctx(net_id, &mc_src, &mc_dst, m->category,
+                    m->src_gid, m->pull_size, delay,
+                    m->event_size_bytes, tmp_ptr, 0, NULL, lp);
+        }
+        else{
+            /* schedule event to final destination for when the recv is complete */
+            e_new = tw_event_new(m->final_dest_gid, delay, lp);
+            void *m_new = tw_event_data(e_new);
+            memcpy(m_new, tmp_ptr, m->event_size_bytes);
+            tw_event_send(e_new);
+        }
+    }
+}
+
+static void sp_deliver_rc(sp_message * m, tw_lp * lp)
+{
+    if (m->event_size_bytes && m->is_pull){
+        int net_id = model_net_get_id(LP_METHOD_NM);
+        model_net_event_rc(net_id, lp, m->pull_size);
+    }
+}
+
+/* sends the local completion event of a sent message delay ns from now */
+static void sp_send_local_event(sp_message * m, tw_stime delay, tw_lp * lp)
+{
+    tw_event *e_new;
+    void *m_new;
+
+    if(m->local_event_size_bytes > 0)
+    {
+        e_new = tw_event_new(m->src_gid, delay+codes_local_latency(lp), lp);
+        m_new = tw_event_data(e_new);
+
+        void * m_loc = (char*) model_net_method_get_edata(SIMPLEP2P, m) +
+            m->event_size_bytes;
+        /* copy just the local event data over */
+        memcpy(m_new, m_loc, m->local_event_size_bytes);
+        tw_event_send(e_new);
+    }
+}
+
 /* reverse computation for msg ready event */
 static void handle_msg_ready_rev_event(
     sp_state * ns,
@@ -514,16 +968,21 @@ static void handle_msg_ready_rev_event(
     stat->recv_bytes -= m->net_msg_size_bytes;
     stat->recv_time = m->recv_time_saved;
 
-    ns->recv_next_idle[m->src_mn_rel_id] = m->recv_next_idle_saved;
     idles = sp_get_category_idles(m->category, ns->idle_times_cat);
     idles->recv_next_idle_all = m->recv_next_idle_all_saved;
     idles->recv_prev_idle_all = m->recv_prev_idle_all_saved;
 
-    if (m->event_size_bytes && m->is_pull){
-        int net_id = model_net_get_id(LP_METHOD_NM);
-        model_net_event_rc(net_id, lp, m->pull_size);
+    if (b->c2){
+        sp_fair_add_rc(ns, SP_RECV, m);
+        ns->flow_seq--;
+        return;
     }
 
+    sp_get_peer_idle(ns, m->src_mn_rel_id)->recv_next_idle =
+        m->recv_next_idle_saved;
+
+    sp_deliver_rc(m, lp);
+
     return;
 }
 
@@ -537,14 +996,14 @@ static void handle_msg_ready_event(
     tw_lp * lp)
 {
     tw_stime recv_queue_time = 0;
-    tw_event *e_new;
+    tw_stime busy_until;
     struct mn_stats* stat;
+    struct sp_peer_idle *peer;
+    double bw, latency;
 
     /* get source->me network stats */
-    double bw = sp_get_table_ent(m->src_mn_rel_id, ns->id,
-            1, ns->params->num_lps, ns->params->net_bw_mbps_table);
-    double latency = sp_get_table_ent(m->src_mn_rel_id, ns->id,
-            1, ns->params->num_lps, ns->params->net_latency_ns_table);
+    sp_get_link_params(ns->params, m->src_mn_rel_id, ns->id, 1, &bw,
+            &latency);
     
    // printf("\n LP %d outgoing bandwidth with LP %d is %f ", ns->id, m->src_mn_rel_id, bw);
     if (bw <= 0.0 || latency < 0.0){
@@ -554,18 +1013,33 @@ static void handle_msg_ready_event(
         abort();
     }
 
-    /* are we available to recv the msg? */
-    /* were we available when the transmission was started? */
-    if(ns->recv_next_idle[m->src_mn_rel_id] > tw_now(lp))
-        recv_queue_time += 
-            ns->recv_next_idle[m->src_mn_rel_id] - tw_now(lp);
+    if (ns->params->fair_sharing){
+        /* share the NIC's recv capacity with the other incoming flows; the
+         * message is delivered when its flow is done */
+        b->c2 = 1;
+        m->flow_id = ns->flow_seq++;
+        m->flow_min_done = maxd(m->sender_done,
+                tw_now(lp) + rate_to_ns(m->net_msg_size_bytes, bw));
+        busy_until = maxd(m->flow_min_done,
+                sp_fair_estimate(ns, SP_RECV, m->net_msg_size_bytes, lp));
+        sp_fair_add(ns, SP_RECV, m, lp);
+    }
+    else{
+        peer = sp_get_peer_idle(ns, m->src_mn_rel_id);
 
-    /* calculate transfer time based on msg size and bandwidth */
-    recv_queue_time += rate_to_ns(m->net_msg_size_bytes, bw);
+        /* are we available to recv the msg? */
+        /* were we available when the transmission was started? */
+        if(peer->recv_next_idle > tw_now(lp))
+            recv_queue_time += peer->recv_next_idle - tw_now(lp);
 
-    /* bump up input queue idle time accordingly */
-    m->recv_next_idle_saved = ns->recv_next_idle[m->src_mn_rel_id];
-    ns->recv_next_idle[m->src_mn_rel_id] = recv_queue_time + tw_now(lp);
+        /* calculate transfer time based on msg size and bandwidth */
+        recv_queue_time += rate_to_ns(m->net_msg_size_bytes, bw);
+
+        /* bump up input queue idle time accordingly */
+        m->recv_next_idle_saved = peer->recv_next_idle;
+        peer->recv_next_idle = recv_queue_time + tw_now(lp);
+        busy_until = peer->recv_next_idle;
+    }
 
     /* get stats, save state (TODO: smarter save state than param dump?)  */
     stat = model_net_find_stats(m->category, ns->sp_stats_array);
@@ -580,7 +1054,7 @@ static void handle_msg_ready_event(
 #if SIMPLEP2P_DEBUG
     printf("%d: from_id:%d now: %8.3lf next_idle_recv: %8.3lf\n",
             ns->id, m->src_mn_rel_id,
-            tw_now(lp), ns->recv_next_idle[m->src_mn_rel_id]);
+            tw_now(lp), busy_until);
     printf("%d: BEFORE all_idles_recv %8.3lf %8.3lf\n",
             ns->id,
             idles->recv_prev_idle_all, idles->recv_next_idle_all);
@@ -593,9 +1067,9 @@ static void handle_msg_ready_event(
             idles->recv_next_idle_all - idles->recv_prev_idle_all;
         idles->recv_prev_idle_all = tw_now(lp); 
     }
-    if (ns->recv_next_idle[m->src_mn_rel_id] > idles->recv_next_idle_all){
+    if (busy_until > idles->recv_next_idle_all){
         /* extend the active period (active until at least this request) */
-        idles->recv_next_idle_all = ns->recv_next_idle[m->src_mn_rel_id];
+        idles->recv_next_idle_all = busy_until;
     }
 
 #if SIMPLEP2P_DEBUG
@@ -609,30 +1083,8 @@ static void handle_msg_ready_event(
     }
 #endif
 
-    /* copy only the part of the message used by higher level */
-    if(m->event_size_bytes)
-    {
-        //char* tmp_ptr = (char*)m;
-        //tmp_ptr += sp_get_msg_sz();
-        void *tmp_ptr = model_net_method_get_edata(SIMPLEP2P, m);
-        if (m->is_pull){
-            struct codes_mctx mc_dst =
-                codes_mctx_set_global_direct(m->src_mn_lp);
-            struct codes_mctx mc_src =
-                codes_mctx_set_global_direct(lp->gid);
-            int net_id = model_net_get_id(LP_METHOD_NM);
-            model_net_event_mctx(net_id, &mc_src, &mc_dst, m->category,
-                    m->src_gid, m->pull_size, recv_queue_time,
-                    m->event_size_bytes, tmp_ptr, 0, NULL, lp);
-        }
-        else{
-            /* schedule event to final destination for when the recv is complete */
-            e_new = tw_event_new(m->final_dest_gid, recv_queue_time, lp);
-            void *m_new = tw_event_data(e_new);
-            memcpy(m_new, tmp_ptr, m->event_size_bytes);
-            tw_event_send(e_new);
-        }
-    }
+    if (!ns->params->fair_sharing)
+        sp_deliver(m, recv_queue_time, lp);
 
     return;
 }
@@ -644,7 +1096,7 @@ static void handle_msg_start_rev_event(
     sp_message * m,
     tw_lp * lp)
 {
-    if(m->local_event_size_bytes > 0)
+    if(!b->c2 && m->local_event_size_bytes > 0)
     {
         codes_local_latency_reverse(lp);
     }
@@ -657,10 +1109,17 @@ static void handle_msg_start_rev_event(
 
     category_idles *idles = 
         sp_get_category_idles(m->category, ns->idle_times_cat);
-    ns->send_next_idle[m->dest_mn_rel_id] = m->send_next_idle_saved;
     idles->send_next_idle_all = m->send_next_idle_all_saved;
     idles->send_prev_idle_all = m->send_prev_idle_all_saved;
 
+    if (b->c2){
+        sp_fair_add_rc(ns, SP_SEND, m);
+        ns->flow_seq--;
+    }
+    else
+        sp_get_peer_idle(ns, m->dest_mn_rel_id)->send_next_idle =
+            m->send_next_idle_saved;
+
     return;
 }
 
@@ -676,10 +1135,12 @@ static void handle_msg_start_event(
     tw_event *e_new;
     sp_message *m_new;
     tw_stime send_queue_time = 0;
+    tw_stime busy_until;
     mn_stats* stat;
     int total_event_size;
     int dest_rel_id;
     double bw, latency;
+    struct sp_peer_idle *peer;
 
     total_event_size = model_net_get_msg_sz(SIMPLEP2P) + m->event_size_bytes +
         m->local_event_size_bytes;
@@ -688,10 +1149,7 @@ static void handle_msg_start_event(
     m->dest_mn_rel_id = dest_rel_id;
 
     /* grab the link params */
-    bw = sp_get_table_ent(ns->id, dest_rel_id,
-            0, ns->params->num_lps, ns->params->net_bw_mbps_table);
-    latency = sp_get_table_ent(ns->id, dest_rel_id,
-            0, ns->params->num_lps, ns->params->net_latency_ns_table);
+    sp_get_link_params(ns->params, ns->id, dest_rel_id, 0, &bw, &latency);
     
     //printf("\n LP %d incoming bandwidth with LP %d is %f ", ns->id, dest_rel_id, bw);
     if (bw <= 0.0 || latency < 0.0){
@@ -701,18 +1159,34 @@ static void handle_msg_start_event(
         abort();
     }
 
-    /* calculate send time stamp */
-    send_queue_time = 0.0; /* net msg latency cost (negligible for this model) */
-    /* bump up time if the NIC send queue isn't idle right now */
-    if(ns->send_next_idle[dest_rel_id] > tw_now(lp))
-        send_queue_time += ns->send_next_idle[dest_rel_id] - tw_now(lp);
-
-    /* move the next idle time ahead to after this transmission is
-     * _complete_ from the sender's perspective 
-     */ 
-    m->send_next_idle_saved = ns->send_next_idle[dest_rel_id];
-    ns->send_next_idle[dest_rel_id] = send_queue_time + tw_now(lp) +
-        rate_to_ns(m->net_msg_size_bytes, bw);
+    if (ns->params->fair_sharing){
+        /* share the NIC's send capacity with the other outgoing flows. The
+         * receiver starts receiving right away but can't finish before the
+         * send is expected to; the local event fires when the flow is done */
+        b->c2 = 1;
+        m->flow_id = ns->flow_seq++;
+        m->flow_min_done = tw_now(lp) + rate_to_ns(m->net_msg_size_bytes, bw);
+        busy_until = maxd(m->flow_min_done,
+                sp_fair_estimate(ns, SP_SEND, m->net_msg_size_bytes, lp));
+        sp_fair_add(ns, SP_SEND, m, lp);
+    }
+    else{
+        peer = sp_get_peer_idle(ns, dest_rel_id);
+
+        /* calculate send time stamp */
+        send_queue_time = 0.0; /* net msg latency cost (negligible for this model) */
+        /* bump up time if the NIC send queue isn't idle right now */
+        if(peer->send_next_idle > tw_now(lp))
+            send_queue_time += peer->send_next_idle - tw_now(lp);
+
+        /* move the next idle time ahead to after this transmission is
+         * _complete_ from the sender's perspective 
+         */ 
+        m->send_next_idle_saved = peer->send_next_idle;
+        peer->send_next_idle = send_queue_time + tw_now(lp) +
+            rate_to_ns(m->net_msg_size_bytes, bw);
+        busy_until = peer->send_next_idle;
+    }
 
     /* get stats, save state (TODO: smarter save state than param dump?)  */
     stat = model_net_find_stats(m->category, ns->sp_stats_array);
@@ -729,7 +1203,7 @@ static void handle_msg_start_event(
 #if SIMPLEP2P_DEBUG
     printf("%d: to_id:%d now: %8.3lf next_idle_send: %8.3lf\n",
             ns->id, dest_rel_id,
-            tw_now(lp), ns->send_next_idle[dest_rel_id]);
+            tw_now(lp), busy_until);
     printf("%d: BEFORE all_idles_send %8.3lf %8.3lf\n",
             ns->id, idles->send_prev_idle_all, idles->send_next_idle_all);
 #endif
@@ -740,9 +1214,9 @@ static void handle_msg_start_event(
         stat->send_time += idles->send_next_idle_all - idles->send_prev_idle_all;
         idles->send_prev_idle_all = tw_now(lp); 
     }
-    if (ns->send_next_idle[dest_rel_id] > idles->send_next_idle_all){
+    if (busy_until > idles->send_next_idle_all){
         /* extend the active period (active until at least this request) */
-        idles->send_next_idle_all = ns->send_next_idle[dest_rel_id];
+        idles->send_next_idle_all = busy_until;
     }
 
 #if SIMPLEP2P_DEBUG
@@ -772,28 +1246,99 @@ static void handle_msg_start_event(
     m_new->event_type = SP_MSG_READY;
     m_new->src_mn_rel_id = ns->id;
     m_new->dest_mn_rel_id = dest_rel_id;
+    m_new->local_event_size_bytes = 0;
+    m_new->sender_done = busy_until + latency;
 
     tw_event_send(e_new);
 
     /* if there is a local event to handle, then create an event for it as
-     * well
+     * well (in fair sharing mode once the flow is done)
      */
-    if(m->local_event_size_bytes > 0)
-    {
-        //char* local_event;
+    if (!ns->params->fair_sharing)
+        sp_send_local_event(m, send_queue_time, lp);
+    return;
+}
 
-        e_new = tw_event_new(m->src_gid, send_queue_time+codes_local_latency(lp), lp);
-        m_new = tw_event_data(e_new);
+/* reverse computation for flow done event */
+static void handle_flow_done_rev_event(
+    sp_state * ns,
+    tw_bf * b,
+    sp_message * m,
+    tw_lp * lp)
+{
+    struct sp_fair_side *f = &ns->fair[m->fair_dir];
+    int edata_sz = m->event_size_bytes + m->local_event_size_bytes;
+    struct sp_flow *fl;
 
-        void * m_loc = (char*) model_net_method_get_edata(SIMPLEP2P, m) +
-            m->event_size_bytes;
-         //local_event = (char*)m;
-         //local_event += sp_get_msg_sz() + m->event_size_bytes;         	 
-        /* copy just the local event data over */
-        memcpy(m_new, m_loc, m->local_event_size_bytes);
-        tw_event_send(e_new);
+    if (!b->c0)
+        return;
+
+    if (m->fair_dir == SP_SEND){
+        if (m->local_event_size_bytes > 0)
+            codes_local_latency_reverse(lp);
     }
-    return;
+    else
+        sp_deliver_rc(m, lp);
+
+    /* put the flow back at the head of the side */
+    fl = malloc(sizeof(*fl) + edata_sz);
+    assert(fl);
+    fl->msg = *m;
+    if (edata_sz > 0)
+        memcpy(fl+1, model_net_method_get_edata(SIMPLEP2P, m), edata_sz);
+    fl->finish_tag = m->flow_tag_saved;
+    qlist_add(&fl->ql, &f->flows);
+
+    f->num_flows++;
+    f->generation--;
+    sp_fair_advance_rc(ns, m->fair_dir, m);
+}
+
+/* handler for flow done event: the first flow of a NIC side has been served
+ * completely, unless the flows changed since the event was scheduled */
+static void handle_flow_done_event(
+    sp_state * ns,
+    tw_bf * b,
+    sp_message * m,
+    tw_lp * lp)
+{
+    struct sp_fair_side *f = &ns->fair[m->fair_dir];
+    struct sp_flow *fl;
+    sp_message done;
+    int edata_sz;
+
+    if (m->fair_gen != f->generation)
+        return;
+    b->c0 = 1;
+
+    sp_fair_advance(ns, m->fair_dir, m, lp);
+
+    /* the flow moves into the event, so that the reverse handler can put
+     * it back */
+    fl = qlist_entry(qlist_pop(&f->flows), struct sp_flow, ql);
+    done = *m;
+    *m = fl->msg;
+    m->event_type = SP_FLOW_DONE;
+    m->fair_dir = done.fair_dir;
+    m->fair_gen = done.fair_gen;
+    m->vtime_saved = done.vtime_saved;
+    m->vtime_update_saved = done.vtime_update_saved;
+    m->flow_tag_saved = fl->finish_tag;
+    edata_sz = m->event_size_bytes + m->local_event_size_bytes;
+    if (edata_sz > 0)
+        memcpy(model_net_method_get_edata(SIMPLEP2P, m), fl+1, edata_sz);
+    free(fl);
+
+    f->num_flows--;
+    f->generation++;
+    sp_fair_schedule(ns, m->fair_dir, lp);
+
+    /* the link may not have carried the message that fast */
+    tw_stime delay = maxd(m->flow_min_done, tw_now(lp)) - tw_now(lp);
+    if (m->fair_dir == SP_SEND)
+        sp_send_local_event(m, delay, lp);
+    else
+        sp_deliver(m, delay, lp);
 }
 
 /* Model-net function calls */
@@ -871,7 +1416,42 @@ static tw_stime simplep2p_packet_event(
 static void sp_read_config(const char * anno, simplep2p_param *p){
     char latency_file[MAX_NAME_LENGTH];
     char bw_file[MAX_NAME_LENGTH];
+    char link_file[MAX_NAME_LENGTH];
     int rc;
+
+    memset(p, 0, sizeof(*p));
+    p->num_lps = codes_mapping_get_lp_count(NULL, 0,
+            LP_CONFIG_NM, anno, 0);
+
+    /* fair sharing of the aggregate NIC capacities */
+    configuration_get_value_int(&config, "PARAMS", "net_fair_sharing", anno,
+            &p->fair_sharing);
+    if (p->fair_sharing){
+        configuration_get_value_double(&config, "PARAMS",
+                "net_nic_send_bw_mbps", anno, &p->nic_bw_mbps[SP_SEND]);
+        configuration_get_value_double(&config, "PARAMS",
+                "net_nic_recv_bw_mbps", anno, &p->nic_bw_mbps[SP_RECV]);
+        if (p->nic_bw_mbps[SP_SEND] <= 0.0 || p->nic_bw_mbps[SP_RECV] <= 0.0)
+            tw_error(TW_LOC, "simplep2p: net_fair_sharing needs positive "
+                    "PARAMS:net_nic_send_bw_mbps and net_nic_recv_bw_mbps");
+    }
+
+    /* a sparse link file takes precedence over the dense matrices */
+    rc = configuration_get_value_relpath(&config, "PARAMS", "net_link_file",
+            anno, link_file, MAX_NAME_LENGTH);
+    if (rc > 0){
+        sp_set_link_params(link_file, p);
+        return;
+    }
+
+    /* then a binary matrix file */
+    rc = configuration_get_value_relpath(&config, "PARAMS", "net_matrix_file",
+            anno, link_file, MAX_NAME_LENGTH);
+    if (rc > 0){
+        sp_set_bin_params(link_file, p);
+        return;
+    }
+
     rc = configuration_get_value_relpath(&config, "PARAMS", 
             "net_latency_ns_file", anno, latency_file, MAX_NAME_LENGTH);
     if (rc <= 0){
@@ -894,9 +1474,10 @@ static void sp_read_config(const char * anno, simplep2p_param *p){
                     "simplep2p: unable to read PARAMS:net_bw_mbps_file@%s",
                     anno);
     }
-    p->num_lps = codes_mapping_get_lp_count(NULL, 0,
-            LP_CONFIG_NM, anno, 0);
-    sp_set_params(latency_file, bw_file, p);
+    int is_tri_mat = 0;
+    configuration_get_value_int(&config, "PARAMS", "net_matrix_triangular",
+            anno, &is_tri_mat);
+    sp_set_params(latency_file, bw_file, is_tri_mat, p);
     if (p->mat_len != (2 * p->num_lps)){
         tw_error(TW_LOC, "simplep2p config matrix doesn't match the "
                 "number of simplep2p LPs (%d vs. %d)\n",
@@ -933,6 +1514,63 @@ static double sp_get_table_ent(
     return table[2 * from_id * num_lps + 2 * to_id + is_incoming]; 
 }
 
+static void sp_get_link_params(
+        const simplep2p_param * params,
+        int      from_id,
+        int      to_id,
+        int      is_incoming,
+        double * bw,
+        double * latency){
+    if (params->mm_latency_ns != NULL){
+        uint64_t N = params->num_lps, idx;
+        if (!params->mm_is_tri)
+            idx = 2 * ((uint64_t)from_id * N + to_id);
+        else if (from_id == to_id){
+            *bw = *latency = 0.0;
+            return;
+        }
+        else{
+            /* pair x:y, x < y, in the row-major upper triangle */
+            uint64_t x = from_id < to_id ? from_id : to_id;
+            uint64_t y = from_id < to_id ? to_id : from_id;
+            idx = 2 * (x * (2 * N - x - 1) / 2 + (y - x - 1));
+        }
+        *bw = params->mm_bw_mbps[idx + is_incoming];
+        *latency = params->mm_latency_ns[idx + is_incoming];
+        return;
+    }
+    if (!params->is_sparse){
+        *bw = sp_get_table_ent(from_id, to_id, is_incoming, params->num_lps,
+                params->net_bw_mbps_table);
+        *latency = sp_get_table_ent(from_id, to_id, is_incoming,
+                params->num_lps, params->net_latency_ns_table);
+        return;
+    }
+
+    int key[2] = {from_id, to_id};
+    struct qhash_head *h = qhash_search(params->link_exceptions, key);
+    const struct sp_link *l = (h == NULL) ? &params->default_link :
+        &qhash_entry(h, struct sp_link_entry, hash_link)->link;
+    *bw = l->bw_mbps[is_incoming];
+    *latency = l->latency_ns[is_incoming];
+}
+
+static struct sp_peer_idle* sp_get_peer_idle(sp_state * ns, int peer_id){
+    struct qhash_head *h = qhash_search(ns->peer_idles, &peer_id);
+    if (h != NULL)
+        return qhash_entry(h, struct sp_peer_idle, hash_link);
+
+    /* first contact: the connection has been idle since the start. The
+     * entry is kept on rollback, it then just holds the initial state */
+    struct sp_peer_idle *p = malloc(sizeof(*p));
+    assert(p);
+    p->peer_id = peer_id;
+    p->send_next_idle = 0.0;
+    p->recv_next_idle = 0.0;
+    qhash_add(ns->peer_idles, &peer_id, &p->hash_link);
+    return p;
+}
+
 /* category lookup (more or less copied from model_net_find_stats) */
 static category_idles* sp_get_category_idles(
         char * category, category_idles *idles){
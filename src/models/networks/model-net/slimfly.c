@@ -0,0 +1,656 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+/* Slim Fly network model.
+ *
+ * The routers are connected by the MMS graph of a prime q = 4w + d, d = 1 or
+ * d = -1: 2 q^2 routers (s, x, y) with s in {0, 1} and x, y in Z_q, each
+ * with (3q - d) / 2 router ports, and a diameter of 2. With a primitive
+ * element e of Z_q, the generator sets X (subgraph 0) and X' (subgraph 1) are
+ *
+ *   d = 1:  X = {1, e^2, ..., e^(q-3)},  X' = {e, e^3, ..., e^(q-2)}
+ *   d = -1: X = {1, e^2, ..., e^(2w-2), e^(2w-1), e^(2w+1), ..., e^(4w-3)},
+ *           X' = {e, e^3, ..., e^(2w-1), e^(2w), e^(2w+2), ..., e^(4w-2)}
+ *
+ * and the routers are linked by
+ *
+ *   (0, x, y) - (0, x, y')  if y - y' is in X
+ *   (1, m, c) - (1, m, c')  if c - c' is in X'
+ *   (0, x, y) - (1, m, c)   if y = m x + c
+ *
+ * The graph and the all-pairs minimal routing table are built once per rank
+ * at configure time and shared by all routers of the rank.
+ *
+ * The terminals and router ports are those of vct-router.c, which forward
+ * packets with virtual cut-through at packet granularity. A packet uses the
+ * virtual channel given by the number of router to router hops it has taken,
+ * which keeps the up to four hops of a Valiant path free of deadlocks. */
+
+#include <ross.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/lp-io.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "codes/net/slimfly.h"
+#include "vct-router.h"
+
+/* virtual channels per router port, one per router to router hop of a
+ * Valiant path */
+#define SLIMFLY_NUM_VCS 4
+
+#define LP_CONFIG_NM (model_net_lp_config_names[SLIMFLY])
+#define LP_ROUTER_NM "slimfly_router"
+
+typedef struct slimfly_param slimfly_param;
+/* annotation-specific parameters (unannotated entry occurs at the
+ * last index) */
+static uint64_t                  num_params = 0;
+static slimfly_param           * all_params = NULL;
+static const config_anno_map_t * anno_map   = NULL;
+
+enum slimfly_routing
+{
+    SF_ROUTE_MINIMAL, /* shortest path, at most two router hops */
+    SF_ROUTE_VALIANT, /* minimal paths to and from a random router */
+    SF_ROUTE_UGAL /* minimal or Valiant, decided at the source router */
+};
+
+struct slimfly_param
+{
+    // configuration parameters
+    int q; /* prime of the MMS construction */
+    int num_cn; /* compute nodes per router */
+    double link_bandwidth; /* bandwidth of the router-router links */
+    double cn_bandwidth; /* bandwidth of the compute node channels */
+    double link_latency; /* latency of a link (ns) */
+    int chunk_size; /* bytes serialized before a packet reaches the next hop */
+    uint64_t vc_size; /* bytes of buffer per router input virtual channel */
+    uint64_t cn_vc_size; /* bytes of buffer of the compute node channels */
+    int routing;
+
+    // derived parameters
+    int num_routers; /* 2 q^2 */
+    int router_radix; /* router ports of a router, (3q - d) / 2 */
+    int total_terminals;
+
+    /* the MMS graph, indexed by router * router_radix + port: the router
+     * linked to the port and the port of that router it is linked to */
+    int *neighbor;
+    int *peer_port;
+    /* all-pairs minimal routes, indexed by source * num_routers +
+     * destination: the first port of a minimal path and its length */
+    int *min_port;
+    unsigned char *dist;
+};
+
+typedef struct sf_router_state sf_router_state;
+typedef struct slimfly_port_record slimfly_port_record;
+
+/* on-disk layout of the per-port counters, one record per router port,
+ * written to the "slimfly-router-ports" lp-io file. port_type is 0 for
+ * router ports and 1 for compute node ports */
+struct slimfly_port_record
+{
+    int32_t router;
+    int32_t port_type;
+    int32_t port_index;
+    int32_t pad;
+    uint64_t bytes;
+    uint64_t packets;
+    double blocked_time;
+    uint64_t peak_queue_bytes;
+};
+
+struct sf_router_state
+{
+    /* router ports followed by the compute node ports */
+    vct_router r;
+
+    const char * anno;
+    const slimfly_param *params;
+};
+
+/* returns the slimfly message size */
+static int slimfly_get_msg_sz(void)
+{
+    return sizeof(slimfly_message);
+}
+
+/* returns a primitive element of Z_q for a prime q */
+static int find_primitive_element(int q)
+{
+    int g, x, order;
+    for(g = 2; g < q; g++)
+    {
+        x = 1;
+        order = 0;
+        do {
+            x = (x * g) % q;
+            order++;
+        } while(x != 1);
+        if(order == q - 1)
+            return g;
+    }
+    return 1;
+}
+
+static int router_index(int q, int sub, int x, int y)
+{
+    return sub * q * q + x * q + y;
+}
+
+/* builds the MMS graph and the minimal routing table shared by all routers
+ * of a rank */
+static void slimfly_build_tables(slimfly_param *p)
+{
+    int q = p->q;
+    int R = p->num_routers;
+    int k = p->router_radix;
+    int delta = (q % 4 == 1) ? 1 : -1;
+    int w = (q - delta) / 4;
+    int xi = find_primitive_element(q);
+    int a, i, j, r, x, y, m;
+
+    /* generator sets as membership flags over Z_q */
+    char *in_gen[2];
+    in_gen[0] = calloc(q, 1);
+    in_gen[1] = calloc(q, 1);
+    assert(in_gen[0] && in_gen[1]);
+    int pw = 1;
+    for(a = 0; a < q; a++)
+    {
+        /* for d = -1 the exponent 2w - 1 is in both sets and the exponent
+         * 4w - 2 = q - 1 gives 1 again */
+        if(delta == 1)
+            in_gen[a % 2][pw] |= a <= q - 2;
+        else
+        {
+            in_gen[0][pw] |= (a % 2 == 0 && a <= 2 * w - 2) ||
+                (a % 2 == 1 && a >= 2 * w - 1 && a <= 4 * w - 3);
+            in_gen[1][pw] |= (a % 2 == 1 && a <= 2 * w - 1) ||
+                (a % 2 == 0 && a >= 2 * w && a <= 4 * w - 2);
+        }
+        pw = (pw * xi) % q;
+    }
+
+    p->neighbor = malloc(R * k * sizeof(int));
+    p->peer_port = malloc(R * k * sizeof(int));
+    p->min_port = malloc((size_t)R * R * sizeof(int));
+    p->dist = malloc((size_t)R * R);
+    assert(p->neighbor && p->peer_port && p->min_port && p->dist);
+
+    /* ports of a router: the routers of its own subgraph first, then the
+     * routers of the other subgraph ordered by m (subgraph 0) or x
+     * (subgraph 1) */
+    for(r = 0; r < R; r++)
+    {
+        int sub = r / (q * q);
+        int rx = (r / q) % q;
+        int ry = r % q;
+        int n = 0;
+        for(y = 0; y < q; y++)
+            if(in_gen[sub][((ry - y) % q + q) % q])
+                p->neighbor[r * k + n++] = router_index(q, sub, rx, y);
+        for(m = 0; m < q; m++)
+        {
+            if(sub == 0)
+                p->neighbor[r * k + n++] = router_index(q, 1, m,
+                        ((ry - m * rx) % q + q) % q);
+            else
+                p->neighbor[r * k + n++] = router_index(q, 0, m,
+                        (rx * m + ry) % q);
+        }
+        if(n != k)
+            tw_error(TW_LOC, "slimfly: router %d has %d ports, expected %d\n",
+                    r, n, k);
+    }
+    free(in_gen[0]);
+    free(in_gen[1]);
+
+    for(r = 0; r < R; r++)
+    {
+        for(i = 0; i < k; i++)
+        {
+            int nbr = p->neighbor[r * k + i];
+            p->peer_port[r * k + i] = -1;
+            for(j = 0; j < k; j++)
+                if(p->neighbor[nbr * k + j] == r)
+                    p->peer_port[r * k + i] = j;
+            if(p->peer_port[r * k + i] < 0)
+                tw_error(TW_LOC, "slimfly: link %d-%d is not symmetric\n",
+                        r, nbr);
+        }
+    }
+
+    /* the neighbours are one hop away, the routers linked to the
+     * neighbours two hops */
+    for(r = 0; r < R; r++)
+    {
+        int *mp = &p->min_port[r * R];
+        unsigned char *d = &p->dist[r * R];
+        for(x = 0; x < R; x++)
+        {
+            mp[x] = -1;
+            d[x] = 0;
+        }
+        for(i = 0; i < k; i++)
+        {
+            mp[p->neighbor[r * k + i]] = i;
+            d[p->neighbor[r * k + i]] = 1;
+        }
+        for(i = 0; i < k; i++)
+        {
+            int nbr = p->neighbor[r * k + i];
+            for(j = 0; j < k; j++)
+            {
+                int t = p->neighbor[nbr * k + j];
+                if(t != r && mp[t] < 0)
+                {
+                    mp[t] = i;
+                    d[t] = 2;
+                }
+            }
+        }
+        for(x = 0; x < R; x++)
+            if(x != r && mp[x] < 0)
+                tw_error(TW_LOC, "slimfly: router %d is not reachable from "
+                        "router %d in two hops\n", x, r);
+    }
+}
+
+static void slimfly_read_config(const char * anno, slimfly_param *params){
+    // shorthand
+    slimfly_param *p = params;
+    int i;
+
+    configuration_get_value_int(&config, "PARAMS", "field_size", anno,
+            &p->q);
+    if(p->q <= 0) {
+        p->q = 5;
+        fprintf(stderr, "MMS field size not specified, setting to %d\n", p->q);
+    }
+    for(i = 2; i * i <= p->q; i++)
+        if(p->q % i == 0)
+            break;
+    if(p->q < 5 || i * i <= p->q || p->q % 4 == 0 || p->q % 4 == 2)
+        tw_error(TW_LOC, "PARAMS:field_size must be a prime of the form "
+                "4w + 1 or 4w - 1 (at least 5), got %d\n", p->q);
+
+    int delta = (p->q % 4 == 1) ? 1 : -1;
+    p->num_routers = 2 * p->q * p->q;
+    p->router_radix = (3 * p->q - delta) / 2;
+
+    configuration_get_value_int(&config, "PARAMS", "num_cn", anno,
+            &p->num_cn);
+    if(p->num_cn <= 0) {
+        p->num_cn = (p->router_radix + 1) / 2;
+        fprintf(stderr, "Number of compute nodes per router not specified, setting to %d\n",
+                p->num_cn);
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "chunk_size", anno,
+            &p->chunk_size);
+    if(p->chunk_size <= 0) {
+        p->chunk_size = 64;
+        fprintf(stderr, "Chunk size for packets is not specified, setting to %d\n", p->chunk_size);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_bandwidth", anno,
+            &p->link_bandwidth);
+    if(p->link_bandwidth <= 0) {
+        p->link_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of router links not specified, setting to %lf\n", p->link_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "cn_bandwidth", anno,
+            &p->cn_bandwidth);
+    if(p->cn_bandwidth <= 0) {
+        p->cn_bandwidth = 5.25;
+        fprintf(stderr, "Bandwidth of compute node channels not specified, setting to %lf\n", p->cn_bandwidth);
+    }
+
+    configuration_get_value_double(&config, "PARAMS", "link_latency", anno,
+            &p->link_latency);
+    if(p->link_latency < 0)
+        p->link_latency = 0;
+
+    long buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "vc_size", anno, &buf);
+    if(buf <= 0) {
+        buf = 8192;
+        fprintf(stderr, "Buffer size of router virtual channels not specified, setting to %ld\n", buf);
+    }
+    p->vc_size = buf;
+
+    buf = 0;
+    configuration_get_value_longint(&config, "PARAMS", "cn_vc_size", anno,
+            &buf);
+    if(buf <= 0)
+        buf = p->vc_size;
+    p->cn_vc_size = buf;
+
+    char routing_str[MAX_NAME_LENGTH];
+    routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "routing", anno, routing_str,
+            MAX_NAME_LENGTH);
+    if(routing_str[0] == '\0' || strcmp(routing_str, "minimal") == 0)
+        p->routing = SF_ROUTE_MINIMAL;
+    else if(strcmp(routing_str, "valiant") == 0 ||
+            strcmp(routing_str, "nonminimal") == 0)
+        p->routing = SF_ROUTE_VALIANT;
+    else if(strcmp(routing_str, "ugal") == 0 ||
+            strcmp(routing_str, "adaptive") == 0)
+        p->routing = SF_ROUTE_UGAL;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:routing: %s "
+                "(expected minimal, valiant or ugal)\n", routing_str);
+
+    p->total_terminals = p->num_routers * p->num_cn;
+
+    slimfly_build_tables(p);
+
+    printf("\n Slim Fly: total nodes %d routers %d router radix %d ",
+            p->total_terminals, p->num_routers, p->router_radix);
+}
+
+static void slimfly_configure(){
+    anno_map = codes_mapping_get_lp_anno_map(LP_CONFIG_NM);
+    assert(anno_map);
+    num_params = anno_map->num_annos + (anno_map->has_unanno_lp > 0);
+    all_params = calloc(num_params, sizeof(*all_params));
+
+    for (uint64_t i = 0; i < anno_map->num_annos; i++){
+        const char * anno = anno_map->annotations[i].ptr;
+        slimfly_read_config(anno, &all_params[i]);
+    }
+    if (anno_map->has_unanno_lp > 0){
+        slimfly_read_config(NULL, &all_params[anno_map->num_annos]);
+    }
+}
+
+/* returns the parameters of the annotation of an LP */
+static const slimfly_param * get_params(tw_lpid gid, const char ** anno)
+{
+    *anno = codes_mapping_get_annotation_by_lpid(gid);
+    if (*anno == NULL)
+        return &all_params[num_params-1];
+    return &all_params[configuration_get_annotation_index(*anno, anno_map)];
+}
+
+static void slimfly_packet_init(const vct_terminal * t, vct_message * msg)
+{
+    ((slimfly_message*)msg)->intm_router = -1;
+}
+
+/* picks a random intermediate router other than the source and destination
+ * routers */
+static int pick_intm_router(const sf_router_state * s, int dest_router,
+        tw_lp * lp)
+{
+    int lo = s->r.router_id < dest_router ? s->r.router_id : dest_router;
+    int hi = s->r.router_id < dest_router ? dest_router : s->r.router_id;
+    int r = tw_rand_integer(lp->rng, 0, s->params->num_routers - 3);
+    if(r >= lo)
+        r++;
+    if(r >= hi)
+        r++;
+    return r;
+}
+
+/* selects the output port of a packet at a router. The source router decides
+ * between the minimal and the Valiant path, the routers on the way follow
+ * the minimal routes to the intermediate router and then to the destination.
+ * Sets bf->c3 if a random number was drawn */
+static int slimfly_route(vct_router * r,
+        tw_bf * bf,
+        vct_message * pkt,
+        tw_lp * lp)
+{
+    sf_router_state *s = (sf_router_state*)r;
+    slimfly_message *sf = (slimfly_message*)pkt;
+    const slimfly_param *p = s->params;
+    int R = p->num_routers;
+    int id = r->router_id;
+    int dest_router = pkt->dest_terminal_id / p->num_cn;
+
+    if(pkt->my_N_hop == 1 && dest_router != id &&
+            p->routing != SF_ROUTE_MINIMAL)
+    {
+        bf->c3 = 1;
+        int intm = pick_intm_router(s, dest_router, lp);
+        int nonmin = 1;
+        if(p->routing == SF_ROUTE_UGAL)
+        {
+            /* UGAL-L: compare the local queues weighted by the hops of each
+             * path */
+            int min_port = p->min_port[id * R + dest_router];
+            int nm_port = p->min_port[id * R + intm];
+            uint64_t min_cost = vct_port_load(r, min_port) *
+                p->dist[id * R + dest_router];
+            uint64_t nm_cost = vct_port_load(r, nm_port) *
+                (p->dist[id * R + intm] + p->dist[intm * R + dest_router]);
+            nonmin = nm_cost < min_cost;
+        }
+        if(nonmin)
+        {
+            sf->intm_router = intm;
+            pkt->path_type = VCT_PATH_NON_MINIMAL;
+        }
+    }
+
+    if(sf->intm_router == id)
+        sf->intm_router = -1;
+    if(sf->intm_router >= 0)
+        return p->min_port[id * R + sf->intm_router];
+    if(dest_router == id)
+        return p->router_radix + pkt->dest_terminal_id % p->num_cn;
+    return p->min_port[id * R + dest_router];
+}
+
+/* one virtual channel per router to router hop */
+static int slimfly_select_vc(const vct_router * r, const vct_message * pkt,
+        int port)
+{
+    return vct_is_cn_port(r, port) ? 0 : pkt->my_N_hop - 1;
+}
+
+static vct_model slimfly_vct =
+{
+    .net_id = SLIMFLY,
+    .msg_size = sizeof(slimfly_message),
+    .packet_init = slimfly_packet_init,
+    .route = slimfly_route,
+    .select_vc = slimfly_select_vc,
+};
+
+/* report Slim Fly statistics like average and maximum packet latency,
+ * average number of hops traversed */
+static void slimfly_report_stats()
+{
+    vct_report_stats(&slimfly_vct);
+}
+
+/* collectives are not supported by the Slim Fly model */
+static void slimfly_collective()
+{
+    return;
+}
+
+static void slimfly_collective_rc()
+{
+    return;
+}
+
+/* slimfly packet event, generates a Slim Fly packet on the compute node */
+static tw_stime slimfly_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
+{
+    return vct_packet_event(&slimfly_vct, category, final_dest_lp,
+            dest_mn_lp, packet_size, is_pull, pull_size, offset,
+            remote_event_size, remote_event, self_event_size, self_event,
+            src_lp, sender, is_last_pckt);
+}
+
+/* initialize a Slim Fly compute node terminal */
+static void terminal_init(vct_terminal * s,
+        tw_lp * lp)
+{
+    const char * anno;
+    const slimfly_param *p = get_params(lp->gid, &anno);
+
+    int num_terminals = codes_mapping_get_lp_count(NULL, 0, LP_CONFIG_NM,
+            NULL, 1);
+    if(num_terminals != p->total_terminals)
+        tw_error(TW_LOC, "Config error: %d Slim Fly terminals configured, the "
+                "Slim Fly of field size %d with %d compute nodes per router "
+                "has %d\n", num_terminals, p->q, p->num_cn,
+                p->total_terminals);
+
+    vct_terminal_init(s, &slimfly_vct, lp);
+    s->total_terminals = p->total_terminals;
+    s->router_port = p->router_radix + s->terminal_id % p->num_cn;
+    s->router_gid = codes_mapping_get_lpid_from_relative(
+            s->terminal_id / p->num_cn, NULL, LP_ROUTER_NM, NULL, 1);
+    s->bandwidth = p->cn_bandwidth;
+    s->latency = p->link_latency;
+    s->buffer_size = p->cn_vc_size;
+    s->chunk_size = p->chunk_size;
+}
+
+/* sets up the ports of a router and the neighbours they are linked to */
+static void router_init(sf_router_state * s, tw_lp * lp)
+{
+    s->params = get_params(lp->gid, &s->anno);
+
+    // shorthand
+    const slimfly_param *p = s->params;
+    vct_router *r = &s->r;
+    int i;
+
+    /* Checking for consistency of configuration */
+    int num_routers = codes_mapping_get_lp_count(NULL, 0, LP_ROUTER_NM,
+            NULL, 1);
+    if(num_routers != p->num_routers)
+        tw_error(TW_LOC, "Config error: %d Slim Fly routers configured, the "
+                "Slim Fly of field size %d has %d\n", num_routers, p->q,
+                p->num_routers);
+
+    vct_router_init(r, &slimfly_vct, p->router_radix + p->num_cn,
+            SLIMFLY_NUM_VCS, p->chunk_size, lp);
+
+    for(i = 0; i < r->num_ports; i++)
+    {
+        if(i < p->router_radix)
+        {
+            r->port_gid[i] = codes_mapping_get_lpid_from_relative(
+                    p->neighbor[r->router_id * p->router_radix + i], NULL,
+                    LP_ROUTER_NM, NULL, 1);
+            r->peer_port[i] = p->peer_port[r->router_id * p->router_radix + i];
+            r->bandwidth[i] = p->link_bandwidth;
+            r->buffer_size[i] = p->vc_size;
+        }
+        else
+        {
+            r->port_gid[i] = codes_mapping_get_lpid_from_relative(
+                    r->router_id * p->num_cn + i - p->router_radix, NULL,
+                    LP_CONFIG_NM, NULL, 1);
+            r->bandwidth[i] = p->cn_bandwidth;
+            r->buffer_size[i] = p->cn_vc_size;
+        }
+        r->latency[i] = p->link_latency;
+    }
+}
+
+static void slimfly_router_final(sf_router_state * s,
+        tw_lp * lp)
+{
+    const slimfly_param *p = s->params;
+    vct_router *r = &s->r;
+    int i, ret;
+
+    slimfly_port_record *rec = calloc(r->num_ports, sizeof(*rec));
+    assert(rec);
+    for(i = 0; i < r->num_ports; i++)
+    {
+        rec[i].router = r->router_id;
+        rec[i].port_type = vct_is_cn_port(r, i);
+        rec[i].port_index = i < p->router_radix ? i : i - p->router_radix;
+        rec[i].bytes = r->port_stats[i].bytes;
+        rec[i].packets = r->port_stats[i].packets;
+        rec[i].blocked_time = vct_port_blocked_time(r, i, lp);
+        rec[i].peak_queue_bytes = r->port_stats[i].peak_queue_bytes;
+    }
+
+    ret = lp_io_write(lp->gid, "slimfly-router-ports",
+            r->num_ports * sizeof(*rec), rec);
+    assert(ret == 0);
+
+    free(rec);
+    vct_router_free(r);
+}
+
+/* Slim Fly compute node and router LP types */
+static tw_lptype slimfly_lps[] =
+{
+    // Terminal handling functions
+    {
+        (init_f)terminal_init,
+        (pre_run_f) NULL,
+        (event_f) vct_terminal_event,
+        (revent_f) vct_terminal_rc_event_handler,
+        (final_f) vct_terminal_final,
+        (map_f) codes_mapping,
+        sizeof(vct_terminal)
+    },
+    {
+        (init_f) router_init,
+        (pre_run_f) NULL,
+        (event_f) vct_router_event,
+        (revent_f) vct_router_rc_event_handler,
+        (final_f) slimfly_router_final,
+        (map_f) codes_mapping,
+        sizeof(sf_router_state),
+    },
+    {0},
+};
+
+/* returns the slimfly lp type for lp registration */
+static const tw_lptype* slimfly_get_cn_lp_type(void)
+{
+    return(&slimfly_lps[0]);
+}
+
+static void slimfly_register(tw_lptype *base_type) {
+    lp_type_register(LP_CONFIG_NM, base_type);
+    lp_type_register(LP_ROUTER_NM, &slimfly_lps[1]);
+}
+
+/* data structure for Slim Fly statistics */
+struct model_net_method slimfly_method =
+{
+    .mn_configure = slimfly_configure,
+    .mn_register = slimfly_register,
+    .model_net_method_packet_event = slimfly_packet_event,
+    .model_net_method_packet_event_rc = vct_packet_event_rc,
+    .model_net_method_recv_msg_event = NULL,
+    .model_net_method_recv_msg_event_rc = NULL,
+    .mn_get_lp_type = slimfly_get_cn_lp_type,
+    .mn_get_msg_sz = slimfly_get_msg_sz,
+    .mn_report_stats = slimfly_report_stats,
+    .mn_collective_call = slimfly_collective,
+    .mn_collective_call_rc = slimfly_collective_rc
+};
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
@@ -14,6 +14,7 @@
 #include "codes/model-net.h"
 #include "codes/model-net-method.h"
 #include "codes/model-net-lp.h"
+#include "codes/quicklist.h"
 #include "codes/net/torus.h"
 
 #define CHUNK_SIZE 32
@@ -22,31 +23,53 @@
 #define TRACE -1
 
 /* collective specific parameters */
-#define TREE_DEGREE 4
-#define LEVEL_DELAY 1000
 #define TORUS_COLLECTIVE_DEBUG 0
-#define NUM_COLLECTIVES  1
-#define COLLECTIVE_COMPUTATION_DELAY 5700
-#define TORUS_FAN_OUT_DELAY 20.0
+/* max. number of collectives in flight at a node (ids are reused modulo) */
+#define NUM_COLLECTIVES  8
 
 #define LP_CONFIG_NM (model_net_lp_config_names[TORUS])
 #define LP_METHOD_NM (model_net_method_names[TORUS])
 
+/* alignment of the per-port state block */
+#define TORUS_CACHE_LINE 64
+
 static double maxd(double a, double b) { return a < b ? b : a; }
+/* rounds a size up to a whole number of cache lines */
+static size_t cache_align(size_t sz)
+{
+    return (sz + TORUS_CACHE_LINE - 1) & ~(size_t)(TORUS_CACHE_LINE - 1);
+}
 
 /* Torus network model implementation of codes, implements the modelnet API */
 
+/* routing algorithms */
+enum torus_routing
+{
+    TORUS_DOR, /* dimension order routing */
+    TORUS_ADAPTIVE /* minimal adaptive routing with DOR escape channels */
+};
+
 typedef struct torus_param torus_param;
 struct torus_param
 {
     int n_dims; /*Dimension of the torus network, 5-D, 7-D or any other*/
     int* dim_length; /*Length of each torus dimension*/
-    double link_bandwidth;/* bandwidth for each torus link */
+    double link_bandwidth;/* bandwidth of the node, the fastest of its links */
+    double* dim_bandwidth; /* bandwidth of the links of each dimension */
+    int* is_mesh; /* dimensions without wraparound links */
     int buffer_size; /* number of buffer slots for each vc in flits*/
     //int num_net_traces; /* number of network traces to be mapped on torus */
     int num_vc; /* number of virtual channels for each torus link */
+    int routing; /* dimension order or minimal adaptive */
     float mean_process;/* mean process time for each flit  */
     int chunk_size; /* chunk is the smallest unit--default set to 32 */
+    int injection_buffer_size; /* chunks a node may have waiting for injection */
+    /* packets of at least this many bytes skip the chunk pipeline and are
+     * routed analytically (0: never), per category overrides come first */
+    uint64_t analytic_threshold;
+    int num_analytic_categories;
+    char analytic_category[CATEGORY_MAX][CATEGORY_NAME_MAX];
+    uint64_t analytic_category_threshold[CATEGORY_MAX];
 
     /* "derived" torus parameters */
 
@@ -55,8 +78,14 @@ struct torus_param
     /* half length of each dimension, used in torus coordinates calculation */
     int * half_length;
 
-    double head_delay;
-    double credit_delay;
+    /* per dimension */
+    double* head_delay;
+    double* credit_delay;
+
+    int collective_tree_degree; /* children per node along each dimension */
+    double collective_level_delay; /* delay of a fan-in step */
+    double collective_computation_delay; /* reduction at the root */
+    double collective_fan_out_delay; /* delay of a fan-out step */
 };
 
 /* codes mapping group name, lp type name */
@@ -71,6 +100,10 @@ static tw_stime         max_collective = 0;
 
 /* number of finished packets on each PE */
 static long long       N_finished_packets = 0;
+/* number of chunks that had to wait for a link buffer slot on each PE */
+static long long       N_link_waits = 0;
+/* time the packet injection was stalled, summed over the nodes of each PE */
+static tw_stime        total_stall_time = 0;
 /* total number of hops traversed by a message on each PE */
 static long long       total_hops = 0;
 
@@ -81,59 +114,95 @@ static torus_param             * all_params = NULL;
 static const config_anno_map_t * anno_map   = NULL;
 
 typedef struct nodes_state nodes_state;
+typedef struct torus_wait_item torus_wait_item;
+
+/* a chunk waiting for a buffer slot on an outgoing link */
+struct torus_wait_item
+{
+  nodes_message msg;
+  /* remote and local events of the chunk */
+  void * edata;
+  struct qlist_head ql;
+};
 
 /* state of a torus node */
 struct nodes_state
 {
   /* counts the number of packets sent from this compute node */
   unsigned long long packet_counter;            
+  /* per-port state, carved out of a single cache-line aligned block
+     allocated in torus_init. Links are indexed by dir + 2 * dim, virtual
+     channels by link * num_vc + vc */
   /* availability time of each torus link */
-  tw_stime** next_link_available_time; 
+  tw_stime* next_link_available_time;
   /* availability of each torus credit link */
-  tw_stime** next_credit_available_time;
-  /* next flit generate time */
-  tw_stime** next_flit_generate_time;
-  /* buffer size for each torus virtual channel */
-  int** buffer;
+  tw_stime* next_credit_available_time;
+  /* occupied slots of each torus virtual channel */
+  int* buffer;
+  /* chunks waiting for a buffer slot on each outgoing link and VC */
+  struct qlist_head* link_waitq;
+  /* chunks of locally generated packets not yet injected on a link */
+  int inj_pending;
+  /* the scheduler waits for room in the injection buffer */
+  int sched_blocked;
+  tw_stime sched_blocked_time;
+  /* injection statistics: bytes handed over by the scheduler and bytes
+     actually injected, the time the node started injecting, its last
+     injection and the time the scheduler was stalled */
+  uint64_t offered_bytes;
+  uint64_t injected_bytes;
+  tw_stime first_offer_time;
+  tw_stime last_inject_time;
+  tw_stime stall_time;
   /* coordinates of the current torus node */
   int* dim_position;
-  /* neighbor LP ids for this torus node */
-  int* neighbour_minus_lpID;
-  int* neighbour_plus_lpID;
+  /* neighbor LP gids for this torus node */
+  tw_lpid* neighbour_minus_lpID;
+  tw_lpid* neighbour_plus_lpID;
 
-  /* records torus statistics for this LP having different communication categories */
-  struct mn_stats torus_stats_array[CATEGORY_MAX];
    /* for collective operations */
 
+   /* collective state, indexed by collective id % NUM_COLLECTIVES */
   /* collective init time */
-  tw_stime collective_init_time;
+  tw_stime collective_init_time[NUM_COLLECTIVES];
+
+   /* messages sent & received in collectives may get interchanged several times so we have to save the 
+     origin server information in the node's state */
+   tw_lpid origin_svr[NUM_COLLECTIVES];
+
+   /* to maintain a count of the contributions (own and children) that have fanned in at the
+      node during the collective fan-in phase*/
+   int num_fan_nodes[NUM_COLLECTIVES];
+
+   /* id of the next collective started at this node */
+   int collective_seq;
 
   /* node ID in the tree */ 
    tw_lpid node_id;
 
-   /* messages sent & received in collectives may get interchanged several times so we have to save the 
-     origin server information in the node's state */
-   tw_lpid origin_svr; 
-  
-  /* parent node ID of the current node */
-   tw_lpid parent_node_id;
-   /* array of children to be allocated in terminal_init*/
+  /* LP gid of the parent node of the current node */
+   tw_lpid parent_gid;
+   /* LP gids of the children, allocated in torus_collective_init */
    tw_lpid* children;
 
-   /* children of a node can be less than or equal to the tree degree */
+   /* children of a node over all the dimensions */
    int num_children;
 
    short is_root;
    short is_leaf;
-
-   /* to maintain a count of child nodes that have fanned in at the parent during the collective
-      fan-in phase*/
-   int num_fan_nodes;
+   /* idle nodes (no server attached) take part in collectives only to pass on
+      the messages of their subtree */
+   short has_server;
 
    /* LPs annotation */
    const char * anno;
    /* LPs configuration */
    const torus_param * params;
+
+  /* records torus statistics for this LP having different communication
+     categories. Kept last so that it stays off the cache lines of the
+     fields touched on every chunk */
+  struct mn_stats torus_stats_array[CATEGORY_MAX];
 };
 
 static void torus_read_config(
@@ -152,13 +221,72 @@ static void torus_read_config(
                 "Warning: Number of dimensions not specified, setting to %d\n",
                 p->n_dims);
     }
-
-    configuration_get_value_double(&config, "PARAMS", "link_bandwidth", anno,
-            &p->link_bandwidth);
-    if(!p->link_bandwidth) {
-        p->link_bandwidth = 2.0; /*default bg/q configuration */
+    if(p->n_dims > TORUS_MAX_DIMS)
+        tw_error(TW_LOC, "n_dims (%d) exceeds the maximum torus dimension "
+                "(%d)\n", p->n_dims, TORUS_MAX_DIMS);
+
+    /* link_bandwidth is either one value for all the dimensions or one value
+     * per dimension, e.g. "2.0,2.0,2.0,2.0,4.0" */
+    char bw_str[MAX_NAME_LENGTH];
+    bw_str[0] = '\0';
+    p->dim_bandwidth = malloc(p->n_dims * sizeof(*p->dim_bandwidth));
+    configuration_get_value(&config, "PARAMS", "link_bandwidth", anno, bw_str,
+            MAX_NAME_LENGTH);
+    if(bw_str[0] == '\0') {
+        for(i = 0; i < p->n_dims; i++)
+            p->dim_bandwidth[i] = 2.0; /*default bg/q configuration */
         fprintf(stderr, "Link bandwidth not specified, setting to %lf\n",
-                p->link_bandwidth);
+                p->dim_bandwidth[0]);
+    }
+    else {
+        char* bw_token = strtok(bw_str, ",");
+        i = 0;
+        while(bw_token != NULL && i < p->n_dims)
+        {
+            sscanf(bw_token, "%lf", &p->dim_bandwidth[i]);
+            if(p->dim_bandwidth[i] <= 0)
+                tw_error(TW_LOC, "Invalid torus link bandwidth specified "
+                        "(%lf at pos %d)\n", p->dim_bandwidth[i], i);
+            i++;
+            bw_token = strtok(NULL, ",");
+        }
+        if(i == 1)
+            for(; i < p->n_dims; i++)
+                p->dim_bandwidth[i] = p->dim_bandwidth[0];
+        else if(i != p->n_dims || bw_token != NULL)
+            tw_error(TW_LOC, "PARAMS:link_bandwidth needs 1 or n_dims (%d) "
+                    "values\n", p->n_dims);
+    }
+    p->link_bandwidth = p->dim_bandwidth[0];
+    for(i = 1; i < p->n_dims; i++)
+        p->link_bandwidth = maxd(p->link_bandwidth, p->dim_bandwidth[i]);
+
+    /* dim_type is either one value for all the dimensions or one per
+     * dimension: "torus" (wraparound links) or "mesh" */
+    char dim_type_str[MAX_NAME_LENGTH];
+    dim_type_str[0] = '\0';
+    p->is_mesh = calloc(p->n_dims, sizeof(*p->is_mesh));
+    configuration_get_value(&config, "PARAMS", "dim_type", anno, dim_type_str,
+            MAX_NAME_LENGTH);
+    if(dim_type_str[0] != '\0') {
+        char* type_token = strtok(dim_type_str, ",");
+        i = 0;
+        while(type_token != NULL && i < p->n_dims)
+        {
+            if(strcmp(type_token, "mesh") == 0)
+                p->is_mesh[i] = 1;
+            else if(strcmp(type_token, "torus") != 0)
+                tw_error(TW_LOC, "Unknown value for PARAMS:dim_type: %s "
+                        "(expected torus or mesh)\n", type_token);
+            i++;
+            type_token = strtok(NULL, ",");
+        }
+        if(i == 1)
+            for(; i < p->n_dims; i++)
+                p->is_mesh[i] = p->is_mesh[0];
+        else if(i != p->n_dims || type_token != NULL)
+            tw_error(TW_LOC, "PARAMS:dim_type needs 1 or n_dims (%d) values\n",
+                    p->n_dims);
     }
 
     configuration_get_value_int(&config, "PARAMS", "buffer_size", anno, &p->buffer_size);
@@ -175,6 +303,48 @@ static void torus_read_config(
         fprintf(stderr, "Warning: Chunk size not specified, setting to %d\n",
                 p->chunk_size);
     }
+    configuration_get_value_int(&config, "PARAMS", "injection_buffer_size",
+            anno, &p->injection_buffer_size);
+    if(p->injection_buffer_size <= 0)
+        p->injection_buffer_size = p->buffer_size;
+
+    long analytic_threshold = 0;
+    configuration_get_value_longint(&config, "PARAMS", "analytic_threshold",
+            anno, &analytic_threshold);
+    if(analytic_threshold < 0)
+        tw_error(TW_LOC, "PARAMS:analytic_threshold must be >= 0 (got %ld)\n",
+                analytic_threshold);
+    p->analytic_threshold = analytic_threshold;
+
+    /* per category thresholds, e.g. "ckpt:65536,halo:0" (0 keeps the category
+     * on the chunk pipeline) */
+    char cat_str[MAX_NAME_LENGTH];
+    cat_str[0] = '\0';
+    p->num_analytic_categories = 0;
+    configuration_get_value(&config, "PARAMS", "analytic_category_threshold",
+            anno, cat_str, MAX_NAME_LENGTH);
+    char* cat_token = strtok(cat_str, ",");
+    while(cat_token != NULL)
+    {
+        char* sep = strchr(cat_token, ':');
+        unsigned long long cat_threshold;
+        i = p->num_analytic_categories;
+        if(i == CATEGORY_MAX)
+            tw_error(TW_LOC, "PARAMS:analytic_category_threshold has more "
+                    "than %d categories\n", CATEGORY_MAX);
+        if(sep == NULL || sep == cat_token ||
+                sep - cat_token >= CATEGORY_NAME_MAX ||
+                sscanf(sep + 1, "%llu", &cat_threshold) != 1)
+            tw_error(TW_LOC, "Invalid entry in "
+                    "PARAMS:analytic_category_threshold: %s (expected "
+                    "category:bytes)\n", cat_token);
+        *sep = '\0';
+        strcpy(p->analytic_category[i], cat_token);
+        p->analytic_category_threshold[i] = cat_threshold;
+        p->num_analytic_categories++;
+        cat_token = strtok(NULL, ",");
+    }
+
     configuration_get_value_int(&config, "PARAMS", "num_vc", anno, &p->num_vc);
     if(!p->num_vc) {
         /* by default, we have one for taking packets,
@@ -184,6 +354,24 @@ static void torus_read_config(
                 p->num_vc);
     }
 
+    char routing_str[MAX_NAME_LENGTH];
+    routing_str[0] = '\0';
+    configuration_get_value(&config, "PARAMS", "routing", anno, routing_str,
+            MAX_NAME_LENGTH);
+    if(routing_str[0] == '\0' || strcmp(routing_str, "dor") == 0 ||
+            strcmp(routing_str, "dimension-order") == 0)
+        p->routing = TORUS_DOR;
+    else if(strcmp(routing_str, "adaptive") == 0)
+        p->routing = TORUS_ADAPTIVE;
+    else
+        tw_error(TW_LOC, "Unknown value for PARAMS:routing: %s "
+                "(expected dor or adaptive)\n", routing_str);
+    /* VCs 0 and 1 are the dateline classes of the (escape) DOR channels, the
+     * remaining ones are used by the adaptive routing */
+    if(p->routing == TORUS_ADAPTIVE && p->num_vc < 3)
+        tw_error(TW_LOC, "adaptive torus routing needs num_vc >= 3 (2 escape "
+                "and at least 1 adaptive VC), got %d\n", p->num_vc);
+
     int rc = configuration_get_value(&config, "PARAMS", "dim_length", anno,
             dim_length_str, MAX_NAME_LENGTH);
     if (rc == 0){
@@ -231,8 +419,28 @@ static void torus_read_config(
         p->half_length[i] = p->dim_length[i] / 2;
 
     // some latency numbers
-    p->head_delay = (1.0 / p->link_bandwidth) * p->chunk_size;
-    p->credit_delay = (1.0 / p->link_bandwidth) * p->chunk_size;
+    p->head_delay = malloc(p->n_dims * sizeof(*p->head_delay));
+    p->credit_delay = malloc(p->n_dims * sizeof(*p->credit_delay));
+    for (i = 0; i < p->n_dims; i++) {
+        p->head_delay[i] = (1.0 / p->dim_bandwidth[i]) * p->chunk_size;
+        p->credit_delay[i] = (1.0 / p->dim_bandwidth[i]) * p->chunk_size;
+    }
+
+    configuration_get_value_int(&config, "PARAMS", "collective_tree_degree",
+            anno, &p->collective_tree_degree);
+    if(p->collective_tree_degree <= 0)
+        p->collective_tree_degree = 4;
+
+    p->collective_level_delay = 1000.0;
+    configuration_get_value_double(&config, "PARAMS", "collective_level_delay",
+            anno, &p->collective_level_delay);
+    p->collective_computation_delay = 5700.0;
+    configuration_get_value_double(&config, "PARAMS",
+            "collective_computation_delay", anno,
+            &p->collective_computation_delay);
+    p->collective_fan_out_delay = 20.0;
+    configuration_get_value_double(&config, "PARAMS",
+            "collective_fan_out_delay", anno, &p->collective_fan_out_delay);
 }
 
 static void torus_configure(){
@@ -277,55 +485,138 @@ static int to_flat_id(
     return flat_id;
 }
 
-void torus_collective_init(nodes_state * s,
-           		   tw_lp * lp)
+/* returns 1 if a server is attached to the torus node gid, i.e. its LP group
+ * holds an LP type other than the model-net ones. Nodes placed in a group of
+ * their own are idle */
+static int torus_node_has_server(tw_lpid gid)
 {
-    // TODO: be annotation-aware somehow 
-    codes_mapping_get_lp_info(lp->gid, grp_name, &mapping_grp_id, NULL, &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
-    int num_lps = codes_mapping_get_lp_count(grp_name, 1, LP_CONFIG_NM, s->anno, 0);
-    int num_reps = codes_mapping_get_group_reps(grp_name);
-    s->node_id = (mapping_rep_id * num_lps) + mapping_offset;
+    char grp[MAX_NAME_LENGTH];
+    int grp_id, type_id, rep_id, offset;
+    uint64_t lpt;
+    int n;
+
+    codes_mapping_get_lp_info(gid, grp, &grp_id, NULL, &type_id, NULL,
+            &rep_id, &offset);
+    const config_lpgroup_t *lpgroup = &lpconf.lpgroups[grp_id];
+    for (lpt = 0; lpt < lpgroup->lptypes_count; lpt++){
+        char const *nm = lpgroup->lptypes[lpt].name.ptr;
+        for (n = 0; n < MAX_NETS; n++){
+            if (strcmp(model_net_lp_config_names[n], nm) == 0)
+                break;
+        }
+        if (n == MAX_NETS)
+            return 1;
+    }
+    return 0;
+}
 
-    int i;
-   /* handle collective operations by forming a tree of all the LPs */
-   /* special condition for root of the tree */
-   if( s->node_id == 0)
+/* The collective tree is dimension ordered: the nodes of a line along
+ * dimension 0 gather at the node with coordinate 0, those lines gather along
+ * dimension 1 and so on. Each line is split into a tree of degree
+ * collective_tree_degree. Computes the parent (-1 at the root) and the
+ * children (flat ids) of the node at pos, returns the number of children */
+static int collective_tree_links(const torus_param *p,
+        const int *pos,
+        int *parent,
+        int *children)
+{
+    int degree = p->collective_tree_degree;
+    int tmp_dim_pos[p->n_dims];
+    int num_children = 0;
+    int j, k;
+
+    *parent = -1;
+    for( k = 0; k < p->n_dims; k++ )
+        tmp_dim_pos[k] = pos[k];
+
+    /* a node leads its line along dimension k only if its coordinates below
+     * k are zero, so walk up the dimensions until the node becomes a child */
+    for( k = 0; k < p->n_dims; k++ )
     {
-        s->parent_node_id = -1;
-        s->is_root = 1;
-   }
-   else
-   {
-       s->parent_node_id = (s->node_id - ((s->node_id - 1) % TREE_DEGREE)) / TREE_DEGREE;
-       s->is_root = 0;
-   }
-   s->children = (tw_lpid*)malloc(TREE_DEGREE * sizeof(tw_lpid));
-
-   /* set the isleaf to zero by default */
-   s->is_leaf = 1;
-   s->num_children = 0;
+        for( j = 1; j <= degree; j++ )
+        {
+            tmp_dim_pos[k] = degree * pos[k] + j;
+            if(tmp_dim_pos[k] >= p->dim_length[k])
+                break;
+            children[num_children++] =
+                to_flat_id(p->n_dims, p->dim_length, tmp_dim_pos);
+        }
+        tmp_dim_pos[k] = pos[k];
+        if(pos[k] != 0)
+        {
+            tmp_dim_pos[k] = (pos[k] - 1) / degree;
+            *parent = to_flat_id(p->n_dims, p->dim_length, tmp_dim_pos);
+            break;
+        }
+    }
+    return num_children;
+}
 
-   /* calculate the children of the current node. If its a leaf, no need to set children,
-      only set isleaf and break the loop*/
+/* returns 1 if a node of the subtree rooted at flat_id has a server. Subtrees
+ * of idle nodes only are left out of the collectives */
+static int collective_subtree_active(const nodes_state *s, int flat_id)
+{
+    const torus_param *p = s->params;
+    int pos[p->n_dims];
+    int children[p->n_dims * p->collective_tree_degree];
+    int parent, num_children, i;
+
+    if(torus_node_has_server(codes_mapping_get_lpid_from_relative(flat_id,
+                    NULL, LP_CONFIG_NM, s->anno, 1)))
+        return 1;
+
+    to_dim_id(flat_id, p->n_dims, p->dim_length, pos);
+    num_children = collective_tree_links(p, pos, &parent, children);
+    for( i = 0; i < num_children; i++ )
+        if(collective_subtree_active(s, children[i]))
+            return 1;
+    return 0;
+}
 
-   for( i = 0; i < TREE_DEGREE; i++ )
+/* The collective tree follows the torus dimensions (see
+ * collective_tree_links). Parent and children are kept as LP gids so the
+ * fan-in and fan-out phases do no mapping lookups. */
+void torus_collective_init(nodes_state * s,
+           		   tw_lp * lp)
+{
+    const torus_param *p = s->params;
+    int children[p->n_dims * p->collective_tree_degree];
+    int parent;
+    int i, num_links;
+
+    s->node_id = to_flat_id(p->n_dims, p->dim_length, s->dim_position);
+    s->has_server = torus_node_has_server(lp->gid);
+
+    num_links = collective_tree_links(p, s->dim_position, &parent, children);
+    s->num_children = 0;
+    for( i = 0; i < num_links; i++ )
+        if(collective_subtree_active(s, children[i]))
+            children[s->num_children++] = children[i];
+
+    s->is_root = (parent < 0);
+    s->is_leaf = (s->num_children == 0);
+    s->parent_gid = s->is_root ? lp->gid :
+        codes_mapping_get_lpid_from_relative(parent, NULL, LP_CONFIG_NM,
+                s->anno, 1);
+    s->children = (tw_lpid*)malloc((s->num_children ? s->num_children : 1) *
+            sizeof(tw_lpid));
+    for( i = 0; i < s->num_children; i++ )
+        s->children[i] = codes_mapping_get_lpid_from_relative(children[i],
+                NULL, LP_CONFIG_NM, s->anno, 1);
+
+    s->collective_seq = 0;
+    for( i = 0; i < NUM_COLLECTIVES; i++ )
     {
-        tw_lpid next_child = (TREE_DEGREE * s->node_id) + i + 1;
-        if(next_child < (num_lps * num_reps))
-        {
-            s->num_children++;
-            s->is_leaf = 0;
-            s->children[i] = next_child;
-        }
-        else
-           s->children[i] = -1;
+        s->collective_init_time[i] = 0.0;
+        s->origin_svr[i] = 0;
+        s->num_fan_nodes[i] = 0;
     }
 
 #if TORUS_COLLECTIVE_DEBUG == 1
-   printf("\n LP %ld parent node id ", s->node_id);
+   printf("\n LP %ld parent node id %d ", s->node_id, parent);
 
-   for( i = 0; i < TREE_DEGREE; i++ )
-        printf(" child node ID %ld ", s->children[i]);
+   for( i = 0; i < s->num_children; i++ )
+        printf(" child node ID %d ", children[i]);
    printf("\n");
 
    if(s->is_leaf)
@@ -345,6 +636,45 @@ static int torus_get_msg_sz(void)
    return sizeof(nodes_message);
 }
 
+/* number of chunks of a packet */
+static uint64_t get_num_chunks(const torus_param *p, uint64_t packet_size)
+{
+    uint64_t num_chunks = packet_size / p->chunk_size;
+    if(packet_size % p->chunk_size)
+        num_chunks++;
+    if(!num_chunks)
+        num_chunks = 1;
+    return num_chunks;
+}
+
+/* bytes carried by the chunk of msg, the last one may be partial */
+static uint64_t get_chunk_bytes(const torus_param *p, const nodes_message *msg)
+{
+    uint64_t offset = (uint64_t)msg->chunk_id * p->chunk_size;
+    if(msg->packet_size < offset + p->chunk_size)
+        return msg->packet_size > offset ? msg->packet_size - offset : 0;
+    return p->chunk_size;
+}
+
+/* whether the packet of msg skips the chunk pipeline: it is routed
+ * analytically when it reaches the threshold of its category (or the global
+ * one if the category has none) */
+static int is_analytic(const torus_param *p, const nodes_message *msg)
+{
+    uint64_t threshold = p->analytic_threshold;
+    int i;
+
+    for(i = 0; i < p->num_analytic_categories; i++)
+    {
+        if(strcmp(p->analytic_category[i], msg->category) == 0)
+        {
+            threshold = p->analytic_category_threshold[i];
+            break;
+        }
+    }
+    return threshold > 0 && msg->packet_size >= threshold;
+}
+
 /* torus packet event , generates a torus packet on the compute node */
 static tw_stime torus_packet_event(char const * category, tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size, int is_pull, uint64_t pull_size, tw_stime offset, const mn_sched_params *sched_params, int remote_event_size, const void* remote_event, int self_event_size, const void* self_event, tw_lpid src_lp, tw_lp *sender, int is_last_pckt)
 {
@@ -412,31 +742,38 @@ static void torus_init( nodes_state * s,
     // shorthand
     const torus_param *p = s->params;
 
-    s->neighbour_minus_lpID = (int*)malloc(p->n_dims * sizeof(int));
-    s->neighbour_plus_lpID = (int*)malloc(p->n_dims * sizeof(int));
+    s->neighbour_minus_lpID = (tw_lpid*)malloc(p->n_dims * sizeof(tw_lpid));
+    s->neighbour_plus_lpID = (tw_lpid*)malloc(p->n_dims * sizeof(tw_lpid));
     s->dim_position = (int*)malloc(p->n_dims * sizeof(int));
-    s->buffer = (int**)malloc(2*p->n_dims * sizeof(int*));
-    s->next_link_available_time = 
-        (tw_stime**)malloc(2*p->n_dims * sizeof(tw_stime*));
-    s->next_credit_available_time = 
-        (tw_stime**)malloc(2*p->n_dims * sizeof(tw_stime*));
-    s->next_flit_generate_time = 
-        (tw_stime**)malloc(2*p->n_dims*sizeof(tw_stime*));
-
-    for(i=0; i < 2*p->n_dims; i++)
-    {
-	s->buffer[i] = (int*)malloc(p->num_vc * sizeof(int));
-	s->next_link_available_time[i] =
-            (tw_stime*)malloc(p->num_vc * sizeof(tw_stime));
-	s->next_credit_available_time[i] = 
-            (tw_stime*)malloc(p->num_vc * sizeof(tw_stime));
-	s->next_flit_generate_time[i] = 
-            (tw_stime*)malloc(p->num_vc * sizeof(tw_stime));
-    }
+    /* the per-port state shares one block: the link and credit availability
+       times of each link, then the occupancy and wait queue of each VC, each
+       array starting on its own cache line */
+    int num_links = 2 * p->n_dims;
+    int num_link_vcs = num_links * p->num_vc;
+    size_t times_sz = cache_align(num_links * sizeof(tw_stime));
+    size_t buffer_sz = cache_align(num_link_vcs * sizeof(int));
+    size_t waitq_sz = num_link_vcs * sizeof(struct qlist_head);
+    char * port_block;
+    if(posix_memalign((void**)&port_block, TORUS_CACHE_LINE,
+                2 * times_sz + buffer_sz + waitq_sz) != 0)
+        tw_error(TW_LOC, "torus node: unable to allocate port state\n");
+    memset(port_block, 0, 2 * times_sz + buffer_sz + waitq_sz);
+    s->next_link_available_time = (tw_stime*)port_block;
+    s->next_credit_available_time = (tw_stime*)(port_block + times_sz);
+    s->buffer = (int*)(port_block + 2 * times_sz);
+    s->link_waitq =
+        (struct qlist_head*)(port_block + 2 * times_sz + buffer_sz);
 
     // calculate my torus coords
-    to_dim_id(codes_mapping_get_lp_relative_id(lp->gid, 0, 1),
-            s->params->n_dims, s->params->dim_length, s->dim_position);
+    int num_nodes = 1;
+    for( i = 0; i < p->n_dims; i++ )
+        num_nodes *= p->dim_length[i];
+    int rel_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 1);
+    if(rel_id >= num_nodes)
+        tw_error(TW_LOC, "torus node %d does not fit in the torus dimensions "
+                "(%d nodes)\n", rel_id, num_nodes);
+    to_dim_id(rel_id, s->params->n_dims, s->params->dim_length,
+            s->dim_position);
     /* DEBUG
     printf("%lu: my coords:", lp->gid);
     for (i = 0; i < p->n_dims; i++)
@@ -448,20 +785,19 @@ static void torus_init( nodes_state * s,
   for ( i = 0; i < p->n_dims; i++ )
     temp_dim_pos[ i ] = s->dim_position[ i ];
 
-  // calculate minus neighbour's lpID
+  // calculate minus neighbour's lpID (the wraparound neighbours of the
+  // boundary nodes of a mesh dimension are never routed to)
   for ( j = 0; j < p->n_dims; j++ )
     {
       temp_dim_pos[ j ] = (s->dim_position[ j ] -1 + p->dim_length[ j ]) %
           p->dim_length[ j ];
 
-      s->neighbour_minus_lpID[j] =
-          to_flat_id(p->n_dims, p->dim_length, temp_dim_pos);
+      s->neighbour_minus_lpID[j] = codes_mapping_get_lpid_from_relative(
+              to_flat_id(p->n_dims, p->dim_length, temp_dim_pos),
+              NULL, LP_CONFIG_NM, s->anno, 1);
 
       /* DEBUG
-      printf(" minus neighbor: flat:%d lpid:%lu\n",
-              s->neighbour_minus_lpID[j],
-              codes_mapping_get_lpid_from_relative(s->neighbour_minus_lpID[j],
-                      NULL, LP_CONFIG_NM, s->anno, 1));
+      printf(" minus neighbor: lpid:%lu\n", s->neighbour_minus_lpID[j]);
       */
 
       temp_dim_pos[ j ] = s->dim_position[ j ];
@@ -472,29 +808,29 @@ static void torus_init( nodes_state * s,
       temp_dim_pos[ j ] = ( s->dim_position[ j ] + 1 + p->dim_length[ j ]) %
           p->dim_length[ j ];
 
-      s->neighbour_plus_lpID[j] =
-          to_flat_id(p->n_dims, p->dim_length, temp_dim_pos);
+      s->neighbour_plus_lpID[j] = codes_mapping_get_lpid_from_relative(
+              to_flat_id(p->n_dims, p->dim_length, temp_dim_pos),
+              NULL, LP_CONFIG_NM, s->anno, 1);
 
       /* DEBUG
-      printf(" plus neighbor: flat:%d lpid:%lu\n",
-              s->neighbour_plus_lpID[j],
-              codes_mapping_get_lpid_from_relative(s->neighbour_plus_lpID[j],
-                      NULL, LP_CONFIG_NM, s->anno, 1));
+      printf(" plus neighbor: lpid:%lu\n", s->neighbour_plus_lpID[j]);
       */
 
       temp_dim_pos[ j ] = s->dim_position[ j ];
     }
 
   //printf("\n");
-  for( j=0; j < 2 * p->n_dims; j++ )
-   {
-    for( i = 0; i < p->num_vc; i++ )
-     {
-       s->buffer[ j ][ i ] = 0; 
-       s->next_link_available_time[ j ][ i ] = 0.0;
-       s->next_credit_available_time[j][i] = 0.0; 
-     }
-   }
+  for( j = 0; j < num_link_vcs; j++ )
+      INIT_QLIST_HEAD(&s->link_waitq[j]);
+  s->inj_pending = 0;
+  s->sched_blocked = 0;
+  s->sched_blocked_time = 0.0;
+  s->offered_bytes = 0;
+  s->injected_bytes = 0;
+  s->first_offer_time = 0.0;
+  s->last_inject_time = 0.0;
+  s->stall_time = 0.0;
+
   // record LP time
     s->packet_counter = 0;
     torus_collective_init(s, lp);
@@ -551,13 +887,14 @@ static void send_remote_event(nodes_state * s,
                         tw_lp * lp)
 {
     // Trigger an event on receiving server
-    if(msg->remote_event_size_bytes)
+    if(msg->remote_event_size_bytes && s->has_server)
      {
             tw_event* e;
             tw_stime ts;
             nodes_message * m;
             ts = (1/s->params->link_bandwidth) * msg->remote_event_size_bytes;
-            e = codes_event_new(s->origin_svr, ts, lp);
+            e = codes_event_new(s->origin_svr[msg->collective_id % NUM_COLLECTIVES],
+                    ts, lp);
             m = tw_event_data(e);
             char* tmp_ptr = (char*)msg;
             tmp_ptr += torus_get_msg_sz();
@@ -566,271 +903,242 @@ static void send_remote_event(nodes_state * s,
      }
 }
 
-static void node_collective_init(nodes_state * s,
-                        tw_bf * bf,
+/* sends a collective message (with the remote event of msg) to a tree node */
+static void send_collective_event(nodes_state * s,
                         nodes_message * msg,
+                        tw_lpid dest_gid,
+                        tw_stime ts,
+                        nodes_event_t type,
                         tw_lp * lp)
 {
-        tw_event * e_new;
-        tw_lpid parent_nic_id;
-        tw_stime xfer_to_nic_time;
-        nodes_message * msg_new;
-        int num_lps;
-
-        msg->saved_collective_init_time = s->collective_init_time;
-        s->collective_init_time = tw_now(lp);
-	s->origin_svr = msg->sender_svr;
-	
-        if(s->is_leaf)
-        {
-            //printf("\n LP %ld sending message to parent %ld ", s->node_id, s->parent_node_id);
-            /* get the global LP ID of the parent node */
-            // TODO: be annotation-aware
-            codes_mapping_get_lp_info(lp->gid, grp_name, &mapping_grp_id, NULL,
-                    &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
-            num_lps = codes_mapping_get_lp_count(grp_name, 1, LP_CONFIG_NM,
-                    NULL, 1);
-            codes_mapping_get_lp_id(grp_name, LP_CONFIG_NM, NULL, 1,
-                    s->parent_node_id/num_lps, (s->parent_node_id % num_lps),
-                    &parent_nic_id);
-
-           /* send a message to the parent that the LP has entered the collective operation */
-            xfer_to_nic_time = g_tw_lookahead + LEVEL_DELAY;
-            //e_new = codes_event_new(parent_nic_id, xfer_to_nic_time, lp);
-	    void* m_data;
-	    e_new = model_net_method_event_new(parent_nic_id, xfer_to_nic_time,
-            	lp, TORUS, (void**)&msg_new, (void**)&m_data);
-	    	
-            memcpy(msg_new, msg, sizeof(nodes_message));
-	    if (msg->remote_event_size_bytes){
-        	memcpy(m_data, model_net_method_get_edata(TORUS, msg),
-                	msg->remote_event_size_bytes);
-      	    }
-	    
-            msg_new->type = T_COLLECTIVE_FAN_IN;
-            msg_new->sender_node = s->node_id;
-
-            tw_event_send(e_new);
-        }
-        return;
+    tw_event * e_new;
+    nodes_message * msg_new;
+    void * m_data;
+
+    e_new = model_net_method_event_new(dest_gid, ts, lp, TORUS,
+            (void**)&msg_new, &m_data);
+    memcpy(msg_new, msg, sizeof(nodes_message));
+    if (msg->remote_event_size_bytes){
+        memcpy(m_data, model_net_method_get_edata(TORUS, msg),
+                msg->remote_event_size_bytes);
+    }
+    msg_new->type = type;
+    msg_new->sender_node = s->node_id;
+    tw_event_send(e_new);
 }
 
-static void node_collective_fan_in(nodes_state * s,
+/* a contribution (the node's own or a child's) has reached the node. Once all
+ * of them are in, signal the parent or, at the root, start the fan-out */
+static void node_collective_arrive(nodes_state * s,
                         tw_bf * bf,
                         nodes_message * msg,
                         tw_lp * lp)
 {
         int i;
-        s->num_fan_nodes++;
+        int slot = msg->collective_id % NUM_COLLECTIVES;
+        const torus_param *p = s->params;
 
-        // TODO: be annotation-aware
-        codes_mapping_get_lp_info(lp->gid, grp_name, &mapping_grp_id, NULL,
-                &mapping_type_id, NULL, &mapping_rep_id, &mapping_offset);
-        int num_lps = codes_mapping_get_lp_count(grp_name, 1, LP_CONFIG_NM,
-                NULL, 1);
+        s->num_fan_nodes[slot]++;
 
-        tw_event* e_new;
-        nodes_message * msg_new;
-        tw_stime xfer_to_nic_time;
+        if(s->num_fan_nodes[slot] < s->num_children + s->has_server)
+            return;
 
-        bf->c1 = 0;
-        bf->c2 = 0;
+        msg->saved_fan_nodes = s->num_fan_nodes[slot]-1;
+        s->num_fan_nodes[slot] = 0;
 
-        /* if the number of fanned in nodes have completed at the current node then signal the parent */
-        if((s->num_fan_nodes == s->num_children) && !s->is_root)
+        /* signal the parent that the subtree has entered the collective operation */
+        if(!s->is_root)
         {
             bf->c1 = 1;
-            msg->saved_fan_nodes = s->num_fan_nodes-1;
-            s->num_fan_nodes = 0;
-            tw_lpid parent_nic_id;
-            xfer_to_nic_time = g_tw_lookahead + LEVEL_DELAY;
-
-            /* get the global LP ID of the parent node */
-            codes_mapping_get_lp_id(grp_name, LP_CONFIG_NM, NULL, 1,
-                    s->parent_node_id/num_lps, (s->parent_node_id % num_lps),
-                    &parent_nic_id);
-
-           /* send a message to the parent that the LP has entered the collective operation */
-            //e_new = codes_event_new(parent_nic_id, xfer_to_nic_time, lp);
-            //msg_new = tw_event_data(e_new);
-	    void * m_data;
-      	    e_new = model_net_method_event_new(parent_nic_id,
-              xfer_to_nic_time,
-              lp, TORUS, (void**)&msg_new, &m_data);
-	    
-            memcpy(msg_new, msg, sizeof(nodes_message));
-            msg_new->type = T_COLLECTIVE_FAN_IN;
-            msg_new->sender_node = s->node_id;
-
-            if (msg->remote_event_size_bytes){
-	        memcpy(m_data, model_net_method_get_edata(TORUS, msg),
-        	        msg->remote_event_size_bytes);
-      	   }
-	    
-            tw_event_send(e_new);
-      }
+            send_collective_event(s, msg, s->parent_gid,
+                    g_tw_lookahead + p->collective_level_delay,
+                    T_COLLECTIVE_FAN_IN, lp);
+            return;
+        }
 
-      /* root node starts off with the fan-out phase */
-      if(s->is_root && (s->num_fan_nodes == s->num_children))
-      {
-           bf->c2 = 1;
-           msg->saved_fan_nodes = s->num_fan_nodes-1;
-           s->num_fan_nodes = 0;
-           send_remote_event(s, bf, msg, lp);
+        /* root node starts off with the fan-out phase */
+        bf->c2 = 1;
+        send_remote_event(s, bf, msg, lp);
 
-           for( i = 0; i < s->num_children; i++ )
-           {
-                tw_lpid child_nic_id;
-                /* Do some computation and fan out immediate child nodes from the collective */
-                xfer_to_nic_time = g_tw_lookahead + COLLECTIVE_COMPUTATION_DELAY + LEVEL_DELAY + tw_rand_exponential(lp->rng, (double)LEVEL_DELAY/50);
-
-                /* get global LP ID of the child node */
-                codes_mapping_get_lp_id(grp_name, LP_CONFIG_NM, NULL, 1,
-                        s->children[i]/num_lps, (s->children[i] % num_lps),
-                        &child_nic_id);
-                //e_new = codes_event_new(child_nic_id, xfer_to_nic_time, lp);
-
-                //msg_new = tw_event_data(e_new);
-                void * m_data;
-	        e_new = model_net_method_event_new(child_nic_id,
-                xfer_to_nic_time,
-		lp, TORUS, (void**)&msg_new, &m_data);
-
-		memcpy(msg_new, msg, sizeof(nodes_message));
-	        if (msg->remote_event_size_bytes){
-	                memcpy(m_data, model_net_method_get_edata(TORUS, msg),
-        	               msg->remote_event_size_bytes);
-      		}
-		
-                msg_new->type = T_COLLECTIVE_FAN_OUT;
-                msg_new->sender_node = s->node_id;
-
-                tw_event_send(e_new);
-           }
-      }
+        for( i = 0; i < s->num_children; i++ )
+        {
+            /* Do some computation and fan out immediate child nodes from the collective */
+            send_collective_event(s, msg, s->children[i],
+                    g_tw_lookahead + p->collective_computation_delay +
+                    p->collective_level_delay +
+                    tw_rand_exponential(lp->rng, p->collective_level_delay/50),
+                    T_COLLECTIVE_FAN_OUT, lp);
+        }
+}
+
+static void node_collective_init(nodes_state * s,
+                        tw_bf * bf,
+                        nodes_message * msg,
+                        tw_lp * lp)
+{
+        int slot;
+
+        /* collectives are started in the same order on every node, so the
+         * per-node sequence number identifies the collective */
+        msg->collective_id = s->collective_seq++;
+        slot = msg->collective_id % NUM_COLLECTIVES;
+
+        msg->saved_collective_init_time = s->collective_init_time[slot];
+        s->collective_init_time[slot] = tw_now(lp);
+	s->origin_svr[slot] = msg->sender_svr;
+
+        node_collective_arrive(s, bf, msg, lp);
+}
+
+static void node_collective_fan_in(nodes_state * s,
+                        tw_bf * bf,
+                        nodes_message * msg,
+                        tw_lp * lp)
+{
+        node_collective_arrive(s, bf, msg, lp);
 }
-	     
+
 static void node_collective_fan_out(nodes_state * s,
                         tw_bf * bf,
                         nodes_message * msg,
                         tw_lp * lp)
 {
         int i;
-        //TODO: be annotation-aware
-        int num_lps = codes_mapping_get_lp_count(grp_name, 1, LP_CONFIG_NM,
-                NULL, 1);
-        bf->c1 = 0;
-        bf->c2 = 0;
+        int slot = msg->collective_id % NUM_COLLECTIVES;
+        const torus_param *p = s->params;
 
         send_remote_event(s, bf, msg, lp);
 
         if(!s->is_leaf)
         {
-            bf->c1 = 1;
-            tw_event* e_new;
-            nodes_message * msg_new;
-            tw_stime xfer_to_nic_time;
-
+           bf->c1 = 1;
            for( i = 0; i < s->num_children; i++ )
            {
-                xfer_to_nic_time = g_tw_lookahead + TORUS_FAN_OUT_DELAY + tw_rand_exponential(lp->rng, (double)TORUS_FAN_OUT_DELAY/10);
-
-                if(s->children[i] > 0)
-                {
-                        tw_lpid child_nic_id;
-
-                        /* get global LP ID of the child node */
-                        codes_mapping_get_lp_id(grp_name, LP_CONFIG_NM, NULL, 1,
-                                s->children[i]/num_lps,
-                                (s->children[i] % num_lps), &child_nic_id);
-                        //e_new = codes_event_new(child_nic_id, xfer_to_nic_time, lp);
-                        //msg_new = tw_event_data(e_new);
-                        //memcpy(msg_new, msg, sizeof(nodes_message) + msg->remote_event_size_bytes);
-			void* m_data;
-			e_new = model_net_method_event_new(child_nic_id,
-							xfer_to_nic_time,
-					                lp, TORUS, (void**)&msg_new, &m_data);
-		        memcpy(msg_new, msg, sizeof(nodes_message));
-		        if (msg->remote_event_size_bytes){
-			        memcpy(m_data, model_net_method_get_edata(TORUS, msg),
-			                msg->remote_event_size_bytes);
-      			}
-
-
-                        msg_new->type = T_COLLECTIVE_FAN_OUT;
-                        msg_new->sender_node = s->node_id;
-                        tw_event_send(e_new);
-                }
+                send_collective_event(s, msg, s->children[i],
+                        g_tw_lookahead + p->collective_fan_out_delay +
+                        tw_rand_exponential(lp->rng, p->collective_fan_out_delay/10),
+                        T_COLLECTIVE_FAN_OUT, lp);
            }
          }
 	//printf("\n Fan out phase completed %ld ", lp->gid);
-        if(max_collective < tw_now(lp) - s->collective_init_time )
+        if(s->has_server &&
+                max_collective < tw_now(lp) - s->collective_init_time[slot] )
           {
               bf->c2 = 1;
-              max_collective = tw_now(lp) - s->collective_init_time;
+              max_collective = tw_now(lp) - s->collective_init_time[slot];
           }
 }
     
-/*Returns the next neighbor to which the packet should be routed by using DOR (Taken from Ning's code of the torus model)*/
+/* minimal direction to take along dimension dim to reach dest: 1 for plus, 0
+ * for minus, -1 if the node is already aligned with dest in that dimension */
+static int get_min_direction( const nodes_state * s,
+			     const int * dest,
+			     int dim )
+{
+  int diff = s->dim_position[ dim ] - dest[ dim ];
+  int half = s->params->half_length[ dim ];
+
+  /* no wraparound in a mesh dimension */
+  if ( s->params->is_mesh[ dim ] )
+      return diff > 0 ? 0 : ( diff < 0 ? 1 : -1 );
+
+  if ( diff > half )
+      return 1;
+  if ( diff < -half )
+      return 0;
+  if ( diff > 0 )
+      return 0;
+  if ( diff < 0 )
+      return 1;
+  return -1;
+}
+
+/* dateline VC class of a hop along dim: packets that still have to cross the
+ * wraparound link of the dimension use class 0, the others class 1, so the
+ * channel dependencies of a ring never form a cycle */
+static int get_dateline_vc( const nodes_state * s,
+			     const int * dest,
+			     int dim,
+			     int dir )
+{
+  if(s->params->num_vc < 2 || s->params->is_mesh[ dim ])
+      return 0;
+  if(dir)
+      return s->dim_position[ dim ] > dest[ dim ] ? 0 : 1;
+  return s->dim_position[ dim ] < dest[ dim ] ? 0 : 1;
+}
+
+/*Returns the next neighbor to which the packet should be routed by using DOR (Taken from Ning's code of the torus model)
+ * dest holds the torus coordinates of the destination node */
 static void dimension_order_routing( nodes_state * s,
+			     const int * dest,
 			     tw_lpid * dst_lp, 
 			     int * dim, 
-			     int * dir )
+			     int * dir,
+			     int * vc )
 {
-     int dest[s->params->n_dims];
-     int dest_id;
-
   /* dummys - check later */
   *dim = -1;
   *dir = -1;
 
-  to_dim_id(codes_mapping_get_lp_relative_id(*dst_lp, 0, 1),
-          s->params->n_dims, s->params->dim_length, dest);
-
   for(int i = 0; i < s->params->n_dims; i++ )
     {
-      if ( s->dim_position[ i ] - dest[ i ] > s->params->half_length[ i ] )
-	{
-	  dest_id = s->neighbour_plus_lpID[ i ];
-	  *dim = i;
-	  *dir = 1;
-	  break;
-	}
-      if ( s->dim_position[ i ] - dest[ i ] < -s->params->half_length[ i ] )
-	{
-	  dest_id = s->neighbour_minus_lpID[ i ];
-	  *dim = i;
-	  *dir = 0;
-	  break;
-	}
-      if ( ( s->dim_position[i] - dest[i] <= s->params->half_length[i] ) &&
-              ( s->dim_position[ i ] - dest[ i ] > 0 ) )
-	{
-	  dest_id = s->neighbour_minus_lpID[ i ];
-	  *dim = i;
-	  *dir = 0;
-	  break;
-	}
-      if (( s->dim_position[i] - dest[i] >= -s->params->half_length[i] ) &&
-              ( s->dim_position[ i ] - dest[ i ] < 0) )
+      *dir = get_min_direction( s, dest, i );
+      if ( *dir != -1 )
 	{
-	  dest_id = s->neighbour_plus_lpID[ i ];
 	  *dim = i;
-	  *dir = 1;
 	  break;
 	}
     }
 
   assert(*dim != -1 && *dir != -1);
-  *dst_lp = codes_mapping_get_lpid_from_relative(dest_id, NULL, LP_CONFIG_NM,
-          s->anno, 1);
+  *dst_lp = *dir ? s->neighbour_plus_lpID[ *dim ] :
+      s->neighbour_minus_lpID[ *dim ];
+  *vc = get_dateline_vc( s, dest, *dim, *dir );
 }
 
-/*Generates a packet. If there is a buffer slot available, then the packet is 
-injected in the network. Else, a buffer overflow exception is thrown.
-TODO: We might want to modify this so that if the buffer is full, the packet
-injection is delayed in turn slowing down the injection rate. The average achieved
-injection rate can be reported at the end of the simulation. */
+/* minimal adaptive routing: among the productive dimensions, take the adaptive
+ * VC with the most free buffer slots downstream. If none has a free slot, the
+ * chunk falls back to the DOR escape channel (with dateline VCs) */
+static void adaptive_routing( nodes_state * s,
+			     const int * dest,
+			     tw_lpid * dst_lp, 
+			     int * dim, 
+			     int * dir,
+			     int * vc )
+{
+  int best_free = 0;
+  int i, j;
+
+  for( i = 0; i < s->params->n_dims; i++ )
+    {
+      int d = get_min_direction( s, dest, i );
+      if( d == -1 )
+          continue;
+
+      for( j = 2; j < s->params->num_vc; j++ )
+        {
+          int free_slots = s->params->buffer_size - s->buffer[ (d + ( i * 2 )) * s->params->num_vc + j ];
+          if( free_slots > best_free )
+            {
+              best_free = free_slots;
+              *dim = i;
+              *dir = d;
+              *vc = j;
+            }
+        }
+    }
+
+  if( best_free > 0 )
+      *dst_lp = *dir ? s->neighbour_plus_lpID[ *dim ] :
+          s->neighbour_minus_lpID[ *dim ];
+  else
+      dimension_order_routing( s, dest, dst_lp, dim, dir, vc );
+}
+
+/*Generates a packet. Its chunks are counted against the injection buffer of
+the node: the scheduler is asked for the next packet only while the buffer has
+room, otherwise it waits until packet_send injects enough chunks. */
 static void packet_generate( nodes_state * s, 
 		tw_bf * bf, 
 		nodes_message * msg, 
@@ -850,6 +1158,37 @@ static void packet_generate( nodes_state * s,
     msg->packet_ID = lp->gid + g_tw_nlp * s->packet_counter;
     msg->my_N_hop = 0;
 
+    /* destination coordinates are carried along with the packet so that
+     * routing needs no mapping lookups */
+    if(chunk_id == 0)
+    {
+        to_dim_id(codes_mapping_get_lp_relative_id(msg->dest_lp, 0, 1),
+                s->params->n_dims, s->params->dim_length, msg->dest);
+
+        if(s->offered_bytes == 0)
+        {
+            bf->c4 = 1;
+            msg->saved_inject_time = s->first_offer_time;
+            s->first_offer_time = tw_now(lp);
+        }
+        s->offered_bytes += msg->packet_size;
+        s->inj_pending += get_num_chunks(s->params, msg->packet_size);
+
+        /* ask the scheduler for the next packet as long as the injection
+         * buffer has room */
+        if(s->inj_pending < s->params->injection_buffer_size)
+        {
+            bf->c2 = 1;
+            model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+        }
+        else
+        {
+            bf->c3 = 1;
+            s->sched_blocked = 1;
+            s->sched_blocked_time = tw_now(lp);
+        }
+    }
+
     uint64_t num_chunks = msg->packet_size/s->params->chunk_size;
     if(msg->packet_size % s->params->chunk_size)
         num_chunks++;
@@ -939,7 +1278,7 @@ static void credit_send( nodes_state * s,
 	    nodes_message * msg)
 {
 #if DEBUG
-    //printf("\n (%lf) sending credit tmp_dir %d tmp_dim %d %lf ", tw_now(lp), msg->source_direction, msg->source_dim, s->params->credit_delay );
+    //printf("\n (%lf) sending credit tmp_dir %d tmp_dim %d %lf ", tw_now(lp), msg->source_direction, msg->source_dim, s->params->credit_delay[msg->source_dim] );
 #endif
     bf->c1 = 0;
     tw_event * buf_e;
@@ -948,59 +1287,55 @@ static void credit_send( nodes_state * s,
     int src_dir = msg->source_direction;
     int src_dim = msg->source_dim;
 
-    msg->saved_available_time = s->next_credit_available_time[(2 * src_dim) + src_dir][0];
-    s->next_credit_available_time[(2 * src_dim) + src_dir][0] = maxd(s->next_credit_available_time[(2 * src_dim) + src_dir][0], tw_now(lp));
-    ts =  s->params->credit_delay + 
-        tw_rand_exponential(lp->rng, s->params->credit_delay/1000);
-    s->next_credit_available_time[(2 * src_dim) + src_dir][0] += ts;
+    msg->saved_available_time = s->next_credit_available_time[(2 * src_dim) + src_dir];
+    s->next_credit_available_time[(2 * src_dim) + src_dir] = maxd(s->next_credit_available_time[(2 * src_dim) + src_dir], tw_now(lp));
+    ts =  s->params->credit_delay[src_dim] + 
+        tw_rand_exponential(lp->rng, s->params->credit_delay[src_dim]/1000);
+    s->next_credit_available_time[(2 * src_dim) + src_dir] += ts;
 
-    //buf_e = tw_event_new( msg->sender_lp, s->next_credit_available_time[(2 * src_dim) + src_dir][0] - tw_now(lp), lp);
+    //buf_e = tw_event_new( msg->sender_lp, s->next_credit_available_time[(2 * src_dim) + src_dir] - tw_now(lp), lp);
     //m = tw_event_data(buf_e);
     buf_e = model_net_method_event_new(msg->sender_node,
-            s->next_credit_available_time[(2*src_dim) + src_dir][0] - tw_now(lp),
+            s->next_credit_available_time[(2*src_dim) + src_dir] - tw_now(lp),
             lp, TORUS, (void**)&m, NULL);
     m->source_direction = msg->source_direction;
     m->source_dim = msg->source_dim;
+    m->vc = msg->vc;
 
     m->type = CREDIT;
     tw_event_send( buf_e );
 }
-/* send a packet from one torus node to another torus node
- A packet can be up to 256 bytes on BG/L and BG/P and up to 512 bytes on BG/Q */
-static void packet_send( nodes_state * s, 
-	         tw_bf * bf, 
-		 nodes_message * msg, 
-		 tw_lp * lp )
-{ 
-    bf->c2 = 0;
-    bf->c1 = 0;
-    int tmp_dir, tmp_dim;
+/* puts a chunk on VC tmp_vc of the link (tmp_dim, tmp_dir) towards dst_lp, the
+ * VC must have a free buffer slot. The VCs share the bandwidth of the link. A chunk leaving its source node frees a slot of the
+ * injection buffer, which may let the scheduler go on (bf->c3) */
+static void link_send( nodes_state * s,
+	         tw_bf * bf,
+		 nodes_message * msg,
+		 tw_lp * lp,
+		 int tmp_dim,
+		 int tmp_dir,
+		 int tmp_vc,
+		 tw_lpid dst_lp )
+{
     tw_stime ts;
     tw_event *e;
     nodes_message *m;
-    tw_lpid dst_lp = msg->dest_lp;
-    dimension_order_routing( s, &dst_lp, &tmp_dim, &tmp_dir );     
 
-    if(s->buffer[ tmp_dir + ( tmp_dim * 2 ) ][ 0 ] < s->params->buffer_size)
-    {
-       bf->c2 = 1;
        msg->saved_src_dir = tmp_dir;
        msg->saved_src_dim = tmp_dim;
-       ts = tw_rand_exponential( lp->rng, s->params->head_delay/200.0 ) + 
-           s->params->head_delay;
+       msg->saved_src_vc = tmp_vc;
+       ts = tw_rand_exponential( lp->rng, s->params->head_delay[tmp_dim]/200.0 ) + 
+           s->params->head_delay[tmp_dim];
 
 //    For reverse computation 
-      msg->saved_available_time = s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )][0];
+      msg->saved_available_time = s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )];
 
-      s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )][0] = maxd( s->next_link_available_time[ tmp_dir + ( tmp_dim * 2 )][0], tw_now(lp) );
-      s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )][0] += ts;
+      s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )] = maxd( s->next_link_available_time[ tmp_dir + ( tmp_dim * 2 )], tw_now(lp) );
+      s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )] += ts;
     
-      //e = tw_event_new( dst_lp, s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )][0] - tw_now(lp), lp );
-      //m = tw_event_data( e );
-      //memcpy(m, msg, torus_get_msg_sz() + msg->remote_event_size_bytes);
       void * m_data;
       e = model_net_method_event_new(dst_lp, 
-              s->next_link_available_time[tmp_dir+(tmp_dim*2)][0] - tw_now(lp),
+              s->next_link_available_time[tmp_dir+(tmp_dim*2)] - tw_now(lp),
               lp, TORUS, (void**)&m, &m_data);
       memcpy(m, msg, sizeof(nodes_message));
       if (msg->remote_event_size_bytes){
@@ -1010,26 +1345,23 @@ static void packet_send( nodes_state * s,
       m->type = ARRIVAL;
 
       if(msg->packet_ID == TRACE)
-        printf("\n lp %d packet %lld flit id %d being sent to %d after time %lf ", (int) lp->gid, msg->packet_ID, msg->chunk_id, (int)dst_lp, s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )][0] - tw_now(lp)); 
+        printf("\n lp %d packet %lld flit id %d being sent to %d after time %lf ", (int) lp->gid, msg->packet_ID, msg->chunk_id, (int)dst_lp, s->next_link_available_time[tmp_dir + ( tmp_dim * 2 )] - tw_now(lp)); 
       //Carry on the message info
       m->source_dim = tmp_dim;
       m->source_direction = tmp_dir;
+      m->vc = tmp_vc;
       m->next_stop = dst_lp;
       m->sender_node = lp->gid;
       m->local_event_size_bytes = 0; /* We just deliver the local event here */
 
       tw_event_send( e );
 
-      s->buffer[ tmp_dir + ( tmp_dim * 2 ) ][ 0 ]++;
+      s->buffer[ (tmp_dir + ( tmp_dim * 2 )) * s->params->num_vc + tmp_vc ]++;
     
-      uint64_t num_chunks = msg->packet_size/s->params->chunk_size;
-
-      if(msg->packet_size % s->params->chunk_size)
-          num_chunks++;
+      uint64_t num_chunks = get_num_chunks(s->params, msg->packet_size);
 
       if(msg->chunk_id == num_chunks - 1)
       {
-        bf->c1 = 1;
 	/* Invoke an event on the sending server */
 	if(msg->local_event_size_bytes > 0)
 	{
@@ -1039,20 +1371,103 @@ static void packet_send( nodes_state * s,
 	  ts = (1/s->params->link_bandwidth) * msg->local_event_size_bytes;
 	  e_new = tw_event_new(msg->sender_svr, ts, lp);
 	  m_new = tw_event_data(e_new);
-	  //local_event = (char*)msg;
-	  //local_event += torus_get_msg_sz() + msg->remote_event_size_bytes;
           local_event = (char*)model_net_method_get_edata(TORUS, msg) +
               msg->remote_event_size_bytes;
 	  memcpy(m_new, local_event, msg->local_event_size_bytes);
 	  tw_event_send(e_new);
 	}
      }
-  } // end if
+
+    /* a chunk of a locally generated packet is injected */
+    if(msg->my_N_hop == 0)
+    {
+        s->inj_pending--;
+        s->injected_bytes += get_chunk_bytes(s->params, msg);
+        msg->saved_inject_time = s->last_inject_time;
+        s->last_inject_time = tw_now(lp);
+
+        if(s->sched_blocked &&
+                s->inj_pending < s->params->injection_buffer_size)
+        {
+            bf->c3 = 1;
+            s->sched_blocked = 0;
+            s->stall_time += tw_now(lp) - s->sched_blocked_time;
+            total_stall_time += tw_now(lp) - s->sched_blocked_time;
+            model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+        }
+    }
+}
+
+static void link_send_rc( nodes_state * s,
+	         tw_bf * bf,
+		 nodes_message * msg,
+		 tw_lp * lp )
+{
+    int next_dim = msg->saved_src_dim;
+    int next_dir = msg->saved_src_dir;
+
+    s->next_link_available_time[next_dir + ( next_dim * 2 )] = msg->saved_available_time;
+    s->buffer[ (next_dir + ( next_dim * 2 )) * s->params->num_vc + msg->saved_src_vc ] --;
+    tw_rand_reverse_unif(lp->rng);
+
+    if(msg->my_N_hop == 0)
+    {
+        s->inj_pending++;
+        s->injected_bytes -= get_chunk_bytes(s->params, msg);
+        s->last_inject_time = msg->saved_inject_time;
+
+        if(bf->c3)
+        {
+            s->sched_blocked = 1;
+            s->stall_time -= tw_now(lp) - s->sched_blocked_time;
+            total_stall_time -= tw_now(lp) - s->sched_blocked_time;
+            codes_local_latency_reverse(lp);
+        }
+    }
+}
+
+/* send a packet from one torus node to another torus node
+ A packet can be up to 256 bytes on BG/L and BG/P and up to 512 bytes on BG/Q.
+ If the buffer of the chosen VC is full, the chunk waits in the VC's queue
+ until a credit frees a slot */
+static void packet_send( nodes_state * s, 
+	         tw_bf * bf, 
+		 nodes_message * msg, 
+		 tw_lp * lp )
+{ 
+    int tmp_dir, tmp_dim, tmp_vc;
+    tw_lpid dst_lp;
+
+    if(s->params->routing == TORUS_ADAPTIVE)
+        adaptive_routing( s, msg->dest, &dst_lp, &tmp_dim, &tmp_dir, &tmp_vc );
     else
+        dimension_order_routing( s, msg->dest, &dst_lp, &tmp_dim, &tmp_dir,
+                &tmp_vc );
+
+    if(s->buffer[ (tmp_dir + ( tmp_dim * 2 )) * s->params->num_vc + tmp_vc ] < s->params->buffer_size)
     {
-	    printf("\n buffer overflown ");
-	    MPI_Finalize();
-	    exit(-1);
+       bf->c2 = 1;
+       link_send(s, bf, msg, lp, tmp_dim, tmp_dir, tmp_vc, dst_lp);
+    }
+    else
+    {
+       int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+       torus_wait_item *item = malloc(sizeof(torus_wait_item));
+
+       msg->saved_src_dir = tmp_dir;
+       msg->saved_src_dim = tmp_dim;
+       msg->saved_src_vc = tmp_vc;
+       memcpy(&item->msg, msg, sizeof(nodes_message));
+       item->edata = NULL;
+       if(edata_size > 0)
+       {
+           item->edata = malloc(edata_size);
+           memcpy(item->edata, model_net_method_get_edata(TORUS, msg),
+                   edata_size);
+       }
+       qlist_add_tail(&item->ql, &s->link_waitq[
+               ( tmp_dir + ( tmp_dim * 2 ) ) * s->params->num_vc + tmp_vc ]);
+       N_link_waits++;
     }
 }
 
@@ -1143,6 +1558,229 @@ static void packet_arrive( nodes_state * s,
    }
 }
 
+/* generates a packet that is routed analytically. The whole packet is handed
+ * to the first hop at once, without going through the injection buffer, so
+ * the scheduler can go on right away */
+static void analytic_generate( nodes_state * s,
+		tw_bf * bf,
+		nodes_message * msg,
+		tw_lp * lp )
+{
+    tw_event * e;
+    nodes_message * m;
+    void * m_data;
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+
+    msg->travel_start_time = tw_now(lp);
+    msg->packet_ID = lp->gid + g_tw_nlp * s->packet_counter;
+    msg->my_N_hop = 0;
+    to_dim_id(codes_mapping_get_lp_relative_id(msg->dest_lp, 0, 1),
+            s->params->n_dims, s->params->dim_length, msg->dest);
+    s->packet_counter++;
+
+    if(s->offered_bytes == 0)
+    {
+        bf->c4 = 1;
+        msg->saved_inject_time = s->first_offer_time;
+        s->first_offer_time = tw_now(lp);
+    }
+    s->offered_bytes += msg->packet_size;
+
+    bf->c2 = 1;
+    model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+
+    e = model_net_method_event_new(lp->gid, codes_local_latency(lp), lp, TORUS,
+            (void**)&m, &m_data);
+    memcpy(m, msg, sizeof(nodes_message));
+    if(edata_size > 0)
+        memcpy(m_data, model_net_method_get_edata(TORUS, msg), edata_size);
+    m->analytic_tail_time = tw_now(lp);
+    m->type = ANALYTIC;
+    tw_event_send(e);
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->torus_stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/s->params->link_bandwidth) * msg->packet_size;
+    int total_event_size = model_net_get_msg_sz(TORUS) + edata_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
+}
+
+static void analytic_generate_rc( nodes_state * s,
+		tw_bf * bf,
+		nodes_message * msg,
+		tw_lp * lp )
+{
+    s->packet_counter--;
+    s->offered_bytes -= msg->packet_size;
+    if(bf->c4)
+        s->first_offer_time = msg->saved_inject_time;
+    codes_local_latency_reverse(lp);
+    codes_local_latency_reverse(lp);
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->torus_stats_array);
+    stat->send_count--;
+    stat->send_bytes -= msg->packet_size;
+    stat->send_time -= (1/s->params->link_bandwidth) * msg->packet_size;
+}
+
+/* one hop of an analytically routed packet. The next DOR link is reserved for
+ * the serialization time of the whole packet and the packet moves on once its
+ * head has crossed the link; chunks sent later on the link queue up behind the
+ * reservation. At the destination, the remote event is delivered when the
+ * tail of the packet has arrived */
+static void analytic_hop( nodes_state * s,
+		tw_bf * bf,
+		nodes_message * msg,
+		tw_lp * lp )
+{
+  tw_event *e;
+  nodes_message *m;
+  tw_stime ts;
+
+  if( lp->gid == msg->dest_lp )
+    {
+      bf->c1 = 1;
+      tw_stime arrival = maxd(msg->analytic_tail_time, tw_now(lp));
+      tw_stime latency = arrival - msg->travel_start_time;
+      void *tmp_ptr = model_net_method_get_edata(TORUS, msg);
+
+      mn_stats* stat = model_net_find_stats(msg->category, s->torus_stats_array);
+      stat->recv_count++;
+      stat->recv_bytes += msg->packet_size;
+      stat->recv_time += latency;
+
+      N_finished_packets++;
+      total_time += latency;
+      total_hops += msg->my_N_hop;
+      if(max_latency < latency)
+        {
+          bf->c3 = 1;
+          msg->saved_available_time = max_latency;
+          max_latency = latency;
+        }
+
+      ts = arrival - tw_now(lp) + 0.1;
+      if(msg->remote_event_size_bytes)
+        {
+          if (msg->is_pull){
+              int net_id = model_net_get_id(LP_METHOD_NM);
+              struct codes_mctx mc_dst =
+                  codes_mctx_set_global_direct(msg->sender_node);
+              struct codes_mctx mc_src =
+                  codes_mctx_set_global_direct(lp->gid);
+              model_net_event_mctx(net_id, &mc_src, &mc_dst,
+                      msg->category, msg->sender_svr, msg->pull_size,
+                      ts, msg->remote_event_size_bytes, tmp_ptr, 0,
+                      NULL, lp);
+          }
+          else{
+              e = tw_event_new(msg->final_dest_gid, ts, lp);
+              m = tw_event_data(e);
+              memcpy(m, tmp_ptr, msg->remote_event_size_bytes);
+              tw_event_send(e);
+          }
+        }
+      /* a packet to the node itself never left the node */
+      if(msg->local_event_size_bytes > 0)
+        {
+          e = tw_event_new(msg->sender_svr, ts, lp);
+          m = tw_event_data(e);
+          memcpy(m, (char*)tmp_ptr + msg->remote_event_size_bytes,
+                  msg->local_event_size_bytes);
+          tw_event_send(e);
+        }
+      return;
+    }
+
+  int tmp_dim, tmp_dir, tmp_vc;
+  tw_lpid dst_lp;
+  dimension_order_routing( s, msg->dest, &dst_lp, &tmp_dim, &tmp_dir, &tmp_vc );
+
+  int link = tmp_dir + ( tmp_dim * 2 );
+  tw_stime start = maxd( s->next_link_available_time[link], tw_now(lp) );
+
+  msg->saved_src_dim = tmp_dim;
+  msg->saved_src_dir = tmp_dir;
+  msg->saved_available_time = s->next_link_available_time[link];
+  s->next_link_available_time[link] = start +
+      (1 / s->params->dim_bandwidth[tmp_dim]) * msg->packet_size;
+
+  void * m_data;
+  e = model_net_method_event_new(dst_lp,
+          start + s->params->head_delay[tmp_dim] - tw_now(lp),
+          lp, TORUS, (void**)&m, &m_data);
+  memcpy(m, msg, sizeof(nodes_message));
+  if (msg->remote_event_size_bytes){
+    memcpy(m_data, model_net_method_get_edata(TORUS, msg),
+            msg->remote_event_size_bytes);
+  }
+  m->my_N_hop++;
+  m->analytic_tail_time = s->next_link_available_time[link];
+  m->sender_node = lp->gid;
+  m->local_event_size_bytes = 0; /* We just deliver the local event here */
+  tw_event_send(e);
+
+  /* the packet has left its source node once its tail is on the first link */
+  if(msg->my_N_hop == 0)
+    {
+      s->injected_bytes += msg->packet_size;
+      msg->saved_inject_time = s->last_inject_time;
+      s->last_inject_time = tw_now(lp);
+
+      if(msg->local_event_size_bytes > 0)
+        {
+          e = tw_event_new(msg->sender_svr,
+                  s->next_link_available_time[link] - tw_now(lp), lp);
+          m = tw_event_data(e);
+          memcpy(m, (char*)model_net_method_get_edata(TORUS, msg) +
+                  msg->remote_event_size_bytes, msg->local_event_size_bytes);
+          tw_event_send(e);
+        }
+    }
+}
+
+static void analytic_hop_rc( nodes_state * s,
+		tw_bf * bf,
+		nodes_message * msg,
+		tw_lp * lp )
+{
+  if(bf->c1)
+    {
+      tw_stime latency = maxd(msg->analytic_tail_time, tw_now(lp)) -
+          msg->travel_start_time;
+
+      mn_stats* stat = model_net_find_stats(msg->category, s->torus_stats_array);
+      stat->recv_count--;
+      stat->recv_bytes -= msg->packet_size;
+      stat->recv_time -= latency;
+
+      N_finished_packets--;
+      total_time -= latency;
+      total_hops -= msg->my_N_hop;
+      if(bf->c3)
+          max_latency = msg->saved_available_time;
+
+      if(msg->remote_event_size_bytes && msg->is_pull)
+        {
+          int net_id = model_net_get_id(LP_METHOD_NM);
+          model_net_event_rc(net_id, lp, msg->pull_size);
+        }
+      return;
+    }
+
+  s->next_link_available_time[msg->saved_src_dir + ( msg->saved_src_dim * 2 )] =
+      msg->saved_available_time;
+  if(msg->my_N_hop == 0)
+    {
+      s->injected_bytes -= msg->packet_size;
+      s->last_inject_time = msg->saved_inject_time;
+    }
+}
+
 /* reports torus statistics like average packet latency, maximum packet latency and average
  * number of torus hops traversed by the packet */
 static void torus_report_stats()
@@ -1155,9 +1793,15 @@ static void torus_report_stats()
     MPI_Reduce( &total_time, &avg_time, 1,MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
     MPI_Reduce( &max_latency, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
+    long long total_link_waits;
+    tw_stime stall_time;
+    MPI_Reduce( &N_link_waits, &total_link_waits, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &total_stall_time, &stall_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
     if(!g_tw_mynode)
      {
        printf(" Average number of hops traversed %f average message latency %lf us maximum message latency %lf us \n", (float)avg_hops/total_finished_packets, avg_time/(total_finished_packets*1000), max_time/1000);
+       printf(" Chunks that waited for a link buffer slot %lld total injection stall time %lf us \n", total_link_waits, stall_time/1000);
      }
 }
 /* finalize the torus node and free all event buffers available */
@@ -1165,9 +1809,27 @@ void
 final( nodes_state * s, tw_lp * lp )
 {
   model_net_print_stats(lp->gid, &s->torus_stats_array[0]); 
+
+  /* offered vs. achieved injection rate (bytes/ns) of the node. The offered
+   * rate is the rate the node would have injected at without the stalls */
+  if(s->offered_bytes > 0)
+  {
+      int ret;
+      char data[512];
+      tw_stime active = s->last_inject_time - s->first_offer_time;
+      tw_stime unstalled = active - s->stall_time;
+
+      sprintf(data, "lp:%ld\toffered_bytes:%llu\tinjected_bytes:%llu\t"
+              "stall_time:%f\toffered_rate:%f\tachieved_rate:%f\n",
+              (long)lp->gid, (unsigned long long)s->offered_bytes,
+              (unsigned long long)s->injected_bytes, s->stall_time,
+              unstalled > 0 ? s->offered_bytes / unstalled : 0.0,
+              active > 0 ? s->injected_bytes / active : 0.0);
+      ret = lp_io_write(lp->gid, "torus-injection", strlen(data), data);
+      assert(ret == 0);
+  }
+  /* the base of the per-port block */
   free(s->next_link_available_time);
-  free(s->next_credit_available_time);
-  free(s->next_flit_generate_time);
   // since all LPs are sharing params, just let them leak for now
   // TODO: add a post-sim "cleanup" function?
   //free(s->buffer); 
@@ -1176,10 +1838,43 @@ final( nodes_state * s, tw_lp * lp )
   //free(s->params->half_length);
 }
 
-/* increments the buffer count after a credit arrives from the remote compute node */
+/* frees a buffer slot after a credit arrives from the remote compute node. The
+ * first chunk waiting for the link takes the slot; it is copied into msg so
+ * that the reverse handler can put it back in the queue, and the credit's own
+ * port and virtual channel are kept in the saved_credit_* fields */
 static void packet_buffer_process( nodes_state * s, tw_bf * bf, nodes_message * msg, tw_lp * lp )
 {
-   s->buffer[ msg->source_direction + ( msg->source_dim * 2 ) ][  0 ]--;
+   int dim = msg->source_dim;
+   int dir = msg->source_direction;
+   int link = dir + ( dim * 2 );
+   int vc = msg->vc;
+
+   s->buffer[ link * s->params->num_vc + vc ]--;
+
+   if(!qlist_empty(&s->link_waitq[link * s->params->num_vc + vc]))
+   {
+       struct qlist_head *ent = qlist_pop(&s->link_waitq[link * s->params->num_vc + vc]);
+       torus_wait_item *item = qlist_entry(ent, torus_wait_item, ql);
+
+       bf->c1 = 1;
+       memcpy(msg, &item->msg, sizeof(nodes_message));
+       if(item->edata)
+       {
+           memcpy(model_net_method_get_edata(TORUS, msg), item->edata,
+                   msg->remote_event_size_bytes + msg->local_event_size_bytes);
+           free(item->edata);
+       }
+       free(item);
+       msg->type = CREDIT;
+       msg->saved_credit_dim = dim;
+       msg->saved_credit_dir = dir;
+       msg->saved_credit_vc = vc;
+
+       link_send(s, bf, msg, lp, msg->saved_src_dim, msg->saved_src_dir, vc,
+               msg->saved_src_dir ?
+               s->neighbour_plus_lpID[ msg->saved_src_dim ] :
+               s->neighbour_minus_lpID[ msg->saved_src_dim ]);
+   }
 }
 
 /* reverse handler for torus node */
@@ -1188,6 +1883,11 @@ static void node_rc_handler(nodes_state * s, tw_bf * bf, nodes_message * msg, tw
   switch(msg->type)
     {
        case GENERATE:
+		   if(msg->chunk_id == 0 && is_analytic(s->params, msg))
+		   {
+		     analytic_generate_rc(s, bf, msg, lp);
+		     break;
+		   }
 		   {
 		     s->packet_counter--;
 		     int i;//, saved_dim, saved_dir;
@@ -1200,12 +1900,23 @@ static void node_rc_handler(nodes_state * s, tw_bf * bf, nodes_message * msg, tw
 
 		     if(!num_chunks)
 			num_chunks = 1;
-		     //s->next_flit_generate_time[(saved_dim * 2) + saved_dir][0] = msg->saved_available_time;
 	     	     codes_local_latency_reverse(lp);
 			
 		     if(bf->c1)
 			codes_local_latency_reverse(lp);
 
+		     if(msg->chunk_id == 0)
+		     {
+		         s->offered_bytes -= msg->packet_size;
+		         s->inj_pending -= num_chunks;
+		         if(bf->c4)
+		             s->first_offer_time = msg->saved_inject_time;
+		         if(bf->c2)
+		             codes_local_latency_reverse(lp);
+		         if(bf->c3)
+		             s->sched_blocked = 0;
+		     }
+
 		     mn_stats* stat;
 		     stat = model_net_find_stats(msg->category, s->torus_stats_array);
 		     stat->send_count--; 
@@ -1224,7 +1935,7 @@ static void node_rc_handler(nodes_state * s, tw_bf * bf, nodes_message * msg, tw
                     if(msg->packet_size % s->params->chunk_size)
                         num_chunks++;
 
-		    s->next_credit_available_time[next_dir + ( next_dim * 2 )][0] = msg->saved_available_time;
+		    s->next_credit_available_time[next_dir + ( next_dim * 2 )] = msg->saved_available_time;
 		    if(bf->c2)
 		    {
 		       struct mn_stats* stat;
@@ -1250,38 +1961,78 @@ static void node_rc_handler(nodes_state * s, tw_bf * bf, nodes_message * msg, tw
 		 {
 		    if(bf->c2)
 		     {
-                        int next_dim = msg->saved_src_dim;
-			int next_dir = msg->saved_src_dir;
-			s->next_link_available_time[next_dir + ( next_dim * 2 )][0] = msg->saved_available_time;
-			s->buffer[ next_dir + ( next_dim * 2 ) ][ 0 ] --;
-	                tw_rand_reverse_unif(lp->rng);
+                        link_send_rc(s, bf, msg, lp);
+		    }
+		    else
+		    {
+		        struct qlist_head *ent = qlist_pop_back(
+		                &s->link_waitq[( msg->saved_src_dir + ( msg->saved_src_dim * 2 ) ) *
+		                s->params->num_vc + msg->saved_src_vc]);
+		        torus_wait_item *item = qlist_entry(ent, torus_wait_item, ql);
+		        free(item->edata);
+		        free(item);
+		        N_link_waits--;
 		    }
 		 }
 	break;
 
        case CREDIT:
 		{
-		  s->buffer[ msg->source_direction + ( msg->source_dim * 2 ) ][  0 ]++;
+		  if(bf->c1)
+		  {
+		      int link = msg->saved_src_dir + ( msg->saved_src_dim * 2 );
+		      int edata_size = msg->remote_event_size_bytes +
+		          msg->local_event_size_bytes;
+		      torus_wait_item *item = malloc(sizeof(torus_wait_item));
+
+		      link_send_rc(s, bf, msg, lp);
+		      memcpy(&item->msg, msg, sizeof(nodes_message));
+		      item->msg.type = SEND;
+		      item->edata = NULL;
+		      if(edata_size > 0)
+		      {
+		          item->edata = malloc(edata_size);
+		          memcpy(item->edata, model_net_method_get_edata(TORUS, msg),
+		                  edata_size);
+		      }
+		      qlist_add(&item->ql, &s->link_waitq[link * s->params->num_vc +
+		              msg->saved_src_vc]);
+		      s->buffer[ link * s->params->num_vc + msg->saved_src_vc ]++;
+
+		      /* the event is run again as the credit it was */
+		      msg->source_dim = msg->saved_credit_dim;
+		      msg->source_direction = msg->saved_credit_dir;
+		      msg->vc = msg->saved_credit_vc;
+		  }
+		  else
+		      s->buffer[ (msg->source_direction + ( msg->source_dim * 2 )) * s->params->num_vc + msg->vc ]++;
               }
        break;
 	
+       case ANALYTIC:
+                analytic_hop_rc(s, bf, msg, lp);
+       break;
+
        case T_COLLECTIVE_INIT:
                 {
-                    s->collective_init_time = msg->saved_collective_init_time;
+                   int slot = msg->collective_id % NUM_COLLECTIVES;
+                   s->collective_seq--;
+                   s->collective_init_time[slot] = msg->saved_collective_init_time;
                 }
-        break;
-
+        /* fall through: the node's own contribution is undone like a
+           child's */
         case T_COLLECTIVE_FAN_IN:
                 {
                    int i;
-                   s->num_fan_nodes--;
+                   int slot = msg->collective_id % NUM_COLLECTIVES;
+                   s->num_fan_nodes[slot]--;
                    if(bf->c1)
                     {
-                        s->num_fan_nodes = msg->saved_fan_nodes;
+                        s->num_fan_nodes[slot] = msg->saved_fan_nodes;
                     }
                    if(bf->c2)
                      {
-                        s->num_fan_nodes = msg->saved_fan_nodes;
+                        s->num_fan_nodes[slot] = msg->saved_fan_nodes;
                         for( i = 0; i < s->num_children; i++ )
                             tw_rand_reverse_unif(lp->rng);
                      }
@@ -1308,7 +2059,14 @@ static void event_handler(nodes_state * s, tw_bf * bf, nodes_message * msg, tw_l
  switch(msg->type)
  {
   case GENERATE:
-    packet_generate(s,bf,msg,lp);
+    if(msg->chunk_id == 0 && is_analytic(s->params, msg))
+      analytic_generate(s,bf,msg,lp);
+    else
+      packet_generate(s,bf,msg,lp);
+  break;
+
+  case ANALYTIC:
+    analytic_hop(s,bf,msg,lp);
   break;
 
   case ARRIVAL:
@@ -0,0 +1,1114 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#include <ross.h>
+
+#include "codes/codes_mapping.h"
+#include "codes/jenkins-hash.h"
+#include "codes/codes.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/model-net-lp.h"
+#include "vct-router.h"
+
+#define CREDIT_SIZE 8
+
+/* alignment of the per-port state blocks */
+#define VCT_CACHE_LINE 64
+
+static double maxd(double a, double b) { return a < b ? b : a; }
+/* rounds a size up to a whole number of cache lines */
+static size_t cache_align(size_t sz)
+{
+    return (sz + VCT_CACHE_LINE - 1) & ~(size_t)(VCT_CACHE_LINE - 1);
+}
+
+typedef struct vct_queue_item vct_queue_item;
+
+/* a packet waiting for an output link, at a terminal or a router port. The
+ * model message and the remote and local events of the packet follow the
+ * item in the same allocation */
+struct vct_queue_item
+{
+    vct_message *msg;
+    void * edata;
+    struct qlist_head ql;
+};
+
+/* terminal and router event types */
+enum vct_event_t
+{
+    T_GENERATE=1,
+    T_ARRIVE,
+    T_SEND,
+    T_BUFFER,
+    R_ARRIVE,
+    R_SEND,
+    R_BUFFER
+};
+
+/* copies a packet and its events into a new queue item */
+static vct_queue_item * queue_item_new(const vct_model *m,
+        const vct_message *msg, const void *edata, int edata_size)
+{
+    vct_queue_item *item = malloc(sizeof(vct_queue_item) + m->msg_size +
+            edata_size);
+    assert(item);
+    item->msg = (vct_message*)(item + 1);
+    memcpy(item->msg, msg, m->msg_size);
+    item->edata = (char*)item->msg + m->msg_size;
+    if(edata_size > 0)
+        memcpy(item->edata, edata, edata_size);
+    return item;
+}
+
+static void queue_item_free(vct_queue_item *item)
+{
+    free(item);
+}
+
+/* remote event of a packet travelling between routers, it follows the
+ * model message */
+static void * router_edata(const vct_model *m, vct_message *msg)
+{
+    return (char*)msg + m->msg_size;
+}
+
+/* time until the head of a packet has been serialized on a link */
+static tw_stime get_head_delay(int chunk_size, uint64_t size,
+        double bandwidth)
+{
+    uint64_t head = size < (uint64_t)chunk_size ? size : chunk_size;
+    return (1/bandwidth) * head;
+}
+
+/* generates a packet on the compute node of the model */
+tw_stime vct_packet_event(vct_model *m, char const * category,
+        tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size,
+        int is_pull, uint64_t pull_size, tw_stime offset,
+        int remote_event_size, const void* remote_event, int self_event_size,
+        const void* self_event, tw_lpid src_lp, tw_lp *sender,
+        int is_last_pckt)
+{
+    tw_event * e_new;
+    tw_stime xfer_to_nic_time;
+    vct_message * msg;
+    char* tmp_ptr;
+
+    xfer_to_nic_time = codes_local_latency(sender);
+    e_new = model_net_method_event_new(sender->gid, xfer_to_nic_time+offset,
+            sender, m->net_id, (void**)&msg, (void**)&tmp_ptr);
+    strcpy(msg->category, category);
+    msg->final_dest_gid = final_dest_lp;
+    msg->dest_terminal_gid = dest_mn_lp;
+    msg->sender_lp = src_lp;
+    msg->sender_mn_lp = sender->gid;
+    msg->packet_size = packet_size;
+    msg->remote_event_size_bytes = 0;
+    msg->local_event_size_bytes = 0;
+    msg->type = T_GENERATE;
+    msg->magic = m->magic_num;
+    msg->is_pull = is_pull;
+    msg->pull_size = pull_size;
+
+    if(is_last_pckt) /* Its the last packet so pass in remote and local event information*/
+    {
+        if(remote_event_size > 0)
+        {
+            msg->remote_event_size_bytes = remote_event_size;
+            memcpy(tmp_ptr, remote_event, remote_event_size);
+            tmp_ptr += remote_event_size;
+        }
+        if(self_event_size > 0)
+        {
+            msg->local_event_size_bytes = self_event_size;
+            memcpy(tmp_ptr, self_event, self_event_size);
+            tmp_ptr += self_event_size;
+        }
+    }
+    tw_event_send(e_new);
+    return xfer_to_nic_time;
+}
+
+/* packet event reverse handler */
+void vct_packet_event_rc(tw_lp *sender)
+{
+    codes_local_latency_reverse(sender);
+    return;
+}
+
+/* reports the average and maximum packet latency and the average number of
+ * hops traversed */
+void vct_report_stats(const vct_model *m)
+{
+    long long avg_hops, total_finished_packets;
+    long long total_minimal_packets, total_nonmin_packets;
+    tw_stime avg_time, max_time;
+    vct_stats st = m->stats;
+
+    MPI_Reduce( &st.total_hops, &avg_hops, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &st.finished_packets, &total_finished_packets, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &st.minimal_packets, &total_minimal_packets, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &st.nonmin_packets, &total_nonmin_packets, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &st.total_time, &avg_time, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce( &st.max_latency, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    /* print statistics */
+    if(!g_tw_mynode && total_finished_packets)
+    {
+        printf("\n total finished packets %lld ", total_finished_packets);
+        printf(" Average number of hops traversed %f average message latency %lf us maximum message latency %lf us \n",
+                (float)avg_hops/total_finished_packets,
+                avg_time/(total_finished_packets*1000), max_time/1000);
+        if(total_nonmin_packets)
+            printf("\n ROUTING STATS: %lld packets routed minimally %lld packets routed non-minimally ",
+                    total_minimal_packets, total_nonmin_packets);
+    }
+}
+
+/* schedules the next send on the terminal-router link once the link is free */
+static void terminal_start_send_loop(vct_terminal * s, tw_lp * lp)
+{
+    tw_event *e;
+    vct_message *m;
+    tw_stime ts;
+
+    s->in_send_loop = 1;
+    ts = maxd(s->terminal_available_time - tw_now(lp), 0.0) +
+        codes_local_latency(lp);
+    e = model_net_method_event_new(lp->gid, ts, lp, s->model->net_id,
+            (void**)&m, NULL);
+    m->type = T_SEND;
+    m->magic = s->model->magic_num;
+    tw_event_send(e);
+}
+
+static void packet_generate_rc(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    struct qlist_head *ent = qlist_pop_back(&s->injq);
+    assert(ent);
+    queue_item_free(qlist_entry(ent, vct_queue_item, ql));
+    s->injq_bytes -= msg->packet_size;
+    s->packet_counter--;
+
+    if(bf->c1)
+    {
+        s->in_send_loop = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c2)
+        codes_local_latency_reverse(lp);
+    if(bf->c3)
+        s->sched_blocked = 0;
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->stats_array);
+    stat->send_count--;
+    stat->send_bytes -= msg->packet_size;
+    stat->send_time -= (1/s->bandwidth) * msg->packet_size;
+}
+
+/* generates a packet at the current compute node and places it into the
+ * injection queue */
+static void packet_generate(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    const vct_model *m = s->model;
+    int total_event_size;
+
+    msg->packet_ID = s->packet_counter * s->total_terminals + s->terminal_id;
+    s->packet_counter++;
+    msg->travel_start_time = tw_now(lp);
+    msg->src_terminal_id = s->terminal_id;
+    msg->dest_terminal_id =
+        codes_mapping_get_lp_relative_id(msg->dest_terminal_gid, 0, 0);
+    msg->my_N_hop = 0;
+    msg->path_type = VCT_PATH_MINIMAL;
+    if(m->packet_init)
+        m->packet_init(s, msg);
+
+    /* copy the packet along with its remote and local events into the
+     * injection queue, it is sent out of the queue by packet_send */
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    vct_queue_item *item = queue_item_new(m, msg,
+            model_net_method_get_edata(m->net_id, msg), edata_size);
+    qlist_add_tail(&item->ql, &s->injq);
+    s->injq_bytes += msg->packet_size;
+
+    if(!s->in_send_loop)
+    {
+        bf->c1 = 1;
+        terminal_start_send_loop(s, lp);
+    }
+
+    /* ask the scheduler for the next packet as long as the injection queue
+     * has room, otherwise wait until packet_send drains it */
+    if(s->injq_bytes < s->buffer_size)
+    {
+        bf->c2 = 1;
+        model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->sched_blocked = 1;
+    }
+
+    total_event_size = model_net_get_msg_sz(m->net_id) +
+        msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->stats_array);
+    stat->send_count++;
+    stat->send_bytes += msg->packet_size;
+    stat->send_time += (1/s->bandwidth) * msg->packet_size;
+    if(stat->max_event_size < total_event_size)
+        stat->max_event_size = total_event_size;
+}
+
+static void packet_send_rc(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    if(bf->c1)
+    {
+        s->in_send_loop = 1;
+        return;
+    }
+
+    s->terminal_available_time = msg->saved_available_time;
+    s->credit_used -= msg->packet_size;
+    s->injq_bytes += msg->packet_size;
+
+    /* put the packet back at the queue head */
+    vct_queue_item *item = queue_item_new(s->model, msg,
+            model_net_method_get_edata(s->model->net_id, msg),
+            msg->remote_event_size_bytes + msg->local_event_size_bytes);
+    qlist_add(&item->ql, &s->injq);
+
+    if(bf->c2)
+    {
+        s->sched_blocked = 1;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c3)
+        s->in_send_loop = 1;
+}
+
+/* sends the packet at the head of the injection queue to the router if the
+ * router has buffer space for it */
+static void packet_send(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    const vct_model *mdl = s->model;
+    tw_stime start, ts;
+    tw_event *e;
+    vct_message *m;
+
+    vct_queue_item *item = qlist_empty(&s->injq) ? NULL :
+        qlist_entry(s->injq.next, vct_queue_item, ql);
+    if(item == NULL || (s->credit_used > 0 &&
+                s->credit_used + item->msg->packet_size > s->buffer_size))
+    {
+        /* nothing to send or no buffer space at the router, the loop is
+         * restarted by a new packet or a credit */
+        bf->c1 = 1;
+        s->in_send_loop = 0;
+        return;
+    }
+
+    /* the packet leaves the queue, keep a copy in the event for reverse
+     * computation */
+    qlist_pop(&s->injq);
+    memcpy(msg, item->msg, mdl->msg_size);
+    int edata_size = msg->remote_event_size_bytes + msg->local_event_size_bytes;
+    if(edata_size > 0)
+        memcpy(model_net_method_get_edata(mdl->net_id, msg), item->edata,
+                edata_size);
+    msg->type = T_SEND;
+    msg->magic = mdl->magic_num;
+    msg->saved_available_time = s->terminal_available_time;
+
+    start = maxd(s->terminal_available_time, tw_now(lp));
+    s->terminal_available_time = start +
+        (1/s->bandwidth) * msg->packet_size;
+    s->credit_used += msg->packet_size;
+    s->injq_bytes -= msg->packet_size;
+
+    // we are sending an event to the router, so no method_event here
+    ts = start - tw_now(lp) + s->latency + g_tw_lookahead +
+        get_head_delay(s->chunk_size, msg->packet_size, s->bandwidth);
+    e = tw_event_new(s->router_gid, ts, lp);
+    m = tw_event_data(e);
+    memcpy(m, msg, mdl->msg_size);
+    if(msg->remote_event_size_bytes)
+        memcpy(router_edata(mdl, m), item->edata,
+                msg->remote_event_size_bytes);
+    m->type = R_ARRIVE;
+    m->magic = mdl->magic_num;
+    m->in_port = s->router_port;
+    m->vc = 0;
+    m->local_event_size_bytes = 0;
+    tw_event_send(e);
+
+    /* local completion message, once the packet has left the terminal */
+    if(msg->local_event_size_bytes > 0)
+    {
+        e = tw_event_new(msg->sender_lp,
+                s->terminal_available_time - tw_now(lp), lp);
+        memcpy(tw_event_data(e),
+                (char*)item->edata + msg->remote_event_size_bytes,
+                msg->local_event_size_bytes);
+        tw_event_send(e);
+    }
+    queue_item_free(item);
+
+    /* the queue drained enough for the scheduler to hand over more packets */
+    if(s->sched_blocked && s->injq_bytes < s->buffer_size)
+    {
+        bf->c2 = 1;
+        s->sched_blocked = 0;
+        model_net_method_idle_event(codes_local_latency(lp), 0, lp);
+    }
+
+    /* keep sending at the link rate while there are queued packets */
+    if(!qlist_empty(&s->injq))
+    {
+        e = model_net_method_event_new(lp->gid,
+                s->terminal_available_time - tw_now(lp), lp, mdl->net_id,
+                (void**)&m, NULL);
+        m->type = T_SEND;
+        m->magic = mdl->magic_num;
+        tw_event_send(e);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->in_send_loop = 0;
+    }
+}
+
+static void packet_arrive_rc(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    vct_stats *st = &s->model->stats;
+
+    mn_stats* stat;
+    stat = model_net_find_stats(msg->category, s->stats_array);
+    stat->recv_count--;
+    stat->recv_bytes -= msg->packet_size;
+    stat->recv_time -= tw_now(lp) - msg->travel_start_time;
+
+    st->finished_packets--;
+    if(msg->path_type == VCT_PATH_MINIMAL)
+        st->minimal_packets--;
+    else
+        st->nonmin_packets--;
+    st->total_hops -= msg->my_N_hop;
+    st->total_time -= tw_now(lp) - msg->travel_start_time;
+    if(bf->c3)
+        st->max_latency = msg->saved_available_time;
+
+    codes_local_latency_reverse(lp);
+    if(msg->remote_event_size_bytes)
+    {
+        codes_local_latency_reverse(lp);
+        if(msg->is_pull)
+        {
+            int net_id = model_net_get_id(
+                    model_net_method_names[s->model->net_id]);
+            model_net_event_rc(net_id, lp, msg->pull_size);
+        }
+    }
+}
+
+/* packet arrives at the destination terminal */
+static void packet_arrive(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    vct_stats *st = &s->model->stats;
+    tw_event *e;
+    vct_message *m;
+    tw_stime ts;
+
+    mn_stats* stat = model_net_find_stats(msg->category, s->stats_array);
+    stat->recv_count++;
+    stat->recv_bytes += msg->packet_size;
+    stat->recv_time += tw_now(lp) - msg->travel_start_time;
+
+    st->finished_packets++;
+    if(msg->path_type == VCT_PATH_MINIMAL)
+        st->minimal_packets++;
+    else
+        st->nonmin_packets++;
+    st->total_hops += msg->my_N_hop;
+    st->total_time += tw_now(lp) - msg->travel_start_time;
+    if(st->max_latency < tw_now(lp) - msg->travel_start_time)
+    {
+        bf->c3 = 1;
+        msg->saved_available_time = st->max_latency;
+        st->max_latency = tw_now(lp) - msg->travel_start_time;
+    }
+
+    /* the terminal consumes the packet right away, return the buffer space
+     * to the router */
+    ts = (1/s->bandwidth) * CREDIT_SIZE + s->latency +
+        codes_local_latency(lp);
+    e = tw_event_new(s->router_gid, ts, lp);
+    m = tw_event_data(e);
+    m->magic = s->model->magic_num;
+    m->type = R_BUFFER;
+    m->port = s->router_port;
+    m->vc = 0;
+    m->credit_bytes = msg->packet_size;
+    tw_event_send(e);
+
+    // Trigger an event on receiving server
+    if(msg->remote_event_size_bytes)
+    {
+        void * tmp_ptr = model_net_method_get_edata(s->model->net_id, msg);
+        ts = codes_local_latency(lp);
+        if (msg->is_pull){
+            struct codes_mctx mc_dst =
+                codes_mctx_set_global_direct(msg->sender_mn_lp);
+            struct codes_mctx mc_src =
+                codes_mctx_set_global_direct(lp->gid);
+            int net_id = model_net_get_id(
+                    model_net_method_names[s->model->net_id]);
+            model_net_event_mctx(net_id, &mc_src, &mc_dst, msg->category,
+                    msg->sender_lp, msg->pull_size, ts,
+                    msg->remote_event_size_bytes, tmp_ptr, 0, NULL, lp);
+        }
+        else{
+            e = tw_event_new(msg->final_dest_gid, ts, lp);
+            memcpy(tw_event_data(e), tmp_ptr, msg->remote_event_size_bytes);
+            tw_event_send(e);
+        }
+    }
+}
+
+static void terminal_buf_update_rc(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    s->credit_used += msg->credit_bytes;
+    if(bf->c1)
+    {
+        s->in_send_loop = 0;
+        codes_local_latency_reverse(lp);
+    }
+}
+
+/* the router has forwarded a packet of the terminal, freeing buffer space */
+static void terminal_buf_update(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    s->credit_used -= msg->credit_bytes;
+
+    /* restart sending if the injection queue was blocked on credits */
+    if(!s->in_send_loop && !qlist_empty(&s->injq))
+    {
+        bf->c1 = 1;
+        terminal_start_send_loop(s, lp);
+    }
+}
+
+/* returns the magic number of the terminal and router messages of a model */
+static int get_magic_num(const vct_model *m)
+{
+    const char *name = model_net_method_names[m->net_id];
+    uint32_t h1 = 0, h2 = 0;
+    bj_hashlittle2(name, strlen(name), &h1, &h2);
+    return h1 + h2;
+}
+
+void vct_terminal_init(vct_terminal * s, vct_model *m, tw_lp * lp)
+{
+    m->magic_num = get_magic_num(m);
+
+    s->model = m;
+    s->terminal_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    s->packet_counter = 0;
+    s->terminal_available_time = 0.0;
+    s->injq_bytes = 0;
+    s->credit_used = 0;
+    s->in_send_loop = 0;
+    s->sched_blocked = 0;
+    INIT_QLIST_HEAD(&s->injq);
+}
+
+void vct_terminal_event(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == s->model->magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive(s, bf, msg, lp);
+            break;
+        case T_SEND:
+            packet_send(s, bf, msg, lp);
+            break;
+        case T_BUFFER:
+            terminal_buf_update(s, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n LP %d Terminal message type not supported %d ",
+                    (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a terminal event */
+void vct_terminal_rc_event_handler(vct_terminal * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case T_GENERATE:
+            packet_generate_rc(s, bf, msg, lp);
+            break;
+        case T_ARRIVE:
+            packet_arrive_rc(s, bf, msg, lp);
+            break;
+        case T_SEND:
+            packet_send_rc(s, bf, msg, lp);
+            break;
+        case T_BUFFER:
+            terminal_buf_update_rc(s, bf, msg, lp);
+            break;
+    }
+}
+
+void vct_terminal_final(vct_terminal * s,
+        tw_lp * lp)
+{
+    model_net_print_stats(lp->gid, s->stats_array);
+    while(!qlist_empty(&s->injq))
+        queue_item_free(qlist_entry(qlist_pop(&s->injq), vct_queue_item, ql));
+}
+
+/* returns the virtual channel of an output port the next packet is sent
+ * from, -1 if no queued packet fits into the buffer of the next hop. The
+ * channels of later hops go first so that packets closer to their
+ * destination drain the network */
+static int router_pick_vc(const vct_router * s, int port)
+{
+    uint64_t buf_size = s->buffer_size[port];
+    int vc;
+
+    for(vc = s->num_vcs - 1; vc >= 0; vc--)
+    {
+        int i = port * s->num_vcs + vc;
+        if(qlist_empty(&s->queue[i]))
+            continue;
+        vct_queue_item *item = qlist_entry(s->queue[i].next, vct_queue_item,
+                ql);
+        if(s->credit_used[i] == 0 ||
+                s->credit_used[i] + item->msg->packet_size <= buf_size)
+            return vc;
+    }
+    return -1;
+}
+
+/* returns 1 if no packets are queued for any virtual channel of a port */
+static int router_port_empty(const vct_router * s, int port)
+{
+    int vc;
+    for(vc = 0; vc < s->num_vcs; vc++)
+        if(!qlist_empty(&s->queue[port * s->num_vcs + vc]))
+            return 0;
+    return 1;
+}
+
+uint64_t vct_port_load(const vct_router * s, int port)
+{
+    uint64_t load = s->queue_bytes[port];
+    int vc;
+    for(vc = 0; vc < s->num_vcs; vc++)
+        load += s->credit_used[port * s->num_vcs + vc];
+    return load;
+}
+
+tw_stime vct_port_blocked_time(const vct_router * s, int port, tw_lp * lp)
+{
+    tw_stime t = s->port_stats[port].blocked_time;
+    /* account for a port that is still waiting for credits */
+    if(s->blocked_start[port] >= 0)
+        t += tw_now(lp) - s->blocked_start[port];
+    return t;
+}
+
+/* schedules the next send on an output port once the port is free */
+static void router_start_send_loop(vct_router * s, int port, tw_lp * lp)
+{
+    tw_event *e;
+    vct_message *m;
+    tw_stime ts;
+
+    s->in_send_loop[port] = 1;
+    ts = maxd(s->next_available_time[port] - tw_now(lp), 0.0) +
+        codes_local_latency(lp);
+    // router self message - no need for method_event
+    e = tw_event_new(lp->gid, ts, lp);
+    m = tw_event_data(e);
+    m->type = R_SEND;
+    m->magic = s->model->magic_num;
+    m->port = port;
+    tw_event_send(e);
+}
+
+static void router_packet_arrive_rc(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+    struct qlist_head *ent =
+        qlist_pop_back(&s->queue[port * s->num_vcs + msg->vc]);
+    assert(ent);
+    vct_queue_item *item = qlist_entry(ent, vct_queue_item, ql);
+    /* the forward handler overwrote the upstream virtual channel with the
+     * output one; put it back before the event is re-executed */
+    msg->vc = item->msg->in_vc;
+    queue_item_free(item);
+    s->queue_bytes[port] -= msg->packet_size;
+
+    if(bf->c1)
+        s->port_stats[port].peak_queue_bytes = msg->saved_peak_bytes;
+    if(bf->c2)
+    {
+        s->in_send_loop[port] = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c3)
+        tw_rand_reverse_unif(lp->rng);
+}
+
+/* a packet arrives at the router and is queued for its output port */
+static void router_packet_arrive(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    const vct_model *m = s->model;
+
+    /* the queued copy carries the routing state, the event keeps the output
+     * port and virtual channel for reverse computation */
+    vct_queue_item *item = queue_item_new(m, msg, router_edata(m, msg),
+            msg->remote_event_size_bytes);
+    item->msg->my_N_hop++;
+    item->msg->in_vc = msg->vc;
+
+    int port = m->route(s, bf, item->msg, lp);
+    int vc = m->select_vc(s, item->msg, port);
+    assert(vc >= 0 && vc < s->num_vcs);
+    item->msg->port = port;
+    item->msg->vc = vc;
+    msg->port = port;
+    msg->vc = vc;
+
+    qlist_add_tail(&item->ql, &s->queue[port * s->num_vcs + vc]);
+    s->queue_bytes[port] += msg->packet_size;
+
+    vct_port_stats *ps = &s->port_stats[port];
+    if(s->queue_bytes[port] > ps->peak_queue_bytes)
+    {
+        bf->c1 = 1;
+        msg->saved_peak_bytes = ps->peak_queue_bytes;
+        ps->peak_queue_bytes = s->queue_bytes[port];
+    }
+
+    if(!s->in_send_loop[port])
+    {
+        bf->c2 = 1;
+        router_start_send_loop(s, port, lp);
+    }
+}
+
+static void router_packet_send_rc(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+
+    if(bf->c1)
+    {
+        s->in_send_loop[port] = 1;
+        return;
+    }
+    if(bf->c2)
+    {
+        s->in_send_loop[port] = 1;
+        s->blocked_start[port] = msg->saved_blocked_start;
+        return;
+    }
+
+    int i = port * s->num_vcs + msg->vc;
+    s->next_available_time[port] = msg->saved_available_time;
+    s->credit_used[i] -= msg->packet_size;
+    s->queue_bytes[port] += msg->packet_size;
+    s->port_stats[port].bytes -= msg->packet_size;
+    s->port_stats[port].packets--;
+    if(bf->c4)
+    {
+        s->blocked_start[port] = msg->saved_blocked_start;
+        s->port_stats[port].blocked_time -=
+            tw_now(lp) - msg->saved_blocked_start;
+    }
+
+    /* put the packet back at the queue head */
+    vct_queue_item *item = queue_item_new(s->model, msg,
+            router_edata(s->model, msg), msg->remote_event_size_bytes);
+    qlist_add(&item->ql, &s->queue[i]);
+
+    if(bf->c3)
+        s->in_send_loop[port] = 1;
+}
+
+/* forwards the next packet of an output port to the next hop and returns the
+ * buffer space it used to the previous hop */
+static void router_packet_send(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    const vct_model *mdl = s->model;
+    int port = msg->port;
+    tw_stime start, xmit, ts;
+    tw_event *e;
+    vct_message *m;
+    void *m_data;
+
+    if(router_port_empty(s, port))
+    {
+        bf->c1 = 1;
+        s->in_send_loop[port] = 0;
+        return;
+    }
+    int vc = router_pick_vc(s, port);
+    if(vc < 0)
+    {
+        /* wait for a credit from the next hop, which restarts the loop */
+        bf->c2 = 1;
+        s->in_send_loop[port] = 0;
+        msg->saved_blocked_start = s->blocked_start[port];
+        if(s->blocked_start[port] < 0)
+            s->blocked_start[port] = tw_now(lp);
+        return;
+    }
+
+    /* the packet leaves the queue, keep a copy in the event for reverse
+     * computation */
+    int i = port * s->num_vcs + vc;
+    struct qlist_head *ent = qlist_pop(&s->queue[i]);
+    vct_queue_item *item = qlist_entry(ent, vct_queue_item, ql);
+    memcpy(msg, item->msg, mdl->msg_size);
+    if(msg->remote_event_size_bytes)
+        memcpy(router_edata(mdl, msg), item->edata,
+                msg->remote_event_size_bytes);
+    queue_item_free(item);
+    msg->type = R_SEND;
+    msg->magic = mdl->magic_num;
+    msg->saved_available_time = s->next_available_time[port];
+
+    /* the port is sending again, close a wait for credits that was not
+     * ended by the credit that restarted the loop */
+    if(s->blocked_start[port] >= 0)
+    {
+        bf->c4 = 1;
+        msg->saved_blocked_start = s->blocked_start[port];
+        s->port_stats[port].blocked_time +=
+            tw_now(lp) - s->blocked_start[port];
+        s->blocked_start[port] = -1;
+    }
+
+    start = maxd(s->next_available_time[port], tw_now(lp));
+    xmit = (1/s->bandwidth[port]) * msg->packet_size;
+    s->next_available_time[port] = start + xmit;
+    s->credit_used[i] += msg->packet_size;
+    s->queue_bytes[port] -= msg->packet_size;
+    s->port_stats[port].bytes += msg->packet_size;
+    s->port_stats[port].packets++;
+
+    /* the next hop can be a router or a terminal, the terminal only sees the
+     * packet once all of it has arrived */
+    if(vct_is_cn_port(s, port))
+    {
+        ts = start - tw_now(lp) + xmit + s->latency[port] + g_tw_lookahead;
+        e = model_net_method_event_new(s->port_gid[port], ts, lp,
+                mdl->net_id, (void**)&m, &m_data);
+        memcpy(m, msg, mdl->msg_size);
+        m->type = T_ARRIVE;
+        m->magic = mdl->magic_num;
+    }
+    else
+    {
+        ts = start - tw_now(lp) + s->latency[port] + g_tw_lookahead +
+            get_head_delay(s->chunk_size, msg->packet_size,
+                    s->bandwidth[port]);
+        e = tw_event_new(s->port_gid[port], ts, lp);
+        m = tw_event_data(e);
+        m_data = router_edata(mdl, m);
+        memcpy(m, msg, mdl->msg_size);
+        m->type = R_ARRIVE;
+        m->magic = mdl->magic_num;
+        m->in_port = s->peer_port[port];
+    }
+    if(msg->remote_event_size_bytes)
+        memcpy(m_data, router_edata(mdl, msg), msg->remote_event_size_bytes);
+    tw_event_send(e);
+
+    /* the packet has left the input buffer once it is fully transmitted */
+    int in = msg->in_port;
+    ts = start - tw_now(lp) + xmit + s->latency[in] + g_tw_lookahead +
+        (1/s->bandwidth[in]) * CREDIT_SIZE;
+    if(vct_is_cn_port(s, in))
+    {
+        e = model_net_method_event_new(s->port_gid[in], ts, lp, mdl->net_id,
+                (void**)&m, NULL);
+        m->type = T_BUFFER;
+        m->magic = mdl->magic_num;
+    }
+    else
+    {
+        e = tw_event_new(s->port_gid[in], ts, lp);
+        m = tw_event_data(e);
+        m->type = R_BUFFER;
+        m->magic = mdl->magic_num;
+        m->port = s->peer_port[in];
+        m->vc = msg->in_vc;
+    }
+    m->credit_bytes = msg->packet_size;
+    tw_event_send(e);
+
+    /* keep sending at the link rate while there are queued packets */
+    if(!router_port_empty(s, port))
+    {
+        e = tw_event_new(lp->gid, s->next_available_time[port] - tw_now(lp),
+                lp);
+        m = tw_event_data(e);
+        m->type = R_SEND;
+        m->magic = mdl->magic_num;
+        m->port = port;
+        tw_event_send(e);
+    }
+    else
+    {
+        bf->c3 = 1;
+        s->in_send_loop[port] = 0;
+    }
+}
+
+static void router_buf_update_rc(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+
+    s->credit_used[port * s->num_vcs + msg->vc] += msg->credit_bytes;
+    if(bf->c1)
+    {
+        s->in_send_loop[port] = 0;
+        codes_local_latency_reverse(lp);
+    }
+    if(bf->c2)
+    {
+        s->blocked_start[port] = msg->saved_blocked_start;
+        s->port_stats[port].blocked_time -=
+            tw_now(lp) - msg->saved_blocked_start;
+    }
+}
+
+/* the next hop has freed buffer space, restart a port waiting for it */
+static void router_buf_update(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    int port = msg->port;
+    int i = port * s->num_vcs + msg->vc;
+
+    assert(s->credit_used[i] >= msg->credit_bytes);
+    s->credit_used[i] -= msg->credit_bytes;
+
+    if(!s->in_send_loop[port] && router_pick_vc(s, port) >= 0)
+    {
+        bf->c1 = 1;
+        router_start_send_loop(s, port, lp);
+
+        if(s->blocked_start[port] >= 0)
+        {
+            bf->c2 = 1;
+            msg->saved_blocked_start = s->blocked_start[port];
+            s->port_stats[port].blocked_time +=
+                tw_now(lp) - s->blocked_start[port];
+            s->blocked_start[port] = -1;
+        }
+    }
+}
+
+void vct_router_init(vct_router * s, vct_model *m, int num_ports, int num_vcs,
+        int chunk_size, tw_lp * lp)
+{
+    int i;
+
+    m->magic_num = get_magic_num(m);
+
+    s->model = m;
+    s->router_id = codes_mapping_get_lp_relative_id(lp->gid, 0, 0);
+    s->num_ports = num_ports;
+    s->num_vcs = num_vcs;
+    s->chunk_size = chunk_size;
+
+    // one block for the per-port state, each array starting on its own
+    // cache line
+    int n = num_ports;
+    int nvc = n * num_vcs;
+    size_t times_sz = cache_align(n * sizeof(tw_stime));
+    size_t u64_sz = cache_align(n * sizeof(uint64_t));
+    size_t ints_sz = cache_align(n * sizeof(int));
+    size_t gid_sz = cache_align(n * sizeof(tw_lpid));
+    size_t stats_sz = cache_align(n * sizeof(vct_port_stats));
+    size_t credit_sz = cache_align(nvc * sizeof(uint64_t));
+    char * block;
+    if(posix_memalign((void**)&block, VCT_CACHE_LINE, 4 * times_sz +
+                2 * u64_sz + 2 * ints_sz + gid_sz + stats_sz + credit_sz +
+                nvc * sizeof(struct qlist_head)) != 0)
+        tw_error(TW_LOC, "%s: unable to allocate port state\n",
+                model_net_method_names[m->net_id]);
+
+    s->next_available_time = (tw_stime*)block;
+    block += times_sz;
+    s->blocked_start = (tw_stime*)block;
+    block += times_sz;
+    s->bandwidth = (double*)block;
+    block += times_sz;
+    s->latency = (double*)block;
+    block += times_sz;
+    s->queue_bytes = (uint64_t*)block;
+    block += u64_sz;
+    s->buffer_size = (uint64_t*)block;
+    block += u64_sz;
+    s->in_send_loop = (int*)block;
+    block += ints_sz;
+    s->peer_port = (int*)block;
+    block += ints_sz;
+    s->port_gid = (tw_lpid*)block;
+    block += gid_sz;
+    s->port_stats = (vct_port_stats*)block;
+    block += stats_sz;
+    s->credit_used = (uint64_t*)block;
+    block += credit_sz;
+    s->queue = (struct qlist_head*)block;
+
+    for(i = 0; i < n; i++)
+    {
+        s->next_available_time[i] = 0.0;
+        s->blocked_start[i] = -1;
+        s->bandwidth[i] = 0.0;
+        s->latency[i] = 0.0;
+        s->queue_bytes[i] = 0;
+        s->buffer_size[i] = 0;
+        s->in_send_loop[i] = 0;
+        s->peer_port[i] = -1;
+        s->port_gid[i] = 0;
+        memset(&s->port_stats[i], 0, sizeof(vct_port_stats));
+    }
+    for(i = 0; i < nvc; i++)
+    {
+        s->credit_used[i] = 0;
+        INIT_QLIST_HEAD(&s->queue[i]);
+    }
+}
+
+void vct_router_event(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    assert(msg->magic == s->model->magic_num);
+    *(int *)bf = (int)0;
+    switch(msg->type)
+    {
+        case R_ARRIVE:
+            router_packet_arrive(s, bf, msg, lp);
+            break;
+        case R_SEND:
+            router_packet_send(s, bf, msg, lp);
+            break;
+        case R_BUFFER:
+            router_buf_update(s, bf, msg, lp);
+            break;
+        default:
+            tw_error(TW_LOC, "\n (%lf) [Router %d] Router message type not supported %d ",
+                    tw_now(lp), (int)lp->gid, msg->type);
+    }
+}
+
+/* Reverse computation handler for a router event */
+void vct_router_rc_event_handler(vct_router * s,
+        tw_bf * bf,
+        vct_message * msg,
+        tw_lp * lp)
+{
+    switch(msg->type)
+    {
+        case R_ARRIVE:
+            router_packet_arrive_rc(s, bf, msg, lp);
+            break;
+        case R_SEND:
+            router_packet_send_rc(s, bf, msg, lp);
+            break;
+        case R_BUFFER:
+            router_buf_update_rc(s, bf, msg, lp);
+            break;
+    }
+}
+
+void vct_router_free(vct_router * s)
+{
+    int i;
+
+    for(i = 0; i < s->num_ports * s->num_vcs; i++)
+        while(!qlist_empty(&s->queue[i]))
+            queue_item_free(qlist_entry(qlist_pop(&s->queue[i]),
+                        vct_queue_item, ql));
+    /* base of the per-port block */
+    free(s->next_available_time);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
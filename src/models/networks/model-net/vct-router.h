@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2015 University of Chicago.
+ * See COPYRIGHT notice in top-level directory.
+ *
+ */
+
+#ifndef VCT_ROUTER_H
+#define VCT_ROUTER_H
+
+/* Compute node terminals and router ports forwarding packets with virtual
+ * cut-through at packet granularity, shared by the Slim Fly, HyperX and graph
+ * models.
+ *
+ * A terminal queues the packets handed over by the scheduler and sends them
+ * to its router as long as the router has buffer space for them. A router
+ * queues an arriving packet for the output port and virtual channel picked by
+ * the model, sends the queued packets of a port at the link rate once the
+ * next hop has buffer space for them and returns the buffer space to the
+ * previous hop with a credit once a packet is fully transmitted.
+ *
+ * A model supplies the topology (the neighbours and links of the ports, set
+ * up after vct_terminal_init and vct_router_init), the routing and the
+ * virtual channel selection through a vct_model. Its message starts with a
+ * vct_message, followed by the routing state of the packet. Its router state
+ * starts with a vct_router. */
+
+#include <ross.h>
+
+#include "codes/quicklist.h"
+#include "codes/model-net.h"
+#include "codes/model-net-method.h"
+#include "codes/net/vct.h"
+
+typedef struct vct_model vct_model;
+typedef struct vct_stats vct_stats;
+typedef struct vct_terminal vct_terminal;
+typedef struct vct_router vct_router;
+typedef struct vct_port_stats vct_port_stats;
+
+/* path taken by a packet */
+enum vct_path
+{
+    VCT_PATH_MINIMAL = 0,
+    VCT_PATH_NON_MINIMAL
+};
+
+/* packet statistics of a model, summed over the terminals of a rank */
+struct vct_stats
+{
+    tw_stime total_time;
+    tw_stime max_latency;
+    long long total_hops;
+    long long finished_packets;
+    long long minimal_packets;
+    long long nonmin_packets;
+};
+
+struct vct_model
+{
+    int net_id; /* model-net id of the model */
+    int msg_size; /* size of the model message */
+
+    /* sets up the routing state of a new packet, may be NULL */
+    void (*packet_init)(const vct_terminal *t, vct_message *msg);
+    /* returns the output port of a packet at a router and updates the
+     * routing state the packet carries. Sets bf->c3 if a random number was
+     * drawn */
+    int (*route)(vct_router *r, tw_bf *bf, vct_message *pkt, tw_lp *lp);
+    /* returns the virtual channel of the output port a packet is queued
+     * for */
+    int (*select_vc)(const vct_router *r, const vct_message *pkt, int port);
+
+    int magic_num; /* set up by vct_terminal_init and vct_router_init */
+    vct_stats stats;
+};
+
+struct vct_terminal
+{
+    vct_model *model;
+    unsigned long long packet_counter;
+    int terminal_id;
+    int total_terminals;
+
+    /* router the terminal is attached to, the router port leading to the
+     * terminal and the parameters of the link */
+    tw_lpid router_gid;
+    int router_port;
+    double bandwidth;
+    double latency;
+    uint64_t buffer_size;
+    int chunk_size; /* bytes serialized before a packet reaches the router */
+
+    /* packets waiting for the terminal-router link */
+    struct qlist_head injq;
+    uint64_t injq_bytes;
+    /* bytes sent to the router which have not left its buffer yet */
+    uint64_t credit_used;
+    tw_stime terminal_available_time;
+    int in_send_loop; /* a T_SEND event is pending */
+    int sched_blocked; /* scheduler waits for room in the injection queue */
+
+    struct mn_stats stats_array[CATEGORY_MAX];
+};
+
+/* traffic counters of a router output port */
+struct vct_port_stats
+{
+    uint64_t bytes; /* bytes forwarded */
+    uint64_t packets; /* packets forwarded */
+    tw_stime blocked_time; /* time spent waiting for credits */
+    uint64_t peak_queue_bytes; /* maximum bytes queued for the port */
+};
+
+struct vct_router
+{
+    vct_model *model;
+    int router_id;
+    int num_ports;
+    int num_vcs; /* virtual channels per port */
+    int chunk_size; /* bytes serialized before a packet reaches the next hop */
+
+    /* all of the per-port arrays below are carved out of one cache-line
+       aligned block allocated in vct_router_init, based at
+       next_available_time. The per virtual channel arrays are indexed by
+       port * num_vcs + vc. The model sets up the link of each port:
+       port_gid, peer_port, bandwidth, latency and buffer_size */
+    tw_stime *next_available_time;
+    tw_stime *blocked_start; /* start of a wait for credits, -1 if none */
+    double *bandwidth;
+    double *latency;
+    uint64_t *queue_bytes; /* bytes queued for the port */
+    uint64_t *buffer_size; /* bytes of buffer per virtual channel downstream */
+    int *in_send_loop; /* an R_SEND event is pending for the port */
+    /* port of the neighbour router the port is linked to, -1 for the ports
+     * leading to compute nodes */
+    int *peer_port;
+    tw_lpid *port_gid; /* neighbour (router or terminal) of the port */
+    vct_port_stats *port_stats;
+    uint64_t *credit_used; /* per vc: bytes in flight to or buffered downstream */
+    struct qlist_head *queue; /* per vc */
+};
+
+static inline int vct_is_cn_port(const vct_router *r, int port)
+{
+    return r->peer_port[port] < 0;
+}
+
+/* bytes queued for a port and buffered at the next hop */
+uint64_t vct_port_load(const vct_router *r, int port);
+/* time a port has spent waiting for credits, up to now */
+tw_stime vct_port_blocked_time(const vct_router *r, int port, tw_lp *lp);
+
+tw_stime vct_packet_event(vct_model *m, char const * category,
+        tw_lpid final_dest_lp, tw_lpid dest_mn_lp, uint64_t packet_size,
+        int is_pull, uint64_t pull_size, tw_stime offset,
+        int remote_event_size, const void* remote_event, int self_event_size,
+        const void* self_event, tw_lpid src_lp, tw_lp *sender,
+        int is_last_pckt);
+void vct_packet_event_rc(tw_lp *sender);
+void vct_report_stats(const vct_model *m);
+
+/* resets a terminal, the model then attaches it to its router */
+void vct_terminal_init(vct_terminal *t, vct_model *m, tw_lp *lp);
+void vct_terminal_event(vct_terminal *t, tw_bf *bf, vct_message *msg,
+        tw_lp *lp);
+void vct_terminal_rc_event_handler(vct_terminal *t, tw_bf *bf,
+        vct_message *msg, tw_lp *lp);
+void vct_terminal_final(vct_terminal *t, tw_lp *lp);
+
+/* allocates the port state of a router, the model then sets up the links of
+ * the ports */
+void vct_router_init(vct_router *r, vct_model *m, int num_ports, int num_vcs,
+        int chunk_size, tw_lp *lp);
+void vct_router_event(vct_router *r, tw_bf *bf, vct_message *msg,
+        tw_lp *lp);
+void vct_router_rc_event_handler(vct_router *r, tw_bf *bf,
+        vct_message *msg, tw_lp *lp);
+/* releases the port state and the packets still queued */
+void vct_router_free(vct_router *r);
+
+#endif /* end of include guard: VCT_ROUTER_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 4
+ *  c-basic-offset: 4
+ * End:
+ *
+ * vim: ft=c ts=8 sts=4 sw=4 expandtab
+ */
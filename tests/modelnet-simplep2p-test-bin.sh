@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# converts the text matrices of the simplep2p tests into binary matrix files
+# (net_matrix_file), the servers have to see the same transfers as with the
+# text matrices
+trap 'rm -f tests/conf/modelnet-test-matrix.bin \
+    tests/conf/modelnet-test-matrix-tri.bin simplep2p-text.out \
+    simplep2p-bin.out' EXIT
+
+python misc/simplep2p-matrix-convert.py \
+    tests/conf/modelnet-test-latency.conf tests/conf/modelnet-test-bw.conf \
+    tests/conf/modelnet-test-matrix.bin || exit 1
+python misc/simplep2p-matrix-convert.py -t \
+    tests/conf/modelnet-test-latency-tri.conf \
+    tests/conf/modelnet-test-bw-tri.conf \
+    tests/conf/modelnet-test-matrix-tri.bin || exit 1
+
+for suffix in "" "-tri"; do
+    tests/modelnet-simplep2p-test --sync=1 -- \
+        tests/conf/modelnet-test-simplep2p$suffix.conf > simplep2p-text.out
+    err=$?
+    if [[ $err -ne 0 ]]; then
+        exit $err
+    fi
+    tests/modelnet-simplep2p-test --sync=1 -- \
+        tests/conf/modelnet-test-simplep2p-bin$suffix.conf > simplep2p-bin.out
+    err=$?
+    if [[ $err -ne 0 ]]; then
+        exit $err
+    fi
+
+    # only the server lines, the rest holds wall clock times
+    diff <(grep '^server' simplep2p-text.out) \
+        <(grep '^server' simplep2p-bin.out) || exit 1
+    if ! grep -q '^server' simplep2p-bin.out; then
+        echo "no server output for modelnet-test-simplep2p-bin$suffix.conf"
+        exit 1
+    fi
+done
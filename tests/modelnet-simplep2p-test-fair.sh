@@ -0,0 +1,16 @@
+#!/bin/bash
+
+tests/modelnet-simplep2p-test --sync=1 -- \
+    tests/conf/modelnet-test-simplep2p-fair.conf
+err=$?
+if [[ $err -ne 0 ]]; then
+    exit $err
+fi
+
+# optimistic run, exercises the reverse handlers of the shared NIC sides
+mpirun -np 2 tests/modelnet-simplep2p-test --sync=3 -- \
+    tests/conf/modelnet-test-simplep2p-fair.conf
+err=$?
+if [[ $err -ne 0 ]]; then
+    exit $err
+fi
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+tests/modelnet-simplep2p-test --sync=1 -- \
+    tests/conf/modelnet-test-simplep2p-tri.conf
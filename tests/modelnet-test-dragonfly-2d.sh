@@ -0,0 +1,3 @@
+#!/bin/bash
+
+tests/modelnet-test --sync=1 -- tests/conf/modelnet-test-dragonfly-2d.conf
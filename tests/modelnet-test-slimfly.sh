@@ -0,0 +1,15 @@
+#!/bin/bash
+
+tests/modelnet-test --sync=1 -- tests/conf/modelnet-test-slimfly.conf
+err=$?
+if [[ $err -ne 0 ]]; then
+    exit $err
+fi
+
+# optimistic run, exercises the reverse handlers of the router model
+mpirun -np 2 tests/modelnet-test --sync=3 -- \
+    tests/conf/modelnet-test-slimfly.conf
+err=$?
+if [[ $err -ne 0 ]]; then
+    exit $err
+fi
@@ -38,6 +38,9 @@ static int do_pull = 0;
 static int num_routers_per_rep = 0;
 static int num_servers_per_rep = 0;
 static int lps_per_rep = 0;
+/* LP name of the routers or switches of networks that map them next to the
+ * servers, NULL otherwise */
+static const char * router_lp_name = NULL;
 
 typedef struct svr_msg svr_msg;
 typedef struct svr_state svr_state;
@@ -186,9 +189,19 @@ int main(
     num_servers = codes_mapping_get_lp_count("MODELNET_GRP", 0, "server",
             NULL, 1);
     if(net_id == DRAGONFLY)
+        router_lp_name = "dragonfly_router";
+    else if(net_id == FATTREE)
+        router_lp_name = "fattree_switch";
+    else if(net_id == SLIMFLY)
+        router_lp_name = "slimfly_router";
+    else if(net_id == HYPERX)
+        router_lp_name = "hyperx_router";
+    else if(net_id == GRAPH)
+        router_lp_name = "graph_switch";
+    if(router_lp_name != NULL)
     {
 	  num_routers = codes_mapping_get_lp_count("MODELNET_GRP", 0,
-                  "dragonfly_router", NULL, 1); 
+                  router_lp_name, NULL, 1); 
 	  offset = 1;
     }
 
@@ -344,16 +357,17 @@ static void handle_kickoff_event(
 
     num_servers_per_rep = codes_mapping_get_lp_count("MODELNET_GRP", 1,
             "server", NULL, 1);
-    num_routers_per_rep = codes_mapping_get_lp_count("MODELNET_GRP", 1,
-            "dragonfly_router", NULL, 1);
+    if(router_lp_name != NULL)
+        num_routers_per_rep = codes_mapping_get_lp_count("MODELNET_GRP", 1,
+                router_lp_name, NULL, 1);
 
     lps_per_rep = num_servers_per_rep * 2 + num_routers_per_rep;
 
     int opt_offset = 0;
     int total_lps = num_servers * 2 + num_routers;
 
-    if(net_id == DRAGONFLY && (lp->gid % lps_per_rep == num_servers_per_rep - 1))
-          opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to dragonfly mapping */
+    if(router_lp_name != NULL && (lp->gid % lps_per_rep == num_servers_per_rep - 1))
+          opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to router mapping */
     
     /* each server sends a request to the next highest server */
     int dest_id = (lp->gid + offset + opt_offset)%total_lps;
@@ -461,8 +475,8 @@ static void handle_ack_event(
 //    printf("\n m->src %d lp->gid %d ", m->src, lp->gid);
     int opt_offset = 0;
     
-   if(net_id == DRAGONFLY && (lp->gid % lps_per_rep == num_servers_per_rep - 1))
-      opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to dragonfly mapping */    	
+   if(router_lp_name != NULL && (lp->gid % lps_per_rep == num_servers_per_rep - 1))
+      opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to router mapping */    	
 
     tw_lpid dest_id = (lp->gid + offset + opt_offset)%(num_servers*2 + num_routers);
 
@@ -519,8 +533,8 @@ static void handle_req_event(
     /* safety check that this request got to the right server */
 //    printf("\n m->src %d lp->gid %d ", m->src, lp->gid);
     int opt_offset = 0;
-    if(net_id == DRAGONFLY && (m->src % lps_per_rep == num_servers_per_rep - 1))
-          opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to dragonfly mapping */       
+    if(router_lp_name != NULL && (m->src % lps_per_rep == num_servers_per_rep - 1))
+          opt_offset = num_servers_per_rep + num_routers_per_rep; /* optional offset due to router mapping */       
  
     assert(lp->gid == (m->src + offset + opt_offset)%(num_servers*2 + num_routers));
     ns->msg_recvd_count++;